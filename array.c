@@ -11,6 +11,7 @@ struct array_brackets* array_brackets_new()
 
 void array_brackets_free(struct array_brackets* brackets)
 {
+  free(brackets->strides);
   free(brackets);
 }
 
@@ -25,33 +26,48 @@ struct vector* array_brackets_node_vector(struct array_brackets* brackets)
   return brackets->n_brackets;
 }
 
-size_t array_brackets_calculate_size_from_index(struct datatype* dtype, struct array_brackets* brackets, int index)
+void array_brackets_calculate_strides(struct array_brackets* brackets)
 {
   struct vector* array_vec = array_brackets_node_vector(brackets);
-  size_t size = dtype->size;
-  if (index >= vector_count(array_vec))
+  int total = vector_count(array_vec);
+  free(brackets->strides);
+  brackets->strides = calloc(total + 1, sizeof(size_t));
+  brackets->total = total;
+
+  // Walk backwards so each stride is the product of the dimensions after it
+  size_t stride = 1;
+  brackets->strides[total] = stride;
+  for (int i = total - 1; i >= 0; i--)
   {
-    // char* abc;
-    // return abc[0]; return abc[1];
-    return size;
+    struct node* array_bracket_node = *(struct node**)(vector_at(array_vec, i));
+    assert(array_bracket_node->bracket.inner->type == NODE_TYPE_NUMBER);
+    stride *= array_bracket_node->bracket.inner->llnum;
+    brackets->strides[i] = stride;
   }
+}
 
-  vector_set_peek_pointer(array_vec, index);
-  struct node* array_bracket_node = vector_peek_ptr(array_vec);
-  if (!array_bracket_node)
+size_t array_brackets_stride(struct array_brackets* brackets, int index)
+{
+  assert(brackets->strides);
+  if (index < 0 || index > brackets->total)
   {
-    return 0;
+    return 1;
   }
 
-  while(array_bracket_node)
+  return brackets->strides[index];
+}
+
+size_t array_brackets_calculate_size_from_index(struct datatype* dtype, struct array_brackets* brackets, int index)
+{
+  size_t size = dtype->size;
+  if (index >= brackets->total)
   {
-    assert(array_bracket_node->bracket.inner->type == NODE_TYPE_NUMBER);
-    int number = array_bracket_node->bracket.inner->llnum;
-    size *= number;
-    array_bracket_node = vector_peek_ptr(array_vec);
+    // char* abc;
+    // return abc[0]; return abc[1];
+    return size;
   }
 
-  return size;
+  return size * array_brackets_stride(brackets, index);
 }
 
 size_t array_brackets_calculate_size(struct datatype* dtype, struct array_brackets* brackets)
@@ -63,10 +79,10 @@ int array_total_indexes(struct datatype* dtype)
 {
   assert(dtype->flags & DATATYPE_FLAG_IS_ARRAY);
   struct array_brackets* brackets = dtype->array.brackets;
-  return vector_count(brackets->n_brackets);
+  return brackets->total;
 }
 
 size_t array_brackets_count(struct datatype* dtype)
 {
-  return vector_count(dtype->array.brackets->n_brackets);
+  return dtype->array.brackets->total;
 }
\ No newline at end of file
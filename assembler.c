@@ -0,0 +1,1353 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+
+/**
+ * Encodes the final instruction list as x86-32 machine code so an object file can be written
+ * without running NASM. Only what the code generator emits is understood: the instructions in
+ * the instruction list, labels, the section, global, extern and align directives and data
+ * declared with db, dw, dd, dq and resb through resq.
+ *
+ * Jumps to labels in the same section start out short and are made long when their label
+ * turns out to be too far away, every time that happens the list is encoded again.
+ */
+
+#define ASSEMBLER_START_BUCKETS 256
+#define ASSEMBLER_LONGEST_NOP 8
+
+// Register numbers as the processor encodes them
+static const int assembler_register_codes[] = {
+  [REGISTER_EAX] = 0,
+  [REGISTER_EBX] = 3,
+  [REGISTER_ECX] = 1,
+  [REGISTER_EDX] = 2,
+  [REGISTER_ESI] = 6,
+  [REGISTER_EDI] = 7,
+  [REGISTER_EBP] = 5,
+  [REGISTER_ESP] = 4,
+  [REGISTER_AX] = 0,
+  [REGISTER_BX] = 3,
+  [REGISTER_CX] = 1,
+  [REGISTER_DX] = 2,
+  [REGISTER_AL] = 0,
+  [REGISTER_BL] = 3,
+  [REGISTER_CL] = 1,
+  [REGISTER_DL] = 2,
+  [REGISTER_AH] = 4,
+  [REGISTER_BH] = 7,
+  [REGISTER_CH] = 5,
+  [REGISTER_DH] = 6,
+};
+
+// Condition codes in the order of the jump and set opcodes, je/sete first
+static const int assembler_condition_codes[] = {0x4, 0x5, 0xF, 0xC, 0xD, 0xE, 0x7, 0x2, 0x3, 0x6};
+
+// The recommended nop of every length up to ASSEMBLER_LONGEST_NOP bytes
+static const unsigned char assembler_nops[ASSEMBLER_LONGEST_NOP][ASSEMBLER_LONGEST_NOP] = {
+  {0x90},
+  {0x66, 0x90},
+  {0x0F, 0x1F, 0x00},
+  {0x0F, 0x1F, 0x40, 0x00},
+  {0x0F, 0x1F, 0x44, 0x00, 0x00},
+  {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+  {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+  {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+static const char* assembler_section_names[] = {
+  [ASSEMBLER_SECTION_TEXT] = ".text",
+  [ASSEMBLER_SECTION_DATA] = ".data",
+  [ASSEMBLER_SECTION_RODATA] = ".rodata",
+  [ASSEMBLER_SECTION_BSS] = ".bss",
+};
+
+static const int assembler_section_alignments[] = {
+  [ASSEMBLER_SECTION_TEXT] = 16,
+  [ASSEMBLER_SECTION_DATA] = 4,
+  [ASSEMBLER_SECTION_RODATA] = 4,
+  [ASSEMBLER_SECTION_BSS] = 4,
+};
+
+struct assembler_address
+{
+  // REGISTER_* or -1 when there is none
+  int base;
+  int index;
+  int scale;
+  long long displacement;
+  // Symbol the displacement is relative to, NULL if it is a plain number
+  struct assembler_symbol* symbol;
+};
+
+static unsigned int assembler_hash(const char* str, size_t len)
+{
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= (unsigned char) str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void assembler_buckets_grow(struct assembler* assembler)
+{
+  free(assembler->buckets);
+  assembler->total_buckets *= 2;
+  assembler->buckets = calloc(assembler->total_buckets, sizeof(struct assembler_symbol*));
+  for (int i = 0; i < vector_count(assembler->symbols); i++)
+  {
+    struct assembler_symbol* symbol = *(struct assembler_symbol**) vector_at(assembler->symbols, i);
+    unsigned int bucket = assembler_hash(symbol->name, strlen(symbol->name)) & (assembler->total_buckets - 1);
+    symbol->next = assembler->buckets[bucket];
+    assembler->buckets[bucket] = symbol;
+  }
+}
+
+/**
+ * @brief Returns the symbol with the given name, creating it undefined if we have not seen it yet
+ */
+static struct assembler_symbol* assembler_symbol(struct assembler* assembler, const char* name, size_t len)
+{
+  unsigned int hash = assembler_hash(name, len);
+  struct assembler_symbol* symbol = assembler->buckets[hash & (assembler->total_buckets - 1)];
+  while (symbol)
+  {
+    if (strlen(symbol->name) == len && strncmp(symbol->name, name, len) == 0)
+    {
+      return symbol;
+    }
+    symbol = symbol->next;
+  }
+
+  symbol = calloc(1, sizeof(struct assembler_symbol));
+  symbol->name = strndup(name, len);
+  symbol->section = -1;
+  vector_push(assembler->symbols, &symbol);
+  if (vector_count(assembler->symbols) > assembler->total_buckets)
+  {
+    assembler_buckets_grow(assembler);
+    return symbol;
+  }
+
+  unsigned int bucket = hash & (assembler->total_buckets - 1);
+  symbol->next = assembler->buckets[bucket];
+  assembler->buckets[bucket] = symbol;
+  return symbol;
+}
+
+/**
+ * @brief Looks up a symbol as written in the assembly, labels starting with a dot belong to the last normal label
+ */
+static struct assembler_symbol* assembler_reference(struct assembler* assembler, const char* name, size_t len)
+{
+  if (len > 0 && name[0] == '.')
+  {
+    char qualified[256];
+    int total = snprintf(qualified, sizeof(qualified), "%s%.*s", assembler->scope_label, (int) len, name);
+    return assembler_symbol(assembler, qualified, total);
+  }
+
+  return assembler_symbol(assembler, name, len);
+}
+
+static struct assembler_section* assembler_section(struct assembler* assembler)
+{
+  return &assembler->sections[assembler->current_section];
+}
+
+static void assembler_write(struct assembler* assembler, const void* data, int len)
+{
+  struct assembler_section* section = assembler_section(assembler);
+  section->size += len;
+  if (assembler->current_section == ASSEMBLER_SECTION_BSS)
+  {
+    for (int i = 0; i < len; i++)
+    {
+      if (((const char*) data)[i] != 0)
+      {
+        compiler_error(assembler->process, "Only zeros can be written to .bss\n");
+      }
+    }
+    return;
+  }
+
+  for (int i = 0; i < len; i++)
+  {
+    buffer_write(section->data, ((const char*) data)[i]);
+  }
+}
+
+static void assembler_byte(struct assembler* assembler, int value)
+{
+  unsigned char byte = value;
+  assembler_write(assembler, &byte, 1);
+}
+
+/**
+ * @brief Writes the low size bytes of the value, little endian as the processor reads them
+ */
+static void assembler_value(struct assembler* assembler, long long value, int size)
+{
+  unsigned char bytes[8];
+  for (int i = 0; i < size; i++)
+  {
+    bytes[i] = (unsigned char)((unsigned long long) value >> (i * 8));
+  }
+  assembler_write(assembler, bytes, size);
+}
+
+static void assembler_fixup(struct assembler* assembler, int type, struct assembler_symbol* symbol, int instruction_index)
+{
+  struct assembler_fixup fixup = {.type=type, .section=assembler->current_section, .offset=assembler_section(assembler)->size, .symbol=symbol, .instruction_index=instruction_index};
+  vector_push(assembler->fixups, &fixup);
+}
+
+static void assembler_define_label(struct assembler* assembler, const char* name, size_t len)
+{
+  if (len > 0 && name[0] != '.')
+  {
+    snprintf(assembler->scope_label, sizeof(assembler->scope_label), "%.*s", (int) len, name);
+  }
+
+  struct assembler_symbol* symbol = assembler_reference(assembler, name, len);
+  if (symbol->section != -1)
+  {
+    compiler_error(assembler->process, "The label %s is defined more than once\n", symbol->name);
+  }
+
+  symbol->section = assembler->current_section;
+  symbol->offset = assembler_section(assembler)->size;
+}
+
+static int assembler_register_size(int reg)
+{
+  if (register_is_dword(reg))
+  {
+    return DATA_SIZE_DWORD;
+  }
+
+  return reg >= REGISTER_AL ? DATA_SIZE_BYTE : DATA_SIZE_WORD;
+}
+
+static int assembler_register_code(int reg)
+{
+  return assembler_register_codes[reg];
+}
+
+static bool assembler_fits_byte(long long value)
+{
+  return value >= -128 && value <= 127;
+}
+
+/**
+ * @brief Returns the immediate as the processor sees it for an operation of the given size, i.e 4294967295 is -1 for a dword
+ */
+static long long assembler_immediate_value(struct instruction_operand* operand, int size)
+{
+  switch (size)
+  {
+    case DATA_SIZE_BYTE:
+      return (signed char) operand->imm;
+
+    case DATA_SIZE_WORD:
+      return (short) operand->imm;
+  }
+
+  return (int)(unsigned int) operand->imm;
+}
+
+/**
+ * @brief eax, ax and al have shorter encodings with an immediate
+ */
+static bool assembler_is_accumulator(struct instruction_operand* operand)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && (operand->reg == REGISTER_EAX || operand->reg == REGISTER_AX || operand->reg == REGISTER_AL);
+}
+
+static bool assembler_is_immediate(struct instruction_operand* operand)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE || operand->type == INSTRUCTION_OPERAND_TYPE_SYMBOL;
+}
+
+/**
+ * @brief The size the instruction operates on, taken from its registers and size keywords. Dword if nothing says
+ */
+static int assembler_operation_size(struct instruction* ins)
+{
+  for (int i = 0; i < ins->total_operands; i++)
+  {
+    struct instruction_operand* operand = &ins->operands[i];
+    if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+    {
+      return assembler_register_size(operand->reg);
+    }
+
+    if (operand->size)
+    {
+      return operand->size;
+    }
+  }
+
+  return DATA_SIZE_DWORD;
+}
+
+static void assembler_write_immediate(struct assembler* assembler, struct instruction_operand* operand, int size)
+{
+  if (operand->type == INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    if (size != DATA_SIZE_DWORD)
+    {
+      compiler_error(assembler->process, "The address of %s does not fit in %i bytes\n", operand->symbol, size);
+    }
+    assembler_fixup(assembler, ASSEMBLER_RELOCATION_ABSOLUTE, assembler_reference(assembler, operand->symbol, strlen(operand->symbol)), -1);
+    assembler_value(assembler, 0, size);
+    return;
+  }
+
+  assembler_value(assembler, operand->imm, size);
+}
+
+/**
+ * @brief Gives the address of the memory operand in the form we encode it, the symbol is a reference we fix up
+ */
+static void assembler_address_for(struct assembler* assembler, struct instruction_operand* operand, struct assembler_address* address)
+{
+  struct instruction_address* from = &operand->address;
+  *address = (struct assembler_address){.base=from->base, .index=from->index, .scale=from->scale, .displacement=from->displacement};
+  if ((address->base != -1 && !register_is_dword(address->base)) || (address->index != -1 && !register_is_dword(address->index)) ||
+    (address->scale != 1 && address->scale != 2 && address->scale != 4 && address->scale != 8))
+  {
+    compiler_error(assembler->process, "Invalid address\n");
+  }
+
+  if (from->symbol)
+  {
+    address->symbol = assembler_reference(assembler, from->symbol, strlen(from->symbol));
+  }
+
+  // esp can only be a base
+  if (address->index == REGISTER_ESP && address->scale == 1 && address->base != REGISTER_ESP)
+  {
+    address->index = address->base;
+    address->base = REGISTER_ESP;
+  }
+
+  if (address->index == REGISTER_ESP)
+  {
+    compiler_error(assembler->process, "esp can not be scaled in an address\n");
+  }
+}
+
+static int assembler_scale_bits(int scale)
+{
+  switch (scale)
+  {
+    case 2:
+      return 1;
+    case 4:
+      return 2;
+    case 8:
+      return 3;
+  }
+
+  return 0;
+}
+
+static void assembler_write_address(struct assembler* assembler, int reg_field, struct assembler_address* address)
+{
+  int index = address->index == -1 ? 4 : assembler_register_code(address->index);
+  int sib_scale = assembler_scale_bits(address->scale) << 6;
+  if (address->base == -1)
+  {
+    // No base is an absolute address, with an index it needs the SIB byte to say so
+    if (address->index == -1)
+    {
+      assembler_byte(assembler, (reg_field << 3) | 5);
+    }
+    else
+    {
+      assembler_byte(assembler, (reg_field << 3) | 4);
+      assembler_byte(assembler, sib_scale | (index << 3) | 5);
+    }
+  }
+  else
+  {
+    int base = assembler_register_code(address->base);
+    int mod = 2;
+    if (!address->symbol && address->displacement == 0 && base != 5)
+    {
+      mod = 0;
+    }
+    else if (!address->symbol && assembler_fits_byte(address->displacement))
+    {
+      mod = 1;
+    }
+
+    if (address->index == -1 && base != 4)
+    {
+      assembler_byte(assembler, (mod << 6) | (reg_field << 3) | base);
+    }
+    else
+    {
+      assembler_byte(assembler, (mod << 6) | (reg_field << 3) | 4);
+      assembler_byte(assembler, sib_scale | (index << 3) | base);
+    }
+
+    if (mod == 0)
+    {
+      return;
+    }
+
+    if (mod == 1)
+    {
+      assembler_value(assembler, address->displacement, 1);
+      return;
+    }
+  }
+
+  if (address->symbol)
+  {
+    assembler_fixup(assembler, ASSEMBLER_RELOCATION_ABSOLUTE, address->symbol, -1);
+  }
+  assembler_value(assembler, address->displacement, 4);
+}
+
+/**
+ * @brief Writes the ModRM byte and whatever follows it for a register or memory operand
+ */
+static void assembler_write_rm(struct assembler* assembler, int reg_field, struct instruction_operand* operand)
+{
+  if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    assembler_byte(assembler, 0xC0 | (reg_field << 3) | assembler_register_code(operand->reg));
+    return;
+  }
+
+  if (operand->type != INSTRUCTION_OPERAND_TYPE_MEMORY)
+  {
+    compiler_error(assembler->process, "Expected a register or memory operand\n");
+  }
+
+  struct assembler_address address;
+  assembler_address_for(assembler, operand, &address);
+  assembler_write_address(assembler, reg_field, &address);
+}
+
+static void assembler_write_size_prefix(struct assembler* assembler, int size)
+{
+  if (size == DATA_SIZE_WORD)
+  {
+    assembler_byte(assembler, 0x66);
+  }
+}
+
+/**
+ * @brief Moves between the accumulator and a global have a form without the ModRM byte, i.e mov eax, [x]
+ */
+static bool assembler_encode_mov_absolute(struct assembler* assembler, struct instruction_operand* dst, struct instruction_operand* src, bool byte)
+{
+  bool load = dst->type == INSTRUCTION_OPERAND_TYPE_REGISTER && src->type == INSTRUCTION_OPERAND_TYPE_MEMORY;
+  bool store = src->type == INSTRUCTION_OPERAND_TYPE_REGISTER && dst->type == INSTRUCTION_OPERAND_TYPE_MEMORY;
+  if (!load && !store)
+  {
+    return false;
+  }
+
+  int reg = load ? dst->reg : src->reg;
+  if (assembler_register_code(reg) != 0 || reg == REGISTER_AH)
+  {
+    return false;
+  }
+
+  struct assembler_address address;
+  assembler_address_for(assembler, load ? src : dst, &address);
+  if (address.base != -1 || address.index != -1)
+  {
+    return false;
+  }
+
+  assembler_byte(assembler, (load ? 0xA0 : 0xA2) + (byte ? 0 : 1));
+  if (address.symbol)
+  {
+    assembler_fixup(assembler, ASSEMBLER_RELOCATION_ABSOLUTE, address.symbol, -1);
+  }
+  assembler_value(assembler, address.displacement, 4);
+  return true;
+}
+
+static void assembler_encode_mov(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* src = &ins->operands[1];
+  int size = assembler_operation_size(ins);
+  bool byte = size == DATA_SIZE_BYTE;
+  assembler_write_size_prefix(assembler, size);
+  if (assembler_is_immediate(src))
+  {
+    if (dst->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+    {
+      assembler_byte(assembler, (byte ? 0xB0 : 0xB8) + assembler_register_code(dst->reg));
+    }
+    else
+    {
+      assembler_byte(assembler, byte ? 0xC6 : 0xC7);
+      assembler_write_rm(assembler, 0, dst);
+    }
+    assembler_write_immediate(assembler, src, size);
+    return;
+  }
+
+  if (assembler_encode_mov_absolute(assembler, dst, src, byte))
+  {
+    return;
+  }
+
+  if (src->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    assembler_byte(assembler, byte ? 0x88 : 0x89);
+    assembler_write_rm(assembler, assembler_register_code(src->reg), dst);
+    return;
+  }
+
+  if (dst->type != INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    compiler_error(assembler->process, "mov can not move memory to memory\n");
+  }
+  assembler_byte(assembler, byte ? 0x8A : 0x8B);
+  assembler_write_rm(assembler, assembler_register_code(dst->reg), src);
+}
+
+/**
+ * @brief add, or, and, sub, xor and cmp, the extension is the operation's number in the 0x80 group
+ */
+static void assembler_encode_arithmetic(struct assembler* assembler, struct instruction* ins, int extension)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* src = &ins->operands[1];
+  int size = assembler_operation_size(ins);
+  bool byte = size == DATA_SIZE_BYTE;
+  assembler_write_size_prefix(assembler, size);
+  if (assembler_is_immediate(src))
+  {
+    if (byte && assembler_is_accumulator(dst))
+    {
+      assembler_byte(assembler, (extension << 3) | 0x04);
+      assembler_write_immediate(assembler, src, size);
+      return;
+    }
+
+    if (byte)
+    {
+      assembler_byte(assembler, 0x80);
+      assembler_write_rm(assembler, extension, dst);
+      assembler_write_immediate(assembler, src, size);
+      return;
+    }
+
+    if (src->type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE && assembler_fits_byte(assembler_immediate_value(src, size)))
+    {
+      assembler_byte(assembler, 0x83);
+      assembler_write_rm(assembler, extension, dst);
+      assembler_value(assembler, src->imm, 1);
+      return;
+    }
+
+    if (assembler_is_accumulator(dst))
+    {
+      assembler_byte(assembler, (extension << 3) | 0x05);
+      assembler_write_immediate(assembler, src, size);
+      return;
+    }
+
+    assembler_byte(assembler, 0x81);
+    assembler_write_rm(assembler, extension, dst);
+    assembler_write_immediate(assembler, src, size);
+    return;
+  }
+
+  if (src->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    assembler_byte(assembler, (extension << 3) | (byte ? 0x00 : 0x01));
+    assembler_write_rm(assembler, assembler_register_code(src->reg), dst);
+    return;
+  }
+
+  if (dst->type != INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    compiler_error(assembler->process, "%s can not use two memory operands\n", instruction_opcode_name(ins->opcode));
+  }
+  assembler_byte(assembler, (extension << 3) | (byte ? 0x02 : 0x03));
+  assembler_write_rm(assembler, assembler_register_code(dst->reg), src);
+}
+
+static void assembler_encode_test(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* src = &ins->operands[1];
+  int size = assembler_operation_size(ins);
+  bool byte = size == DATA_SIZE_BYTE;
+  assembler_write_size_prefix(assembler, size);
+  if (assembler_is_immediate(src) && assembler_is_accumulator(dst))
+  {
+    assembler_byte(assembler, byte ? 0xA8 : 0xA9);
+    assembler_write_immediate(assembler, src, size);
+    return;
+  }
+
+  if (assembler_is_immediate(src))
+  {
+    assembler_byte(assembler, byte ? 0xF6 : 0xF7);
+    assembler_write_rm(assembler, 0, dst);
+    assembler_write_immediate(assembler, src, size);
+    return;
+  }
+
+  if (src->type != INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    compiler_error(assembler->process, "test needs a register or immediate as its second operand\n");
+  }
+  assembler_byte(assembler, byte ? 0x84 : 0x85);
+  assembler_write_rm(assembler, assembler_register_code(src->reg), dst);
+}
+
+/**
+ * @brief Instructions of the 0xF6/0xF7 and 0xFE/0xFF groups that take a single register or memory operand
+ */
+static void assembler_encode_unary(struct assembler* assembler, struct instruction* ins, int opcode, int extension)
+{
+  int size = assembler_operation_size(ins);
+  assembler_write_size_prefix(assembler, size);
+  assembler_byte(assembler, size == DATA_SIZE_BYTE ? opcode - 1 : opcode);
+  assembler_write_rm(assembler, extension, &ins->operands[0]);
+}
+
+static void assembler_encode_imul(struct assembler* assembler, struct instruction* ins)
+{
+  if (ins->total_operands == 1)
+  {
+    assembler_encode_unary(assembler, ins, 0xF7, 5);
+    return;
+  }
+
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* src = &ins->operands[1];
+  struct instruction_operand* imm = ins->total_operands == 3 ? &ins->operands[2] : NULL;
+  if (!imm && assembler_is_immediate(src))
+  {
+    // imul eax, 5 is imul eax, eax, 5
+    imm = src;
+    src = dst;
+  }
+
+  if (dst->type != INSTRUCTION_OPERAND_TYPE_REGISTER || !register_is_dword(dst->reg))
+  {
+    compiler_error(assembler->process, "imul needs a dword register to multiply into\n");
+  }
+
+  int reg_field = assembler_register_code(dst->reg);
+  if (!imm)
+  {
+    assembler_byte(assembler, 0x0F);
+    assembler_byte(assembler, 0xAF);
+    assembler_write_rm(assembler, reg_field, src);
+    return;
+  }
+
+  if (imm->type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE && assembler_fits_byte(assembler_immediate_value(imm, DATA_SIZE_DWORD)))
+  {
+    assembler_byte(assembler, 0x6B);
+    assembler_write_rm(assembler, reg_field, src);
+    assembler_value(assembler, imm->imm, 1);
+    return;
+  }
+
+  assembler_byte(assembler, 0x69);
+  assembler_write_rm(assembler, reg_field, src);
+  assembler_write_immediate(assembler, imm, DATA_SIZE_DWORD);
+}
+
+static void assembler_encode_shift(struct assembler* assembler, struct instruction* ins, int extension)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* count = &ins->operands[1];
+  int size = dst->type == INSTRUCTION_OPERAND_TYPE_REGISTER ? assembler_register_size(dst->reg) : (dst->size ? dst->size : DATA_SIZE_DWORD);
+  bool byte = size == DATA_SIZE_BYTE;
+  assembler_write_size_prefix(assembler, size);
+  if (count->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    if (count->reg != REGISTER_CL)
+    {
+      compiler_error(assembler->process, "Shifts can only shift by cl\n");
+    }
+    assembler_byte(assembler, byte ? 0xD2 : 0xD3);
+    assembler_write_rm(assembler, extension, dst);
+    return;
+  }
+
+  if (count->type != INSTRUCTION_OPERAND_TYPE_IMMEDIATE)
+  {
+    compiler_error(assembler->process, "Shifts need a constant or cl to shift by\n");
+  }
+
+  if (count->imm == 1)
+  {
+    assembler_byte(assembler, byte ? 0xD0 : 0xD1);
+    assembler_write_rm(assembler, extension, dst);
+    return;
+  }
+
+  assembler_byte(assembler, byte ? 0xC0 : 0xC1);
+  assembler_write_rm(assembler, extension, dst);
+  assembler_value(assembler, count->imm, 1);
+}
+
+static void assembler_encode_extend(struct assembler* assembler, struct instruction* ins, int byte_opcode)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  struct instruction_operand* src = &ins->operands[1];
+  int src_size = src->type == INSTRUCTION_OPERAND_TYPE_REGISTER ? assembler_register_size(src->reg) : src->size;
+  if (dst->type != INSTRUCTION_OPERAND_TYPE_REGISTER || (src_size != DATA_SIZE_BYTE && src_size != DATA_SIZE_WORD))
+  {
+    compiler_error(assembler->process, "%s needs a register and a byte or word to extend\n", instruction_opcode_name(ins->opcode));
+  }
+
+  assembler_write_size_prefix(assembler, assembler_register_size(dst->reg));
+  assembler_byte(assembler, 0x0F);
+  assembler_byte(assembler, src_size == DATA_SIZE_BYTE ? byte_opcode : byte_opcode + 1);
+  assembler_write_rm(assembler, assembler_register_code(dst->reg), src);
+}
+
+static void assembler_encode_push(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* operand = &ins->operands[0];
+  switch (operand->type)
+  {
+    case INSTRUCTION_OPERAND_TYPE_REGISTER:
+      assembler_byte(assembler, 0x50 + assembler_register_code(operand->reg));
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_IMMEDIATE:
+      if (assembler_fits_byte(assembler_immediate_value(operand, DATA_SIZE_DWORD)))
+      {
+        assembler_byte(assembler, 0x6A);
+        assembler_value(assembler, operand->imm, 1);
+        break;
+      }
+      assembler_byte(assembler, 0x68);
+      assembler_value(assembler, operand->imm, 4);
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_SYMBOL:
+      assembler_byte(assembler, 0x68);
+      assembler_write_immediate(assembler, operand, DATA_SIZE_DWORD);
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_MEMORY:
+      assembler_byte(assembler, 0xFF);
+      assembler_write_rm(assembler, 6, operand);
+    break;
+  }
+}
+
+static void assembler_encode_pop(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* operand = &ins->operands[0];
+  if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    assembler_byte(assembler, 0x58 + assembler_register_code(operand->reg));
+    return;
+  }
+
+  assembler_byte(assembler, 0x8F);
+  assembler_write_rm(assembler, 0, operand);
+}
+
+/**
+ * @brief Jumps to a label, short unless an earlier pass found the label too far away for a byte
+ */
+static void assembler_encode_jump(struct assembler* assembler, struct instruction* ins, int index)
+{
+  struct instruction_operand* target = &ins->operands[0];
+  if (target->type != INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    if (ins->opcode != INSTRUCTION_OPCODE_JMP)
+    {
+      compiler_error(assembler->process, "Conditional jumps need a label to jump to\n");
+    }
+    assembler_byte(assembler, 0xFF);
+    assembler_write_rm(assembler, 4, target);
+    return;
+  }
+
+  struct assembler_symbol* symbol = assembler_reference(assembler, target->symbol, strlen(target->symbol));
+  int condition = ins->opcode == INSTRUCTION_OPCODE_JMP ? -1 : assembler_condition_codes[ins->opcode - INSTRUCTION_OPCODE_JE];
+  if (!assembler->long_jumps[index])
+  {
+    assembler_byte(assembler, condition == -1 ? 0xEB : 0x70 + condition);
+    assembler_fixup(assembler, ASSEMBLER_RELOCATION_SHORT, symbol, index);
+    assembler_byte(assembler, 0);
+    return;
+  }
+
+  if (condition == -1)
+  {
+    assembler_byte(assembler, 0xE9);
+  }
+  else
+  {
+    assembler_byte(assembler, 0x0F);
+    assembler_byte(assembler, 0x80 + condition);
+  }
+  assembler_fixup(assembler, ASSEMBLER_RELOCATION_RELATIVE, symbol, index);
+  assembler_value(assembler, 0, 4);
+}
+
+static void assembler_encode_call(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* target = &ins->operands[0];
+  if (target->type != INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    assembler_byte(assembler, 0xFF);
+    assembler_write_rm(assembler, 2, target);
+    return;
+  }
+
+  assembler_byte(assembler, 0xE8);
+  assembler_fixup(assembler, ASSEMBLER_RELOCATION_RELATIVE, assembler_reference(assembler, target->symbol, strlen(target->symbol)), -1);
+  assembler_value(assembler, 0, 4);
+}
+
+static void assembler_encode_set(struct assembler* assembler, struct instruction* ins)
+{
+  struct instruction_operand* operand = &ins->operands[0];
+  if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && assembler_register_size(operand->reg) != DATA_SIZE_BYTE)
+  {
+    compiler_error(assembler->process, "%s needs a byte register\n", instruction_opcode_name(ins->opcode));
+  }
+
+  assembler_byte(assembler, 0x0F);
+  assembler_byte(assembler, 0x90 + assembler_condition_codes[ins->opcode - INSTRUCTION_OPCODE_SETE]);
+  assembler_write_rm(assembler, 0, operand);
+}
+
+static void assembler_encode(struct assembler* assembler, struct instruction* ins, int index)
+{
+  switch (ins->opcode)
+  {
+    case INSTRUCTION_OPCODE_MOV:
+      assembler_encode_mov(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_MOVZX:
+      assembler_encode_extend(assembler, ins, 0xB6);
+    break;
+
+    case INSTRUCTION_OPCODE_MOVSX:
+      assembler_encode_extend(assembler, ins, 0xBE);
+    break;
+
+    case INSTRUCTION_OPCODE_LEA:
+      if (ins->operands[0].type != INSTRUCTION_OPERAND_TYPE_REGISTER || ins->operands[1].type != INSTRUCTION_OPERAND_TYPE_MEMORY)
+      {
+        compiler_error(assembler->process, "lea needs a register and an address\n");
+      }
+      assembler_byte(assembler, 0x8D);
+      assembler_write_rm(assembler, assembler_register_code(ins->operands[0].reg), &ins->operands[1]);
+    break;
+
+    case INSTRUCTION_OPCODE_PUSH:
+      assembler_encode_push(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_POP:
+      assembler_encode_pop(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_ADD:
+      assembler_encode_arithmetic(assembler, ins, 0);
+    break;
+
+    case INSTRUCTION_OPCODE_OR:
+      assembler_encode_arithmetic(assembler, ins, 1);
+    break;
+
+    case INSTRUCTION_OPCODE_AND:
+      assembler_encode_arithmetic(assembler, ins, 4);
+    break;
+
+    case INSTRUCTION_OPCODE_SUB:
+      assembler_encode_arithmetic(assembler, ins, 5);
+    break;
+
+    case INSTRUCTION_OPCODE_XOR:
+      assembler_encode_arithmetic(assembler, ins, 6);
+    break;
+
+    case INSTRUCTION_OPCODE_CMP:
+      assembler_encode_arithmetic(assembler, ins, 7);
+    break;
+
+    case INSTRUCTION_OPCODE_TEST:
+      assembler_encode_test(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_IMUL:
+      assembler_encode_imul(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_MUL:
+      assembler_encode_unary(assembler, ins, 0xF7, 4);
+    break;
+
+    case INSTRUCTION_OPCODE_DIV:
+      assembler_encode_unary(assembler, ins, 0xF7, 6);
+    break;
+
+    case INSTRUCTION_OPCODE_IDIV:
+      assembler_encode_unary(assembler, ins, 0xF7, 7);
+    break;
+
+    case INSTRUCTION_OPCODE_NEG:
+      assembler_encode_unary(assembler, ins, 0xF7, 3);
+    break;
+
+    case INSTRUCTION_OPCODE_NOT:
+      assembler_encode_unary(assembler, ins, 0xF7, 2);
+    break;
+
+    case INSTRUCTION_OPCODE_INC:
+      assembler_encode_unary(assembler, ins, 0xFF, 0);
+    break;
+
+    case INSTRUCTION_OPCODE_DEC:
+      assembler_encode_unary(assembler, ins, 0xFF, 1);
+    break;
+
+    case INSTRUCTION_OPCODE_CDQ:
+      assembler_byte(assembler, 0x99);
+    break;
+
+    case INSTRUCTION_OPCODE_SAL:
+    case INSTRUCTION_OPCODE_SHL:
+      assembler_encode_shift(assembler, ins, 4);
+    break;
+
+    case INSTRUCTION_OPCODE_SHR:
+      assembler_encode_shift(assembler, ins, 5);
+    break;
+
+    case INSTRUCTION_OPCODE_SAR:
+      assembler_encode_shift(assembler, ins, 7);
+    break;
+
+    case INSTRUCTION_OPCODE_CALL:
+      assembler_encode_call(assembler, ins);
+    break;
+
+    case INSTRUCTION_OPCODE_RET:
+      assembler_byte(assembler, 0xC3);
+    break;
+
+    default:
+      if (ins->opcode >= INSTRUCTION_OPCODE_JMP && ins->opcode <= INSTRUCTION_OPCODE_JBE)
+      {
+        assembler_encode_jump(assembler, ins, index);
+        break;
+      }
+
+      if (ins->opcode >= INSTRUCTION_OPCODE_SETE && ins->opcode <= INSTRUCTION_OPCODE_SETBE)
+      {
+        assembler_encode_set(assembler, ins);
+        break;
+      }
+
+      compiler_error(assembler->process, "The built in assembler can not encode %s\n", instruction_opcode_name(ins->opcode));
+  }
+}
+
+static void assembler_align(struct assembler* assembler, int alignment)
+{
+  if (alignment <= 0 || (alignment & (alignment - 1)) != 0)
+  {
+    compiler_error(assembler->process, "Can not align to %i bytes\n", alignment);
+  }
+
+  struct assembler_section* section = assembler_section(assembler);
+  if (alignment > section->alignment)
+  {
+    section->alignment = alignment;
+  }
+
+  int padding = (alignment - section->size % alignment) % alignment;
+  if (assembler->current_section != ASSEMBLER_SECTION_TEXT)
+  {
+    for (int i = 0; i < padding; i++)
+    {
+      assembler_byte(assembler, 0);
+    }
+    return;
+  }
+
+  // Padding in code is executed when we fall into the label after it, a few long nops are cheaper than many short ones
+  while (padding > 0)
+  {
+    int len = padding > ASSEMBLER_LONGEST_NOP ? ASSEMBLER_LONGEST_NOP : padding;
+    assembler_write(assembler, assembler_nops[len - 1], len);
+    padding -= len;
+  }
+}
+
+static const char* assembler_skip_spaces(const char* ptr)
+{
+  while (*ptr == ' ')
+  {
+    ptr++;
+  }
+  return ptr;
+}
+
+static int assembler_data_size(const char* directive, size_t len, bool* reserve)
+{
+  static const char* sizes = "bwdq";
+  if (len == 2 && directive[0] == 'd')
+  {
+    *reserve = false;
+  }
+  else if (len == 4 && strncmp(directive, "res", 3) == 0)
+  {
+    *reserve = true;
+  }
+  else
+  {
+    return 0;
+  }
+
+  const char* size = strchr(sizes, directive[len - 1]);
+  return size ? 1 << (size - sizes) : 0;
+}
+
+/**
+ * @brief Writes the comma separated items of a db, dw, dd or dq. Items are numbers,
+ * characters in quotes or a symbol when the item is big enough to hold an address
+ */
+static void assembler_data(struct assembler* assembler, const char* items, int size)
+{
+  const char* ptr = assembler_skip_spaces(items);
+  while (*ptr)
+  {
+    if (*ptr == '\'')
+    {
+      // Characters are written as they are so a quote or comma is its own character, i.e ','
+      const char* end = ptr[1] && ptr[2] == '\'' ? ptr + 2 : strchr(ptr + 1, '\'');
+      if (!end)
+      {
+        compiler_error(assembler->process, "Missing closing quote in %s\n", items);
+      }
+
+      for (const char* c = ptr + 1; c < end; c++)
+      {
+        assembler_value(assembler, (unsigned char) *c, size);
+      }
+      ptr = end + 1;
+    }
+    else if (isdigit(*ptr) || *ptr == '-')
+    {
+      char* end = NULL;
+      assembler_value(assembler, strtoll(ptr, &end, 10), size);
+      ptr = end;
+    }
+    else
+    {
+      const char* end = ptr;
+      while (*end && *end != ',' && *end != ' ' && *end != '+')
+      {
+        end++;
+      }
+
+      if (size != DATA_SIZE_DWORD || end == ptr)
+      {
+        compiler_error(assembler->process, "Invalid data %s\n", items);
+      }
+
+      long long addend = 0;
+      if (*end == '+')
+      {
+        char* number_end = NULL;
+        addend = strtoll(end + 1, &number_end, 10);
+        end = number_end;
+      }
+
+      assembler_fixup(assembler, ASSEMBLER_RELOCATION_ABSOLUTE, assembler_reference(assembler, ptr, end - ptr), -1);
+      assembler_value(assembler, addend, size);
+      ptr = end;
+    }
+
+    ptr = assembler_skip_spaces(ptr);
+    if (*ptr == ',')
+    {
+      ptr = assembler_skip_spaces(ptr + 1);
+    }
+  }
+}
+
+static void assembler_section_directive(struct assembler* assembler, const char* name)
+{
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    if (S_EQ(name, assembler_section_names[i]))
+    {
+      assembler->current_section = i;
+      return;
+    }
+  }
+
+  compiler_error(assembler->process, "The built in assembler does not know the section %s\n", name);
+}
+
+/**
+ * @brief Lines the instruction list keeps as text, directives, data and instructions it does not model
+ */
+static void assembler_raw(struct assembler* assembler, const char* line)
+{
+  if (strncmp(line, "section ", 8) == 0)
+  {
+    assembler_section_directive(assembler, assembler_skip_spaces(line + 8));
+    return;
+  }
+
+  if (strncmp(line, "global ", 7) == 0 || strncmp(line, "extern ", 7) == 0)
+  {
+    const char* name = assembler_skip_spaces(line + 7);
+    assembler_symbol(assembler, name, strlen(name))->global = true;
+    return;
+  }
+
+  if (S_EQ(line, "rep movsd"))
+  {
+    assembler_byte(assembler, 0xF3);
+    assembler_byte(assembler, 0xA5);
+    return;
+  }
+
+  // Data with or without a label, i.e "y: dd 50" or "dd main.switch_1_case_2"
+  const char* directive = line;
+  const char* colon = strchr(line, ':');
+  const char* space = strchr(line, ' ');
+  if (colon && (!space || colon < space))
+  {
+    assembler_define_label(assembler, line, colon - line);
+    directive = assembler_skip_spaces(colon + 1);
+  }
+
+  const char* directive_end = strchr(directive, ' ');
+  size_t len = directive_end ? (size_t)(directive_end - directive) : strlen(directive);
+  bool reserve = false;
+  int size = assembler_data_size(directive, len, &reserve);
+  if (size == 0 || !directive_end)
+  {
+    compiler_error(assembler->process, "The built in assembler does not understand \"%s\"\n", line);
+  }
+
+  if (!reserve)
+  {
+    assembler_data(assembler, directive_end, size);
+    return;
+  }
+
+  long long total = strtoll(directive_end, NULL, 10) * size;
+  for (long long i = 0; i < total; i++)
+  {
+    assembler_byte(assembler, 0);
+  }
+}
+
+/**
+ * @brief Patches every symbol reference now that all labels are placed. References to labels in
+ * the same section are finished here, anything else becomes a relocation for the linker.
+ * Returns false if a short jump could not reach its label, it is marked long for the next pass
+ */
+static bool assembler_resolve_fixups(struct assembler* assembler)
+{
+  bool resolved = true;
+  for (int i = 0; i < vector_count(assembler->fixups); i++)
+  {
+    struct assembler_fixup* fixup = vector_at(assembler->fixups, i);
+    struct assembler_section* section = &assembler->sections[fixup->section];
+    struct assembler_symbol* symbol = fixup->symbol;
+    if (symbol->section == -1 && !symbol->global)
+    {
+      compiler_error(assembler->process, "The symbol %s is never defined\n", symbol->name);
+    }
+
+    if (fixup->type == ASSEMBLER_RELOCATION_SHORT)
+    {
+      long long displacement = (long long) symbol->offset - (fixup->offset + 1);
+      if (symbol->section != fixup->section || !assembler_fits_byte(displacement))
+      {
+        assembler->long_jumps[fixup->instruction_index] = true;
+        resolved = false;
+        continue;
+      }
+      section->data->data[fixup->offset] = (char) displacement;
+      continue;
+    }
+
+    unsigned char* field = (unsigned char*) section->data->data + fixup->offset;
+    int32_t value = field[0] | (field[1] << 8) | (field[2] << 16) | ((uint32_t) field[3] << 24);
+    if (fixup->type == ASSEMBLER_RELOCATION_RELATIVE && symbol->section == fixup->section)
+    {
+      value += symbol->offset - (fixup->offset + 4);
+    }
+    else
+    {
+      struct assembler_symbol* target = symbol;
+      if (symbol->section != -1)
+      {
+        // Anything we defined is relocated against its section, the linker only needs to move that
+        value += symbol->offset;
+        target = &assembler->sections[symbol->section].symbol;
+      }
+
+      if (fixup->type == ASSEMBLER_RELOCATION_RELATIVE)
+      {
+        // The processor adds the displacement to the address of the next instruction
+        value -= 4;
+      }
+
+      struct assembler_relocation relocation = {.type=fixup->type, .offset=fixup->offset, .symbol=target};
+      vector_push(section->relocations, &relocation);
+    }
+
+    for (int j = 0; j < 4; j++)
+    {
+      field[j] = (unsigned char)((uint32_t) value >> (j * 8));
+    }
+  }
+
+  return resolved;
+}
+
+static void assembler_reset(struct assembler* assembler)
+{
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    struct assembler_section* section = &assembler->sections[i];
+    section->data->len = 0;
+    section->size = 0;
+    section->alignment = assembler_section_alignments[i];
+    vector_clear(section->relocations);
+  }
+
+  for (int i = 0; i < vector_count(assembler->symbols); i++)
+  {
+    struct assembler_symbol* symbol = *(struct assembler_symbol**) vector_at(assembler->symbols, i);
+    symbol->section = -1;
+    symbol->offset = 0;
+    symbol->global = false;
+  }
+
+  vector_clear(assembler->fixups);
+  assembler->current_section = ASSEMBLER_SECTION_TEXT;
+  assembler->scope_label[0] = 0;
+}
+
+/**
+ * @brief Encodes every instruction once, returns false if some jump has to be made long and we need another pass
+ */
+static bool assembler_pass(struct assembler* assembler, struct vector* instructions)
+{
+  assembler_reset(assembler);
+  for (int i = 0; i < vector_count(instructions); i++)
+  {
+    struct instruction* ins = vector_at(instructions, i);
+    if (ins->flags & INSTRUCTION_FLAG_DELETED)
+    {
+      continue;
+    }
+
+    switch (ins->opcode)
+    {
+      case INSTRUCTION_OPCODE_COMMENT:
+      break;
+
+      case INSTRUCTION_OPCODE_LABEL:
+        assembler_define_label(assembler, ins->text, strlen(ins->text));
+      break;
+
+      case INSTRUCTION_OPCODE_ALIGN:
+        // align or alignb, the number follows the space
+        assembler_align(assembler, atoi(strchr(ins->text, ' ') + 1));
+      break;
+
+      case INSTRUCTION_OPCODE_RAW:
+        assembler_raw(assembler, ins->text);
+      break;
+
+      default:
+        assembler_encode(assembler, ins, i);
+    }
+  }
+
+  return assembler_resolve_fixups(assembler);
+}
+
+static struct assembler* assembler_new(struct compile_process* process, int total_instructions)
+{
+  struct assembler* assembler = calloc(1, sizeof(struct assembler));
+  assembler->process = process;
+  assembler->symbols = vector_create(sizeof(struct assembler_symbol*));
+  assembler->total_buckets = ASSEMBLER_START_BUCKETS;
+  assembler->buckets = calloc(assembler->total_buckets, sizeof(struct assembler_symbol*));
+  assembler->fixups = vector_create(sizeof(struct assembler_fixup));
+  assembler->long_jumps = calloc(total_instructions + 1, sizeof(bool));
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    struct assembler_section* section = &assembler->sections[i];
+    section->name = assembler_section_names[i];
+    section->data = buffer_create();
+    section->relocations = vector_create(sizeof(struct assembler_relocation));
+    section->symbol.name = (char*) section->name;
+    section->symbol.section = i;
+  }
+
+  return assembler;
+}
+
+void assembler_free(struct assembler* assembler)
+{
+  for (int i = 0; i < vector_count(assembler->symbols); i++)
+  {
+    struct assembler_symbol* symbol = *(struct assembler_symbol**) vector_at(assembler->symbols, i);
+    free(symbol->name);
+    free(symbol);
+  }
+
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    buffer_free(assembler->sections[i].data);
+    vector_free(assembler->sections[i].relocations);
+  }
+
+  vector_free(assembler->symbols);
+  vector_free(assembler->fixups);
+  free(assembler->buckets);
+  free(assembler->long_jumps);
+  free(assembler);
+}
+
+struct assembler* assemble(struct compile_process* process)
+{
+  struct vector* instructions = process->generator->instructions->instructions;
+  struct assembler* assembler = assembler_new(process, vector_count(instructions));
+
+  // Every pass can only make more jumps long so this always settles
+  while (!assembler_pass(assembler, instructions))
+  {
+  }
+
+  return assembler;
+}
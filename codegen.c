@@ -4,11 +4,21 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <assert.h>
+#include <limits.h>
 
-static struct compile_process* current_process = NULL;
-static struct node* current_function = NULL;
+static _Thread_local struct compile_process* current_process = NULL;
 
 #define STRUCTURE_PUSH_START_POSITION_ONE 1
+// Structures with more dwords than this are copied with rep movsd rather than a push or pop per dword
+#define STRUCTURE_COPY_UNROLL_LIMIT 16
+// Switches with fewer cases than this compare against each case in turn
+#define SWITCH_LINEAR_CASES 4
+// A switch gets a jump table while at least one table entry in this many is a case
+#define SWITCH_TABLE_DENSITY 3
+// Loop heads start on a fetch block boundary
+#define LOOP_HEAD_ALIGNMENT 16
+// Vectorized loops handle this many elements an iteration, the dwords of an xmm register
+#define VECTOR_LANES 4
 
 enum
 {
@@ -112,12 +122,19 @@ static struct history* history_down(struct history* history, int flags)
 }
 
 void codegen_generate_exp_node(struct node* node, struct history* history);
-const char* codegen_sub_register(const char* original_register, size_t size);
+int codegen_sub_register(int reg, size_t size);
 void codegen_generate_entity_access_for_function_call(struct resolver_result* result, struct resolver_entity* entity);
 void codegen_generate_structure_push(struct resolver_entity* entity, struct history* history, int start_pos);
-void codegen_plus_or_minus_string_for_value(char* out, int val, size_t len);
+void codegen_generate_move_struct(struct datatype* dtype, struct instruction_operand address);
 bool codegen_resolve_node_for_value(struct node* node, struct history* history);
 bool asm_datatype_back(struct datatype* dtype_out);
+bool asm_datatype_at_depth(int depth, struct datatype* dtype_out);
+struct stack_frame_element* asm_stack_back();
+void codegen_generate_statement(struct node* node, struct history* history);
+bool codegen_is_compare_flag(int op_flags);
+void codegen_gen_floating_cmp(int op_flags, struct datatype* dtype);
+void codegen_reduce_register(int reg, size_t size, bool is_signed);
+unsigned long long codegen_floating_bits(double value, struct datatype* dtype);
 
 void codegen_new_scope(int flags)
 {
@@ -139,17 +156,16 @@ struct resolver_default_entity_data* codegen_entity_private(struct resolver_enti
   return resolver_default_entity_private(entity);
 }
 
+/**
+ * @brief Writes labels, comments, directives and the instructions the passes do not model.
+ * Everything else is built with asm_ins
+ */
 void asm_push_args(const char* ins, va_list args)
 {
-  va_list args2;
-  va_copy(args2, args);
-  vfprintf(stdout, ins, args);
-  fprintf(stdout, "\n");
-  if (current_process->ofile)
-  {
-    vfprintf(current_process->ofile, ins, args2);
-    fprintf(current_process->ofile, "\n");
-  }
+  struct code_generator* generator = current_process->generator;
+  emitter_vprintf(generator->line, ins, args);
+  instruction_list_push_text(generator->instructions, generator->line->data, generator->line->len);
+  generator->line->len = 0;
 }
 
 void asm_push(const char* ins, ...)
@@ -164,92 +180,214 @@ void asm_push_no_nl(const char* ins, ...)
 {
   va_list args;
   va_start(args, ins);
-  vfprintf(stdout, ins, args);
+  emitter_vprintf(current_process->generator->line, ins, args);
   va_end(args);
+}
+
+void asm_push_instruction(struct instruction* ins)
+{
+  instruction_list_push(current_process->generator->instructions, ins);
+}
+
+void asm_ins0(int opcode)
+{
+  asm_push_instruction(&(struct instruction){.opcode=opcode});
+}
+
+void asm_ins1(int opcode, struct instruction_operand operand)
+{
+  asm_push_instruction(&(struct instruction){.opcode=opcode, .total_operands=1, .operands={operand}});
+}
+
+void asm_ins2(int opcode, struct instruction_operand dst, struct instruction_operand src)
+{
+  asm_push_instruction(&(struct instruction){.opcode=opcode, .total_operands=2, .operands={dst, src}});
+}
+
+void asm_ins3(int opcode, struct instruction_operand dst, struct instruction_operand src, struct instruction_operand extra)
+{
+  asm_push_instruction(&(struct instruction){.opcode=opcode, .total_operands=3, .operands={dst, src, extra}});
+}
+
+struct instruction_operand asm_reg(int reg)
+{
+  return instruction_register(reg);
+}
+
+struct instruction_operand asm_imm(long long value)
+{
+  return instruction_immediate(value);
+}
+
+// A size keyword in front of an immediate, i.e push dword 5
+struct instruction_operand asm_sized_imm(int size, long long value)
+{
+  struct instruction_operand operand = instruction_immediate(value);
+  operand.size = size;
+  return operand;
+}
+
+// [ebp-4], [ebx]
+struct instruction_operand asm_mem(int size, int base, long long displacement)
+{
+  return instruction_memory(size, base, -1, 1, NULL, displacement);
+}
+
+// [esi+eax*4]
+struct instruction_operand asm_mem_index(int size, int base, int index, int scale)
+{
+  return instruction_memory(size, base, index, scale, NULL, 0);
+}
+
+// [name+4], [switch_table_1+eax*4] when given an index
+struct instruction_operand asm_mem_symbol(int size, const char* symbol, int index, int scale, long long displacement)
+{
+  return instruction_memory(size, -1, index, scale, instruction_list_symbol(current_process->generator->instructions, symbol), displacement);
+}
+
+// Labels and functions we jump to or call
+struct instruction_operand asm_label(const char* name)
+{
+  return instruction_symbol(instruction_list_symbol(current_process->generator->instructions, name));
+}
 
-  if (current_process->ofile)
+/**
+ * @brief The address of a variable some bytes past where its base address is, locals are ebp based and globals are named
+ */
+struct instruction_operand asm_base_mem(int size, const char* base_address, long long displacement)
+{
+  if (S_EQ(base_address, "ebp"))
   {
-    va_list args;
-    va_start(args, ins);
-    vfprintf(current_process->ofile, ins, args);
-    va_end(args);
+    return asm_mem(size, REGISTER_EBP, displacement);
   }
+
+  return asm_mem_symbol(size, base_address, -1, 1, displacement);
 }
 
-void asm_push_ins_push(const char* fmt, int stack_entity_type, const char* stack_entity_name, ...)
+/**
+ * @brief The memory of the variable or function the entity was resolved to, offset bytes into it
+ */
+struct instruction_operand asm_entity_mem(int size, struct resolver_entity* entity, int offset)
 {
-  char tmp_buf[200];
-  sprintf(tmp_buf, "push %s", fmt);
-  va_list args;
-  va_start(args, stack_entity_name);
-  asm_push_args(tmp_buf, args);
-  va_end(args);
+  struct resolver_default_entity_data* data = codegen_entity_private(entity);
+  if (data->flags & RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK)
+  {
+    return asm_mem(size, REGISTER_EBP, data->offset + offset);
+  }
+
+  // Functions have no base address, their address is their name
+  if (!data->base_address[0])
+  {
+    return asm_mem_symbol(size, data->address, -1, 1, offset);
+  }
 
-  assert(current_function);
-  stackframe_push(current_function, &(struct stack_frame_element){.type=stack_entity_type, .name=stack_entity_name});
+  return asm_mem_symbol(size, data->base_address, -1, 1, data->offset + offset);
 }
 
-void asm_push_ins_push_with_flags(const char* fmt, int stack_entity_type, const char* stack_entity_name, int flags, ...)
+/**
+ * @brief The memory the resolver result starts at, offset bytes into it
+ */
+struct instruction_operand asm_result_mem(int size, struct resolver_result* result, int offset)
 {
-  char tmp_buf[200];
-  sprintf(tmp_buf, "push %s", fmt);
-  va_list args;
-  va_start(args, flags);
-  asm_push_args(tmp_buf, args);
-  va_end(args);
-  assert(current_function);
-  stackframe_push(current_function, &(struct stack_frame_element){.flags=flags, .type=stack_entity_type, .name=stack_entity_name});
+  if (!result->base.base_address[0])
+  {
+    return asm_mem_symbol(size, result->base.address, -1, 1, offset);
+  }
+
+  return asm_base_mem(size, result->base.base_address, result->base.offset + offset);
 }
 
-int asm_push_ins_pop(const char* fmt, int expecting_stack_entity_type, const char* expecting_stack_entity_name, ...)
+/**
+ * @brief Jumps or calls to the label, its name is formatted like asm_push. i.e asm_jump(INSTRUCTION_OPCODE_JMP, ".exit_point_%i", id)
+ */
+void asm_jump(int opcode, const char* fmt, ...)
 {
-  char tmp_buf[200];
-  sprintf(tmp_buf, "pop %s", fmt);
+  char label[128];
   va_list args;
-  va_start(args, expecting_stack_entity_name);
-  asm_push_args(tmp_buf, args);
+  va_start(args, fmt);
+  vsnprintf(label, sizeof(label), fmt, args);
   va_end(args);
+  asm_ins1(opcode, asm_label(label));
+}
+
+void asm_push_ins_push(struct instruction_operand value, int stack_entity_type, const char* stack_entity_name)
+{
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, value);
+  assert(current_process->generator->current_function);
+  stackframe_push(current_process->generator->current_function, &(struct stack_frame_element){.type=stack_entity_type, .name=stack_entity_name});
+}
+
+void asm_push_ins_push_with_flags(struct instruction_operand value, int stack_entity_type, const char* stack_entity_name, int flags)
+{
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, value);
+  assert(current_process->generator->current_function);
+  stackframe_push(current_process->generator->current_function, &(struct stack_frame_element){.flags=flags, .type=stack_entity_type, .name=stack_entity_name});
+}
 
-  assert(current_function);
-  struct stack_frame_element* element = stackframe_back(current_function);
+int asm_push_ins_pop(struct instruction_operand dst, int expecting_stack_entity_type, const char* expecting_stack_entity_name)
+{
+  asm_ins1(INSTRUCTION_OPCODE_POP, dst);
+  assert(current_process->generator->current_function);
+  struct stack_frame_element* element = stackframe_back(current_process->generator->current_function);
   int flags = element->flags;
-  stackframe_pop_expecting(current_function, expecting_stack_entity_type, expecting_stack_entity_name);
+  stackframe_pop_expecting(current_process->generator->current_function, expecting_stack_entity_type, expecting_stack_entity_name);
   return flags;
 }
 
-void asm_push_ins_push_with_data(const char* fmt, int stack_entity_type, const char* stack_entity_name, int flags, struct stack_frame_data* data, ...)
+void asm_push_ins_push_with_data(struct instruction_operand value, int stack_entity_type, const char* stack_entity_name, int flags, struct stack_frame_data* data)
 {
-  char tmp_buf[200];
-  sprintf(tmp_buf, "push %s", fmt);
-  va_list args;
-  va_start(args, data);
-  asm_push_args(tmp_buf, args);
-  va_end(args);
-
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, value);
   flags |= STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE;
-  assert(current_function);
-  stackframe_push(current_function, &(struct stack_frame_element){.type=stack_entity_type, .name=stack_entity_name, .flags=flags, .data=*data});
+  assert(current_process->generator->current_function);
+  stackframe_push(current_process->generator->current_function, &(struct stack_frame_element){.type=stack_entity_type, .name=stack_entity_name, .flags=flags, .data=*data});
 }
 
 void asm_push_ebp()
 {
-  asm_push_ins_push("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
+  asm_push_ins_push(asm_reg(REGISTER_EBP), STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
 }
 
 void asm_pop_ebp()
 {
-  asm_push_ins_pop("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
+  asm_push_ins_pop(asm_reg(REGISTER_EBP), STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
 }
 
 void codegen_stack_sub_with_name(size_t stack_size, const char* name)
 {
   if (stack_size != 0)
   {
-    stackframe_sub(current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
-    asm_push("sub esp, %lld", stack_size);
+    stackframe_sub(current_process->generator->current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
+    asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_ESP), asm_imm(stack_size));
+  }
+}
+
+/**
+ * @brief Moves esp down for values that are copied in rather than pushed one at a time.
+ * They are recorded in the stack frame as if each dword had been pushed.
+ */
+void codegen_stack_sub_pushed_values(int total, struct datatype* dtype)
+{
+  asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_ESP), asm_imm(total * DATA_SIZE_DWORD));
+  for (int i = 0; i < total; i++)
+  {
+    stackframe_push(current_process->generator->current_function, &(struct stack_frame_element){.type=STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, .name="result_value", .flags=STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE, .data.dtype=*dtype});
+  }
+}
+
+void codegen_stack_pop_pushed_values(int total)
+{
+  for (int i = 0; i < total; i++)
+  {
+    stackframe_pop_expecting(current_process->generator->current_function, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
   }
 }
 
+void codegen_stack_add_pushed_values(int total)
+{
+  codegen_stack_pop_pushed_values(total);
+  asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_ESP), asm_imm(total * DATA_SIZE_DWORD));
+}
+
 void codegen_stack_sub(size_t stack_size)
 {
   codegen_stack_sub_with_name(stack_size, "literal_stack_change");
@@ -259,8 +397,8 @@ void codegen_stack_add_with_name(size_t stack_size, const char* name)
 {
   if (stack_size != 0)
   {
-    stackframe_add(current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
-    asm_push("add esp, %lld", stack_size);
+    stackframe_add(current_process->generator->current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
+    asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_ESP), asm_imm(stack_size));
   }
 }
 
@@ -274,24 +412,57 @@ struct resolver_entity* codegen_new_scope_entity(struct node* var_node, int offs
   return resolver_default_new_scope_entity(current_process->resolver, var_node, offset, flags);
 }
 
+unsigned int codegen_string_hash(const char* str)
+{
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (const char* c = str; *c; c++)
+  {
+    hash = (hash ^ (unsigned char) *c) * 16777619u;
+  }
+  return hash;
+}
+
+void codegen_string_bucket_add(struct string_table_element* element)
+{
+  struct code_generator* generator = current_process->generator;
+  int index = codegen_string_hash(element->str) & (generator->total_string_buckets - 1);
+  element->next = generator->string_buckets[index];
+  generator->string_buckets[index] = element;
+}
+
+/**
+ * @brief Doubles the hash buckets once there are more strings than buckets
+ * so looking a string up stays constant time
+ */
+void codegen_string_buckets_grow()
+{
+  struct code_generator* generator = current_process->generator;
+  free(generator->string_buckets);
+  generator->total_string_buckets *= 2;
+  generator->string_buckets = calloc(generator->total_string_buckets, sizeof(struct string_table_element*));
+  for (int i = 0; i < vector_count(generator->string_table); i++)
+  {
+    codegen_string_bucket_add(*(struct string_table_element**) vector_at(generator->string_table, i));
+  }
+}
+
 const char* codegen_get_label_for_string(const char* str)
 {
-  const char* result = NULL;
   struct code_generator* generator = current_process->generator;
-  vector_set_peek_pointer(generator->string_table, 0);
-  struct string_table_element* current = vector_peek_ptr(generator->string_table);
+  int index = codegen_string_hash(str) & (generator->total_string_buckets - 1);
+  struct string_table_element* current = generator->string_buckets[index];
   while (current)
   {
     if (S_EQ(current->str, str))
     {
-      result = current->label;
-      break;
+      return current->label;
     }
 
-    current = vector_peek_ptr(generator->string_table);
+    current = current->next;
   }
 
-  return result;
+  return NULL;
 }
 
 const char* codegen_register_string(const char* str)
@@ -305,22 +476,80 @@ const char* codegen_register_string(const char* str)
 
   struct string_table_element* str_elem = calloc(1, sizeof(struct string_table_element));
   int label_id = codegen_label_count();
-  sprintf((char*)str_elem->label, "str_%i", label_id);
+  sprintf(str_elem->label, "str_%i", label_id);
   str_elem->str = str;
   vector_push(current_process->generator->string_table, &str_elem);
+  if (vector_count(current_process->generator->string_table) > current_process->generator->total_string_buckets)
+  {
+    codegen_string_buckets_grow();
+  }
+  else
+  {
+    codegen_string_bucket_add(str_elem);
+  }
   return str_elem->label;
 }
 
 struct code_generator* codegenerator_new(struct compile_process* process)
 {
   struct code_generator* generator = calloc(1, sizeof(struct code_generator));
+  generator->emitter = emitter_new(process->ofile, process->flags);
+  generator->instructions = instruction_list_new();
+  generator->line = emitter_new(NULL, 0);
   generator->string_table = vector_create(sizeof(struct string_table_element*));
+  generator->total_string_buckets = STRING_TABLE_START_BUCKETS;
+  generator->string_buckets = calloc(generator->total_string_buckets, sizeof(struct string_table_element*));
+  generator->bss_variables = vector_create(sizeof(struct node*));
+  generator->rodata_variables = vector_create(sizeof(struct node*));
   generator->entry_points = vector_create(sizeof(struct codegen_entry_point*));
   generator->exit_points = vector_create(sizeof(struct codegen_exit_point*));
   generator->responses = vector_create(sizeof(struct response*));
+  generator->switches = vector_create(sizeof(int));
+  generator->jump_tables = vector_create(sizeof(struct codegen_jump_table*));
+  generator->functions = vector_create(sizeof(struct regalloc_function));
+  generator->struct_push_end = -1;
   return generator;
 }
 
+/**
+ * @brief Frees what every element of the vector points to and then the vector
+ */
+static void codegen_free_pointer_vector(struct vector* vector)
+{
+  for (int i = 0; i < vector_count(vector); i++)
+  {
+    free(*(void**) vector_at(vector, i));
+  }
+  vector_free(vector);
+}
+
+void codegenerator_free(struct code_generator* generator)
+{
+  emitter_free(generator->emitter);
+  emitter_free(generator->line);
+  instruction_list_free(generator->instructions);
+  codegen_free_pointer_vector(generator->string_table);
+  free(generator->string_buckets);
+  vector_free(generator->bss_variables);
+  vector_free(generator->rodata_variables);
+  // Entry, exit points and responses are left behind when a compiler error stops code generation
+  codegen_free_pointer_vector(generator->entry_points);
+  codegen_free_pointer_vector(generator->exit_points);
+  codegen_free_pointer_vector(generator->responses);
+  vector_free(generator->switches);
+  for (int i = 0; i < vector_count(generator->jump_tables); i++)
+  {
+    vector_free((*(struct codegen_jump_table**) vector_at(generator->jump_tables, i))->values);
+  }
+  codegen_free_pointer_vector(generator->jump_tables);
+  for (int i = 0; i < vector_count(generator->functions); i++)
+  {
+    vector_free(((struct regalloc_function*) vector_at(generator->functions, i))->locals);
+  }
+  vector_free(generator->functions);
+  free(generator);
+}
+
 void codegen_register_exit_point(int exit_point_id)
 {
   struct code_generator* gen = current_process->generator;
@@ -337,9 +566,8 @@ struct codegen_exit_point* codegen_current_exit_point()
 
 int codegen_label_count()
 {
-  static int count = 0;
-  count++;
-  return count;
+  current_process->generator->label_count++;
+  return current_process->generator->label_count;
 }
 
 void codegen_begin_exit_point()
@@ -362,7 +590,7 @@ void codegen_goto_exit_point(struct node* node)
 {
   struct code_generator* gen = current_process->generator;
   struct codegen_exit_point* exit_point = codegen_current_exit_point();
-  asm_push("jmp .exit_point_%i", exit_point->id);
+  asm_jump(INSTRUCTION_OPCODE_JMP, ".exit_point_%i", exit_point->id);
 }
 
 void codegen_register_entry_point(int entry_point_id)
@@ -399,7 +627,7 @@ void codegen_goto_entry_point(struct node* current_node)
 {
   struct code_generator* gen = current_process->generator;
   struct codegen_entry_point* entry_point = codegen_current_entry_point();
-  asm_push("jmp .entry_point_%i", entry_point->id);
+  asm_jump(INSTRUCTION_OPCODE_JMP, ".entry_point_%i", entry_point->id);
 }
 
 void codegen_begin_entry_exit_point()
@@ -444,7 +672,53 @@ static const char* asm_keyword_for_size(size_t size, char* tmp_buf)
   return tmp_buf;
 }
 
-void codegen_generate_global_variable_for_primitive(struct node* node)
+static const char* asm_reserve_keyword_for_size(size_t size, char* tmp_buf)
+{
+  switch (size)
+  {
+    case DATA_SIZE_BYTE:
+      strcpy(tmp_buf, "resb 1");
+    break;
+
+    case DATA_SIZE_WORD:
+      strcpy(tmp_buf, "resw 1");
+    break;
+
+    case DATA_SIZE_DWORD:
+      strcpy(tmp_buf, "resd 1");
+    break;
+
+    case DATA_SIZE_DDWORD:
+      strcpy(tmp_buf, "resq 1");
+    break;
+
+    default:
+      sprintf(tmp_buf, "resb %lld", (unsigned long long) size);
+  }
+
+  return tmp_buf;
+}
+
+/**
+ * @brief Returns true if the global can never be written, so it may live in .rodata.
+ * const char* is a pointer to constant characters, the pointer itself can still change.
+ */
+bool codegen_global_variable_is_read_only(struct node* node)
+{
+  int flags = node->var.type.flags;
+  return node->var.val && flags & DATATYPE_FLAG_IS_CONST && !(flags & DATATYPE_FLAG_IS_POINTER);
+}
+
+/**
+ * @brief Returns true if the global starts as all zeros, so it can be reserved in .bss
+ * rather than stored in the file
+ */
+bool codegen_global_variable_is_zero(struct node* node)
+{
+  return !node->var.val || (node->var.val->type == NODE_TYPE_NUMBER && node->var.val->llnum == 0);
+}
+
+void codegen_write_global_variable_for_primitive(struct node* node)
 {
   char tmp_buf[256];
   if (node->var.val != NULL)
@@ -455,6 +729,16 @@ void codegen_generate_global_variable_for_primitive(struct node* node)
       const char* label = codegen_register_string(node->var.val->sval);
       asm_push("%s: %s %s", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf), label);
     }
+    else if (datatype_is_floating(&node->var.type))
+    {
+      struct node* value_node = node->var.val;
+      double value = node_is_floating_number(value_node) ? value_node->dnum : (double)(long long) value_node->llnum;
+      asm_push("%s: %s %llu", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf), codegen_floating_bits(value, &node->var.type));
+    }
+    else if (node_is_floating_number(node->var.val))
+    {
+      asm_push("%s: %s %lld", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf), (long long) node->var.val->dnum);
+    }
     else
     {
       asm_push("%s: %s %lld", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf), node->var.val->llnum);
@@ -466,6 +750,45 @@ void codegen_generate_global_variable_for_primitive(struct node* node)
   }
 }
 
+/**
+ * @brief Aligns the global that follows to the size of its elements, structures to a dword.
+ * The directive is align in sections with data and alignb in .bss
+ */
+void codegen_align_global_variable(struct node* node, const char* directive)
+{
+  struct datatype* dtype = &node->var.type;
+  int alignment = datatype_is_struct_or_union_non_pointer(dtype) ? DATA_SIZE_DWORD : datatype_element_size(dtype);
+  if (alignment > DATA_SIZE_DDWORD)
+  {
+    alignment = DATA_SIZE_DDWORD;
+  }
+
+  if (alignment > DATA_SIZE_BYTE)
+  {
+    asm_push("%s %i", directive, alignment);
+  }
+}
+
+void codegen_generate_global_variable_for_primitive(struct node* node)
+{
+  struct code_generator* generator = current_process->generator;
+  if (codegen_global_variable_is_read_only(node))
+  {
+    vector_push(generator->rodata_variables, &node);
+    return;
+  }
+
+  if (codegen_global_variable_is_zero(node))
+  {
+    vector_push(generator->bss_variables, &node);
+    return;
+  }
+
+  asm_push("; %s %s", node->var.type.type_str, node->var.name);
+  codegen_align_global_variable(node, "align");
+  codegen_write_global_variable_for_primitive(node);
+}
+
 void codegen_generate_global_variable_for_struct(struct node* node)
 {
   if (node->var.val != NULL)
@@ -474,13 +797,11 @@ void codegen_generate_global_variable_for_struct(struct node* node)
     return;
   }
 
-  char tmp_buf[256];
-  asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
+  vector_push(current_process->generator->bss_variables, &node);
 }
 
 void codegen_generate_global_variable(struct node* node)
 {
-  asm_push("; %s %s", node->var.type.type_str, node->var.name);
   switch (node->var.type.type)
   {
     case DATA_TYPE_VOID:
@@ -488,17 +809,14 @@ void codegen_generate_global_variable(struct node* node)
     case DATA_TYPE_SHORT:
     case DATA_TYPE_INTEGER:
     case DATA_TYPE_LONG:
+    case DATA_TYPE_FLOAT:
+    case DATA_TYPE_DOUBLE:
       codegen_generate_global_variable_for_primitive(node);
     break;
 
     case DATA_TYPE_STRUCT:
       codegen_generate_global_variable_for_struct(node);
     break;
-
-    case DATA_TYPE_DOUBLE:
-    case DATA_TYPE_FLOAT:
-      compiler_error(current_process, "Doubles and floats aren't supported in our subset of C\n");
-    break;
   }
 }
 
@@ -527,6 +845,27 @@ void codegen_generate_data_section_part(struct node* node)
   }
 }
 
+void codegen_generate_bss_section()
+{
+  struct code_generator* generator = current_process->generator;
+  if (vector_count(generator->bss_variables) == 0)
+  {
+    return;
+  }
+
+  asm_push("section .bss");
+  char tmp_buf[256];
+  vector_set_peek_pointer(generator->bss_variables, 0);
+  struct node* node = vector_peek_ptr(generator->bss_variables);
+  while (node)
+  {
+    asm_push("; %s %s", node->var.type.type_str, node->var.name);
+    codegen_align_global_variable(node, "alignb");
+    asm_push("%s: %s", node->var.name, asm_reserve_keyword_for_size(variable_size(node), tmp_buf));
+    node = vector_peek_ptr(generator->bss_variables);
+  }
+}
+
 void codegen_generate_data_section()
 {
   asm_push("section .data");
@@ -536,6 +875,9 @@ void codegen_generate_data_section()
     codegen_generate_data_section_part(node);
     node = codegen_node_next();
   }
+
+  // Globals that start as zero take no space in the file
+  codegen_generate_bss_section();
 }
 
 struct resolver_entity* codegen_register_function(struct node* func_node, int flags)
@@ -560,977 +902,2669 @@ void codegen_generate_function_arguments(struct vector* argument_vector)
   }
 }
 
-void codegen_generate_number_node(struct node* node, struct history* history)
-{
-  asm_push_ins_push_with_data("dword %i", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_NUMERICAL, &(struct stack_frame_data){.dtype=datatype_for_numeric()}, node->llnum);
-}
+/**
+ * Floating values are kept on the stack like every other value, a float takes a slot and a
+ * double takes two with its low half on top. They are loaded into xmm0 and xmm1 to be worked on.
+ */
 
-bool codegen_is_exp_root_for_flags(int flags)
+/**
+ * @brief The stack slots a value of this type takes once it is pushed
+ */
+int codegen_pushed_slots(struct datatype* dtype)
 {
-  return !(flags & EXPRESSION_IS_NOT_ROOT_NODE);
+  return datatype_is_floating(dtype) && dtype->type == DATA_TYPE_DOUBLE ? 2 : 1;
 }
 
-bool codegen_is_exp_root(struct history* history)
+/**
+ * @brief The suffix of the SSE instructions for the type, ss for float and sd for double
+ */
+const char* codegen_floating_suffix(struct datatype* dtype)
 {
-  return codegen_is_exp_root_for_flags(history->flags);
+  return dtype->type == DATA_TYPE_FLOAT ? "ss" : "sd";
 }
 
-void codegen_reduce_register(const char* reg, size_t size, bool is_signed)
+/**
+ * @brief The bits of the value as the type stores them, the dword of a float or the qword of a double
+ */
+unsigned long long codegen_floating_bits(double value, struct datatype* dtype)
 {
-  if (size != DATA_SIZE_DWORD)
+  if (dtype->type == DATA_TYPE_FLOAT)
   {
-    const char* ins = "movsx";
-    if (!is_signed)
-    {
-      ins = "movzx";
-    }
-    asm_push("%s eax, %s", ins, codegen_sub_register("eax", size));
+    float single_value = (float) value;
+    unsigned int bits = 0;
+    memcpy(&bits, &single_value, sizeof(bits));
+    return bits;
   }
+
+  unsigned long long bits = 0;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
 }
 
-void codegen_gen_mem_access_get_address(struct node* node, int flags, struct resolver_entity* entity)
+/**
+ * @brief Pushes the floating value in the memory, the high half of a double is the dword after it
+ */
+void codegen_push_floating_from(struct instruction_operand address, struct datatype* dtype)
 {
-  asm_push("lea ebx, [%s]", codegen_entity_private(entity)->address);
-  asm_push_ins_push_with_flags("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
+  address.size = DATA_SIZE_DWORD;
+  if (dtype->type == DATA_TYPE_DOUBLE)
+  {
+    struct instruction_operand high_address = address;
+    high_address.address.displacement += DATA_SIZE_DWORD;
+    asm_push_ins_push_with_data(high_address, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=*dtype});
+  }
+  asm_push_ins_push_with_data(address, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=*dtype});
 }
 
-void codegen_generate_structure_push_or_return(struct resolver_entity* entity, struct history* history, int start_pos)
+/**
+ * @brief Pushes the value in the xmm register as the given floating type
+ */
+void codegen_push_floating(const char* xmm, struct datatype* dtype)
 {
-  codegen_generate_structure_push(entity, history, start_pos);
+  codegen_stack_sub_pushed_values(codegen_pushed_slots(dtype), dtype);
+  asm_push("mov%s [esp], %s", codegen_floating_suffix(dtype), xmm);
 }
 
-void codegen_gen_mem_access(struct node* node, int flags, struct resolver_entity* entity)
+/**
+ * @brief Pops the value on top of the stack into the xmm register converted to the floating type, integers are converted as int
+ */
+void codegen_pop_floating(const char* xmm, struct datatype* to_dtype)
 {
-  if (flags & EXPRESSION_GET_ADDRESS)
+  struct datatype dtype = datatype_for_numeric();
+  asm_datatype_back(&dtype);
+  const char* to_suffix = codegen_floating_suffix(to_dtype);
+  if (!datatype_is_floating(&dtype))
   {
-    codegen_gen_mem_access_get_address(node, flags, entity);
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    asm_push("cvtsi2%s %s, eax", to_suffix, xmm);
     return;
   }
 
-  if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
-  {
-    codegen_gen_mem_access_get_address(node, 0, entity);
-    asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_generate_structure_push_or_return(entity, history_begin(0), 0);
-  }
-  else if (datatype_element_size(&entity->dtype) != DATA_SIZE_DWORD)
-  {
-    asm_push("mov eax, [%s]", codegen_entity_private(entity)->address);
-    codegen_reduce_register("eax", datatype_element_size(&entity->dtype), entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
-  }
-  else
+  const char* suffix = codegen_floating_suffix(&dtype);
+  asm_push("mov%s %s, [esp]", suffix, xmm);
+  codegen_stack_add_pushed_values(codegen_pushed_slots(&dtype));
+  if (dtype.type != to_dtype->type)
   {
-    // We can push this straight to the stack
-    asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype}, codegen_entity_private(entity)->address);
+    asm_push("cvt%s2%s %s, %s", suffix, to_suffix, xmm, xmm);
   }
 }
 
-void codegen_generate_variable_access_for_entity(struct node* node, struct resolver_entity* entity, struct history* history)
+/**
+ * @brief Pops the value on top of the stack into the register, floating values are truncated to an int as C converts them
+ */
+void codegen_pop_integer(int reg)
 {
-  codegen_gen_mem_access(node, history->flags, entity);
-}
+  struct datatype dtype = datatype_for_numeric();
+  asm_datatype_back(&dtype);
+  if (!datatype_is_floating(&dtype))
+  {
+    asm_push_ins_pop(asm_reg(reg), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    return;
+  }
 
-void codegen_generate_variable_access(struct node* node, struct resolver_entity* entity, struct history* history)
-{
-  codegen_generate_variable_access_for_entity(node, entity, history_down(history, history->flags));
+  asm_push("cvtt%s2si %s, [esp]", codegen_floating_suffix(&dtype), instruction_register_name(reg));
+  codegen_stack_add_pushed_values(codegen_pushed_slots(&dtype));
 }
 
-void codegen_generate_identifier(struct node* node, struct history* history)
+/**
+ * @brief Pops the value on top of the stack into eax as 0 or 1, floating values are true when they are not zero
+ */
+void codegen_pop_condition()
 {
-  struct resolver_result* result = resolver_follow(current_process->resolver, node);
-  assert(resolver_result_ok(result));
-
-  struct resolver_entity* entity = resolver_result_entity(result);
-  codegen_generate_variable_access(node, entity, history);
-  codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity=entity});
-}
+  struct datatype dtype = datatype_for_numeric();
+  asm_datatype_back(&dtype);
+  if (!datatype_is_floating(&dtype))
+  {
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    return;
+  }
 
-void codegen_generate_unary_address(struct node* node, struct history* history)
-{
-  int flags = history->flags;
-  codegen_generate_expressionable(node->unary.operand, history);
-  codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_UNARY_GET_ADDRESS});
+  codegen_pop_floating("xmm0", &dtype);
+  asm_push("xorps xmm1, xmm1");
+  codegen_gen_floating_cmp(EXPRESSION_IS_NOT_EQUAL, &dtype);
 }
 
-void codegen_generate_unary(struct node* node, struct history* history)
+/**
+ * @brief Converts the value on top of the stack to the type when either of them is floating
+ */
+void codegen_convert_top(struct datatype* dtype)
 {
-  int flags = history->flags;
-  if (codegen_resolve_node_for_value(node, history))
+  struct datatype from_dtype = datatype_for_numeric();
+  asm_datatype_back(&from_dtype);
+  if (datatype_is_floating(dtype))
   {
+    if (!datatype_is_floating(&from_dtype) || from_dtype.type != dtype->type)
+    {
+      codegen_pop_floating("xmm0", dtype);
+      codegen_push_floating("xmm0", dtype);
+    }
     return;
   }
 
-  if (op_is_indirection(node->unary.op))
-  {
-    #warning "implement pointer unary later on"
-    return;
-  }
-  else if (op_is_address(node->unary.op))
+  if (datatype_is_floating(&from_dtype))
   {
-    codegen_generate_unary_address(node, history);
-    return;
+    codegen_pop_integer(REGISTER_EAX);
+    codegen_reduce_register(REGISTER_EAX, datatype_element_size(dtype), dtype->flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=*dtype});
   }
-
-  #warning "genrate normal unary"
 }
 
-void codegen_generate_expressionable(struct node* node, struct history* history)
+/**
+ * @brief Returns true if either of the two values on top of the stack is floating, dtype_out
+ * is set to the type they are worked on as. double wins over float
+ */
+bool codegen_floating_operands(struct datatype* dtype_out)
 {
-  bool is_root = codegen_is_exp_root(history);
-  if (is_root)
+  struct datatype right_dtype = datatype_for_numeric();
+  struct datatype left_dtype = datatype_for_numeric();
+  asm_datatype_back(&right_dtype);
+  asm_datatype_at_depth(codegen_pushed_slots(&right_dtype), &left_dtype);
+  if (!datatype_is_floating(&left_dtype) && !datatype_is_floating(&right_dtype))
   {
-    history->flags |= EXPRESSION_IS_NOT_ROOT_NODE;
+    return false;
   }
 
-  switch (node->type)
+  int type = NUMBER_TYPE_FLOAT;
+  if ((datatype_is_floating(&left_dtype) && left_dtype.type == DATA_TYPE_DOUBLE) || (datatype_is_floating(&right_dtype) && right_dtype.type == DATA_TYPE_DOUBLE))
   {
-    case NODE_TYPE_IDENTIFIER:
-      codegen_generate_identifier(node, history);
-    break;
-
-    case NODE_TYPE_NUMBER:
-      codegen_generate_number_node(node, history);
-    break;
-
-    case NODE_TYPE_EXPRESSION:
-      codegen_generate_exp_node(node, history);
-    break;
-
-    case NODE_TYPE_UNARY:
-      codegen_generate_unary(node, history);
-    break;
+    type = NUMBER_TYPE_DOUBLE;
   }
+  *dtype_out = datatype_for_floating(type);
+  return true;
 }
 
-const char* codegen_sub_register(const char* original_register, size_t size)
+/**
+ * @brief Compares xmm0 with xmm1 into eax as 0 or 1. Comparisons with NaN are false
+ * other than !=, ucomiss sets the parity flag for them
+ */
+void codegen_gen_floating_cmp(int op_flags, struct datatype* dtype)
 {
-  const char* reg = NULL;
-  if (S_EQ(original_register, "eax"))
+  const char* suffix = codegen_floating_suffix(dtype);
+  if (op_flags & (EXPRESSION_IS_BELOW | EXPRESSION_IS_BELOW_OR_EQUAL))
   {
-    if (size == DATA_SIZE_BYTE)
-    {
-      reg = "al";
-    }
-    else if (size == DATA_SIZE_WORD)
-    {
-      reg = "ax";
-    }
-    else if (size == DATA_SIZE_DWORD)
-    {
-      reg = "eax";
-    }
+    // a < b is b > a, only above is false when unordered
+    asm_push("ucomi%s xmm1, xmm0", suffix);
   }
-  else if (S_EQ(original_register, "ebx"))
+  else
   {
-    if (size == DATA_SIZE_BYTE)
-    {
-      reg = "bl";
-    }
-    else if (size == DATA_SIZE_WORD)
-    {
-      reg = "bx";
-    }
-    else if (size == DATA_SIZE_DWORD)
-    {
-      reg = "ebx";
-    }
+    asm_push("ucomi%s xmm0, xmm1", suffix);
   }
-  else if (S_EQ(original_register, "ecx"))
+
+  if (op_flags & (EXPRESSION_IS_ABOVE | EXPRESSION_IS_BELOW))
   {
-    if (size == DATA_SIZE_BYTE)
-    {
-      reg = "cl";
-    }
-    else if (size == DATA_SIZE_WORD)
-    {
-      reg = "cx";
-    }
-    else if (size == DATA_SIZE_DWORD)
-    {
-      reg = "ecx";
-    }
+    asm_ins1(INSTRUCTION_OPCODE_SETA, asm_reg(REGISTER_AL));
   }
-  else if (S_EQ(original_register, "edx"))
+  else if (op_flags & (EXPRESSION_IS_ABOVE_OR_EQUAL | EXPRESSION_IS_BELOW_OR_EQUAL))
   {
-    if (size == DATA_SIZE_BYTE)
-    {
-      reg = "dl";
-    }
-    else if (size == DATA_SIZE_WORD)
-    {
-      reg = "dx";
-    }
-    else if (size == DATA_SIZE_DWORD)
-    {
-      reg = "edx";
-    }
+    asm_ins1(INSTRUCTION_OPCODE_SETAE, asm_reg(REGISTER_AL));
   }
-
-  return reg;
+  else if (op_flags & EXPRESSION_IS_EQUAL)
+  {
+    asm_ins1(INSTRUCTION_OPCODE_SETE, asm_reg(REGISTER_AL));
+    asm_push("setnp cl");
+    asm_ins2(INSTRUCTION_OPCODE_AND, asm_reg(REGISTER_AL), asm_reg(REGISTER_CL));
+  }
+  else
+  {
+    asm_ins1(INSTRUCTION_OPCODE_SETNE, asm_reg(REGISTER_AL));
+    asm_push("setp cl");
+    asm_ins2(INSTRUCTION_OPCODE_OR, asm_reg(REGISTER_AL), asm_reg(REGISTER_CL));
+  }
+  asm_ins2(INSTRUCTION_OPCODE_MOVZX, asm_reg(REGISTER_EAX), asm_reg(REGISTER_AL));
 }
 
-const char* codegen_byte_word_or_dword_or_ddword(size_t size, const char** reg_to_use)
+/**
+ * @brief Works out the two floating values on top of the stack and pushes the result
+ */
+void codegen_gen_floating_math(const char* op, int op_flags, struct datatype* dtype)
 {
-  const char* type = NULL;
-  const char* new_register = *reg_to_use;
-  
-  if (size == DATA_SIZE_BYTE)
+  codegen_pop_floating("xmm1", dtype);
+  codegen_pop_floating("xmm0", dtype);
+  const char* suffix = codegen_floating_suffix(dtype);
+  if (codegen_is_compare_flag(op_flags))
   {
-    type = "byte";
-    new_register = codegen_sub_register(*reg_to_use, DATA_SIZE_BYTE);
+    codegen_gen_floating_cmp(op_flags, dtype);
+    struct datatype int_dtype = datatype_for_numeric();
+    int_dtype.flags = DATATYPE_FLAG_IS_SIGNED;
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=int_dtype});
+    return;
   }
-  else if (size == DATA_SIZE_WORD)
+
+  if (op_flags & EXPRESSION_IS_ADDITION)
   {
-    type = "word";
-    new_register = codegen_sub_register(*reg_to_use, DATA_SIZE_WORD);
+    asm_push("add%s xmm0, xmm1", suffix);
   }
-  else if (size == DATA_SIZE_DWORD)
+  else if (op_flags & EXPRESSION_IS_SUBSTRACTION)
   {
-    type = "dword";
-    new_register = codegen_sub_register(*reg_to_use, DATA_SIZE_DWORD);
+    asm_push("sub%s xmm0, xmm1", suffix);
   }
-  else if (size == DATA_SIZE_DDWORD)
+  else if (op_flags & EXPRESSION_IS_MULTIPLICATION)
   {
-    type = "ddword";
-    new_register = codegen_sub_register(*reg_to_use, DATA_SIZE_DDWORD);
+    asm_push("mul%s xmm0, xmm1", suffix);
   }
-
-  *reg_to_use = new_register;
-  return type;
-}
-
-void codegen_generate_assignment_instruction_for_operator(const char* mov_type_keyword, const char* address, const char* reg_to_use, const char* op, bool is_signed)
-{
-  if (S_EQ(op, "="))
+  else if (op_flags & EXPRESSION_IS_DIVISION)
   {
-    asm_push("mov %s [%s], %s", mov_type_keyword, address, reg_to_use);
+    asm_push("div%s xmm0, xmm1", suffix);
   }
-  else if (S_EQ(op, "+="))
+  else
   {
-    asm_push("add %s [%s], %s", mov_type_keyword, address, reg_to_use);
+    compiler_error(current_process, "The operator %s can't be used with floating point values", op);
   }
+  codegen_push_floating("xmm0", dtype);
 }
 
-void codegen_generate_scope_variable(struct node* node)
+/**
+ * @brief Jumps off the flags of ucomiss xmm0, xmm1 for "xmm0 op xmm1". The jumps for false
+ * are taken when the values are unordered so a NaN never makes a comparison other than != true
+ */
+void codegen_gen_floating_compare_jump(int op_flags, struct datatype* dtype, const char* label, bool jump_if_true)
 {
-  struct resolver_entity* entity = codegen_new_scope_entity(node, node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
-  if (node->var.val)
+  const char* suffix = codegen_floating_suffix(dtype);
+  if (op_flags & (EXPRESSION_IS_BELOW | EXPRESSION_IS_BELOW_OR_EQUAL))
   {
-    codegen_generate_expressionable(node->var.val, history_begin(EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
-    // pop eax
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    const char* reg_to_use = "eax";
-    const char* mov_type = codegen_byte_word_or_dword_or_ddword(datatype_element_size(&entity->dtype), &reg_to_use);
-    codegen_generate_assignment_instruction_for_operator(mov_type, codegen_entity_private(entity)->address, reg_to_use, "=", entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push("ucomi%s xmm1, xmm0", suffix);
+  }
+  else
+  {
+    asm_push("ucomi%s xmm0, xmm1", suffix);
   }
-}
 
-void codegen_generate_entity_access_start(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct history* history)
-{
-  if (root_assignment_entity->type == RESOLVER_ENTITY_TYPE_UNSUPPORTED)
+  if (op_flags & (EXPRESSION_IS_ABOVE | EXPRESSION_IS_BELOW))
   {
-    // Unsupported entity then process it
-    codegen_generate_expressionable(root_assignment_entity->node, history);
+    asm_ins1(jump_if_true ? INSTRUCTION_OPCODE_JA : INSTRUCTION_OPCODE_JBE, asm_label(label));
+    return;
   }
-  else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE)
+
+  if (op_flags & (EXPRESSION_IS_ABOVE_OR_EQUAL | EXPRESSION_IS_BELOW_OR_EQUAL))
   {
-    asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=root_assignment_entity->dtype}, result->base.address);
+    asm_ins1(jump_if_true ? INSTRUCTION_OPCODE_JAE : INSTRUCTION_OPCODE_JB, asm_label(label));
+    return;
   }
-  else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX)
+
+  // Unordered values are not equal, so they jump for != and skip the jump for ==
+  bool jump_if_equal = ((op_flags & EXPRESSION_IS_EQUAL) != 0) == jump_if_true;
+  if (jump_if_equal)
   {
-    if (root_assignment_entity->next && root_assignment_entity->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY)
-    {
-      asm_push("mov ebx, [%s]", result->base.address);
-    }
-    else
-    {
-      asm_push("lea ebx, [%s]", result->base.address);
-    }
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=root_assignment_entity->dtype});
+    char skip_label[20];
+    sprintf(skip_label, ".cond_%i", codegen_label_count());
+    asm_push("jp %s", skip_label);
+    asm_ins1(INSTRUCTION_OPCODE_JE, asm_label(label));
+    asm_push("%s:", skip_label);
+    return;
   }
+
+  asm_push("jp %s", label);
+  asm_ins1(INSTRUCTION_OPCODE_JNE, asm_label(label));
 }
 
-void codegen_generate_entity_access_for_variable_or_general(struct resolver_result* result, struct resolver_entity* entity)
+/**
+ * @brief Floating numbers are pushed as the bits of their type, a double as two dwords
+ */
+void codegen_generate_floating_number_node(struct node* node)
 {
-  // Restore the EBX register
-  asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-  if (entity->flags & RESOLVER_ENTITY_FLAG_DO_INDIRECTION)
+  struct datatype dtype = datatype_for_floating(node->num.type);
+  unsigned long long bits = codegen_floating_bits(node->dnum, &dtype);
+  if (dtype.type == DATA_TYPE_DOUBLE)
   {
-    asm_push("mov ebx, [ebx]");
+    asm_push_ins_push_with_data(asm_sized_imm(DATA_SIZE_DWORD, (int)(bits >> 32)), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=dtype});
   }
-  asm_push("add ebx, %i", entity->offset);
-  asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+  asm_push_ins_push_with_data(asm_sized_imm(DATA_SIZE_DWORD, (int) bits), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=dtype});
 }
 
-void codegen_generate_entity_access_for_entity_for_assignment_left_operand(struct resolver_result* result, struct resolver_entity* entity, struct history* history)
+void codegen_generate_number_node(struct node* node, struct history* history)
 {
-  switch (entity->type)
+  if (node_is_floating_number(node))
   {
-    case RESOLVER_ENTITY_TYPE_ARRAY_BRACKET:
-      #warning "TODO implement array bracket"
-    break;
-
-    case RESOLVER_ENTITY_TYPE_VARIABLE:
-    case RESOLVER_ENTITY_TYPE_GENERAL:
-      codegen_generate_entity_access_for_variable_or_general(result, entity);
-    break;
-
-    case RESOLVER_ENTITY_TYPE_FUNCTION_CALL:
-      codegen_generate_entity_access_for_function_call(result, entity);
-    break;
-
-    case RESOLVER_ENTITY_TYPE_UNARY_INDIRECTION:
-      #warning "TODO implement unary indirection"
-    break;
+    codegen_generate_floating_number_node(node);
+    return;
+  }
 
-    case RESOLVER_ENTITY_TYPE_UNARY_GET_ADDRESS:
-      #warning "TODO implement unary get address"
-    break;
+  asm_push_ins_push_with_data(asm_sized_imm(DATA_SIZE_DWORD, (int) node->llnum), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_NUMERICAL, &(struct stack_frame_data){.dtype=datatype_for_numeric()});
+}
 
-    case RESOLVER_ENTITY_TYPE_UNSUPPORTED:
-      #warning "TODO implement unsupported"
-    break;
+/**
+ * @brief Pushes the address of the string, the string itself goes in .rodata
+ */
+void codegen_generate_string_node(struct node* node)
+{
+  const char* label = codegen_register_string(node->sval);
+  struct instruction_operand address = asm_label(label);
+  address.size = DATA_SIZE_DWORD;
+  asm_push_ins_push_with_data(address, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=datatype_for_string()});
+}
 
-    case RESOLVER_ENTITY_TYPE_CAST:
-      #warning "TODO implement cast"
-    break;
+bool codegen_is_exp_root_for_flags(int flags)
+{
+  return !(flags & EXPRESSION_IS_NOT_ROOT_NODE);
+}
 
-    default:
-      compiler_error(current_process, "COMPILER BUG...");
-  }
+bool codegen_is_exp_root(struct history* history)
+{
+  return codegen_is_exp_root_for_flags(history->flags);
 }
 
-void codegen_generate_entity_access_for_assignment_left_operand(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct node* top_most_node, struct history* history)
+/**
+ * @brief True if a value of this size fills a stack slot of the target, i.e it can be pushed as it is
+ */
+bool codegen_is_full_width(size_t size)
 {
-  codegen_generate_entity_access_start(result, root_assignment_entity, history);
-  struct resolver_entity* current = resolver_result_entity_next(root_assignment_entity);
-  while (current)
-  {
-    codegen_generate_entity_access_for_entity_for_assignment_left_operand(result, current, history);
-    current = resolver_result_entity_next(current);
-  }
+  return size == DATA_SIZE_DWORD || size == target_current()->pointer_size;
 }
 
-void codegen_generate_move_struct(struct datatype* dtype, const char* base_address, off_t offset)
+/**
+ * @brief The size to push a value of this type from memory with, pointers are as wide as the target makes them
+ */
+int codegen_push_size(struct datatype* dtype)
 {
-  size_t structure_size = align_value(datatype_size(dtype), DATA_SIZE_DWORD);
-  int pops = structure_size / DATA_SIZE_DWORD;
-  for (int i = 0; i < pops; i++)
-  {
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    char fmt[10];
-    int chunk_offset = offset + (i * DATA_SIZE_DWORD);
-    codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
-    asm_push("mov [%s%s], eax", base_address, fmt);
-  }
+  return datatype_element_size(dtype) == DATA_SIZE_DDWORD ? DATA_SIZE_DDWORD : DATA_SIZE_DWORD;
 }
 
-void codegen_generate_assignment_part(struct node* node, const char* op, struct history* history)
+void codegen_reduce_register(int reg, size_t size, bool is_signed)
 {
-  struct datatype right_operand_dtype;
-  struct resolver_result* result = resolver_follow(current_process->resolver, node);
-  assert(resolver_result_ok(result));
-  struct resolver_entity* root_assignment_entity = resolver_result_entity_root(result);
-  const char* reg_to_use = "eax";
-  const char* mov_type = codegen_byte_word_or_dword_or_ddword(datatype_element_size(&result->last_entity->dtype), &reg_to_use);
-  struct resolver_entity* next_entity = resolver_result_entity_next(root_assignment_entity);
-  if (!next_entity)
+  // Only bytes and words are extended, nothing is left to extend for a void result
+  if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
   {
-    if (datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype))
-    {
-      codegen_generate_move_struct(&result->last_entity->dtype, result->base.address, 0);
-    }
-    else
+    int opcode = INSTRUCTION_OPCODE_MOVSX;
+    if (!is_signed)
     {
-      asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-      codegen_generate_assignment_instruction_for_operator(mov_type, result->base.address, reg_to_use, op, result->last_entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+      opcode = INSTRUCTION_OPCODE_MOVZX;
     }
-  }
-  else
-  {
-    codegen_generate_entity_access_for_assignment_left_operand(result, root_assignment_entity, node, history);
-    asm_push_ins_pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_generate_assignment_instruction_for_operator(mov_type, "edx", reg_to_use, op, result->last_entity->flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_ins2(opcode, asm_reg(reg), asm_reg(codegen_sub_register(reg, size)));
   }
 }
 
-void codegen_generate_assignment_expression(struct node* node, struct history* history)
+void codegen_gen_mem_access_get_address(struct node* node, int flags, struct resolver_entity* entity)
 {
-  codegen_generate_expressionable(node->exp.right, history_down(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
-  codegen_generate_assignment_part(node->exp.left, node->exp.op, history);
+  asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_EBX), asm_entity_mem(0, entity, 0));
+  asm_push_ins_push_with_flags(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
 }
 
-void codegen_generate_entity_access_for_function_call(struct resolver_result* result, struct resolver_entity* entity)
+void codegen_generate_structure_push_or_return(struct resolver_entity* entity, struct history* history, int start_pos)
 {
-  vector_set_flag(entity->func_call_data.arguments, VECTOR_FLAG_PEEK_DECREMENT);
-  vector_set_peek_pointer_end(entity->func_call_data.arguments);
+  codegen_generate_structure_push(entity, history, start_pos);
+}
 
-  struct node* node = vector_peek_ptr(entity->func_call_data.arguments);
-  asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-  asm_push("mov ecx, ebx");
-  if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+void codegen_gen_mem_access(struct node* node, int flags, struct resolver_entity* entity)
+{
+  if (flags & EXPRESSION_GET_ADDRESS)
   {
-    asm_push("; SUBSTRACT ROOM FOR RETURNED STRUCTURE/UNION DATATYPE");
-    codegen_stack_sub_with_name(align_value(datatype_size(&entity->dtype), DATA_SIZE_DWORD), "result_value");
-    asm_push_ins_push("esp", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    codegen_gen_mem_access_get_address(node, flags, entity);
+    return;
   }
 
-  while (node)
+  if (entity->dtype.flags & DATATYPE_FLAG_IS_ARRAY)
   {
-    codegen_generate_expressionable(node, history_begin(EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
-    node = vector_peek_ptr(entity->func_call_data.arguments);
+    // char abc[50]; char* p = abc; an array on its own is its address
+    asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_EBX), asm_entity_mem(0, entity, 0));
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
   }
-  asm_push("call ecx");
-  size_t stack_size = entity->func_call_data.stack_size;
-  if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+  else if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
   {
-    stack_size += DATA_SIZE_DWORD;
+    codegen_gen_mem_access_get_address(node, 0, entity);
+    asm_push_ins_pop(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    codegen_generate_structure_push_or_return(entity, history_begin(0), 0);
   }
-  codegen_stack_add(stack_size);
-  if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+  else if (datatype_is_floating(&entity->dtype))
   {
-    asm_push("mov ebx, eax");
-    codegen_generate_structure_push(entity, history_begin(0), 0);
+    codegen_push_floating_from(asm_entity_mem(0, entity, 0), &entity->dtype);
   }
-  else
+  else if (!codegen_is_full_width(datatype_element_size(&entity->dtype)))
   {
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_entity_mem(0, entity, 0));
+    codegen_reduce_register(REGISTER_EAX, datatype_element_size(&entity->dtype), entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
   }
-
-  struct resolver_entity* next_entity = resolver_result_entity_next(entity);
-  if (next_entity && datatype_is_struct_or_union(&entity->dtype))
+  else
   {
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("mov ebx, eax");
-    asm_push_ins_push("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    // We can push this straight to the stack
+    asm_push_ins_push_with_data(asm_entity_mem(codegen_push_size(&entity->dtype), entity, 0), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
   }
 }
 
-void codegen_generate_entity_access_fot_entity(struct resolver_result* result, struct resolver_entity* entity, struct history* history)
+void codegen_generate_variable_access_for_entity(struct node* node, struct resolver_entity* entity, struct history* history)
 {
-  switch (entity->type)
-  {
-    case RESOLVER_ENTITY_TYPE_ARRAY_BRACKET:
-      #warning "TODO implement array bracket"
-    break;
+  codegen_gen_mem_access(node, history->flags, entity);
+}
 
-    case RESOLVER_ENTITY_TYPE_VARIABLE:
-    case RESOLVER_ENTITY_TYPE_GENERAL:
-      codegen_generate_entity_access_for_variable_or_general(result, entity);
-    break;
+void codegen_generate_variable_access(struct node* node, struct resolver_entity* entity, struct history* history)
+{
+  codegen_generate_variable_access_for_entity(node, entity, history_down(history, history->flags));
+}
 
-    case RESOLVER_ENTITY_TYPE_FUNCTION_CALL:
-      codegen_generate_entity_access_for_function_call(result, entity);
-    break;
+void codegen_generate_identifier(struct node* node, struct history* history)
+{
+  struct resolver_result* result = resolver_follow(current_process->resolver, node);
+  assert(resolver_result_ok(result));
 
-    case RESOLVER_ENTITY_TYPE_UNARY_INDIRECTION:
-      #warning "TODO implement unary indirection"
-    break;
+  struct resolver_entity* entity = resolver_result_entity(result);
+  codegen_generate_variable_access(node, entity, history);
+  codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity=entity});
+}
 
-    case RESOLVER_ENTITY_TYPE_UNARY_GET_ADDRESS:
-      #warning "TODO implement unary get address"
-    break;
+void codegen_generate_unary_address(struct node* node, struct history* history)
+{
+  int flags = history->flags;
+  codegen_generate_expressionable(node->unary.operand, history);
+  codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_UNARY_GET_ADDRESS});
+}
 
-    case RESOLVER_ENTITY_TYPE_UNSUPPORTED:
-      #warning "TODO implement unsupported"
-    break;
+void codegen_generate_unary(struct node* node, struct history* history)
+{
+  int flags = history->flags;
+  if (codegen_resolve_node_for_value(node, history))
+  {
+    return;
+  }
 
-    case RESOLVER_ENTITY_TYPE_CAST:
-      #warning "TODO implement cast"
-    break;
+  if (op_is_indirection(node->unary.op))
+  {
+    #warning "implement pointer unary later on"
+    return;
+  }
+  else if (op_is_address(node->unary.op))
+  {
+    codegen_generate_unary_address(node, history);
+    return;
+  }
+
+  #warning "genrate normal unary"
+}
+
+/**
+ * @brief Converts the operand to the type, integers are only narrowed and everything else keeps its bits
+ */
+void codegen_generate_cast(struct node* node, struct history* history)
+{
+  struct datatype* dtype = &node->cast.dtype;
+  codegen_generate_expressionable(node->cast.operand, history_down(history, history->flags));
+  struct datatype from_dtype = datatype_for_numeric();
+  asm_datatype_back(&from_dtype);
+  if (datatype_is_floating(dtype) || datatype_is_floating(&from_dtype))
+  {
+    codegen_convert_top(dtype);
+    return;
+  }
+
+  if (!(dtype->flags & DATATYPE_FLAG_IS_POINTER) && !codegen_is_full_width(datatype_element_size(dtype)))
+  {
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    codegen_reduce_register(REGISTER_EAX, datatype_element_size(dtype), dtype->flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=*dtype});
+    return;
+  }
+
+  struct stack_frame_element* element = asm_stack_back();
+  element->flags |= STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE;
+  element->data.dtype = *dtype;
+}
+
+void codegen_generate_expressionable(struct node* node, struct history* history)
+{
+  bool is_root = codegen_is_exp_root(history);
+  if (is_root)
+  {
+    history->flags |= EXPRESSION_IS_NOT_ROOT_NODE;
+  }
+
+  switch (node->type)
+  {
+    case NODE_TYPE_IDENTIFIER:
+      codegen_generate_identifier(node, history);
+    break;
+
+    case NODE_TYPE_NUMBER:
+      codegen_generate_number_node(node, history);
+    break;
+
+    case NODE_TYPE_STRING:
+      codegen_generate_string_node(node);
+    break;
+
+    case NODE_TYPE_EXPRESSION:
+      codegen_generate_exp_node(node, history);
+    break;
+
+    case NODE_TYPE_UNARY:
+      codegen_generate_unary(node, history);
+    break;
+
+    case NODE_TYPE_CAST:
+      codegen_generate_cast(node, history);
+    break;
+  }
+}
+
+/**
+ * @brief The part of eax, ebx, ecx or edx a value of the size is in, i.e al for a byte in eax
+ */
+int codegen_sub_register(int reg, size_t size)
+{
+  assert(reg >= REGISTER_EAX && reg <= REGISTER_EDX);
+  if (size == DATA_SIZE_BYTE)
+  {
+    return REGISTER_AL + (reg - REGISTER_EAX);
+  }
+  else if (size == DATA_SIZE_WORD)
+  {
+    return REGISTER_AX + (reg - REGISTER_EAX);
+  }
+
+  return reg;
+}
+
+/**
+ * @brief Returns the size to store a value of the given size with and swaps the register for the part of it that holds the value
+ */
+int codegen_byte_word_or_dword_or_ddword(size_t size, int* reg_to_use)
+{
+  *reg_to_use = codegen_sub_register(*reg_to_use, size);
+  return size;
+}
+
+void codegen_generate_assignment_instruction_for_operator(struct instruction_operand address, int reg_to_use, const char* op)
+{
+  if (S_EQ(op, "="))
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, address, asm_reg(reg_to_use));
+  }
+  else if (S_EQ(op, "+="))
+  {
+    asm_ins2(INSTRUCTION_OPCODE_ADD, address, asm_reg(reg_to_use));
+  }
+}
+
+/**
+ * @brief Stores the value on top of the stack to the floating variable at the address, converting it to the type of the variable
+ */
+void codegen_generate_floating_assignment(struct datatype* dtype, const char* address, const char* op)
+{
+  const char* suffix = codegen_floating_suffix(dtype);
+  codegen_pop_floating("xmm0", dtype);
+  if (S_EQ(op, "+="))
+  {
+    asm_push("add%s xmm0, [%s]", suffix, address);
+  }
+  asm_push("mov%s [%s], xmm0", suffix, address);
+}
+
+void codegen_register_local(struct resolver_entity* entity)
+{
+  struct datatype* dtype = &entity->dtype;
+  if (datatype_is_struct_or_union_non_pointer(dtype) || dtype->flags & DATATYPE_FLAG_IS_ARRAY || datatype_size(dtype) != DATA_SIZE_DWORD)
+  {
+    return;
+  }
+
+  // Only scalars the size of a register are worth considering
+  struct regalloc_function* function = vector_back(current_process->generator->functions);
+  int offset = codegen_entity_private(entity)->offset;
+  vector_push(function->locals, &offset);
+}
+
+void codegen_generate_scope_variable(struct node* node)
+{
+  struct resolver_entity* entity = codegen_new_scope_entity(node, node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
+  codegen_register_local(entity);
+  if (node->var.val)
+  {
+    codegen_generate_expressionable(node->var.val, history_begin(EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+    if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+    {
+      codegen_generate_move_struct(&entity->dtype, asm_entity_mem(0, entity, 0));
+      return;
+    }
+
+    if (datatype_is_floating(&entity->dtype))
+    {
+      codegen_generate_floating_assignment(&entity->dtype, codegen_entity_private(entity)->address, "=");
+      return;
+    }
+
+    // pop eax
+    codegen_pop_integer(REGISTER_EAX);
+    int reg_to_use = REGISTER_EAX;
+    int size = codegen_byte_word_or_dword_or_ddword(datatype_element_size(&entity->dtype), &reg_to_use);
+    codegen_generate_assignment_instruction_for_operator(asm_entity_mem(size, entity, 0), reg_to_use, "=");
+  }
+}
+
+void codegen_generate_entity_access_start(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct history* history)
+{
+  if (root_assignment_entity->type == RESOLVER_ENTITY_TYPE_UNSUPPORTED)
+  {
+    // Unsupported entity then process it
+    codegen_generate_expressionable(root_assignment_entity->node, history);
+  }
+  else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE && datatype_is_floating(&root_assignment_entity->dtype))
+  {
+    codegen_push_floating_from(asm_result_mem(0, result, 0), &root_assignment_entity->dtype);
+  }
+  else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE)
+  {
+    asm_push_ins_push_with_data(asm_result_mem(codegen_push_size(&root_assignment_entity->dtype), result, 0), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=root_assignment_entity->dtype});
+  }
+  else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX)
+  {
+    if (root_assignment_entity->next && root_assignment_entity->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY)
+    {
+      asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_result_mem(0, result, 0));
+    }
+    else
+    {
+      asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_EBX), asm_result_mem(0, result, 0));
+    }
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=root_assignment_entity->dtype});
+  }
+}
+
+void codegen_generate_entity_access_for_variable_or_general(struct resolver_result* result, struct resolver_entity* entity)
+{
+  // Restore the EBX register
+  asm_push_ins_pop(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  if (entity->flags & RESOLVER_ENTITY_FLAG_DO_INDIRECTION)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_mem(0, REGISTER_EBX, 0));
+  }
+  asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EBX), asm_imm(entity->offset));
+  asm_push_ins_push_with_data(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+}
+
+/**
+ * @brief Adds the index of the bracket times its stride to the address on the stack, the
+ * index is computed first as it may use ebx
+ */
+void codegen_generate_entity_access_for_array_bracket(struct resolver_result* result, struct resolver_entity* entity)
+{
+  codegen_generate_expressionable(entity->array.array_index_node, history_begin(0));
+  codegen_pop_integer(REGISTER_EAX);
+  asm_push_ins_pop(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  // The stride of a bracket on a pointer is the size of what it points to
+  int stride = entity->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY ? datatype_element_size(&entity->dtype) : entity->offset;
+  if (stride != 1)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_IMUL, asm_reg(REGISTER_EAX), asm_imm(stride));
+  }
+  asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EBX), asm_reg(REGISTER_EAX));
+  asm_push_ins_push_with_data(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+}
+
+/**
+ * @brief The value below is the pointer, **p loads it once more to reach the address p points at in the end
+ */
+void codegen_generate_entity_access_for_unary_indirection(struct resolver_result* result, struct resolver_entity* entity)
+{
+  asm_push_ins_pop(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  for (int i = 1; i < entity->indirection.depth; i++)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_mem(0, REGISTER_EBX, 0));
+  }
+  asm_push_ins_push_with_data(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+}
+
+void codegen_generate_entity_access_for_entity_for_assignment_left_operand(struct resolver_result* result, struct resolver_entity* entity, struct history* history)
+{
+  switch (entity->type)
+  {
+    case RESOLVER_ENTITY_TYPE_ARRAY_BRACKET:
+      codegen_generate_entity_access_for_array_bracket(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_VARIABLE:
+    case RESOLVER_ENTITY_TYPE_GENERAL:
+      codegen_generate_entity_access_for_variable_or_general(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_FUNCTION_CALL:
+      codegen_generate_entity_access_for_function_call(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNARY_INDIRECTION:
+      codegen_generate_entity_access_for_unary_indirection(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNARY_GET_ADDRESS:
+      #warning "TODO implement unary get address"
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNSUPPORTED:
+      #warning "TODO implement unsupported"
+    break;
+
+    case RESOLVER_ENTITY_TYPE_CAST:
+      #warning "TODO implement cast"
+    break;
+
+    default:
+      compiler_error(current_process, "COMPILER BUG...");
+  }
+}
+
+void codegen_generate_entity_access_for_assignment_left_operand(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct node* top_most_node, struct history* history)
+{
+  codegen_generate_entity_access_start(result, root_assignment_entity, history);
+  struct resolver_entity* current = resolver_result_entity_next(root_assignment_entity);
+  while (current)
+  {
+    codegen_generate_entity_access_for_entity_for_assignment_left_operand(result, current, history);
+    current = resolver_result_entity_next(current);
+  }
+}
+
+/**
+ * @brief Copies dwords from the source memory to the destination memory through esi and edi.
+ * esi, edi and ecx are saved around the copy, so addresses relative to esp
+ * must allow for the three pushes.
+ */
+void codegen_generate_block_copy(struct instruction_operand source, struct instruction_operand destination, int dwords)
+{
+  // esi and edi belong to our caller and ecx may hold the function we are pushing arguments for
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, asm_reg(REGISTER_ESI));
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, asm_reg(REGISTER_EDI));
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, asm_reg(REGISTER_ECX));
+  asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_ESI), source);
+  asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_EDI), destination);
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_imm(dwords));
+  asm_push("rep movsd");
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_ECX));
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_EDI));
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_ESI));
+}
+
+void codegen_generate_move_struct(struct datatype* dtype, struct instruction_operand address)
+{
+  size_t structure_size = align_value(datatype_size(dtype), DATA_SIZE_DWORD);
+  int pops = structure_size / DATA_SIZE_DWORD;
+  if (pops > STRUCTURE_COPY_UNROLL_LIMIT)
+  {
+    struct code_generator* generator = current_process->generator;
+    struct vector* instructions = generator->instructions->instructions;
+    if (generator->struct_push_end == vector_count(instructions) && generator->struct_push_dwords == pops)
+    {
+      // The structure was only just copied onto the stack from ebx, copy it straight from there instead
+      for (int i = generator->struct_push_start; i < generator->struct_push_end; i++)
+      {
+        ((struct instruction*) vector_at(instructions, i))->flags |= INSTRUCTION_FLAG_DELETED;
+      }
+      codegen_stack_pop_pushed_values(pops);
+      codegen_generate_block_copy(asm_mem(0, REGISTER_EBX, 0), address, pops);
+      return;
+    }
+
+    codegen_generate_block_copy(asm_mem(0, REGISTER_ESP, 12), address, pops);
+    codegen_stack_add_pushed_values(pops);
+    return;
+  }
+
+  for (int i = 0; i < pops; i++)
+  {
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    struct instruction_operand chunk = address;
+    chunk.address.displacement += i * DATA_SIZE_DWORD;
+    asm_ins2(INSTRUCTION_OPCODE_MOV, chunk, asm_reg(REGISTER_EAX));
+  }
+}
+
+void codegen_generate_assignment_part(struct node* node, const char* op, struct history* history)
+{
+  struct datatype right_operand_dtype;
+  struct resolver_result* result = resolver_follow(current_process->resolver, node);
+  assert(resolver_result_ok(result));
+  struct resolver_entity* root_assignment_entity = resolver_result_entity_root(result);
+  int reg_to_use = REGISTER_EAX;
+  int size = codegen_byte_word_or_dword_or_ddword(datatype_element_size(&result->last_entity->dtype), &reg_to_use);
+  struct resolver_entity* next_entity = resolver_result_entity_next(root_assignment_entity);
+  if (!next_entity)
+  {
+    if (datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype))
+    {
+      codegen_generate_move_struct(&result->last_entity->dtype, asm_result_mem(0, result, 0));
+    }
+    else if (datatype_is_floating(&result->last_entity->dtype))
+    {
+      codegen_generate_floating_assignment(&result->last_entity->dtype, result->base.address, op);
+    }
+    else
+    {
+      codegen_pop_integer(REGISTER_EAX);
+      codegen_generate_assignment_instruction_for_operator(asm_result_mem(size, result, 0), reg_to_use, op);
+    }
+  }
+  else
+  {
+    codegen_generate_entity_access_for_assignment_left_operand(result, root_assignment_entity, node, history);
+    asm_push_ins_pop(asm_reg(REGISTER_EDX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    if (datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype))
+    {
+      codegen_generate_move_struct(&result->last_entity->dtype, asm_mem(0, REGISTER_EDX, 0));
+      return;
+    }
+
+    if (datatype_is_floating(&result->last_entity->dtype))
+    {
+      codegen_generate_floating_assignment(&result->last_entity->dtype, "edx", op);
+      return;
+    }
+
+    codegen_pop_integer(REGISTER_EAX);
+    codegen_generate_assignment_instruction_for_operator(asm_mem(size, REGISTER_EDX, 0), reg_to_use, op);
+  }
+}
+
+void codegen_generate_assignment_expression(struct node* node, struct history* history)
+{
+  codegen_generate_expressionable(node->exp.right, history_down(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+  codegen_generate_assignment_part(node->exp.left, node->exp.op, history);
+}
+
+/**
+ * @brief Generates one argument of a call. Every argument has to leave its value on the stack,
+ * the stack is cleaned up after the call by what was pushed
+ */
+void codegen_generate_function_call_argument(struct node* node)
+{
+  struct vector* frame_elements = current_process->generator->current_function->func.frame.elements;
+  int total_elements = vector_count(frame_elements);
+  codegen_generate_expressionable(node, history_begin(EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
+  if (vector_count(frame_elements) <= total_elements)
+  {
+    compiler_error(current_process, "This kind of expression can't be passed as a function call argument yet");
+  }
+}
+
+/**
+ * @brief Converts the argument on top of the stack to the type of the parameter it is passed as.
+ * Arguments without a parameter are promoted, a float is passed as a double
+ */
+void codegen_convert_argument(struct node* function, int index)
+{
+  struct datatype dtype;
+  struct vector* parameters = function ? function_node_argument_vec(function) : NULL;
+  if (parameters && index < vector_count(parameters))
+  {
+    struct node* parameter = *(struct node**) vector_at(parameters, index);
+    codegen_convert_top(&parameter->var.type);
+  }
+  else if (asm_datatype_back(&dtype) && datatype_is_floating(&dtype) && dtype.type == DATA_TYPE_FLOAT)
+  {
+    struct datatype double_dtype = datatype_for_floating(NUMBER_TYPE_DOUBLE);
+    codegen_convert_top(&double_dtype);
+  }
+}
+
+void codegen_generate_entity_access_for_function_call(struct resolver_result* result, struct resolver_entity* entity)
+{
+  vector_set_flag(entity->func_call_data.arguments, VECTOR_FLAG_PEEK_DECREMENT);
+  vector_set_peek_pointer_end(entity->func_call_data.arguments);
+
+  struct node* node = vector_peek_ptr(entity->func_call_data.arguments);
+  bool returns_struct = datatype_is_struct_or_union_non_pointer(&entity->dtype);
+  if (returns_struct)
+  {
+    // The room for the returned structure goes under the arguments so the function comes off the stack first
+    asm_push_ins_pop(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_reg(REGISTER_EBX));
+    asm_push("; SUBSTRACT ROOM FOR RETURNED STRUCTURE/UNION DATATYPE");
+    codegen_stack_sub_with_name(align_value(datatype_size(&entity->dtype), DATA_SIZE_DWORD), "result_value");
+    asm_push_ins_push(asm_reg(REGISTER_ESP), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  }
+
+  // Arguments are converted to their parameters so what they take on the stack is counted as they are pushed
+  struct vector* frame_elements = current_process->generator->current_function->func.frame.elements;
+  int arguments_start = vector_count(frame_elements);
+  if (returns_struct)
+  {
+    // The pointer to the room for the returned structure
+    arguments_start--;
+  }
+
+  for (int i = vector_count(entity->func_call_data.arguments) - 1; node; i--)
+  {
+    codegen_generate_function_call_argument(node);
+    codegen_convert_argument(entity->func_call_data.function, i);
+    node = vector_peek_ptr(entity->func_call_data.arguments);
+  }
+
+  // Otherwise the function is still under the arguments, computing them may have used ecx
+  int argument_slots = vector_count(frame_elements) - arguments_start;
+  if (!returns_struct)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_mem(0, REGISTER_ESP, argument_slots * DATA_SIZE_DWORD));
+    argument_slots++;
+  }
+  asm_ins1(INSTRUCTION_OPCODE_CALL, asm_reg(REGISTER_ECX));
+  codegen_stack_add(argument_slots * DATA_SIZE_DWORD);
+  if (returns_struct)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_reg(REGISTER_EAX));
+    codegen_generate_structure_push(entity, history_begin(0), 0);
+  }
+  else if (datatype_is_floating(&entity->dtype))
+  {
+    // Floating values are returned in st0
+    codegen_stack_sub_pushed_values(codegen_pushed_slots(&entity->dtype), &entity->dtype);
+    asm_push("fstp %s [esp]", entity->dtype.type == DATA_TYPE_DOUBLE ? "qword" : "dword");
+  }
+  else
+  {
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
+  }
+
+  struct resolver_entity* next_entity = resolver_result_entity_next(entity);
+  if (next_entity && datatype_is_struct_or_union(&entity->dtype))
+  {
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_reg(REGISTER_EAX));
+    asm_push_ins_push(asm_reg(REGISTER_EBX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  }
+}
+
+/**
+ * @brief The entities before it left the address on the stack, it is a pointer to what they addressed
+ */
+void codegen_generate_entity_access_for_unary_get_address(struct resolver_result* result, struct resolver_entity* entity)
+{
+  struct stack_frame_element* element = asm_stack_back();
+  element->flags |= STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE;
+  element->data.dtype = entity->dtype;
+}
+
+void codegen_generate_entity_access_fot_entity(struct resolver_result* result, struct resolver_entity* entity, struct history* history)
+{
+  switch (entity->type)
+  {
+    case RESOLVER_ENTITY_TYPE_ARRAY_BRACKET:
+      codegen_generate_entity_access_for_array_bracket(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_VARIABLE:
+    case RESOLVER_ENTITY_TYPE_GENERAL:
+      codegen_generate_entity_access_for_variable_or_general(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_FUNCTION_CALL:
+      codegen_generate_entity_access_for_function_call(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNARY_INDIRECTION:
+      codegen_generate_entity_access_for_unary_indirection(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNARY_GET_ADDRESS:
+      codegen_generate_entity_access_for_unary_get_address(result, entity);
+    break;
+
+    case RESOLVER_ENTITY_TYPE_UNSUPPORTED:
+      #warning "TODO implement unsupported"
+    break;
+
+    case RESOLVER_ENTITY_TYPE_CAST:
+      #warning "TODO implement cast"
+    break;
+
+    default:
+      compiler_error(current_process, "COMPILER BUG...");
+  }
+}
+
+void codegen_generate_entity_access(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct node* top_most_node, struct history* history)
+{
+  codegen_generate_entity_access_start(result, root_assignment_entity, history);
+  struct resolver_entity* current = resolver_result_entity_next(root_assignment_entity);
+  while (current)
+  {
+    codegen_generate_entity_access_fot_entity(result, current, history);
+    current = resolver_result_entity_next(current);
+  }
+}
+
+bool codegen_resolver_node_return_result(struct node* node, struct history* history, struct resolver_result** result_out)
+{
+  struct resolver_result* result = resolver_follow(current_process->resolver, node);
+  if (resolver_result_ok(result))
+  {
+    struct resolver_entity* root_assignment_entity = resolver_result_entity_root(result);
+    codegen_generate_entity_access(result, root_assignment_entity, node, history);
+    if (result_out)
+    {
+      *result_out = result;
+    }
+    codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity=result->last_entity});
+    return true;
+  }
+
+  return false;
+}
+
+bool codegen_resolve_node_for_value(struct node* node, struct history* history)
+{
+  struct resolver_result* result = NULL;
+  if (!codegen_resolver_node_return_result(node, history, &result))
+  {
+    return false;
+  }
+
+  struct datatype dtype;
+  assert(asm_datatype_back(&dtype));
+  // Structure members and anything else read through the resolver
+  if (!(dtype.flags & DATATYPE_FLAG_IS_ARRAY))
+  {
+  }
+
+  if (datatype_is_struct_or_union_non_pointer(&dtype))
+  {
+    codegen_generate_structure_push(result->last_entity, history, 0);
+  }
+  else if (datatype_is_floating(&dtype))
+  {
+    // Values returned by functions are already on the stack
+    if (result->flags & RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE)
+    {
+      asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+      codegen_push_floating_from(asm_mem(0, REGISTER_EAX, 0), &dtype);
+    }
+  }
+  else if (!(dtype.flags & DATATYPE_FLAG_IS_POINTER))
+  {
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    if (result->flags & RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE)
+    {
+      asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_mem(0, REGISTER_EAX, 0));
+    }
+
+    codegen_reduce_register(REGISTER_EAX, datatype_element_size(&dtype), dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=dtype});
+  }
+
+  return true;
+}
+
+int get_additional_flags(int current_flags, struct node* node)
+{
+  if (node->type != NODE_TYPE_EXPRESSION)
+  {
+    return 0;
+  }
+
+  int additional_flags = 0;
+  bool maintain_function_call_argument_flag = (current_flags & EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS) && S_EQ(node->exp.op, ",");
+  if (maintain_function_call_argument_flag)
+  {
+    additional_flags |= EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS;
+  }
+  return additional_flags;
+}
+
+int codegen_set_flag_for_operator(const char* op)
+{
+  int flag = 0;
+  if (S_EQ(op, "+"))
+  {
+    flag |= EXPRESSION_IS_ADDITION;
+  }
+  else if (S_EQ(op, "-"))
+  {
+    flag |= EXPRESSION_IS_SUBSTRACTION;
+  }
+  else if (S_EQ(op, "*"))
+  {
+    flag |= EXPRESSION_IS_MULTIPLICATION;
+  }
+  else if (S_EQ(op, "/"))
+  {
+    flag |= EXPRESSION_IS_DIVISION;
+  }
+  else if (S_EQ(op, "%"))
+  {
+    flag |= EXPRESSION_IS_MODULAS;
+  }
+  else if (S_EQ(op, ">"))
+  {
+    flag |= EXPRESSION_IS_ABOVE;
+  }
+  else if (S_EQ(op, "<"))
+  {
+    flag |= EXPRESSION_IS_BELOW;
+  }
+  else if (S_EQ(op, ">="))
+  {
+    flag |= EXPRESSION_IS_ABOVE_OR_EQUAL;
+  }
+  else if (S_EQ(op, "<="))
+  {
+    flag |= EXPRESSION_IS_BELOW_OR_EQUAL;
+  }
+  else if (S_EQ(op, "!="))
+  {
+    flag |= EXPRESSION_IS_NOT_EQUAL;
+  }
+  else if (S_EQ(op, "=="))
+  {
+    flag |= EXPRESSION_IS_EQUAL;
+  }
+  else if (S_EQ(op, "&&"))
+  {
+    flag |= EXPRESSION_LOGICAL_AND;
+  }
+  else if (S_EQ(op, "||"))
+  {
+    flag |= EXPRESSION_LOGICAL_OR;
+  }
+  else if (S_EQ(op, "<<"))
+  {
+    flag |= EXPRESSION_IS_BITSHIFT_LEFT;
+  }
+  else if (S_EQ(op, ">>"))
+  {
+    flag |= EXPRESSION_IS_BITSHIFT_RIGHT;
+  }
+  else if (S_EQ(op, "&"))
+  {
+    flag |= EXPRESSION_IS_BITWISE_AND;
+  }
+  else if (S_EQ(op, "|"))
+  {
+    flag |= EXPRESSION_IS_BITWISE_OR;
+  }
+  else if (S_EQ(op, "^"))
+  {
+    flag |= EXPRESSION_IS_BITWISE_XOR;
+  }
+  return flag;
+}
+
+struct stack_frame_element* asm_stack_back()
+{
+  return stackframe_back(current_process->generator->current_function);
+}
+
+struct stack_frame_element* asm_stack_peek()
+{
+  return stackframe_peek(current_process->generator->current_function);
+}
+
+void asm_stack_peek_start()
+{
+  stackframe_peek_start(current_process->generator->current_function);
+}
+
+bool asm_datatype_back(struct datatype* dtype_out)
+{
+  struct stack_frame_element* last_stack_frame_element = asm_stack_back();
+  if (!last_stack_frame_element)
+  {
+    return false;
+  }
+
+  if (!(last_stack_frame_element->flags & STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE))
+  {
+    return false;
+  }
+
+  *dtype_out = last_stack_frame_element->data.dtype;
+  return true;
+}
+
+/**
+ * @brief Gets the datatype of the value the given number of slots under the top of the stack
+ */
+bool asm_datatype_at_depth(int depth, struct datatype* dtype_out)
+{
+  struct vector* elements = current_process->generator->current_function->func.frame.elements;
+  int index = vector_count(elements) - 1 - depth;
+  if (index < 0)
+  {
+    return false;
+  }
+
+  struct stack_frame_element* element = vector_at(elements, index);
+  if (!(element->flags & STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE))
+  {
+    return false;
+  }
+
+  *dtype_out = element->data.dtype;
+  return true;
+}
+
+bool codegen_can_gen_math(int flags)
+{
+  return flags & EXPRESSION_GEN_MATHABLE;
+}
+
+void codegen_gen_cmp(int value_reg, int set_opcode)
+{
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_reg(value_reg));
+  asm_ins1(set_opcode, asm_reg(REGISTER_AL));
+  asm_ins2(INSTRUCTION_OPCODE_MOVZX, asm_reg(REGISTER_EAX), asm_reg(REGISTER_AL));
+}
+
+/**
+ * @brief Returns true if the node is a number that fits in an int, numbers are generated as ints
+ */
+bool codegen_node_int_value(struct node* node, int* value_out)
+{
+  if (node->type != NODE_TYPE_NUMBER || node_is_floating_number(node) || (long long) node->llnum < INT_MIN || (long long) node->llnum > INT_MAX)
+  {
+    return false;
+  }
+
+  *value_out = (int) node->llnum;
+  return true;
+}
+
+/**
+ * @brief Returns the shift that is the same as multiplying by the value, or -1 if the value
+ * is not a power of two
+ */
+int codegen_power_of_two_shift(unsigned int value)
+{
+  if (value == 0 || (value & (value - 1)))
+  {
+    return -1;
+  }
+
+  int shift = 0;
+  while (value >>= 1)
+  {
+    shift++;
+  }
+  return shift;
+}
+
+/**
+ * @brief Multiplies the register by a constant with shifts and lea where it can,
+ * i.e x*8 is "sal eax, 3" and x*10 is "lea eax, [eax+eax*4]" then "sal eax, 1"
+ */
+void codegen_gen_multiply_by_constant(int reg, int value)
+{
+  if (value == 0)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_XOR, asm_reg(reg), asm_reg(reg));
+    return;
+  }
+
+  if (value == -1)
+  {
+    asm_ins1(INSTRUCTION_OPCODE_NEG, asm_reg(reg));
+    return;
+  }
+
+  // Take the power of two out, what is left may be done with a lea
+  unsigned int odd = (unsigned int) value;
+  int shift = 0;
+  while (!(odd & 1))
+  {
+    odd >>= 1;
+    shift++;
+  }
+
+  if (odd == 3 || odd == 5 || odd == 9)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(reg), asm_mem_index(0, reg, reg, odd - 1));
+  }
+  else if (odd != 1)
+  {
+    asm_ins3(INSTRUCTION_OPCODE_IMUL, asm_reg(reg), asm_reg(reg), asm_imm(value));
+    return;
+  }
+
+  if (shift > 0)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_SAL, asm_reg(reg), asm_imm(shift));
+  }
+}
+
+/**
+ * @brief Finds the magic number and shift for signed division by a constant of at least two,
+ * see Hacker's Delight chapter 10. The quotient is the high half of magic*n shifted right.
+ */
+void codegen_signed_division_magic(int divisor, int* magic_out, int* shift_out)
+{
+  const unsigned int two31 = 0x80000000;
+  unsigned int d = (unsigned int) divisor;
+  unsigned int anc = two31 - 1 - two31 % d;
+  unsigned int q1 = two31 / anc;
+  unsigned int r1 = two31 - q1 * anc;
+  unsigned int q2 = two31 / d;
+  unsigned int r2 = two31 - q2 * d;
+  unsigned int delta = 0;
+  int p = 31;
+  do
+  {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc)
+    {
+      q1++;
+      r1 -= anc;
+    }
+
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= d)
+    {
+      q2++;
+      r2 -= d;
+    }
+    delta = d - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  *magic_out = (int)(q2 + 1);
+  *shift_out = p - 32;
+}
+
+/**
+ * @brief Finds the magic number for unsigned division by a constant of at least two.
+ * The quotient is (t + ((n - t) >> 1)) >> (shift - 1) where t is the high half of magic*n
+ */
+void codegen_unsigned_division_magic(unsigned int divisor, unsigned int* magic_out, int* shift_out)
+{
+  int shift = 0;
+  while ((1ULL << shift) < divisor)
+  {
+    shift++;
+  }
+
+  *magic_out = (unsigned int)((((1ULL << shift) - divisor) << 32) / divisor) + 1;
+  *shift_out = shift;
+}
+
+/**
+ * @brief Divides eax by a positive constant without the divide instruction.
+ * The quotient is left in eax and the value that was divided in ecx.
+ */
+void codegen_gen_divide_by_constant(int value, bool is_signed)
+{
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_reg(REGISTER_EAX));
+  int shift = codegen_power_of_two_shift(value);
+  if (shift == 0)
+  {
+    return;
+  }
+
+  if (shift > 0)
+  {
+    if (is_signed)
+    {
+      // Negative values need rounding towards zero, add value-1 first when the sign is set
+      asm_ins0(INSTRUCTION_OPCODE_CDQ);
+      asm_ins2(INSTRUCTION_OPCODE_AND, asm_reg(REGISTER_EDX), asm_imm(value - 1));
+      asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+      asm_ins2(INSTRUCTION_OPCODE_SAR, asm_reg(REGISTER_EAX), asm_imm(shift));
+    }
+    else
+    {
+      asm_ins2(INSTRUCTION_OPCODE_SHR, asm_reg(REGISTER_EAX), asm_imm(shift));
+    }
+    return;
+  }
+
+  if (is_signed)
+  {
+    int magic = 0;
+    codegen_signed_division_magic(value, &magic, &shift);
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_imm(magic));
+    asm_ins1(INSTRUCTION_OPCODE_IMUL, asm_reg(REGISTER_ECX));
+    if (magic < 0)
+    {
+      // The magic number did not fit as a positive int, add the value back in
+      asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EDX), asm_reg(REGISTER_ECX));
+    }
+
+    if (shift > 0)
+    {
+      asm_ins2(INSTRUCTION_OPCODE_SAR, asm_reg(REGISTER_EDX), asm_imm(shift));
+    }
+
+    // Round towards zero by adding one for negative values
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+    asm_ins2(INSTRUCTION_OPCODE_SHR, asm_reg(REGISTER_EAX), asm_imm(31));
+    asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+    return;
+  }
+
+  unsigned int magic = 0;
+  codegen_unsigned_division_magic(value, &magic, &shift);
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_imm(magic));
+  asm_ins1(INSTRUCTION_OPCODE_MUL, asm_reg(REGISTER_ECX));
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+  asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+  asm_ins2(INSTRUCTION_OPCODE_SHR, asm_reg(REGISTER_EAX), asm_imm(1));
+  asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+  if (shift > 1)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_SHR, asm_reg(REGISTER_EAX), asm_imm(shift - 1));
+  }
+}
+
+/**
+ * @brief Generates eax*value, eax/value or eax%value for a constant value.
+ * Returns false if nothing cheaper than the divide and multiply instructions was found.
+ */
+bool codegen_gen_math_for_constant(int value, int flags, bool is_signed)
+{
+  if (flags & EXPRESSION_IS_MULTIPLICATION)
+  {
+    codegen_gen_multiply_by_constant(REGISTER_EAX, value);
+    return true;
+  }
+
+  if (!(flags & (EXPRESSION_IS_DIVISION | EXPRESSION_IS_MODULAS)) || value <= 0)
+  {
+    return false;
+  }
+
+  if (flags & EXPRESSION_IS_MODULAS && !is_signed && codegen_power_of_two_shift(value) >= 0)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_AND, asm_reg(REGISTER_EAX), asm_imm(value - 1));
+    return true;
+  }
+
+  codegen_gen_divide_by_constant(value, is_signed);
+  if (flags & EXPRESSION_IS_MODULAS)
+  {
+    // The remainder is what is left after taking away quotient*value
+    codegen_gen_multiply_by_constant(REGISTER_EAX, value);
+    asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_ECX), asm_reg(REGISTER_EAX));
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+  }
+  return true;
+}
+
+void codegen_gen_math_for_value(int reg, int value, int flags, bool is_signed)
+{
+  if (flags & EXPRESSION_IS_ADDITION)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(reg), asm_reg(value));
+  }
+  else if (flags & EXPRESSION_IS_SUBSTRACTION)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(reg), asm_reg(value));
+  }
+  else if (flags & EXPRESSION_IS_MULTIPLICATION)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_reg(value));
+    if (is_signed)
+    {
+      asm_ins1(INSTRUCTION_OPCODE_IMUL, asm_reg(REGISTER_ECX));
+    }
+    else
+    {
+      asm_ins1(INSTRUCTION_OPCODE_MUL, asm_reg(REGISTER_ECX));
+    }
+  }
+  else if (flags & EXPRESSION_IS_DIVISION)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_reg(value));
+    if (is_signed)
+    {
+      asm_ins0(INSTRUCTION_OPCODE_CDQ);
+      asm_ins1(INSTRUCTION_OPCODE_IDIV, asm_reg(REGISTER_ECX));
+    }
+    else
+    {
+      // Unsigned division takes edx:eax as the value so the top half must be zero
+      asm_ins2(INSTRUCTION_OPCODE_XOR, asm_reg(REGISTER_EDX), asm_reg(REGISTER_EDX));
+      asm_ins1(INSTRUCTION_OPCODE_DIV, asm_reg(REGISTER_ECX));
+    }
+  }
+  else if (flags & EXPRESSION_IS_MODULAS)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_reg(value));
+    if (is_signed)
+    {
+      asm_ins0(INSTRUCTION_OPCODE_CDQ);
+      asm_ins1(INSTRUCTION_OPCODE_IDIV, asm_reg(REGISTER_ECX));
+    }
+    else
+    {
+      asm_ins2(INSTRUCTION_OPCODE_XOR, asm_reg(REGISTER_EDX), asm_reg(REGISTER_EDX));
+      asm_ins1(INSTRUCTION_OPCODE_DIV, asm_reg(REGISTER_ECX));
+    }
+
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EDX));
+  }
+  else if (flags & EXPRESSION_IS_ABOVE)
+  {
+    codegen_gen_cmp(value, is_signed ? INSTRUCTION_OPCODE_SETG : INSTRUCTION_OPCODE_SETA);
+  }
+  else if (flags & EXPRESSION_IS_BELOW)
+  {
+    codegen_gen_cmp(value, is_signed ? INSTRUCTION_OPCODE_SETL : INSTRUCTION_OPCODE_SETB);
+  }
+  else if (flags & EXPRESSION_IS_EQUAL)
+  {
+    codegen_gen_cmp(value, INSTRUCTION_OPCODE_SETE);
+  }
+  else if (flags & EXPRESSION_IS_ABOVE_OR_EQUAL)
+  {
+    codegen_gen_cmp(value, is_signed ? INSTRUCTION_OPCODE_SETGE : INSTRUCTION_OPCODE_SETAE);
+  }
+  else if (flags & EXPRESSION_IS_BELOW_OR_EQUAL)
+  {
+    codegen_gen_cmp(value, is_signed ? INSTRUCTION_OPCODE_SETLE : INSTRUCTION_OPCODE_SETBE);
+  }
+  else if (flags & EXPRESSION_IS_NOT_EQUAL)
+  {
+    codegen_gen_cmp(value, INSTRUCTION_OPCODE_SETNE);
+  }
+  else if (flags & EXPRESSION_IS_BITSHIFT_LEFT)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_SAL, asm_reg(reg), asm_reg(codegen_sub_register(value, DATA_SIZE_BYTE)));
+  }
+  else if (flags & EXPRESSION_IS_BITSHIFT_RIGHT)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_SAR, asm_reg(reg), asm_reg(codegen_sub_register(value, DATA_SIZE_BYTE)));
+  }
+  else if (flags & EXPRESSION_IS_BITWISE_AND)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_AND, asm_reg(reg), asm_reg(value));
+  }
+  else if (flags & EXPRESSION_IS_BITWISE_OR)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_OR, asm_reg(reg), asm_reg(value));
+  }
+  else if (flags & EXPRESSION_IS_BITWISE_XOR)
+  {
+    asm_ins2(INSTRUCTION_OPCODE_XOR, asm_reg(reg), asm_reg(value));
+  }
+}
+
+void codegen_setup_new_logical_expression(struct history* history, struct node* node)
+{
+  int label_index = codegen_label_count();
+  sprintf(history->exp.logical_end_label, ".endc_%i", label_index);
+  sprintf(history->exp.logical_end_label_positive, ".endc_%i_positive", label_index);
+  history->exp.logical_start_op = node->exp.op;
+  history->flags |= EXPRESSION_IN_LOGICAL_EXPRESSION;
+}
+
+void codegen_generate_logical_cmp_and(int reg, const char* fail_label)
+{
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(reg), asm_imm(0));
+  asm_ins1(INSTRUCTION_OPCODE_JE, asm_label(fail_label));
+}
+
+void codegen_generate_logical_cmp_or(int reg, const char* equal_label)
+{
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(reg), asm_imm(0));
+  asm_ins1(INSTRUCTION_OPCODE_JNE, asm_label(equal_label));
+}
+
+void codegen_generate_logical_cmp(const char* op, const char* fail_label, const char* equal_label)
+{
+  if (S_EQ(op, "&&"))
+  {
+    codegen_generate_logical_cmp_and(REGISTER_EAX, fail_label);
+  }
+  else if (S_EQ(op, "||"))
+  {
+    codegen_generate_logical_cmp_or(REGISTER_EAX, equal_label);
+  }
+}
+
+void codegen_generate_end_labels_for_logical_expression(const char* op, const char* end_label, const char* end_label_positive)
+{
+  if (S_EQ(op, "&&"))
+  {
+    asm_push("; && END CLAUSE");
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_imm(1));
+    asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(end_label_positive));
+    asm_push("%s:", end_label);
+    asm_ins2(INSTRUCTION_OPCODE_XOR, asm_reg(REGISTER_EAX), asm_reg(REGISTER_EAX));
+    asm_push("%s:", end_label_positive);
+  }
+  else if (S_EQ(op, "||"))
+  {
+    asm_push("; || END CLAUSE"),
+    asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(end_label));
+    asm_push("%s:", end_label_positive);
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_imm(1));
+    asm_push("%s:", end_label);
+  }
+}
+
+void codegen_generate_exp_node_for_logical_arithmetic(struct node* node, struct history* history)
+{
+  bool start_of_logical_exp = !(history->flags & EXPRESSION_IN_LOGICAL_EXPRESSION);
+  if (start_of_logical_exp)
+  {
+    codegen_setup_new_logical_expression(history, node);
+  }
+  codegen_generate_expressionable(node->exp.left, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
+  codegen_pop_condition();
+  codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
+  codegen_generate_expressionable(node->exp.right, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
+  if (!is_logical_node(node->exp.right))
+  {
+    codegen_pop_condition();
+    codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
+    codegen_generate_end_labels_for_logical_expression(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
+    asm_push_ins_push(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  }
+}
+
+void codegen_generate_exp_node_for_arithmetic(struct node* node, struct history* history)
+{
+  assert(node->type == NODE_TYPE_EXPRESSION);
+  int flags = history->flags;
+
+  if (is_logical_operator(node->exp.op))
+  {
+    codegen_generate_exp_node_for_logical_arithmetic(node, history);
+    return;
+  }
+
+  struct node* left_node = node->exp.left;
+  struct node* right_node = node->exp.right;
+  int op_flags = codegen_set_flag_for_operator(node->exp.op);
+  codegen_generate_expressionable(left_node, history_down(history, flags));
+  codegen_generate_expressionable(right_node, history_down(history, flags));
+  struct datatype floating_dtype;
+  if (codegen_can_gen_math(op_flags) && codegen_floating_operands(&floating_dtype))
+  {
+    codegen_gen_floating_math(node->exp.op, op_flags, &floating_dtype);
+    return;
+  }
+
+  struct datatype last_dtype = datatype_for_numeric();
+  asm_datatype_back(&last_dtype);
+  if (codegen_can_gen_math(op_flags))
+  {
+    struct datatype right_dtype = datatype_for_numeric();
+    asm_datatype_back(&right_dtype);
+    asm_push_ins_pop(asm_reg(REGISTER_ECX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    if (last_dtype.flags & DATATYPE_FLAG_IS_LITERAL)
+    {
+      asm_datatype_back(&last_dtype);
+    }
+
+    struct datatype left_dtype = datatype_for_numeric();
+    asm_datatype_back(&left_dtype);
+    asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    struct datatype* pointer_datatype = datatype_thats_a_pointer(&left_dtype, &right_dtype);
+    if (pointer_datatype && datatype_size(datatype_pointer_reduce(pointer_datatype, 1)) > DATA_SIZE_BYTE)
+    {
+      int reg = REGISTER_ECX;
+      if (pointer_datatype == &right_dtype)
+      {
+        reg = REGISTER_EAX;
+      }
+      codegen_gen_multiply_by_constant(reg, datatype_size(datatype_pointer_reduce(pointer_datatype, 1)));
+    }
+
+    bool is_signed = last_dtype.flags & DATATYPE_FLAG_IS_SIGNED;
+    int constant = 0;
+    bool generated = false;
+    bool can_reduce = !pointer_datatype && !(current_process->flags & COMPILE_PROCESS_NO_OPTIMIZE);
+    if (can_reduce && codegen_node_int_value(right_node, &constant))
+    {
+      // The constant is still popped into ecx, the peephole pass removes the unused load
+      generated = codegen_gen_math_for_constant(constant, op_flags, is_signed);
+    }
+    else if (can_reduce && op_flags & EXPRESSION_IS_MULTIPLICATION && codegen_node_int_value(left_node, &constant))
+    {
+      asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+      codegen_gen_multiply_by_constant(REGISTER_EAX, constant);
+      generated = true;
+    }
+
+    if (!generated)
+    {
+      codegen_gen_math_for_value(REGISTER_EAX, REGISTER_ECX, op_flags, is_signed);
+    }
+  }
+
+  asm_push_ins_push_with_data(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=last_dtype});
+}
+
+bool codegen_is_compare_flag(int op_flags)
+{
+  return op_flags & (EXPRESSION_IS_ABOVE | EXPRESSION_IS_BELOW | EXPRESSION_IS_EQUAL | EXPRESSION_IS_ABOVE_OR_EQUAL | EXPRESSION_IS_BELOW_OR_EQUAL | EXPRESSION_IS_NOT_EQUAL);
+}
+
+int codegen_invert_compare_flag(int op_flags)
+{
+  switch (op_flags)
+  {
+    case EXPRESSION_IS_ABOVE: return EXPRESSION_IS_BELOW_OR_EQUAL;
+    case EXPRESSION_IS_BELOW: return EXPRESSION_IS_ABOVE_OR_EQUAL;
+    case EXPRESSION_IS_ABOVE_OR_EQUAL: return EXPRESSION_IS_BELOW;
+    case EXPRESSION_IS_BELOW_OR_EQUAL: return EXPRESSION_IS_ABOVE;
+    case EXPRESSION_IS_EQUAL: return EXPRESSION_IS_NOT_EQUAL;
+    case EXPRESSION_IS_NOT_EQUAL: return EXPRESSION_IS_EQUAL;
+  }
+
+  return op_flags;
+}
+
+/**
+ * @brief Returns the jump taken after "cmp left, right" when "left op right" holds.
+ * Unsigned values use the above and below jumps.
+ */
+int codegen_jump_for_compare(int op_flags, bool is_signed)
+{
+  switch (op_flags)
+  {
+    case EXPRESSION_IS_ABOVE: return is_signed ? INSTRUCTION_OPCODE_JG : INSTRUCTION_OPCODE_JA;
+    case EXPRESSION_IS_BELOW: return is_signed ? INSTRUCTION_OPCODE_JL : INSTRUCTION_OPCODE_JB;
+    case EXPRESSION_IS_ABOVE_OR_EQUAL: return is_signed ? INSTRUCTION_OPCODE_JGE : INSTRUCTION_OPCODE_JAE;
+    case EXPRESSION_IS_BELOW_OR_EQUAL: return is_signed ? INSTRUCTION_OPCODE_JLE : INSTRUCTION_OPCODE_JBE;
+    case EXPRESSION_IS_EQUAL: return INSTRUCTION_OPCODE_JE;
+    case EXPRESSION_IS_NOT_EQUAL: return INSTRUCTION_OPCODE_JNE;
+  }
+
+  compiler_error(current_process, "COMPILER BUG: no jump for the compare");
+  return -1;
+}
+
+void codegen_generate_branch(struct node* node, const char* label, bool jump_if_true);
+
+void codegen_generate_compare_branch(struct node* node, int op_flags, const char* label, bool jump_if_true)
+{
+  codegen_generate_expressionable(node->exp.left, history_begin(0));
+  codegen_generate_expressionable(node->exp.right, history_begin(0));
+  struct datatype floating_dtype;
+  if (codegen_floating_operands(&floating_dtype))
+  {
+    codegen_pop_floating("xmm1", &floating_dtype);
+    codegen_pop_floating("xmm0", &floating_dtype);
+    codegen_gen_floating_compare_jump(op_flags, &floating_dtype, label, jump_if_true);
+    return;
+  }
+
+  struct datatype last_dtype = datatype_for_numeric();
+  asm_datatype_back(&last_dtype);
+  asm_push_ins_pop(asm_reg(REGISTER_ECX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  if (last_dtype.flags & DATATYPE_FLAG_IS_LITERAL)
+  {
+    asm_datatype_back(&last_dtype);
+  }
+  asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+
+  if (!jump_if_true)
+  {
+    op_flags = codegen_invert_compare_flag(op_flags);
+  }
+  asm_ins1(codegen_jump_for_compare(op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED), asm_label(label));
+}
+
+void codegen_generate_logical_branch(struct node* node, const char* label, bool jump_if_true)
+{
+  // a && b can jump when false as soon as either side is false, a || b can jump when true as soon as either side is true
+  bool is_and = S_EQ(node->exp.op, "&&");
+  if (is_and != jump_if_true)
+  {
+    codegen_generate_branch(node->exp.left, label, jump_if_true);
+    codegen_generate_branch(node->exp.right, label, jump_if_true);
+    return;
+  }
+
+  // Otherwise the left side decides whether the right side is needed at all
+  char skip_label[20];
+  sprintf(skip_label, ".cond_%i", codegen_label_count());
+  codegen_generate_branch(node->exp.left, skip_label, !jump_if_true);
+  codegen_generate_branch(node->exp.right, label, jump_if_true);
+  asm_push("%s:", skip_label);
+}
+
+/**
+ * @brief Generates a condition that is only used to branch, i.e the condition of an if statement.
+ * Jumps to the label when the condition is jump_if_true and falls through otherwise,
+ * comparisons jump straight off the flags rather than making a 0 or 1 first.
+ */
+void codegen_generate_branch(struct node* node, const char* label, bool jump_if_true)
+{
+  switch (node->type)
+  {
+    case NODE_TYPE_NUMBER:
+      if ((node_is_floating_number(node) ? node->dnum != 0 : node->llnum != 0) == jump_if_true)
+      {
+        asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(label));
+      }
+      return;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+      codegen_generate_branch(node->parenthesis.exp, label, jump_if_true);
+      return;
+
+    case NODE_TYPE_UNARY:
+      if (S_EQ(node->unary.op, "!"))
+      {
+        codegen_generate_branch(node->unary.operand, label, !jump_if_true);
+        return;
+      }
+    break;
+
+    case NODE_TYPE_EXPRESSION:
+      if (is_logical_operator(node->exp.op))
+      {
+        codegen_generate_logical_branch(node, label, jump_if_true);
+        return;
+      }
+
+      if (codegen_is_compare_flag(codegen_set_flag_for_operator(node->exp.op)))
+      {
+        codegen_generate_compare_branch(node, codegen_set_flag_for_operator(node->exp.op), label, jump_if_true);
+        return;
+      }
+    break;
+  }
+
+  // Anything else is true when it is not zero
+  codegen_generate_expressionable(node, history_begin(0));
+  struct datatype dtype;
+  if (asm_datatype_back(&dtype) && datatype_is_floating(&dtype))
+  {
+    codegen_pop_floating("xmm0", &dtype);
+    asm_push("xorps xmm1, xmm1");
+    codegen_gen_floating_compare_jump(EXPRESSION_IS_NOT_EQUAL, &dtype, label, jump_if_true);
+    return;
+  }
+
+  asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_imm(0));
+  asm_ins1(jump_if_true ? INSTRUCTION_OPCODE_JNE : INSTRUCTION_OPCODE_JE, asm_label(label));
+}
+
+int codegen_remove_uninheritable_flags(int flags)
+{
+  return flags & ~EXPRESSION_UNINHERITABLE_FLAGS;
+}
+
+void codegen_generate_exp_node(struct node* node, struct history* history)
+{
+  if (is_node_assignment(node))
+  {
+    codegen_generate_assignment_expression(node, history);
+    return;
+  }
+
+  // Can we locate a variable for a given expression?
+  if (codegen_resolve_node_for_value(node, history))
+  {
+    return;
+  }
+
+  int additional_flags = get_additional_flags(history->flags, node);
+  codegen_generate_exp_node_for_arithmetic(node, history_down(history, codegen_remove_uninheritable_flags(history->flags) | additional_flags));
+}
+
+void codegen_discard_unused_stack()
+{
+  asm_stack_peek_start();
+
+  struct stack_frame_element* element = asm_stack_peek();
+  size_t stack_adjustement = 0;
+  while (element)
+  {
+    if (!S_EQ(element->name, "result_value"))
+    {
+      break;
+    }
+
+    stack_adjustement += target_current()->stack_slot_size;
+    element = asm_stack_peek();
+  }
+
+  codegen_stack_add(stack_adjustement);
+}
+
+void codegen_generate_structure_push(struct resolver_entity* entity, struct history* history, int start_pos)
+{
+  struct code_generator* generator = current_process->generator;
+  int start = vector_count(generator->instructions->instructions);
+  asm_push("; STRUCTURE PUSH");
+  size_t structure_size = align_value(entity->dtype.size, DATA_SIZE_DWORD);
+  int pushes = structure_size / DATA_SIZE_DWORD;
+  if (pushes - start_pos > STRUCTURE_COPY_UNROLL_LIMIT)
+  {
+    // Make the room then copy the structure in, the stack ends up as if every dword was pushed
+    codegen_stack_sub_pushed_values(pushes - start_pos, &entity->dtype);
+    codegen_generate_block_copy(asm_mem(0, REGISTER_EBX, start_pos * DATA_SIZE_DWORD), asm_mem(0, REGISTER_ESP, 12), pushes - start_pos);
+    asm_push("; END STRUCTURE PUSH");
+    if (start_pos == 0)
+    {
+      generator->struct_push_start = start;
+      generator->struct_push_end = vector_count(generator->instructions->instructions);
+      generator->struct_push_dwords = pushes;
+    }
+    codegen_response_acknowledged(RESPONSE_SET(.flags=RESPONSE_FLAG_PUSHED_STRUCTURE));
+    return;
+  }
 
-    default:
-      compiler_error(current_process, "COMPILER BUG...");
+  for (int i = pushes-1; i >= start_pos; i--)
+  {
+    asm_push_ins_push_with_data(asm_mem(DATA_SIZE_DWORD, REGISTER_EBX, i * DATA_SIZE_DWORD), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype});
   }
+  asm_push("; END STRUCTURE PUSH");
+  codegen_response_acknowledged(RESPONSE_SET(.flags=RESPONSE_FLAG_PUSHED_STRUCTURE));
 }
 
-void codegen_generate_entity_access(struct resolver_result* result, struct resolver_entity* root_assignment_entity, struct node* top_most_node, struct history* history)
+void codegen_generate_body(struct node* node, struct history* history);
+
+void codegen_generate_else_stmt(struct node* node)
 {
-  codegen_generate_entity_access_start(result, root_assignment_entity, history);
-  struct resolver_entity* current = resolver_result_entity_next(root_assignment_entity);
-  while (current)
-  {
-    codegen_generate_entity_access_fot_entity(result, current, history);
-    current = resolver_result_entity_next(current);
-  }
+  codegen_generate_body(node->stmt.else_stmt.body_node, history_begin(IS_ALONE_STATEMENT));
 }
 
-bool codegen_resolver_node_return_result(struct node* node, struct history* history, struct resolver_result** result_out)
+/**
+ * @brief Returns true if the body is nothing but a break or continue, writing the label it jumps to.
+ * "if (x) break;" then becomes a single branch rather than a branch over a jump
+ */
+bool codegen_body_jump_target(struct node* body_node, char* label_out)
 {
-  struct resolver_result* result = resolver_follow(current_process->resolver, node);
-  if (resolver_result_ok(result))
+  struct node* statement = body_node;
+  if (body_node->type == NODE_TYPE_BODY)
   {
-    struct resolver_entity* root_assignment_entity = resolver_result_entity_root(result);
-    codegen_generate_entity_access(result, root_assignment_entity, node, history);
-    if (result_out)
+    if (vector_count(body_node->body.statements) != 1)
     {
-      *result_out = result;
+      return false;
     }
-    codegen_response_acknowledge(&(struct response){.flags=RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity=result->last_entity});
+    statement = *(struct node**) vector_at(body_node->body.statements, 0);
+  }
+
+  if (statement->type == NODE_TYPE_STATEMENT_BREAK && codegen_current_exit_point())
+  {
+    sprintf(label_out, ".exit_point_%i", codegen_current_exit_point()->id);
+    return true;
+  }
+
+  if (statement->type == NODE_TYPE_STATEMENT_CONTINUE && codegen_current_entry_point())
+  {
+    sprintf(label_out, ".entry_point_%i", codegen_current_entry_point()->id);
     return true;
   }
 
   return false;
 }
 
-bool codegen_resolve_node_for_value(struct node* node, struct history* history)
+void codegen_generate_if_stmt(struct node* node, int end_label_id)
 {
-  struct resolver_result* result = NULL;
-  if (!codegen_resolver_node_return_result(node, history, &result))
+  char jump_label[20];
+  if (!node->stmt.if_stmt.next && codegen_body_jump_target(node->stmt.if_stmt.body_node, jump_label))
   {
-    return false;
+    codegen_generate_branch(node->stmt.if_stmt.cond_node, jump_label, true);
+    return;
   }
 
-  struct datatype dtype;
-  assert(asm_datatype_back(&dtype));
-  if (datatype_is_struct_or_union_non_pointer(&dtype))
+  int if_label_id = codegen_label_count();
+  char false_label[20];
+  sprintf(false_label, ".if_%i", if_label_id);
+  codegen_generate_branch(node->stmt.if_stmt.cond_node, false_label, false);
+  codegen_generate_body(node->stmt.if_stmt.body_node, history_begin(IS_ALONE_STATEMENT));
+
+  struct node* next = node->stmt.if_stmt.next;
+  if (next)
   {
-    codegen_generate_structure_push(result->last_entity, history, 0);
+    asm_jump(INSTRUCTION_OPCODE_JMP, ".if_end_%i", end_label_id);
   }
-  else if (!(dtype.flags & DATATYPE_FLAG_IS_POINTER))
+  asm_push("%s:", false_label);
+
+  if (!next)
   {
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    if (result->flags & RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE)
-    {
-      asm_push("mov eax, [eax]");
-    }
+    return;
+  }
 
-    codegen_reduce_register("eax", datatype_element_size(&dtype), dtype.flags & DATATYPE_FLAG_IS_SIGNED);
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=dtype});
+  if (next->type == NODE_TYPE_STATEMENT_IF)
+  {
+    codegen_generate_if_stmt(next, end_label_id);
+  }
+  else
+  {
+    codegen_generate_else_stmt(next);
   }
+}
 
-  return true;
+void codegen_generate_if_stmt_root(struct node* node)
+{
+  int end_label_id = codegen_label_count();
+  codegen_generate_if_stmt(node, end_label_id);
+  asm_push(".if_end_%i:", end_label_id);
 }
 
-int get_additional_flags(int current_flags, struct node* node)
+/**
+ * @brief Loops are rotated so the condition is tested once on the way in and then at the bottom,
+ * each iteration only takes the one branch back to the top
+ */
+void codegen_generate_loop(struct node* init_node, struct node* cond_node, struct node* loop_node, struct node* body_node, bool test_first)
 {
-  if (node->type != NODE_TYPE_EXPRESSION)
+  if (init_node)
   {
-    return 0;
+    codegen_generate_statement(init_node, history_begin(0));
   }
 
-  int additional_flags = 0;
-  bool maintain_function_call_argument_flag = (current_flags & EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS) && S_EQ(node->exp.op, ",");
-  if (maintain_function_call_argument_flag)
+  codegen_begin_exit_point();
+  char exit_label[20];
+  sprintf(exit_label, ".exit_point_%i", codegen_current_exit_point()->id);
+  if (test_first && cond_node)
   {
-    additional_flags |= EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS;
+    codegen_generate_branch(cond_node, exit_label, false);
   }
-  return additional_flags;
-}
 
-int codegen_set_flag_for_operator(const char* op)
-{
-  int flag = 0;
-  if (S_EQ(op, "+"))
+  char loop_label[20];
+  sprintf(loop_label, ".loop_%i", codegen_label_count());
+  asm_push("align %i", LOOP_HEAD_ALIGNMENT);
+  asm_push("%s:", loop_label);
+
+  // Continue lands on the step and condition at the bottom of the loop
+  int entry_point_id = codegen_label_count();
+  codegen_register_entry_point(entry_point_id);
+  codegen_generate_body(body_node, history_begin(IS_ALONE_STATEMENT));
+  asm_push(".entry_point_%i:", entry_point_id);
+  if (loop_node)
   {
-    flag |= EXPRESSION_IS_ADDITION;
+    codegen_generate_statement(loop_node, history_begin(0));
   }
-  else if (S_EQ(op, "-"))
+
+  if (cond_node)
   {
-    flag |= EXPRESSION_IS_SUBSTRACTION;
+    codegen_generate_branch(cond_node, loop_label, true);
   }
-  else if (S_EQ(op, "*"))
+  else
   {
-    flag |= EXPRESSION_IS_MULTIPLICATION;
+    asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(loop_label));
   }
-  else if (S_EQ(op, "/"))
+
+  codegen_end_entry_point();
+  codegen_end_exit_point();
+}
+
+void codegen_generate_while_stmt(struct node* node)
+{
+  codegen_generate_loop(NULL, node->stmt.while_stmt.exp_node, NULL, node->stmt.while_stmt.body_node, true);
+}
+
+void codegen_generate_do_while_stmt(struct node* node)
+{
+  codegen_generate_loop(NULL, node->stmt.do_while_stmt.exp_node, NULL, node->stmt.do_while_stmt.body_node, false);
+}
+
+/**
+ * A loop of the form for (i = x; i < n; i = i + 1) a[i] = b[i] op c[i]; over int or float
+ * arrays, either operand may be a number instead
+ */
+struct codegen_vector_loop
+{
+  struct resolver_entity* counter;
+  // The variable the counter runs up to, NULL when it is the number in limit_node
+  struct resolver_entity* limit;
+  struct node* limit_node;
+  struct resolver_entity* destination;
+  // The arrays read from, NULL when the operand is the number in operand_nodes
+  struct resolver_entity* sources[2];
+  struct node* operand_nodes[2];
+  const char* instruction;
+  struct datatype element_dtype;
+};
+
+/**
+ * @brief Returns the variable the node names, NULL if it is not an identifier of a variable
+ */
+struct resolver_entity* codegen_vectorize_variable(struct node* node)
+{
+  if (node->type != NODE_TYPE_IDENTIFIER)
   {
-    flag |= EXPRESSION_IS_DIVISION;
+    return NULL;
   }
-  else if (S_EQ(op, "%"))
+
+  struct resolver_result* result = resolver_follow(current_process->resolver, node);
+  if (!resolver_result_ok(result))
   {
-    flag |= EXPRESSION_IS_MODULAS;
+    return NULL;
   }
-  else if (S_EQ(op, ">"))
+
+  struct resolver_entity* entity = resolver_result_entity(result);
+  return entity->type == RESOLVER_ENTITY_TYPE_VARIABLE ? entity : NULL;
+}
+
+bool codegen_vectorize_is_int_variable(struct resolver_entity* entity)
+{
+  return entity && entity->dtype.type == DATA_TYPE_INTEGER && !(entity->dtype.flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY));
+}
+
+bool codegen_vectorize_is_local(struct resolver_entity* entity)
+{
+  return S_EQ(codegen_entity_private(entity)->base_address, "ebp");
+}
+
+/**
+ * @brief Returns the array or pointer of an element access the form of name[counter], NULL for anything else
+ */
+struct resolver_entity* codegen_vectorize_element(struct node* node, struct node* counter_node)
+{
+  if (!is_array_node(node) || node->exp.right->type != NODE_TYPE_BRACKET)
   {
-    flag |= EXPRESSION_IS_ABOVE;
+    return NULL;
   }
-  else if (S_EQ(op, "<"))
+
+  struct node* index_node = node->exp.right->bracket.inner;
+  if (index_node->type != NODE_TYPE_IDENTIFIER || !S_EQ(index_node->sval, counter_node->sval))
   {
-    flag |= EXPRESSION_IS_BELOW;
+    return NULL;
   }
-  else if (S_EQ(op, ">="))
+
+  struct resolver_entity* entity = codegen_vectorize_variable(node->exp.left);
+  if (!entity)
   {
-    flag |= EXPRESSION_IS_ABOVE_OR_EQUAL;
+    return NULL;
   }
-  else if (S_EQ(op, "<="))
+
+  struct datatype* dtype = &entity->dtype;
+  bool is_array = dtype->flags & DATATYPE_FLAG_IS_ARRAY && !(dtype->flags & DATATYPE_FLAG_IS_POINTER) && array_brackets_count(dtype) == 1;
+  bool is_pointer = dtype->flags & DATATYPE_FLAG_IS_POINTER && !(dtype->flags & DATATYPE_FLAG_IS_ARRAY) && dtype->pointer_depth == 1;
+  if (!is_array && !is_pointer)
   {
-    flag |= EXPRESSION_IS_BELOW_OR_EQUAL;
+    return NULL;
   }
-  else if (S_EQ(op, "!="))
+
+  return dtype->type == DATA_TYPE_INTEGER || dtype->type == DATA_TYPE_FLOAT ? entity : NULL;
+}
+
+/**
+ * @brief The SSE2 instruction for the operator on four elements of the type, NULL if there is none
+ */
+const char* codegen_vectorize_instruction(const char* op, int type)
+{
+  if (type == DATA_TYPE_FLOAT)
   {
-    flag |= EXPRESSION_IS_NOT_EQUAL;
+    return S_EQ(op, "+") ? "addps" : S_EQ(op, "-") ? "subps" : S_EQ(op, "*") ? "mulps" : S_EQ(op, "/") ? "divps" : NULL;
   }
-  else if (S_EQ(op, "=="))
+
+  // There is no dword multiply until SSE4.1
+  return S_EQ(op, "+") ? "paddd" : S_EQ(op, "-") ? "psubd" : S_EQ(op, "&") ? "pand" : S_EQ(op, "|") ? "por" : S_EQ(op, "^") ? "pxor" : NULL;
+}
+
+bool codegen_vectorize_is_increment(struct node* node, struct node* counter_node)
+{
+  struct node* one_node = NULL;
+  if (node_is_expression(node, "+="))
   {
-    flag |= EXPRESSION_IS_EQUAL;
+    one_node = node->exp.right;
   }
-  else if (S_EQ(op, "&&"))
+  else if (node_is_expression(node, "=") && node_is_expression(node->exp.right, "+") &&
+    node->exp.right->exp.left->type == NODE_TYPE_IDENTIFIER && S_EQ(node->exp.right->exp.left->sval, counter_node->sval))
   {
-    flag |= EXPRESSION_LOGICAL_AND;
+    one_node = node->exp.right->exp.right;
   }
-  else if (S_EQ(op, "||"))
+
+  return one_node && node->exp.left->type == NODE_TYPE_IDENTIFIER && S_EQ(node->exp.left->sval, counter_node->sval) &&
+    one_node->type == NODE_TYPE_NUMBER && !node_is_floating_number(one_node) && one_node->llnum == 1;
+}
+
+bool codegen_vectorize_match(struct for_stmt* for_stmt, struct codegen_vector_loop* loop)
+{
+  struct node* cond_node = for_stmt->cond_node;
+  struct node* body_node = for_stmt->body_node;
+  if (!cond_node || !for_stmt->loop_node || !body_node || !node_is_expression(cond_node, "<") ||
+    body_node->type != NODE_TYPE_BODY || vector_count(body_node->body.statements) != 1)
   {
-    flag |= EXPRESSION_LOGICAL_OR;
+    return false;
   }
-  else if (S_EQ(op, "<<"))
+
+  struct node* counter_node = cond_node->exp.left;
+  loop->counter = codegen_vectorize_variable(counter_node);
+  if (!codegen_vectorize_is_int_variable(loop->counter) || !codegen_vectorize_is_increment(for_stmt->loop_node, counter_node))
   {
-    flag |= EXPRESSION_IS_BITSHIFT_LEFT;
+    return false;
   }
-  else if (S_EQ(op, ">>"))
+
+  loop->limit_node = cond_node->exp.right;
+  if (loop->limit_node->type == NODE_TYPE_NUMBER)
   {
-    flag |= EXPRESSION_IS_BITSHIFT_RIGHT;
+    loop->limit = NULL;
+    if (node_is_floating_number(loop->limit_node))
+    {
+      return false;
+    }
   }
-  else if (S_EQ(op, "&"))
+  else
   {
-    flag |= EXPRESSION_IS_BITWISE_AND;
+    loop->limit = codegen_vectorize_variable(loop->limit_node);
+    if (!codegen_vectorize_is_int_variable(loop->limit) || S_EQ(loop->limit_node->sval, counter_node->sval))
+    {
+      return false;
+    }
   }
-  else if (S_EQ(op, "|"))
+
+  struct node* stmt = *(struct node**) vector_at(body_node->body.statements, 0);
+  if (!node_is_expression(stmt, "=") || stmt->exp.right->type != NODE_TYPE_EXPRESSION)
   {
-    flag |= EXPRESSION_IS_BITWISE_OR;
+    return false;
   }
-  else if (S_EQ(op, "^"))
+
+  loop->destination = codegen_vectorize_element(stmt->exp.left, counter_node);
+  if (!loop->destination)
   {
-    flag |= EXPRESSION_IS_BITWISE_XOR;
+    return false;
   }
-  return flag;
-}
 
-struct stack_frame_element* asm_stack_back()
-{
-  return stackframe_back(current_function);
-}
+  loop->element_dtype = loop->destination->dtype;
+  int type = loop->element_dtype.type;
+  loop->instruction = codegen_vectorize_instruction(stmt->exp.right->exp.op, type);
+  if (!loop->instruction)
+  {
+    return false;
+  }
 
-struct stack_frame_element* asm_stack_peek()
-{
-  return stackframe_peek(current_function);
-}
+  bool uses_pointers = loop->destination->dtype.flags & DATATYPE_FLAG_IS_POINTER;
+  loop->operand_nodes[0] = stmt->exp.right->exp.left;
+  loop->operand_nodes[1] = stmt->exp.right->exp.right;
+  for (int i = 0; i < 2; i++)
+  {
+    struct node* operand_node = loop->operand_nodes[i];
+    loop->sources[i] = NULL;
+    if (operand_node->type == NODE_TYPE_NUMBER)
+    {
+      if (type == DATA_TYPE_INTEGER && node_is_floating_number(operand_node))
+      {
+        return false;
+      }
+      continue;
+    }
 
-void asm_stack_peek_start()
-{
-  stackframe_peek_start(current_function);
-}
+    loop->sources[i] = codegen_vectorize_element(operand_node, counter_node);
+    if (!loop->sources[i] || loop->sources[i]->dtype.type != type)
+    {
+      return false;
+    }
+    uses_pointers |= loop->sources[i]->dtype.flags & DATATYPE_FLAG_IS_POINTER;
+  }
 
-bool asm_datatype_back(struct datatype* dtype_out)
-{
-  struct stack_frame_element* last_stack_frame_element = asm_stack_back();
-  if (!last_stack_frame_element)
+  if (!loop->sources[0] && !loop->sources[1])
   {
     return false;
   }
 
-  if (!(last_stack_frame_element->flags & STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE))
+  // Stores through a pointer could change a global counter or limit
+  if (uses_pointers && (!codegen_vectorize_is_local(loop->counter) || (loop->limit && !codegen_vectorize_is_local(loop->limit))))
   {
     return false;
   }
 
-  *dtype_out = last_stack_frame_element->data.dtype;
   return true;
 }
 
-bool codegen_can_gen_math(int flags)
+void codegen_vectorize_load_base(int reg, struct resolver_entity* entity)
 {
-  return flags & EXPRESSION_GEN_MATHABLE;
+  int opcode = entity->dtype.flags & DATATYPE_FLAG_IS_POINTER ? INSTRUCTION_OPCODE_MOV : INSTRUCTION_OPCODE_LEA;
+  asm_ins2(opcode, asm_reg(reg), asm_entity_mem(0, entity, 0));
 }
 
-void codegen_gen_cmp(const char* value, const char* set_ins)
+/**
+ * @brief Only a source that is ahead of the destination by less than the lanes reads what the scalar loop
+ * would have written first. Distinct arrays never overlap and restrict promises pointers don't
+ */
+bool codegen_vectorize_needs_alias_check(struct resolver_entity* destination, struct resolver_entity* source)
 {
-  asm_push("cmp eax, %s", value);
-  asm_push("%s al", set_ins);
-  asm_push("movzx eax, al");
+  if (!source || S_EQ(codegen_entity_private(destination)->address, codegen_entity_private(source)->address))
+  {
+    return false;
+  }
+
+  int pointer_flags = (destination->dtype.flags | source->dtype.flags) & DATATYPE_FLAG_IS_POINTER;
+  int restrict_flags = (destination->dtype.flags | source->dtype.flags) & DATATYPE_FLAG_IS_RESTRICT;
+  return pointer_flags && !restrict_flags;
 }
 
-void codegen_gen_math_for_value(const char* reg, const char* value, int flags, bool is_signed)
+/**
+ * @brief Runs the loop four elements at a time with SSE2 while four elements are left, the scalar loop
+ * generated after it does the rest. The destination is in edx and the sources in esi and edi, numbers
+ * are spread across xmm2 and xmm3 once before the loop
+ */
+void codegen_generate_vector_loop(struct codegen_vector_loop* loop)
 {
-  if (flags & EXPRESSION_IS_ADDITION)
-  {
-    asm_push("add %s, %s", reg, value);
-  }
-  else if (flags & EXPRESSION_IS_SUBSTRACTION)
-  {
-    asm_push("sub %s, %s", reg, value);
-  }
-  else if (flags & EXPRESSION_IS_MULTIPLICATION)
+  static const int source_registers[] = {REGISTER_ESI, REGISTER_EDI};
+  bool is_float = loop->element_dtype.type == DATA_TYPE_FLOAT;
+  const char* move = is_float ? "movups" : "movdqu";
+  char end_label[20];
+  sprintf(end_label, ".vector_end_%i", codegen_label_count());
+
+  // esi and edi belong to our caller
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, asm_reg(REGISTER_ESI));
+  asm_ins1(INSTRUCTION_OPCODE_PUSH, asm_reg(REGISTER_EDI));
+  codegen_vectorize_load_base(REGISTER_EDX, loop->destination);
+  for (int i = 0; i < 2; i++)
   {
-    asm_push("mov ecx, %s", value);
-    if (is_signed)
+    if (loop->sources[i])
     {
-      asm_push("imul ecx");
+      codegen_vectorize_load_base(source_registers[i], loop->sources[i]);
     }
-    else
+
+    if (codegen_vectorize_needs_alias_check(loop->destination, loop->sources[i]))
     {
-      asm_push("mul ecx");
+      asm_ins2(INSTRUCTION_OPCODE_LEA, asm_reg(REGISTER_EBX), asm_mem(0, REGISTER_EDX, -1));
+      asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_EBX), asm_reg(source_registers[i]));
+      asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EBX), asm_imm(VECTOR_LANES * DATA_SIZE_DWORD - 1));
+      asm_ins1(INSTRUCTION_OPCODE_JB, asm_label(end_label));
     }
   }
-  else if (flags & EXPRESSION_IS_DIVISION)
+
+  if (loop->limit)
   {
-    asm_push("mov ecx, %S", value);
-    asm_push("cdq");
-    if (is_signed)
-    {
-      asm_push("idiv ecx");
-    }
-    else
-    {
-      asm_push("div ecx");
-    }
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_entity_mem(0, loop->limit, 0));
   }
-  else if (flags & EXPRESSION_IS_MODULAS)
+  else
   {
-    asm_push("mov ecx, %s", value);
-    asm_push("cdq");
-    if (is_signed)
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_ECX), asm_imm(loop->limit_node->llnum));
+  }
+  asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_ECX), asm_imm(VECTOR_LANES - 1));
+  asm_push("jo %s", end_label);
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EAX), asm_entity_mem(0, loop->counter, 0));
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+  asm_ins1(INSTRUCTION_OPCODE_JGE, asm_label(end_label));
+
+  for (int i = 0; i < 2; i++)
+  {
+    struct node* number_node = loop->operand_nodes[i];
+    if (loop->sources[i])
     {
-      asm_push("idiv ecx");
+      continue;
     }
-    else
+
+    unsigned int bits = (unsigned int) number_node->llnum;
+    if (is_float)
     {
-      asm_push("div ecx");
+      bits = codegen_floating_bits(node_is_floating_number(number_node) ? number_node->dnum : number_node->llnum, &loop->element_dtype);
     }
-
-    asm_push("mov eax, edx");
-  }
-  else if (flags & EXPRESSION_IS_ABOVE)
-  {
-    codegen_gen_cmp(value, "setg");
-  }
-  else if (flags & EXPRESSION_IS_BELOW)
-  {
-    codegen_gen_cmp(value, "setl");
-  }
-  else if (flags & EXPRESSION_IS_EQUAL)
-  {
-    codegen_gen_cmp(value, "sete");
-  }
-  else if (flags & EXPRESSION_IS_ABOVE_OR_EQUAL)
-  {
-    codegen_gen_cmp(value, "setge");
-  }
-  else if (flags & EXPRESSION_IS_BELOW_OR_EQUAL)
-  {
-    codegen_gen_cmp(value, "setle");
+    asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBX), asm_imm(bits));
+    asm_push("movd xmm%i, ebx", i + 2);
+    asm_push("pshufd xmm%i, xmm%i, 0", i + 2, i + 2);
   }
-  else if (flags & EXPRESSION_IS_NOT_EQUAL)
+
+  char loop_label[20];
+  sprintf(loop_label, ".vector_loop_%i", codegen_label_count());
+  asm_push("align %i", LOOP_HEAD_ALIGNMENT);
+  asm_push("%s:", loop_label);
+  if (loop->sources[0])
   {
-    codegen_gen_cmp(value, "setne");
+    asm_push("%s xmm0, [esi+eax*%i]", move, DATA_SIZE_DWORD);
   }
-  else if (flags & EXPRESSION_IS_BITSHIFT_LEFT)
+  else
   {
-    value = codegen_sub_register(value, DATA_SIZE_BYTE);
-    asm_push("sal %s, %s", reg, value);
+    asm_push("%s xmm0, xmm2", is_float ? "movaps" : "movdqa");
   }
-  else if (flags & EXPRESSION_IS_BITSHIFT_RIGHT)
+
+  if (loop->sources[1])
   {
-    value = codegen_sub_register(value, DATA_SIZE_BYTE);
-    asm_push("sar %s, %s", reg, value);
+    asm_push("%s xmm1, [edi+eax*%i]", move, DATA_SIZE_DWORD);
+    asm_push("%s xmm0, xmm1", loop->instruction);
   }
-  else if (flags & EXPRESSION_IS_BITWISE_AND)
+  else
   {
-    asm_push("and %s, %s", reg, value);
+    asm_push("%s xmm0, xmm3", loop->instruction);
   }
-  else if (flags & EXPRESSION_IS_BITWISE_OR)
+  asm_push("%s [edx+eax*%i], xmm0", move, DATA_SIZE_DWORD);
+  asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_EAX), asm_imm(VECTOR_LANES));
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_reg(REGISTER_ECX));
+  asm_ins1(INSTRUCTION_OPCODE_JL, asm_label(loop_label));
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_entity_mem(DATA_SIZE_DWORD, loop->counter, 0), asm_reg(REGISTER_EAX));
+  asm_push("%s:", end_label);
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_EDI));
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_ESI));
+  current_process->generator->total_vectorized++;
+}
+
+/**
+ * @brief The built in assembler does not know SSE2 packed instructions
+ */
+bool codegen_can_vectorize()
+{
+  return !(current_process->flags & (COMPILE_PROCESS_NO_OPTIMIZE | COMPILE_PROCESS_ASSEMBLE_OBJECT));
+}
+
+void codegen_generate_for_stmt(struct node* node)
+{
+  struct for_stmt* for_stmt = &node->stmt.for_stmt;
+  struct codegen_vector_loop loop = {};
+  if (codegen_can_vectorize() && codegen_vectorize_match(for_stmt, &loop))
   {
-    asm_push("or %s, %s", reg, value);
+    // The vector loop carries on from the counter the loop starts at and leaves the rest to the scalar loop
+    if (for_stmt->init_node)
+    {
+      codegen_generate_statement(for_stmt->init_node, history_begin(0));
+    }
+    codegen_generate_vector_loop(&loop);
+    codegen_generate_loop(NULL, for_stmt->cond_node, for_stmt->loop_node, for_stmt->body_node, true);
+    return;
   }
-  else if (flags & EXPRESSION_IS_BITWISE_XOR)
+
+  codegen_generate_loop(for_stmt->init_node, for_stmt->cond_node, for_stmt->loop_node, for_stmt->body_node, true);
+}
+
+int codegen_current_switch_id()
+{
+  struct vector* switches = current_process->generator->switches;
+  if (vector_count(switches) == 0)
   {
-    asm_push("xor %s, %s", reg, value);
+    compiler_error(current_process, "case and default are only allowed inside a switch statement\n");
   }
+  return *(int*) vector_back(switches);
 }
 
-void codegen_setup_new_logical_expression(struct history* history, struct node* node)
+/**
+ * @brief Returns the case value as the switch compares it, cases are converted to the type of the switch expression
+ */
+long long codegen_switch_case_value(long long value, bool is_signed)
 {
-  int label_index = codegen_label_count();
-  sprintf(history->exp.logical_end_label, ".endc_%i", label_index);
-  sprintf(history->exp.logical_end_label_positive, ".endc_%i_positive", label_index);
-  history->exp.logical_start_op = node->exp.op;
-  history->flags |= EXPRESSION_IN_LOGICAL_EXPRESSION;
+  return is_signed ? (long long)(int) value : (long long)(unsigned int) value;
 }
 
-void codegen_generate_logical_cmp_and(const char* reg, const char* fail_label)
+void codegen_switch_case_label(char* out, int switch_id, long long value)
 {
-  asm_push("cmp %s, 0", reg);
-  asm_push("je %s", fail_label);
+  sprintf(out, ".switch_%i_case_%u", switch_id, (unsigned int) value);
 }
 
-void codegen_generate_logical_cmp_or(const char* reg, const char* equal_label)
+int codegen_compare_case_values(const void* a, const void* b)
 {
-  asm_push("cmp %s, 0", reg);
-  asm_push("jg %s", equal_label);
+  long long left = *(const long long*) a;
+  long long right = *(const long long*) b;
+  return (left > right) - (left < right);
 }
 
-void codegen_generate_logical_cmp(const char* op, const char* fail_label, const char* equal_label)
+/**
+ * @brief Compares against each case in turn, for switches with only a few cases
+ */
+void codegen_generate_switch_linear(int switch_id, long long* values, int low, int high, const char* fallback_label)
 {
-  if (S_EQ(op, "&&"))
+  char case_label[64];
+  for (int i = low; i <= high; i++)
   {
-    codegen_generate_logical_cmp_and("eax", fail_label);
-  }
-  else if (S_EQ(op, "||"))
-  {
-    codegen_generate_logical_cmp_or("eax", equal_label);
+    codegen_switch_case_label(case_label, switch_id, values[i]);
+    asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_imm((int) values[i]));
+    asm_ins1(INSTRUCTION_OPCODE_JE, asm_label(case_label));
   }
+  asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(fallback_label));
 }
 
-void codegen_generate_end_labels_for_logical_expression(const char* op, const char* end_label, const char* end_label_positive)
+/**
+ * @brief Compares against the middle case and splits the rest in half, so a sparse switch
+ * finds its case in log2(n) compares
+ */
+void codegen_generate_switch_search(int switch_id, long long* values, int low, int high, const char* fallback_label, bool is_signed)
 {
-  if (S_EQ(op, "&&"))
+  if (high - low + 1 < SWITCH_LINEAR_CASES)
   {
-    asm_push("; && END CLAUSE");
-    asm_push("mov eax, 1");
-    asm_push("jmp %s", end_label_positive);
-    asm_push("%s:", end_label);
-    asm_push("xor eax, eax");
-    asm_push("%s:", end_label_positive);
+    codegen_generate_switch_linear(switch_id, values, low, high, fallback_label);
+    return;
   }
-  else if (S_EQ(op, "||"))
+
+  int middle = low + (high - low) / 2;
+  char case_label[64];
+  char upper_label[64];
+  codegen_switch_case_label(case_label, switch_id, values[middle]);
+  sprintf(upper_label, ".switch_%i_above_%i", switch_id, middle);
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_imm((int) values[middle]));
+  asm_ins1(INSTRUCTION_OPCODE_JE, asm_label(case_label));
+  asm_ins1(is_signed ? INSTRUCTION_OPCODE_JG : INSTRUCTION_OPCODE_JA, asm_label(upper_label));
+  codegen_generate_switch_search(switch_id, values, low, middle - 1, fallback_label, is_signed);
+  asm_push("%s:", upper_label);
+  codegen_generate_switch_search(switch_id, values, middle + 1, high, fallback_label, is_signed);
+}
+
+/**
+ * @brief Jumps through a table indexed by the value minus the lowest case,
+ * anything outside of the table goes to the fallback label
+ */
+void codegen_generate_switch_table(int switch_id, struct vector* values, const char* fallback_label)
+{
+  long long lowest = *(long long*) vector_at(values, 0);
+  long long highest = *(long long*) vector_back(values);
+  if (lowest != 0)
   {
-    asm_push("; || END CLAUSE"),
-    asm_push("jmp %s", end_label);
-    asm_push("%s:", end_label_positive);
-    asm_push("mov eax, 1");
-    asm_push("%s:", end_label);
+    asm_ins2(INSTRUCTION_OPCODE_SUB, asm_reg(REGISTER_EAX), asm_imm((int) lowest));
   }
+  // Values below the lowest case wrap around to large unsigned numbers
+  asm_ins2(INSTRUCTION_OPCODE_CMP, asm_reg(REGISTER_EAX), asm_imm((unsigned int)(highest - lowest)));
+  asm_ins1(INSTRUCTION_OPCODE_JA, asm_label(fallback_label));
+  char table_label[32];
+  sprintf(table_label, "switch_table_%i", switch_id);
+  asm_ins1(INSTRUCTION_OPCODE_JMP, asm_mem_symbol(0, table_label, REGISTER_EAX, target_current()->pointer_size, 0));
+
+  struct codegen_jump_table* table = calloc(1, sizeof(struct codegen_jump_table));
+  table->id = switch_id;
+  table->function_name = current_process->generator->current_function->func.name;
+  strncpy(table->fallback_label, fallback_label, sizeof(table->fallback_label) - 1);
+  table->values = values;
+  vector_push(current_process->generator->jump_tables, &table);
 }
 
-void codegen_generate_exp_node_for_logical_arithmetic(struct node* node, struct history* history)
+void codegen_generate_switch_stmt(struct node* node)
 {
-  bool start_of_logical_exp = !(history->flags & EXPRESSION_IN_LOGICAL_EXPRESSION);
-  if (start_of_logical_exp)
+  struct code_generator* generator = current_process->generator;
+  codegen_begin_exit_point();
+  int switch_id = codegen_current_exit_point()->id;
+
+  codegen_generate_expressionable(node->stmt.switch_stmt.exp, history_begin(0));
+  struct datatype dtype = datatype_for_numeric();
+  asm_datatype_back(&dtype);
+  bool is_signed = dtype.flags & DATATYPE_FLAG_IS_SIGNED;
+  asm_push_ins_pop(asm_reg(REGISTER_EAX), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+
+  struct vector* cases = node->stmt.switch_stmt.cases;
+  struct vector* values = vector_create(sizeof(long long));
+  for (int i = 0; i < vector_count(cases); i++)
   {
-    codegen_setup_new_logical_expression(history, node);
+    long long value = codegen_switch_case_value(((struct parsed_switch_case*) vector_at(cases, i))->index, is_signed);
+    vector_push(values, &value);
   }
-  codegen_generate_expressionable(node->exp.left, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
-  asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-  codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-  codegen_generate_expressionable(node->exp.right, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
-  if (!is_logical_node(node->exp.right))
+
+  char fallback_label[32];
+  if (node->stmt.switch_stmt.has_default_case)
   {
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value"),
-    codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-    codegen_generate_end_labels_for_logical_expression(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-    asm_push_ins_push("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    sprintf(fallback_label, ".switch_%i_default", switch_id);
+  }
+  else
+  {
+    sprintf(fallback_label, ".exit_point_%i", switch_id);
   }
-}
-
-void codegen_generate_exp_node_for_arithmetic(struct node* node, struct history* history)
-{
-  assert(node->type == NODE_TYPE_EXPRESSION);
-  int flags = history->flags;
 
-  if (is_logical_operator(node->exp.op))
+  int total = vector_count(values);
+  if (total > 0)
   {
-    codegen_generate_exp_node_for_logical_arithmetic(node, history);
-    return;
+    qsort(vector_at(values, 0), total, sizeof(long long), codegen_compare_case_values);
   }
 
-  struct node* left_node = node->exp.left;
-  struct node* right_node = node->exp.right;
-  int op_flags = codegen_set_flag_for_operator(node->exp.op);
-  codegen_generate_expressionable(left_node, history_down(history, flags));
-  codegen_generate_expressionable(right_node, history_down(history, flags));
-  struct datatype last_dtype = datatype_for_numeric();
-  asm_datatype_back(&last_dtype);
-  if (codegen_can_gen_math(op_flags))
+  for (int i = 1; i < total; i++)
   {
-    struct datatype right_dtype = datatype_for_numeric();
-    asm_datatype_back(&right_dtype);
-    asm_push_ins_pop("ecx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    if (last_dtype.flags & DATATYPE_FLAG_IS_LITERAL)
+    if (*(long long*) vector_at(values, i) == *(long long*) vector_at(values, i - 1))
     {
-      asm_datatype_back(&last_dtype);
+      compiler_error(current_process, "Duplicate case value in switch statement\n");
     }
+  }
 
-    struct datatype left_dtype = datatype_for_numeric();
-    asm_datatype_back(&left_dtype);
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    struct datatype* pointer_datatype = datatype_thats_a_pointer(&left_dtype, &right_dtype);
-    if (pointer_datatype && datatype_size(datatype_pointer_reduce(pointer_datatype, 1)) > DATA_SIZE_BYTE)
-    {
-      const char* reg = "ecx";
-      if (pointer_datatype == &right_dtype)
-      {
-        reg = "eax";
-      }
-      asm_push("imul %s, %i", reg, datatype_size(datatype_pointer_reduce(pointer_datatype, 1)));
-    }
-    codegen_gen_math_for_value("eax", "ecx", op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+  if (total == 0)
+  {
+    asm_ins1(INSTRUCTION_OPCODE_JMP, asm_label(fallback_label));
+  }
+  else if (total < SWITCH_LINEAR_CASES)
+  {
+    codegen_generate_switch_linear(switch_id, vector_at(values, 0), 0, total - 1, fallback_label);
+  }
+  else if (*(long long*) vector_back(values) - *(long long*) vector_at(values, 0) < (long long) total * SWITCH_TABLE_DENSITY)
+  {
+    codegen_generate_switch_table(switch_id, values, fallback_label);
+  }
+  else
+  {
+    codegen_generate_switch_search(switch_id, vector_at(values, 0), 0, total - 1, fallback_label, is_signed);
   }
 
-  asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=last_dtype});
+  // Case labels in the body need to know which switch they belong to
+  vector_push(generator->switches, &switch_id);
+  codegen_generate_body(node->stmt.switch_stmt.body, history_begin(IS_ALONE_STATEMENT));
+  vector_pop(generator->switches);
+  codegen_end_exit_point();
 }
 
-int codegen_remove_uninheritable_flags(int flags)
+void codegen_generate_switch_case_stmt(struct node* node)
 {
-  return flags & ~EXPRESSION_UNINHERITABLE_FLAGS;
+  char case_label[64];
+  codegen_switch_case_label(case_label, codegen_current_switch_id(), node->stmt._case.exp->llnum);
+  asm_push("%s:", case_label);
 }
 
-void codegen_generate_exp_node(struct node* node, struct history* history)
+void codegen_generate_switch_default_stmt(struct node* node)
 {
-  if (is_node_assignment(node))
-  {
-    codegen_generate_assignment_expression(node, history);
-    return;
-  }
+  asm_push(".switch_%i_default:", codegen_current_switch_id());
+}
 
-  // Can we locate a variable for a given expression?
-  if (codegen_resolve_node_for_value(node, history))
+void codegen_generate_break_stmt(struct node* node)
+{
+  if (!codegen_current_exit_point())
   {
-    return;
+    compiler_error(current_process, "break is only allowed inside a loop or switch statement\n");
   }
-
-  int additional_flags = get_additional_flags(history->flags, node);
-  codegen_generate_exp_node_for_arithmetic(node, history_down(history, codegen_remove_uninheritable_flags(history->flags) | additional_flags));
+  codegen_goto_exit_point(node);
 }
 
-void codegen_discard_unused_stack()
+void codegen_generate_continue_stmt(struct node* node)
 {
-  asm_stack_peek_start();
-
-  struct stack_frame_element* element = asm_stack_peek();
-  size_t stack_adjustement = 0;
-  while (element)
+  if (!codegen_current_entry_point())
   {
-    if (!S_EQ(element->name, "result_value"))
-    {
-      break;
-    }
-
-    stack_adjustement += DATA_SIZE_DWORD;
-    element = asm_stack_peek();
+    compiler_error(current_process, "continue is only allowed inside a loop\n");
   }
-
-  codegen_stack_add(stack_adjustement);
+  codegen_goto_entry_point(node);
 }
 
-void codegen_plus_or_minus_string_for_value(char* out, int val, size_t len)
+/**
+ * @brief Returns the value in eax, floating values in st0 as cdecl does. The stack is unwound
+ * the way the end of the function does it, what is tracked of the frame is left for the code after us
+ */
+void codegen_generate_return_stmt(struct node* node)
 {
-  memset(out, 0, len);
-  if (val < 0)
-  {
-    sprintf(out, "%i", val);
-  }
-  else
+  struct node* function = current_process->generator->current_function;
+  struct datatype* rtype = &function->func.rtype;
+  struct node* exp = node->stmt.return_stmt.exp;
+  if (exp)
   {
-    sprintf(out, "+%i", val);
+    codegen_generate_expressionable(exp, history_begin(0));
+    if (datatype_is_struct_or_union_non_pointer(rtype))
+    {
+      compiler_error(current_process, "Returning structures and unions is not supported");
+    }
+    else if (datatype_is_floating(rtype))
+    {
+      codegen_convert_top(rtype);
+      asm_push("fld %s [esp]", rtype->type == DATA_TYPE_DOUBLE ? "qword" : "dword");
+      codegen_stack_add_pushed_values(codegen_pushed_slots(rtype));
+    }
+    else
+    {
+      codegen_pop_integer(REGISTER_EAX);
+    }
   }
-}
 
-void codegen_generate_structure_push(struct resolver_entity* entity, struct history* history, int start_pos)
-{
-  asm_push("; STRUCTURE PUSH");
-  size_t structure_size = align_value(entity->dtype.size, DATA_SIZE_DWORD);
-  int pushes = structure_size / DATA_SIZE_DWORD;
-  for (int i = pushes-1; i >= start_pos; i--)
+  // Everything under the saved base pointer
+  size_t frame_size = (vector_count(function->func.frame.elements) - 1) * current_process->target->stack_slot_size;
+  if (frame_size != 0)
   {
-    char fmt[10];
-    int chunk_offset = (i * DATA_SIZE_DWORD);
-    codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
-    asm_push_ins_push_with_data("dword [%s%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype=entity->dtype}, "ebx", fmt);
+    asm_ins2(INSTRUCTION_OPCODE_ADD, asm_reg(REGISTER_ESP), asm_imm(frame_size));
   }
-  asm_push("; END STRUCTURE PUSH");
-  codegen_response_acknowledged(RESPONSE_SET(.flags=RESPONSE_FLAG_PUSHED_STRUCTURE));
+  asm_ins1(INSTRUCTION_OPCODE_POP, asm_reg(REGISTER_EBP));
+  asm_ins0(INSTRUCTION_OPCODE_RET);
 }
 
 void codegen_generate_statement(struct node* node, struct history* history)
@@ -1544,6 +3578,46 @@ void codegen_generate_statement(struct node* node, struct history* history)
     case NODE_TYPE_VARIABLE:
       codegen_generate_scope_variable(node);
     break;
+
+    case NODE_TYPE_STATEMENT_IF:
+      codegen_generate_if_stmt_root(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+      codegen_generate_switch_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_CASE:
+      codegen_generate_switch_case_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_DEFAULT:
+      codegen_generate_switch_default_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_BREAK:
+      codegen_generate_break_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_CONTINUE:
+      codegen_generate_continue_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+      codegen_generate_while_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+      codegen_generate_do_while_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+      codegen_generate_for_stmt(node);
+    break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+      codegen_generate_return_stmt(node);
+    break;
   }
 
   codegen_discard_unused_stack();
@@ -1572,6 +3646,22 @@ void codegen_generate_body(struct node* node, struct history* history)
   codegen_generate_stack_scope(node->body.statements, node->body.size, history);
 }
 
+/**
+ * @brief The room the locals of the function take on the stack below the saved base pointer
+ */
+size_t codegen_function_frame_size(struct node* node)
+{
+  size_t size = function_node_stack_size(node);
+  // A frame only ever reached through esp needs nothing past stack slot alignment
+  int flags = current_process->flags;
+  if (flags & COMPILE_PROCESS_OMIT_FRAME_POINTER && !(flags & COMPILE_PROCESS_NO_OPTIMIZE))
+  {
+    return align_value(size, current_process->target->stack_slot_size);
+  }
+
+  return C_ALIGN(size);
+}
+
 void codegen_generate_function_with_body(struct node* node)
 {
   codegen_register_function(node, 0);
@@ -1579,23 +3669,28 @@ void codegen_generate_function_with_body(struct node* node)
   asm_push("; %s function", node->func.name);
   asm_push("%s:", node->func.name);
 
+  struct vector* instructions = current_process->generator->instructions->instructions;
+  struct regalloc_function function = {.start=vector_count(instructions), .locals=vector_create(sizeof(int))};
+  vector_push(current_process->generator->functions, &function);
   asm_push_ebp();
-  asm_push("mov ebp, esp");
-  codegen_stack_sub(C_ALIGN(function_node_stack_size(node)));
+  asm_ins2(INSTRUCTION_OPCODE_MOV, asm_reg(REGISTER_EBP), asm_reg(REGISTER_ESP));
+  size_t frame_size = codegen_function_frame_size(node);
+  codegen_stack_sub(frame_size);
   codegen_new_scope(RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
   codegen_generate_function_arguments(function_node_argument_vec(node));
 
   codegen_generate_body(node->func.body_n, history_begin(IS_ALONE_STATEMENT));
   codegen_finish_scope();
-  codegen_stack_add(C_ALIGN(function_node_stack_size(node)));
+  codegen_stack_add(frame_size);
   asm_pop_ebp();
-  stackframe_assert_empty(current_function);
-  asm_push("ret");
+  stackframe_assert_empty(current_process->generator->current_function);
+  asm_ins0(INSTRUCTION_OPCODE_RET);
+  ((struct regalloc_function*) vector_back(current_process->generator->functions))->end = vector_count(instructions);
 }
 
 void codegen_generate_function(struct node* node)
 {
-  current_function = node;
+  current_process->generator->current_function = node;
   if (function_node_is_prototype(node))
   {
     codegen_generate_function_prototype(node);
@@ -1645,7 +3740,7 @@ bool codegen_write_string_char_escaped(char c)
 
   if (c_out)
   {
-    asm_push_no_nl("%s, ", c_out);
+    asm_push_no_nl("%s", c_out);
   }
 
   return c_out != NULL;
@@ -1653,41 +3748,220 @@ bool codegen_write_string_char_escaped(char c)
 
 void codegen_write_string(struct string_table_element* element)
 {
-  asm_push_no_nl("%s: db ", element->label);
   size_t len = strlen(element->str);
-  for (int i = 0; i < len; i++)
+  struct string_table_element* label_element = element;
+  for (int i = 0; i <= len; i++)
   {
+    if (label_element && i == len - strlen(label_element->str))
+    {
+      // A shorter string starts here, its label points into our memory
+      if (i > 0)
+      {
+        asm_push("");
+      }
+      asm_push_no_nl("%s: db ", label_element->label);
+      label_element = label_element->suffix;
+    }
+    else
+    {
+      asm_push_no_nl(", ");
+    }
+
+    if (i == len)
+    {
+      asm_push_no_nl("0");
+      break;
+    }
+
     char c = element->str[i];
     bool handled = codegen_write_string_char_escaped(c);
     if (handled)
     {
       continue;
     }
-    asm_push_no_nl("'%c', ", c);
+    asm_push_no_nl("'%c'", c);
   }
 
-  asm_push_no_nl("0");
   asm_push("");
 }
 
+int codegen_compare_string_ends(const void* a, const void* b)
+{
+  const char* left = (*(struct string_table_element**) a)->str;
+  const char* right = (*(struct string_table_element**) b)->str;
+  size_t left_len = strlen(left);
+  size_t right_len = strlen(right);
+  while (left_len > 0 && right_len > 0)
+  {
+    left_len--;
+    right_len--;
+    if (left[left_len] != right[right_len])
+    {
+      return (unsigned char) left[left_len] - (unsigned char) right[right_len];
+    }
+  }
+
+  // The shorter string ends the longer one, it goes first
+  return (left_len > 0) - (right_len > 0);
+}
+
+bool codegen_string_ends_with(const char* str, const char* suffix)
+{
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  return suffix_len <= len && S_EQ(str + len - suffix_len, suffix);
+}
+
+/**
+ * @brief Writes strings that end another string as part of it, i.e "world" is stored inside "Hello world".
+ * Sorted by their reversed text every string comes right before the strings that end with it.
+ */
+void codegen_merge_string_suffixes()
+{
+  struct vector* string_table = current_process->generator->string_table;
+  int total = vector_count(string_table);
+  if (total == 0)
+  {
+    return;
+  }
+
+  struct string_table_element** sorted = calloc(total, sizeof(struct string_table_element*));
+  memcpy(sorted, vector_at(string_table, 0), total * sizeof(struct string_table_element*));
+  qsort(sorted, total, sizeof(struct string_table_element*), codegen_compare_string_ends);
+
+  // Walk from the longest down, each string either ends the one that owns the memory or starts a new one
+  struct string_table_element* owner = sorted[total - 1];
+  struct string_table_element* last = owner;
+  for (int i = total - 2; i >= 0; i--)
+  {
+    if (!codegen_string_ends_with(owner->str, sorted[i]->str))
+    {
+      owner = sorted[i];
+      last = owner;
+      continue;
+    }
+
+    sorted[i]->merged = true;
+    last->suffix = sorted[i];
+    last = sorted[i];
+  }
+
+  free(sorted);
+}
+
 void codegen_write_strings()
 {
   struct code_generator* generator = current_process->generator;
+  if (!(current_process->flags & COMPILE_PROCESS_NO_OPTIMIZE))
+  {
+    codegen_merge_string_suffixes();
+  }
+
   vector_set_peek_pointer(generator->string_table, 0);
   struct string_table_element* element = vector_peek_ptr(generator->string_table);
   while (element)
   {
-    codegen_write_string(element);
+    if (!element->merged)
+    {
+      codegen_write_string(element);
+    }
     element = vector_peek_ptr(generator->string_table);
   }
 }
 
+void codegen_write_read_only_variables()
+{
+  struct code_generator* generator = current_process->generator;
+  vector_set_peek_pointer(generator->rodata_variables, 0);
+  struct node* node = vector_peek_ptr(generator->rodata_variables);
+  while (node)
+  {
+    asm_push("; %s %s", node->var.type.type_str, node->var.name);
+    codegen_align_global_variable(node, "align");
+    codegen_write_global_variable_for_primitive(node);
+    node = vector_peek_ptr(generator->rodata_variables);
+  }
+}
+
+void codegen_write_jump_table(struct codegen_jump_table* table)
+{
+  // The case labels are local to the function, from here they need its name in front
+  char case_label[64];
+  char keyword[20];
+  asm_keyword_for_size(target_current()->pointer_size, keyword);
+  asm_push("switch_table_%i:", table->id);
+  long long lowest = *(long long*) vector_at(table->values, 0);
+  long long highest = *(long long*) vector_back(table->values);
+  int index = 0;
+  for (long long value = lowest; value <= highest; value++)
+  {
+    if (value == *(long long*) vector_at(table->values, index))
+    {
+      codegen_switch_case_label(case_label, table->id, value);
+      asm_push("%s %s%s", keyword, table->function_name, case_label);
+      index++;
+      continue;
+    }
+    asm_push("%s %s%s", keyword, table->function_name, table->fallback_label);
+  }
+}
+
+void codegen_write_jump_tables()
+{
+  struct code_generator* generator = current_process->generator;
+  if (vector_count(generator->jump_tables) == 0)
+  {
+    return;
+  }
+
+  asm_push("align %i", target_current()->pointer_size);
+  vector_set_peek_pointer(generator->jump_tables, 0);
+  struct codegen_jump_table* table = vector_peek_ptr(generator->jump_tables);
+  while (table)
+  {
+    codegen_write_jump_table(table);
+    table = vector_peek_ptr(generator->jump_tables);
+  }
+}
+
 void codegen_generate_rod()
 {
   asm_push("section .rodata");
+  codegen_write_jump_tables();
+  codegen_write_read_only_variables();
   codegen_write_strings();
 }
 
+void codegen_flush(struct compile_process* process)
+{
+  struct code_generator* generator = process->generator;
+  instruction_list_print(generator->instructions, generator->emitter);
+  emitter_flush(generator->emitter);
+}
+
+void codegen_optimize(struct compile_process* process)
+{
+  if (process->flags & COMPILE_PROCESS_NO_OPTIMIZE)
+  {
+    return;
+  }
+
+  struct instruction_list* instructions = process->generator->instructions;
+  instructions->total_removed += peephole_optimize(instructions);
+  if (process->flags & COMPILE_PROCESS_ALLOCATE_REGISTERS)
+  {
+    regalloc(process);
+    // Clean up the moves allocation leaves behind
+    instructions->total_removed += peephole_optimize(instructions);
+  }
+
+  // Last, it needs to see every push and pop the other passes leave
+  if (process->flags & COMPILE_PROCESS_OMIT_FRAME_POINTER)
+  {
+    frame_omit(process);
+  }
+}
+
 int codegen(struct compile_process* process)
 {
   current_process = process;
@@ -1701,6 +3975,13 @@ int codegen(struct compile_process* process)
 
   // Generate read only data
   codegen_generate_rod();
+  codegen_optimize(process);
+  if (process->flags & COMPILE_PROCESS_ASSEMBLE_OBJECT)
+  {
+    // Encode before flushing, flushing empties the instruction list
+    process->assembler = assemble(process);
+  }
+  codegen_flush(process);
 
   return 0;
 }
\ No newline at end of file
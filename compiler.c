@@ -15,7 +15,12 @@ void compiler_error(struct compile_process* compiler, const char* msg, ...)
   vfprintf(stderr, msg, args);
   va_end(args);
   fprintf(stderr, " on line %i, col %i in file %s\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
-  exit(-1);
+  // Keep whatever assembly we generated up to the error
+  if (compiler->generator)
+  {
+    codegen_flush(compiler);
+  }
+  longjmp(compiler->error_jump, 1);
 }
 
 void compiler_warning(struct compile_process* compiler, const char* msg, ...)
@@ -29,10 +34,20 @@ void compiler_warning(struct compile_process* compiler, const char* msg, ...)
 
 int compile_file(const char* filename, const char* out_filename, int flags)
 {
-  struct compile_process* process = compile_process_create(filename, out_filename, flags);
-  if (!process)
+  FILE* out_file = fopen(out_filename, "w");
+  if (!out_file)
+  {
     return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  int res = compile_stream(filename, out_file, out_filename, flags);
+  fclose(out_file);
+  return res;
+}
 
+// Runs every stage of the compile, compiler_error longjmps out of here to compile_stream
+static int compile_process_run(struct compile_process* process, const char* out_filename)
+{
   // Perform lexical analysis
   struct lex_process* lex_process = lex_process_create(process, &compiler_lex_functions, NULL);
   if (!lex_process)
@@ -40,6 +55,7 @@ int compile_file(const char* filename, const char* out_filename, int flags)
     return COMPILER_FAILED_WITH_ERROR;
   }
 
+  process->lex_process = lex_process;
   if (lex(lex_process) != LEXICAL_ANALYSIS_ALL_OK)
   {
     return COMPILER_FAILED_WITH_ERROR;
@@ -53,12 +69,65 @@ int compile_file(const char* filename, const char* out_filename, int flags)
     return COMPILER_FAILED_WITH_ERROR;
   }
 
+  // Inline small functions and then evaluate constant expressions ahead of code generation
+  if (!(process->flags & COMPILE_PROCESS_NO_OPTIMIZE))
+  {
+    inliner(process);
+    fold(process);
+  }
+
   // Perform code generation...
   if (codegen(process) != CODEGEN_ALL_OK)
   {
     return COMPILER_FAILED_WITH_ERROR;
   }
-  
-  fclose(process->ofile);
+
+  if (process->flags & COMPILE_PROCESS_PRINT_STATS)
+  {
+    resolver_print_stats(process->resolver, stderr);
+    fprintf(stderr, "inline: %i calls inlined\n", process->total_inlined);
+    fprintf(stderr, "fold: %i expressions folded\n", process->total_folded);
+    fprintf(stderr, "codegen: %i instructions\n", process->generator->instructions->total_printed);
+    fprintf(stderr, "peephole: %i instructions removed\n", process->generator->instructions->total_removed);
+    fprintf(stderr, "regalloc: %i values in registers, %i left in memory\n", process->generator->total_allocated, process->generator->total_spilled);
+    fprintf(stderr, "vectorize: %i loops vectorized\n", process->generator->total_vectorized);
+    fprintf(stderr, "frame: %i frame pointers omitted\n", process->generator->total_frames_omitted);
+  }
+
+  if (process->assembler)
+  {
+    // Sized from the output name so long paths are never cut short
+    char* object_filename = malloc(strlen(out_filename) + sizeof(".o"));
+    sprintf(object_filename, "%s.o", out_filename);
+    bool written = elf_write_object(process->assembler, object_filename);
+    assembler_free(process->assembler);
+    process->assembler = NULL;
+    if (!written)
+    {
+      fprintf(stderr, "Unable to write the object file %s\n", object_filename);
+      free(object_filename);
+      return COMPILER_FAILED_WITH_ERROR;
+    }
+    free(object_filename);
+  }
+
   return COMPILER_FILE_COMPILED_OK;
-}
\ No newline at end of file
+}
+
+int compile_stream(const char* filename, FILE* out_file, const char* out_filename, int flags)
+{
+  struct compile_process* process = compile_process_create(filename, out_file, flags);
+  if (!process)
+    return COMPILER_FAILED_WITH_ERROR;
+
+  // Any compiler_error from here on lands back here
+  if (setjmp(process->error_jump))
+  {
+    compile_process_free(process);
+    return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  int res = compile_process_run(process, out_filename);
+  compile_process_free(process);
+  return res;
+}
@@ -2,8 +2,10 @@
 #define PEACHCOMPILER_H
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
+#include <setjmp.h>
 
 #define S_EQ(str, str2) \
         (str && str2 && (strcmp(str, str2) == 0))
@@ -100,6 +102,8 @@ struct token
     unsigned int inum;
     unsigned long lnum;
     unsigned long long llnum;
+    // Numbers of NUMBER_TYPE_FLOAT and NUMBER_TYPE_DOUBLE
+    double dnum;
     void* any;
   };
 
@@ -142,6 +146,9 @@ struct lex_process
   struct buffer* parentheses_buffer;
   struct lex_process_functions* function;
 
+  // The token currently being built by the lexer
+  struct token tmp_token;
+
   // This will be private data that the lexer does not understand
   // but the person using the lexer does understand.
   void* private;
@@ -156,21 +163,44 @@ enum
 enum
 {
   COMPILE_PROCESS_EXECUTE_NASM = 0b00000001,
-  COMPILE_PROCESS_EXPORT_AS_OBJECT = 0b00000010
+  COMPILE_PROCESS_EXPORT_AS_OBJECT = 0b00000010,
+  // Print compiler statistics such as resolver cache hit rates to stderr
+  COMPILE_PROCESS_PRINT_STATS = 0b00000100,
+  // Echo the generated assembly to stdout as well as the output file
+  COMPILE_PROCESS_ECHO_ASM = 0b00001000,
+  // Print the instructions exactly as code generation produced them
+  COMPILE_PROCESS_NO_OPTIMIZE = 0b00010000,
+  // Keep scalar locals and expression temporaries in esi and edi where possible, see regalloc.c
+  COMPILE_PROCESS_ALLOCATE_REGISTERS = 0b00100000,
+  // Encode the instructions ourselves and write an ELF32 object next to the assembly
+  COMPILE_PROCESS_ASSEMBLE_OBJECT = 0b01000000,
+  // Keep the assembly and object the driver would otherwise delete once it is done with them
+  COMPILE_PROCESS_SAVE_TEMPS = 0b10000000,
+  // Address the stack frame through esp so functions need not set up ebp
+  COMPILE_PROCESS_OMIT_FRAME_POINTER = 0b100000000
+};
+
+struct target
+{
+  const char* name;
+  // The NASM output format and what gcc needs to link it
+  const char* nasm_format;
+  const char* link_option;
+
+  int pointer_size;
+  // How far every push moves the stack pointer
+  int stack_slot_size;
 };
 
 struct scope
 {
   int flags;
 
-  // void*
-  struct vector* entities;
+  // Index into the compile process entity stack where this scope's entities begin
+  int start;
 
   // The total number of bytes this scop uses. Aligned to 16 bytes.
   size_t size;
-
-  // NULL if no parent
-  struct scope* parent;
 };
 
 enum
@@ -199,20 +229,346 @@ struct codegen_exit_point
   int id;
 };
 
+struct codegen_jump_table
+{
+  // The table is written to .rodata as switch_table_<id>
+  int id;
+  // The function the case labels are local to
+  const char* function_name;
+  // Where values without a case go, i.e .switch_3_default
+  char fallback_label[32];
+  // Vector of long long, the case values from lowest to highest
+  struct vector* values;
+};
+
 struct string_table_element
 {
   // This is the string that the element is related to. "Hello world"
   const char* str;
 
   // This is the assembly label that points to the memory
-  // where the string can be found.
-  const char label[50];
+  // where the string can be found. i.e str_12
+  char label[16];
+
+  // The next element in the same hash bucket
+  struct string_table_element* next;
+
+  // The next shorter string stored inside this one's memory, i.e "world" in "Hello world"
+  struct string_table_element* suffix;
+  // True if this string is written as part of a longer one
+  bool merged;
+};
+
+// The starting number of string table hash buckets, always a power of two
+#define STRING_TABLE_START_BUCKETS 64
+
+// Flush the emitter buffer once it holds this many bytes
+#define EMITTER_FLUSH_SIZE 65536
+
+struct emitter
+{
+  // Compile process flags, i.e COMPILE_PROCESS_ECHO_ASM
+  int flags;
+  // NULL if we have no output file
+  FILE* ofile;
+
+  char* data;
+  size_t len;
+  size_t msize;
+};
+
+enum
+{
+  INSTRUCTION_OPCODE_MOV,
+  INSTRUCTION_OPCODE_MOVZX,
+  INSTRUCTION_OPCODE_MOVSX,
+  INSTRUCTION_OPCODE_LEA,
+  INSTRUCTION_OPCODE_PUSH,
+  INSTRUCTION_OPCODE_POP,
+  INSTRUCTION_OPCODE_ADD,
+  INSTRUCTION_OPCODE_SUB,
+  INSTRUCTION_OPCODE_IMUL,
+  INSTRUCTION_OPCODE_MUL,
+  INSTRUCTION_OPCODE_IDIV,
+  INSTRUCTION_OPCODE_DIV,
+  INSTRUCTION_OPCODE_CDQ,
+  INSTRUCTION_OPCODE_NEG,
+  INSTRUCTION_OPCODE_NOT,
+  INSTRUCTION_OPCODE_INC,
+  INSTRUCTION_OPCODE_DEC,
+  INSTRUCTION_OPCODE_XOR,
+  INSTRUCTION_OPCODE_OR,
+  INSTRUCTION_OPCODE_AND,
+  INSTRUCTION_OPCODE_SAL,
+  INSTRUCTION_OPCODE_SAR,
+  INSTRUCTION_OPCODE_SHL,
+  INSTRUCTION_OPCODE_SHR,
+  INSTRUCTION_OPCODE_CMP,
+  INSTRUCTION_OPCODE_TEST,
+  INSTRUCTION_OPCODE_JMP,
+  INSTRUCTION_OPCODE_JE,
+  INSTRUCTION_OPCODE_JNE,
+  INSTRUCTION_OPCODE_JG,
+  INSTRUCTION_OPCODE_JL,
+  INSTRUCTION_OPCODE_JGE,
+  INSTRUCTION_OPCODE_JLE,
+  INSTRUCTION_OPCODE_JA,
+  INSTRUCTION_OPCODE_JB,
+  INSTRUCTION_OPCODE_JAE,
+  INSTRUCTION_OPCODE_JBE,
+  INSTRUCTION_OPCODE_SETE,
+  INSTRUCTION_OPCODE_SETNE,
+  INSTRUCTION_OPCODE_SETG,
+  INSTRUCTION_OPCODE_SETL,
+  INSTRUCTION_OPCODE_SETGE,
+  INSTRUCTION_OPCODE_SETLE,
+  INSTRUCTION_OPCODE_SETA,
+  INSTRUCTION_OPCODE_SETB,
+  INSTRUCTION_OPCODE_SETAE,
+  INSTRUCTION_OPCODE_SETBE,
+  INSTRUCTION_OPCODE_CALL,
+  INSTRUCTION_OPCODE_RET,
+  INSTRUCTION_OPCODE_TOTAL,
+
+  // Not machine instructions, these print their text as is
+  INSTRUCTION_OPCODE_LABEL,
+  INSTRUCTION_OPCODE_COMMENT,
+  // Padding before a label, it changes where code sits but not what it does
+  INSTRUCTION_OPCODE_ALIGN,
+  // Directives, data and anything else we do not model
+  INSTRUCTION_OPCODE_RAW
+};
+
+enum
+{
+  REGISTER_EAX,
+  REGISTER_EBX,
+  REGISTER_ECX,
+  REGISTER_EDX,
+  REGISTER_ESI,
+  REGISTER_EDI,
+  REGISTER_EBP,
+  REGISTER_ESP,
+  REGISTER_AX,
+  REGISTER_BX,
+  REGISTER_CX,
+  REGISTER_DX,
+  REGISTER_AL,
+  REGISTER_BL,
+  REGISTER_CL,
+  REGISTER_DL,
+  REGISTER_AH,
+  REGISTER_BH,
+  REGISTER_CH,
+  REGISTER_DH,
+  REGISTER_TOTAL
+};
+
+enum
+{
+  INSTRUCTION_OPERAND_TYPE_NONE,
+  INSTRUCTION_OPERAND_TYPE_REGISTER,
+  INSTRUCTION_OPERAND_TYPE_IMMEDIATE,
+  // [ebp-4], [name+4]
+  INSTRUCTION_OPERAND_TYPE_MEMORY,
+  // Labels and function names
+  INSTRUCTION_OPERAND_TYPE_SYMBOL
+};
+
+// The address of a memory operand, [symbol+base+index*scale+displacement]
+struct instruction_address
+{
+  // REGISTER_EBP for [ebp-4], -1 if the address has no base register
+  int base;
+  // REGISTER_EAX for [switch_table_1+eax*4], -1 if the address is not indexed
+  int index;
+  int scale;
+  long long displacement;
+  // The label or global the address is relative to, NULL if there is none
+  const char* symbol;
+};
+
+struct instruction_operand
+{
+  int type;
+  // The size keyword written before the operand, zero if there is none. i.e dword
+  int size;
+  int reg;
+  long long imm;
+  struct instruction_address address;
+  // Labels and function names, interned by the instruction list so operands can be copied freely
+  const char* symbol;
+};
+
+enum
+{
+  // Removed by an optimization, the printer skips it
+  INSTRUCTION_FLAG_DELETED = 0b00000001
+};
+
+#define INSTRUCTION_MAX_OPERANDS 3
+
+struct instruction
+{
+  int opcode;
+  int flags;
+  int total_operands;
+  struct instruction_operand operands[INSTRUCTION_MAX_OPERANDS];
+
+  // Text of labels, comments and raw lines, NULL for machine instructions
+  char* text;
+};
+
+struct instruction_symbol
+{
+  char* name;
+  struct instruction_symbol* next;
+};
+
+struct instruction_insert
+{
+  // The instruction goes in front of the one at this index
+  int index;
+  struct instruction ins;
+};
+
+struct instruction_list
+{
+  // Vector of struct instruction
+  struct vector* instructions;
+
+  // Hash slots of the names operands refer to, every name is stored once
+  struct instruction_symbol** symbol_slots;
+  int total_symbol_slots;
+  int total_symbols;
+
+  // Vector of struct instruction_insert, waiting for instruction_list_apply_inserts
+  struct vector* inserts;
+
+  // The number of machine instructions printed so far
+  int total_printed;
+  // The number of instructions the peephole optimizer removed
+  int total_removed;
+};
+
+struct regalloc_function
+{
+  // Index of the function's first instruction, the push ebp
+  int start;
+  // Index one past the function's last instruction
+  int end;
+  // Vector of int, stack offsets of the scalar dword locals declared in the function
+  struct vector* locals;
+};
+
+enum
+{
+  ASSEMBLER_SECTION_TEXT,
+  ASSEMBLER_SECTION_DATA,
+  ASSEMBLER_SECTION_RODATA,
+  ASSEMBLER_SECTION_BSS,
+  ASSEMBLER_SECTION_TOTAL
+};
+
+enum
+{
+  // R_386_32, the address of the symbol plus what is stored at the offset
+  ASSEMBLER_RELOCATION_ABSOLUTE,
+  // R_386_PC32, as above minus the address of the offset itself
+  ASSEMBLER_RELOCATION_RELATIVE,
+  // A byte displacement of a short jump, always resolved by us and never written to the object
+  ASSEMBLER_RELOCATION_SHORT
+};
+
+struct assembler_symbol
+{
+  char* name;
+  // ASSEMBLER_SECTION_* the symbol is defined in, -1 until it is defined
+  int section;
+  int offset;
+  // Named by a global or extern directive
+  bool global;
+  // The index of the symbol in the object's symbol table
+  int index;
+
+  // Next symbol in the same hash bucket
+  struct assembler_symbol* next;
+};
+
+struct assembler_relocation
+{
+  int type;
+  // Where in the section the address goes
+  int offset;
+  // The section symbol for anything we defined, the symbol itself for externs
+  struct assembler_symbol* symbol;
+};
+
+struct assembler_fixup
+{
+  int type;
+  int section;
+  int offset;
+  struct assembler_symbol* symbol;
+  // The jump instruction a short fixup belongs to, -1 for everything else
+  int instruction_index;
+};
+
+struct assembler_section
+{
+  const char* name;
+  // The encoded bytes, .bss has a size but never any data
+  struct buffer* data;
+  int size;
+  int alignment;
+  // Vector of struct assembler_relocation
+  struct vector* relocations;
+  // Symbol the relocations use to point at this section
+  struct assembler_symbol symbol;
+};
+
+struct assembler
+{
+  struct compile_process* process;
+  struct assembler_section sections[ASSEMBLER_SECTION_TOTAL];
+  int current_section;
+
+  // Vector of struct assembler_symbol* in the order we first saw them
+  struct vector* symbols;
+  struct assembler_symbol** buckets;
+  int total_buckets;
+
+  // The last label not starting with a dot, local labels belong to it as they do in NASM
+  char scope_label[128];
+
+  // Vector of struct assembler_fixup, symbol references patched once every label is known
+  struct vector* fixups;
+
+  // One per instruction, true once a jump was found to be too far for a short displacement
+  bool* long_jumps;
 };
 
 struct code_generator
 {
+  // All assembly is written through here
+  struct emitter* emitter;
+
+  // The instructions generated but not yet printed to the emitter
+  struct instruction_list* instructions;
+  // The line asm_push is currently building
+  struct emitter* line;
+
+
   // A vector of struct string_table_element*
   struct vector* string_table;
+  // Hash buckets for finding strings in the string table
+  struct string_table_element** string_buckets;
+  int total_string_buckets;
+
+  // Vector of struct node*, globals that start as zero and go in .bss
+  struct vector* bss_variables;
+  // Vector of struct node*, initialized const globals that go in .rodata
+  struct vector* rodata_variables;
 
   // A vector of codegen_entry_point*
   struct vector* entry_points;
@@ -221,6 +577,33 @@ struct code_generator
 
   // Vector of strcut respone*
   struct vector* responses;
+
+  // Vector of int, the ids of the switch statements we are generating the bodies of
+  struct vector* switches;
+  // Vector of struct codegen_jump_table*, written to .rodata at the end
+  struct vector* jump_tables;
+
+  // The function node we are currently generating
+  struct node* current_function;
+  // The last label number handed out by codegen_label_count
+  int label_count;
+
+  // The instructions of the last structure pushed with rep movsd and its size in dwords.
+  // A structure move straight after it copies from the source instead of the stack
+  int struct_push_start;
+  int struct_push_end;
+  int struct_push_dwords;
+
+  // Vector of struct regalloc_function, one for every function with a body
+  struct vector* functions;
+  // The number of locals and temporaries the register allocator kept in registers
+  int total_allocated;
+  // The number of locals and temporaries left on the stack for lack of registers
+  int total_spilled;
+  // The number of loops given an SSE2 body that handles several elements an iteration
+  int total_vectorized;
+  // The number of functions that address their frame through esp rather than ebp
+  int total_frames_omitted;
 };
 
 struct resolver_process;
@@ -238,6 +621,8 @@ struct compile_process
 
   // A vector of tokens feom lexical analysis
   struct vector* token_vec;
+  // Owns token_vec, NULL until lexing starts
+  struct lex_process* lex_process;
 
   struct vector* node_vec;
   struct vector* node_tree_vec;
@@ -245,8 +630,14 @@ struct compile_process
 
   struct
   {
+    // Point into the frames vector, only valid until the next scope_new
     struct scope* root;
     struct scope* current;
+
+    // Stack of struct scope, the last element is the current scope
+    struct vector* frames;
+    // Contiguous stack of void* entities for every open scope
+    struct vector* entities;
   } scope;
 
   struct
@@ -261,6 +652,35 @@ struct compile_process
   // Pointer to our code_generator
   struct code_generator* generator;
   struct resolver_process* resolver;
+
+  // State private to the parser for this compile
+  struct parser_state
+  {
+    struct fixup_system* fixup_sys;
+    struct token* last_token;
+    struct node* blank_node;
+
+    // The body and function currently being parsed, NULL if none
+    struct node* current_body;
+    struct node* current_function;
+
+    // Used to name structures and unions that have no name
+    int random_type_index;
+  } parser;
+
+  // The number of calls replaced by the body of the function they call
+  int total_inlined;
+  // The number of expressions constant folding simplified
+  int total_folded;
+
+  // The encoded object when compiling with COMPILE_PROCESS_ASSEMBLE_OBJECT
+  struct assembler* assembler;
+
+  // The machine we generate code for
+  const struct target* target;
+
+  // compiler_error jumps back here so only this compile fails, not every compile in the program
+  jmp_buf error_jump;
 };
 
 enum
@@ -320,6 +740,15 @@ struct array_brackets
 {
   // Vector of struct node*
   struct vector* n_brackets;
+
+  /**
+   * Computed once by the parser, strides[i] is the number of elements covered by
+   * the dimensions from i on. i.e int a[2][3][4] = {24, 12, 4, 1}
+   * strides[0] is the total element count and strides[total] is always 1, one step
+   * of index i moves strides[i + 1] elements
+   */
+  size_t* strides;
+  int total;
 };
 
 struct node;
@@ -570,7 +999,8 @@ struct node
         struct vector* elements;
       } frame;
 
-      // The stack size for all variables inside this function.
+      // The stack size for all variables inside this function, bodies that can't be
+      // live at the same time share their room
       size_t stack_size;
     } func;
 
@@ -656,7 +1086,15 @@ struct node
     unsigned int inum;
     unsigned long lnum;
     unsigned long long llnum;
+    // Number nodes of NUMBER_TYPE_FLOAT and NUMBER_TYPE_DOUBLE
+    double dnum;
   };
+
+  struct node_number
+  {
+    // The NUMBER_TYPE_* of number nodes, i.e NUMBER_TYPE_FLOAT for 1.5f
+    int type;
+  } num;
 };
 
 enum
@@ -714,6 +1152,18 @@ struct resolver_callbacks
 };
 
 struct compile_process;
+struct resolver_cache_entry
+{
+  // The node that was followed
+  struct node* node;
+  // The epoch of the scope it was followed in
+  int epoch;
+  struct resolver_result* result;
+
+  // The next entry in the same slot of the cache
+  struct resolver_cache_entry* next;
+};
+
 struct resolver_process
 {
   struct resolver_scopes
@@ -722,6 +1172,19 @@ struct resolver_process
     struct resolver_scope* current;
   } scope;
 
+  // Memoized results of resolver_follow, an entry is only valid while the current scope has its epoch
+  struct resolver_cache
+  {
+    // Hash index of struct resolver_cache_entry* chained by node, the number of slots is a power of two
+    struct resolver_cache_entry** slots;
+    int total_slots;
+    int total_entries;
+    // The last epoch given out, every entity added gives its scope a new one
+    int epoch;
+    size_t hits;
+    size_t misses;
+  } cache;
+
   struct compile_process* compiler;
   struct resolver_callbacks callbacks;
 };
@@ -823,6 +1286,9 @@ struct resolver_scope
 
   // Private data for the resolver scope
   void* private;
+
+  // Names resolve the same in two scopes with the same epoch, a new scope starts with the epoch of its parent
+  int epoch;
 };
 
 struct resolver_entity
@@ -866,6 +1332,8 @@ struct resolver_entity
       struct vector* arguments;
       // The total bytes used by the function call
       size_t stack_size;
+      // The function node called, NULL when it is not called by name
+      struct node* function;
     } func_call_data;
 
     struct resolver_entity_rule
@@ -927,7 +1395,9 @@ enum
   DATATYPE_FLAG_IGNORE_TYPE_CHECKING = 0b10000000,
   DATATYPE_FLAG_IS_SECONDARY = 0b100000000,
   DATATYPE_FLAG_STRUCT_UNION_NO_NAME = 0b1000000000,
-  DATATYPE_FLAG_IS_LITERAL = 0b10000000000
+  DATATYPE_FLAG_IS_LITERAL = 0b10000000000,
+  // Set on the return type of functions declared inline
+  DATATYPE_FLAG_IS_INLINE = 0b100000000000
 };
 
 enum
@@ -1042,7 +1512,10 @@ enum
 };
 
 int compile_file(const char* filename, const char* out_filename, int flags);
-struct compile_process* compile_process_create(const char* filename, const char* filename_out, int flags);
+// As compile_file but the assembly goes to a stream the caller opened and closes, out_filename names the object next to it
+int compile_stream(const char* filename, FILE* out_file, const char* out_filename, int flags);
+struct compile_process* compile_process_create(const char* filename, FILE* out_file, int flags);
+void compile_process_free(struct compile_process* process);
 
 char compile_process_next_char(struct lex_process* lex_process);
 char compile_process_peek_char(struct lex_process* lex_process);
@@ -1058,7 +1531,9 @@ struct vector* lex_process_tokens(struct lex_process* process);
 int lex(struct lex_process* process);
 int parse(struct compile_process* process);
 int codegen(struct compile_process* process);
+void codegen_flush(struct compile_process* process);
 struct code_generator* codegenerator_new(struct compile_process* process);
+void codegenerator_free(struct code_generator* generator);
 
 /**
  * @brief Builds tokens for the input string
@@ -1099,6 +1574,7 @@ void make_break_node();
 void make_goto_node(struct node* label_node);
 void make_label_node(struct node* name_node);
 void make_case_node(struct node* exp_node);
+void make_default_node();
 void make_tenary_node(struct node* true_node, struct node* false_node);
 void make_cast_node(struct datatype* dtype, struct node* operand_node);
 void make_unary_node(const char* op, struct node* operand_node);
@@ -1106,7 +1582,7 @@ struct node* node_pop();
 struct node* node_peek();
 struct node* node_peek_or_null();
 void node_push(struct node* node);
-void node_set_vector(struct vector* vec, struct vector* root_vec);
+void node_set_process(struct compile_process* process);
 bool node_is_expressionable(struct node* node);
 struct node* node_peek_expressionable_or_null();
 bool node_is_struct_or_union(struct node* node);
@@ -1124,6 +1600,7 @@ size_t function_node_argument_stack_addition(struct node* node);
 bool node_is_expression_or_parentheses(struct node* node);
 bool node_is_value_type(struct node* node);
 bool node_is_expression(struct node* node, const char* op);
+bool node_is_floating_number(struct node* node);
 bool is_node_assignment(struct node* node);
 bool node_valid(struct node* node);
 
@@ -1154,6 +1631,8 @@ struct datatype* datatype_pointer_reduce(struct datatype* datatype, int by);
 
 // Codegen helper functions
 struct datatype datatype_for_numeric();
+struct datatype datatype_for_string();
+struct datatype datatype_for_floating(int type);
 bool is_logical_operator(const char* op);
 bool is_logical_node(struct node* node);
 
@@ -1164,6 +1643,8 @@ void array_brackets_add(struct array_brackets* brackets, struct node* bracket_no
 struct vector* array_brackets_node_vector(struct array_brackets* brackets);
 size_t array_brackets_calculate_size_from_index(struct datatype* dtype, struct array_brackets* brackets, int index);
 size_t array_brackets_calculate_size(struct datatype* dtype, struct array_brackets* brackets);
+void array_brackets_calculate_strides(struct array_brackets* brackets);
+size_t array_brackets_stride(struct array_brackets* brackets, int index);
 int array_total_indexes(struct datatype* dtype);
 
 // Datatype functions
@@ -1174,16 +1655,13 @@ size_t datatype_size_no_ptr(struct datatype* dtype);
 size_t datatype_size(struct datatype* dtype);
 bool datatype_is_primitive(struct datatype* dtype);
 bool datatype_is_struct_or_union_non_pointer(struct datatype* dtype);
+bool datatype_is_floating(struct datatype* dtype);
 
 // Scope functions
 struct scope* scope_new(struct compile_process* process, int flags);
 struct scope* scope_create_root(struct compile_process* process);
 void scope_free_root(struct compile_process* process);
-void scope_iteration_start(struct scope* scope);
-void scope_iteration_end(struct scope* scope);
-void* scope_iterate_back(struct scope* scope);
-void* scope_last_entity_at_scope(struct scope* scope);
-void* scope_last_entity_from_scope_stop_at(struct scope* scope, struct scope* stop_scope);
+void* scope_last_entity_at_scope(struct compile_process* process, struct scope* scope);
 void* scope_last_entity_stop_at(struct compile_process* process, struct scope* stop_scope);
 void* scope_last_entity(struct compile_process* process);
 void scope_push(struct compile_process* process, void* ptr, size_t elem_size);
@@ -1193,11 +1671,14 @@ struct scope* scope_current(struct compile_process* process);
 // Resolver function
 struct resolver_entity* resolver_make_entity(struct resolver_process* process, struct resolver_result* result, struct datatype* custom_dtype, struct node* node, struct resolver_entity* guided_entity, struct resolver_scope* scope);
 struct resolver_process* resolver_new_process(struct compile_process* compiler, struct resolver_callbacks* callbacks);
+void resolver_free(struct resolver_process* process);
 struct resolver_entity* resolver_new_entity_for_var_node(struct resolver_process* process, struct node* var_node, void* private, int offset);
 struct resolver_entity* resolver_register_function(struct resolver_process* process, struct node* func_node, void* private);
 struct resolver_scope* resolver_new_scope(struct resolver_process* resolver, void* private, int flags);
 void resolver_finish_scope(struct resolver_process* resolver);
 struct resolver_result* resolver_follow(struct resolver_process* resolver, struct node* node);
+void resolver_cache_invalidate(struct resolver_process* resolver, struct resolver_scope* scope);
+void resolver_print_stats(struct resolver_process* resolver, FILE* fp);
 bool resolver_result_ok(struct resolver_result* result);
 struct resolver_entity* resolver_result_entity_root(struct resolver_result* result);
 struct resolver_entity* resolver_result_entity_next(struct resolver_entity* entity);
@@ -1260,6 +1741,7 @@ struct symbol* symresolver_get_symbol(struct compile_process* process, const cha
 void symresolver_initialize(struct compile_process* process);
 void symresolver_new_table(struct compile_process* process);
 void symresolver_end_table(struct compile_process* process);
+void symresolver_free(struct compile_process* process);
 struct symbol* symresolver_get_symbol_for_native_function(struct compile_process* process, const char* name);
 
 #define TOTAL_OPERATOR_GROUPS 14
@@ -1296,13 +1778,33 @@ struct fixup_config
 {
   FIXUP_FIX fix;
   FIXUP_END end;
+  // The name of the structure or union this fixup is waiting for, NULL if unknown
+  const char* name;
   void* private;
 };
 
+struct fixup_bucket
+{
+  const char* name;
+  // Vector of struct fixup* waiting for this name
+  struct vector* fixups;
+  // The next bucket whose name hashes to the same slot
+  struct fixup_bucket* next;
+};
+
 struct fixup_system
 {
-  // A vector of fixups.
+  // A vector of struct fixup*
   struct vector* fixups;
+
+  // A vector of struct fixup_bucket*, fixups indexed by the name they wait for
+  struct vector* buckets;
+  // Hash slots for finding the bucket of a name
+  struct fixup_bucket** slots;
+  int total_slots;
+
+  // The number of fixups that are not resolved yet
+  int unresolved;
 };
 
 enum
@@ -1329,5 +1831,68 @@ struct fixup* fixup_register(struct fixup_system* system, struct fixup_config* c
 bool fixup_resolve(struct fixup* fixup);
 void* fixup_private(struct fixup* fixup);
 bool fixups_resolve(struct fixup_system* system);
+void fixups_resolve_for_name(struct fixup_system* system, const char* name);
+
+// Emitter functions
+struct emitter* emitter_new(FILE* ofile, int flags);
+void emitter_free(struct emitter* emitter);
+void emitter_write(struct emitter* emitter, const char* str, size_t len);
+void emitter_printf(struct emitter* emitter, const char* fmt, ...);
+void emitter_vprintf(struct emitter* emitter, const char* fmt, va_list args);
+void emitter_flush(struct emitter* emitter);
+
+// Instruction functions
+const char* instruction_opcode_name(int opcode);
+const char* instruction_register_name(int reg);
+const char* instruction_size_keyword(int size);
+struct instruction_list* instruction_list_new();
+void instruction_list_free(struct instruction_list* list);
+void instruction_list_clear(struct instruction_list* list);
+const char* instruction_list_symbol(struct instruction_list* list, const char* name);
+struct instruction* instruction_list_push(struct instruction_list* list, struct instruction* ins);
+void instruction_list_insert(struct instruction_list* list, int index, struct instruction* ins);
+void instruction_list_apply_inserts(struct instruction_list* list);
+struct instruction* instruction_list_push_text(struct instruction_list* list, const char* line, size_t len);
+struct instruction_operand instruction_register(int reg);
+struct instruction_operand instruction_immediate(long long value);
+struct instruction_operand instruction_memory(int size, int base, int index, int scale, const char* symbol, long long displacement);
+struct instruction_operand instruction_symbol(const char* symbol);
+bool instruction_address_uses(struct instruction_address* address, int reg);
+bool instruction_address_equal(struct instruction_address* address, struct instruction_address* other);
+bool instruction_is_machine_instruction(struct instruction* ins);
+void instruction_print(struct instruction* ins, struct emitter* emitter);
+int instruction_list_print(struct instruction_list* list, struct emitter* emitter);
+
+// Peephole functions
+int register_family(int reg);
+bool register_is_dword(int reg);
+int peephole_optimize(struct instruction_list* list);
+
+// Constant folding functions
+struct node* fold_node(struct compile_process* process, struct node* node);
+void fold(struct compile_process* process);
+
+// Inlining functions
+void inliner(struct compile_process* process);
+
+// Register allocation functions
+void regalloc(struct compile_process* process);
+
+// Frame pointer omission functions
+void frame_omit(struct compile_process* process);
+
+// Target functions
+extern const struct target target_x86_32;
+const struct target* target_for_flags(int flags);
+void target_select(const struct target* target);
+const struct target* target_current();
+
+// Driver functions
+int driver_compile(const char* filename, const char* out_filename, int flags);
+
+// Assembler functions
+struct assembler* assemble(struct compile_process* process);
+void assembler_free(struct assembler* assembler);
+bool elf_write_object(struct assembler* assembler, const char* filename);
 
 #endif
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 
-struct compile_process* compile_process_create(const char* filename, const char* filename_out, int flags)
+struct compile_process* compile_process_create(const char* filename, FILE* out_file, int flags)
 {
   FILE* file = fopen(filename, "r");
   if (!file)
@@ -11,20 +11,12 @@ struct compile_process* compile_process_create(const char* filename, const char*
     return NULL;
   }
 
-  FILE* out_file = NULL;
-  if (filename_out)
-  {
-    out_file = fopen(filename_out, "w");
-    if (!out_file)
-    {
-      return NULL;
-    }
-  }
-
   struct compile_process* process = calloc(1, sizeof(struct compile_process));
   process->node_vec = vector_create(sizeof(struct node*));
   process->node_tree_vec = vector_create(sizeof(struct node*));
   process->flags = flags;
+  process->target = target_for_flags(flags);
+  target_select(process->target);
   process->cfile.fp = file;
   process->ofile = out_file;
   process->generator = codegenerator_new(process);
@@ -36,6 +28,41 @@ struct compile_process* compile_process_create(const char* filename, const char*
   return process;
 }
 
+/**
+ * @brief Closes the input file and frees everything the compile process owns. Safe to call
+ * after a compiler_error at any stage, the parts that were never created are skipped.
+ */
+void compile_process_free(struct compile_process* process)
+{
+  fclose(process->cfile.fp);
+  if (process->lex_process)
+  {
+    lex_process_free(process->lex_process);
+  }
+
+  if (process->scope.frames)
+  {
+    scope_free_root(process);
+  }
+
+  if (process->parser.fixup_sys)
+  {
+    fixup_sys_free(process->parser.fixup_sys);
+  }
+
+  if (process->assembler)
+  {
+    assembler_free(process->assembler);
+  }
+
+  vector_free(process->node_vec);
+  vector_free(process->node_tree_vec);
+  symresolver_free(process);
+  codegenerator_free(process->generator);
+  resolver_free(process->resolver);
+  free(process);
+}
+
 char compile_process_next_char(struct lex_process* lex_process)
 {
   struct compile_process* compiler = lex_process->compiler;
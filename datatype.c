@@ -25,7 +25,7 @@ size_t datatype_element_size(struct datatype* dtype)
 {
   if (dtype->flags & DATATYPE_FLAG_IS_POINTER)
   {
-    return DATA_SIZE_DWORD;
+    return target_current()->pointer_size;
   }
 
   return dtype->size;
@@ -45,7 +45,7 @@ size_t datatype_size(struct datatype* dtype)
 {
   if (dtype->flags & DATATYPE_FLAG_IS_POINTER && dtype->pointer_depth > 0)
   {
-    return DATA_SIZE_DWORD;
+    return target_current()->pointer_size;
   }
 
   if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
@@ -64,4 +64,9 @@ bool datatype_is_primitive(struct datatype* dtype)
 bool datatype_is_struct_or_union_non_pointer(struct datatype* dtype)
 {
   return dtype->type != DATA_TYPE_UNKNOWN && !datatype_is_primitive(dtype) && !(dtype->flags & DATATYPE_FLAG_IS_POINTER);
+}
+
+bool datatype_is_floating(struct datatype* dtype)
+{
+  return (dtype->type == DATA_TYPE_FLOAT || dtype->type == DATA_TYPE_DOUBLE) && !(dtype->flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY));
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+// memfd_create
+#define _GNU_SOURCE
+#include "compiler.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/**
+ * Runs NASM and the linker after compiling, the programs are started directly rather than
+ * through a shell. The assembly can not be streamed to NASM, nothing is written until the
+ * optimization passes have seen every function and NASM reads its input again on every pass
+ * so it needs a file it can seek in. The assembly goes to an anonymous memory file NASM opens
+ * as /proc/self/fd/N, it never touches the disk. Where there are no memory files it goes to a
+ * temporary file that is removed once NASM is done with it. With COMPILE_PROCESS_SAVE_TEMPS
+ * the assembly is written to <out>.asm instead and the object is kept after linking.
+ */
+
+#define DRIVER_MAX_FILENAME 4096
+
+extern char** environ;
+
+static void driver_print_command(char* const argv[])
+{
+  for (int i = 0; argv[i]; i++)
+  {
+    printf(i == 0 ? "%s" : " %s", argv[i]);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+/**
+ * @brief Runs the program and waits for it, returns true if it succeeded
+ */
+static bool driver_run(char* const argv[])
+{
+  driver_print_command(argv);
+  pid_t pid;
+  if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+  {
+    fprintf(stderr, "Unable to run %s\n", argv[0]);
+    return false;
+  }
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0)
+  {
+    if (errno != EINTR)
+    {
+      return false;
+    }
+  }
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool driver_assemble(const char* asm_filename, const char* object_filename, int flags)
+{
+  const struct target* target = target_for_flags(flags);
+  char* nasm_argv[] = {"nasm", "-f", (char*) target->nasm_format, (char*) asm_filename, "-o", (char*) object_filename, NULL};
+  return driver_run(nasm_argv);
+}
+
+/**
+ * @brief Compiles into the file open as fd and assembles it from asm_filename, fd is closed
+ */
+static int driver_compile_to_fd(int fd, const char* asm_filename, const char* filename, const char* out_filename, const char* object_filename, int flags)
+{
+  FILE* out_file = fdopen(fd, "w");
+  if (!out_file)
+  {
+    fprintf(stderr, "Unable to open a file for the assembly\n");
+    close(fd);
+    return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  // NASM reads the file while we still hold it open, the memory file goes away once it is closed
+  int res = compile_stream(filename, out_file, out_filename, flags);
+  if (fflush(out_file) != 0)
+  {
+    res = COMPILER_FAILED_WITH_ERROR;
+  }
+
+  if (res == COMPILER_FILE_COMPILED_OK && !driver_assemble(asm_filename, object_filename, flags))
+  {
+    res = COMPILER_FAILED_WITH_ERROR;
+  }
+
+  fclose(out_file);
+  return res;
+}
+
+/**
+ * @brief Compiles into an anonymous memory file NASM reads through /proc/self/fd, the descriptor
+ * is inherited by NASM so the path names the same file there. Falls back on a temporary file
+ * on systems without memory files
+ */
+static int driver_compile_with_temp_file(const char* filename, const char* out_filename, const char* object_filename, int flags)
+{
+  char asm_filename[DRIVER_MAX_FILENAME];
+  int fd = memfd_create("peachcc-asm", 0);
+  if (fd != -1)
+  {
+    snprintf(asm_filename, sizeof(asm_filename), "/proc/self/fd/%i", fd);
+    return driver_compile_to_fd(fd, asm_filename, filename, out_filename, object_filename, flags);
+  }
+
+  const char* tmp_dir = getenv("TMPDIR");
+  if (snprintf(asm_filename, sizeof(asm_filename), "%s/peachcc-XXXXXX", tmp_dir && *tmp_dir ? tmp_dir : "/tmp") >= sizeof(asm_filename))
+  {
+    fprintf(stderr, "The temporary directory name is too long\n");
+    return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  fd = mkstemp(asm_filename);
+  if (fd == -1)
+  {
+    fprintf(stderr, "Unable to create a temporary file for the assembly\n");
+    return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  int res = driver_compile_to_fd(fd, asm_filename, filename, out_filename, object_filename, flags);
+  unlink(asm_filename);
+  return res;
+}
+
+static int driver_compile_with_temps(const char* filename, const char* out_filename, const char* object_filename, int flags)
+{
+  char asm_filename[DRIVER_MAX_FILENAME];
+  snprintf(asm_filename, sizeof(asm_filename), "%s.asm", out_filename);
+  int res = compile_file(filename, asm_filename, flags);
+  if (res != COMPILER_FILE_COMPILED_OK)
+  {
+    return res;
+  }
+
+  return driver_assemble(asm_filename, object_filename, flags) ? COMPILER_FILE_COMPILED_OK : COMPILER_FAILED_WITH_ERROR;
+}
+
+int driver_compile(const char* filename, const char* out_filename, int flags)
+{
+  // The longest name we derive from the output is the .asm kept with -save-temps
+  if (strlen(out_filename) + strlen(".asm") >= DRIVER_MAX_FILENAME)
+  {
+    fprintf(stderr, "The output file name is too long\n");
+    return COMPILER_FAILED_WITH_ERROR;
+  }
+
+  char object_filename[DRIVER_MAX_FILENAME];
+  snprintf(object_filename, sizeof(object_filename), "%s.o", out_filename);
+
+  int res = flags & COMPILE_PROCESS_SAVE_TEMPS ?
+    driver_compile_with_temps(filename, out_filename, object_filename, flags) :
+    driver_compile_with_temp_file(filename, out_filename, object_filename, flags);
+  if (res != COMPILER_FILE_COMPILED_OK || flags & COMPILE_PROCESS_EXPORT_AS_OBJECT)
+  {
+    return res;
+  }
+
+  const struct target* target = target_for_flags(flags);
+  char* link_argv[] = {"gcc", (char*) target->link_option, object_filename, "-o", (char*) out_filename, NULL};
+  bool linked = driver_run(link_argv);
+
+  // The linker needs the object as a file, it is only kept when asked for
+  if (!(flags & COMPILE_PROCESS_SAVE_TEMPS))
+  {
+    unlink(object_filename);
+  }
+
+  return linked ? COMPILER_FILE_COMPILED_OK : COMPILER_FAILED_WITH_ERROR;
+}
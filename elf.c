@@ -0,0 +1,256 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <stdlib.h>
+#include <elf.h>
+
+/**
+ * Writes what the assembler encoded as an ELF32 relocatable object for i386, the same kind
+ * of file "nasm -f elf32" produces so it links with gcc -m32 or ld -m elf_i386.
+ */
+
+enum
+{
+  ELF_SECTION_NULL,
+  // The assembler sections follow in ASSEMBLER_SECTION_* order
+  ELF_SECTION_FIRST_DATA,
+  ELF_SECTION_FIRST_RELOCATION = ELF_SECTION_FIRST_DATA + ASSEMBLER_SECTION_TOTAL,
+  ELF_SECTION_SYMTAB = ELF_SECTION_FIRST_RELOCATION + ASSEMBLER_SECTION_TOTAL,
+  ELF_SECTION_STRTAB,
+  ELF_SECTION_SHSTRTAB,
+  // Empty, says the code does not need an executable stack
+  ELF_SECTION_NOTE_GNU_STACK,
+  ELF_SECTION_TOTAL
+};
+
+/**
+ * @brief Adds the string to a string table and returns its offset in it
+ */
+static int elf_string(struct buffer* table, const char* str)
+{
+  int offset = table->len;
+  for (const char* c = str; *c; c++)
+  {
+    buffer_write(table, *c);
+  }
+  buffer_write(table, 0);
+  return offset;
+}
+
+static void elf_write_padding(FILE* file, long alignment)
+{
+  long position = ftell(file);
+  while (position % alignment)
+  {
+    fputc(0, file);
+    position++;
+  }
+}
+
+static int elf_symbol_binding(struct assembler_symbol* symbol)
+{
+  return symbol->global ? STB_GLOBAL : STB_LOCAL;
+}
+
+static void elf_push_symbol(struct buffer* symtab, struct buffer* strtab, struct assembler_symbol* symbol, int type)
+{
+  Elf32_Sym sym = {0};
+  sym.st_name = type == STT_SECTION ? 0 : elf_string(strtab, symbol->name);
+  sym.st_value = type == STT_SECTION ? 0 : symbol->offset;
+  sym.st_info = ELF32_ST_INFO(type == STT_SECTION ? STB_LOCAL : elf_symbol_binding(symbol), type);
+  sym.st_shndx = symbol->section == -1 ? SHN_UNDEF : ELF_SECTION_FIRST_DATA + symbol->section;
+  for (size_t i = 0; i < sizeof(sym); i++)
+  {
+    buffer_write(symtab, ((char*) &sym)[i]);
+  }
+}
+
+/**
+ * @brief Builds the symbol table, locals must come before globals. Local labels of functions
+ * are left out, relocations always point at the section symbols and add the offset themselves
+ */
+static int elf_build_symtab(struct assembler* assembler, struct buffer* symtab, struct buffer* strtab)
+{
+  // The null symbol
+  for (size_t i = 0; i < sizeof(Elf32_Sym); i++)
+  {
+    buffer_write(symtab, 0);
+  }
+
+  int index = 1;
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    assembler->sections[i].symbol.index = index++;
+    elf_push_symbol(symtab, strtab, &assembler->sections[i].symbol, STT_SECTION);
+  }
+
+  // Named locals help when reading the object with objdump
+  for (int i = 0; i < vector_count(assembler->symbols); i++)
+  {
+    struct assembler_symbol* symbol = *(struct assembler_symbol**) vector_at(assembler->symbols, i);
+    if (symbol->global || symbol->section == -1 || symbol->name[0] == '.' || strchr(symbol->name, '.'))
+    {
+      continue;
+    }
+    symbol->index = index++;
+    elf_push_symbol(symtab, strtab, symbol, STT_NOTYPE);
+  }
+
+  int first_global = index;
+  for (int i = 0; i < vector_count(assembler->symbols); i++)
+  {
+    struct assembler_symbol* symbol = *(struct assembler_symbol**) vector_at(assembler->symbols, i);
+    if (!symbol->global)
+    {
+      continue;
+    }
+    symbol->index = index++;
+    elf_push_symbol(symtab, strtab, symbol, symbol->section == ASSEMBLER_SECTION_TEXT ? STT_FUNC : STT_NOTYPE);
+  }
+
+  return first_global;
+}
+
+static void elf_build_relocations(struct assembler_section* section, struct buffer* out)
+{
+  for (int i = 0; i < vector_count(section->relocations); i++)
+  {
+    struct assembler_relocation* relocation = vector_at(section->relocations, i);
+    Elf32_Rel rel;
+    rel.r_offset = relocation->offset;
+    rel.r_info = ELF32_R_INFO(relocation->symbol->index, relocation->type == ASSEMBLER_RELOCATION_RELATIVE ? R_386_PC32 : R_386_32);
+    for (size_t j = 0; j < sizeof(rel); j++)
+    {
+      buffer_write(out, ((char*) &rel)[j]);
+    }
+  }
+}
+
+bool elf_write_object(struct assembler* assembler, const char* filename)
+{
+  FILE* file = fopen(filename, "wb");
+  if (!file)
+  {
+    return false;
+  }
+
+  struct buffer* shstrtab = buffer_create();
+  struct buffer* strtab = buffer_create();
+  struct buffer* symtab = buffer_create();
+  struct buffer* relocations[ASSEMBLER_SECTION_TOTAL];
+  Elf32_Shdr headers[ELF_SECTION_TOTAL] = {0};
+
+  // The string tables start with the empty name
+  buffer_write(shstrtab, 0);
+  buffer_write(strtab, 0);
+  int first_global = elf_build_symtab(assembler, symtab, strtab);
+
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    struct assembler_section* section = &assembler->sections[i];
+    Elf32_Shdr* header = &headers[ELF_SECTION_FIRST_DATA + i];
+    header->sh_name = elf_string(shstrtab, section->name);
+    header->sh_type = i == ASSEMBLER_SECTION_BSS ? SHT_NOBITS : SHT_PROGBITS;
+    header->sh_flags = SHF_ALLOC;
+    if (i == ASSEMBLER_SECTION_TEXT)
+    {
+      header->sh_flags |= SHF_EXECINSTR;
+    }
+    else if (i != ASSEMBLER_SECTION_RODATA)
+    {
+      header->sh_flags |= SHF_WRITE;
+    }
+    header->sh_size = section->size;
+    header->sh_addralign = section->alignment;
+
+    char name[32];
+    snprintf(name, sizeof(name), ".rel%s", section->name);
+    relocations[i] = buffer_create();
+    elf_build_relocations(section, relocations[i]);
+    Elf32_Shdr* rel_header = &headers[ELF_SECTION_FIRST_RELOCATION + i];
+    rel_header->sh_name = elf_string(shstrtab, name);
+    rel_header->sh_type = SHT_REL;
+    rel_header->sh_size = relocations[i]->len;
+    rel_header->sh_link = ELF_SECTION_SYMTAB;
+    rel_header->sh_info = ELF_SECTION_FIRST_DATA + i;
+    rel_header->sh_addralign = 4;
+    rel_header->sh_entsize = sizeof(Elf32_Rel);
+  }
+
+  headers[ELF_SECTION_SYMTAB].sh_name = elf_string(shstrtab, ".symtab");
+  headers[ELF_SECTION_SYMTAB].sh_type = SHT_SYMTAB;
+  headers[ELF_SECTION_SYMTAB].sh_size = symtab->len;
+  headers[ELF_SECTION_SYMTAB].sh_link = ELF_SECTION_STRTAB;
+  headers[ELF_SECTION_SYMTAB].sh_info = first_global;
+  headers[ELF_SECTION_SYMTAB].sh_addralign = 4;
+  headers[ELF_SECTION_SYMTAB].sh_entsize = sizeof(Elf32_Sym);
+
+  headers[ELF_SECTION_STRTAB].sh_name = elf_string(shstrtab, ".strtab");
+  headers[ELF_SECTION_STRTAB].sh_type = SHT_STRTAB;
+  headers[ELF_SECTION_STRTAB].sh_size = strtab->len;
+  headers[ELF_SECTION_STRTAB].sh_addralign = 1;
+
+  headers[ELF_SECTION_NOTE_GNU_STACK].sh_name = elf_string(shstrtab, ".note.GNU-stack");
+  headers[ELF_SECTION_NOTE_GNU_STACK].sh_type = SHT_PROGBITS;
+  headers[ELF_SECTION_NOTE_GNU_STACK].sh_addralign = 1;
+
+  // Named last so its own name is in it
+  headers[ELF_SECTION_SHSTRTAB].sh_name = elf_string(shstrtab, ".shstrtab");
+  headers[ELF_SECTION_SHSTRTAB].sh_type = SHT_STRTAB;
+  headers[ELF_SECTION_SHSTRTAB].sh_size = shstrtab->len;
+  headers[ELF_SECTION_SHSTRTAB].sh_addralign = 1;
+
+  // The contents of every section follow the file header, the section headers come last
+  struct buffer* contents[ELF_SECTION_TOTAL] = {0};
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    contents[ELF_SECTION_FIRST_DATA + i] = assembler->sections[i].data;
+    contents[ELF_SECTION_FIRST_RELOCATION + i] = relocations[i];
+  }
+  contents[ELF_SECTION_SYMTAB] = symtab;
+  contents[ELF_SECTION_STRTAB] = strtab;
+  contents[ELF_SECTION_SHSTRTAB] = shstrtab;
+
+  fseek(file, sizeof(Elf32_Ehdr), SEEK_SET);
+  for (int i = 1; i < ELF_SECTION_TOTAL; i++)
+  {
+    Elf32_Shdr* header = &headers[i];
+    elf_write_padding(file, header->sh_addralign ? header->sh_addralign : 1);
+    header->sh_offset = ftell(file);
+    if (contents[i] && header->sh_type != SHT_NOBITS)
+    {
+      fwrite(contents[i]->data, 1, contents[i]->len, file);
+    }
+  }
+
+  elf_write_padding(file, 4);
+  long section_headers = ftell(file);
+  fwrite(headers, sizeof(Elf32_Shdr), ELF_SECTION_TOTAL, file);
+
+  Elf32_Ehdr ehdr = {0};
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS32;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  ehdr.e_type = ET_REL;
+  ehdr.e_machine = EM_386;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_shoff = section_headers;
+  ehdr.e_ehsize = sizeof(Elf32_Ehdr);
+  ehdr.e_shentsize = sizeof(Elf32_Shdr);
+  ehdr.e_shnum = ELF_SECTION_TOTAL;
+  ehdr.e_shstrndx = ELF_SECTION_SHSTRTAB;
+  fseek(file, 0, SEEK_SET);
+  fwrite(&ehdr, sizeof(ehdr), 1, file);
+  fclose(file);
+
+  for (int i = 0; i < ASSEMBLER_SECTION_TOTAL; i++)
+  {
+    buffer_free(relocations[i]);
+  }
+  buffer_free(symtab);
+  buffer_free(strtab);
+  buffer_free(shstrtab);
+  return true;
+}
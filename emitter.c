@@ -0,0 +1,231 @@
+#include "compiler.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+
+struct emitter* emitter_new(FILE* ofile, int flags)
+{
+  struct emitter* emitter = calloc(1, sizeof(struct emitter));
+  emitter->ofile = ofile;
+  emitter->flags = flags;
+  emitter->msize = EMITTER_FLUSH_SIZE;
+  emitter->data = malloc(emitter->msize);
+  return emitter;
+}
+
+void emitter_free(struct emitter* emitter)
+{
+  emitter_flush(emitter);
+  free(emitter->data);
+  free(emitter);
+}
+
+static void emitter_write_fd(int fd, const char* data, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written = write(fd, data, len);
+    if (written < 0)
+    {
+      return;
+    }
+
+    data += written;
+    len -= written;
+  }
+}
+
+void emitter_flush(struct emitter* emitter)
+{
+  if (emitter->len == 0)
+  {
+    return;
+  }
+
+  if (emitter->flags & COMPILE_PROCESS_ECHO_ASM)
+  {
+    fflush(stdout);
+    emitter_write_fd(STDOUT_FILENO, emitter->data, emitter->len);
+  }
+
+  if (emitter->ofile)
+  {
+    // Nothing else writes to the output file but be safe with anything stdio holds
+    fflush(emitter->ofile);
+    emitter_write_fd(fileno(emitter->ofile), emitter->data, emitter->len);
+  }
+
+  emitter->len = 0;
+}
+
+static void emitter_reserve(struct emitter* emitter, size_t len)
+{
+  if (emitter->len + len <= emitter->msize)
+  {
+    return;
+  }
+
+  // Write out what we have in one go before considering growing the buffer,
+  // emitters without an output just keep growing
+  if (emitter->ofile || emitter->flags & COMPILE_PROCESS_ECHO_ASM)
+  {
+    emitter_flush(emitter);
+  }
+  while (emitter->len + len > emitter->msize)
+  {
+    emitter->msize *= 2;
+  }
+  emitter->data = realloc(emitter->data, emitter->msize);
+  assert(emitter->data);
+}
+
+void emitter_write(struct emitter* emitter, const char* str, size_t len)
+{
+  emitter_reserve(emitter, len);
+  memcpy(emitter->data + emitter->len, str, len);
+  emitter->len += len;
+}
+
+static void emitter_write_char(struct emitter* emitter, char c)
+{
+  emitter_reserve(emitter, 1);
+  emitter->data[emitter->len++] = c;
+}
+
+static void emitter_write_number(struct emitter* emitter, long long value)
+{
+  char tmp[24];
+  int i = sizeof(tmp);
+  // Work with the negative value so LLONG_MIN does not overflow
+  bool negative = value < 0;
+  if (!negative)
+  {
+    value = -value;
+  }
+
+  do
+  {
+    tmp[--i] = '0' - (value % 10);
+    value /= 10;
+  } while (value);
+
+  if (negative)
+  {
+    tmp[--i] = '-';
+  }
+
+  emitter_write(emitter, &tmp[i], sizeof(tmp) - i);
+}
+
+/**
+ * @brief Returns true if every conversion in the format is one we can write
+ * without going through vsnprintf. i.e %s %i %d %lld %c %%
+ */
+static bool emitter_format_is_simple(const char* fmt)
+{
+  for (const char* ptr = fmt; *ptr; ptr++)
+  {
+    if (*ptr != '%')
+    {
+      continue;
+    }
+
+    ptr++;
+    if (*ptr == 'l' && *(ptr+1) == 'l')
+    {
+      ptr += 2;
+      if (*ptr != 'i' && *ptr != 'd')
+      {
+        return false;
+      }
+      continue;
+    }
+
+    switch (*ptr)
+    {
+      case 's':
+      case 'i':
+      case 'd':
+      case 'c':
+      case '%':
+      break;
+
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void emitter_printf(struct emitter* emitter, const char* fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  emitter_vprintf(emitter, fmt, args);
+  va_end(args);
+}
+
+void emitter_vprintf(struct emitter* emitter, const char* fmt, va_list args)
+{
+  if (!emitter_format_is_simple(fmt))
+  {
+    va_list args2;
+    va_copy(args2, args);
+    int len = vsnprintf(NULL, 0, fmt, args2);
+    va_end(args2);
+    if (len < 0)
+    {
+      return;
+    }
+    emitter_reserve(emitter, len + 1);
+    vsnprintf(emitter->data + emitter->len, len + 1, fmt, args);
+    emitter->len += len;
+    return;
+  }
+
+  const char* start = fmt;
+  const char* ptr = fmt;
+  while (*ptr)
+  {
+    if (*ptr != '%')
+    {
+      ptr++;
+      continue;
+    }
+
+    emitter_write(emitter, start, ptr - start);
+    ptr++;
+    if (*ptr == 'l')
+    {
+      ptr += 2;
+      emitter_write_number(emitter, va_arg(args, long long));
+    }
+    else if (*ptr == 'i' || *ptr == 'd')
+    {
+      emitter_write_number(emitter, va_arg(args, int));
+    }
+    else if (*ptr == 's')
+    {
+      const char* str = va_arg(args, const char*);
+      if (!str)
+      {
+        str = "(null)";
+      }
+      emitter_write(emitter, str, strlen(str));
+    }
+    else if (*ptr == 'c')
+    {
+      emitter_write_char(emitter, (char) va_arg(args, int));
+    }
+    else
+    {
+      emitter_write_char(emitter, '%');
+    }
+
+    ptr++;
+    start = ptr;
+  }
+
+  emitter_write(emitter, start, ptr - start);
+}
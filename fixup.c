@@ -2,10 +2,15 @@
 #include "helpers/vector.h"
 #include <stdlib.h>
 
+#define FIXUP_START_SLOTS 16
+
 struct fixup_system* fixup_sys_new()
 {
   struct fixup_system* system = calloc(1, sizeof(struct fixup_system));
-  system->fixups = vector_create(sizeof(struct fixup));
+  system->fixups = vector_create(sizeof(struct fixup*));
+  system->buckets = vector_create(sizeof(struct fixup_bucket*));
+  system->total_slots = FIXUP_START_SLOTS;
+  system->slots = calloc(system->total_slots, sizeof(struct fixup_bucket*));
   return system;
 }
 
@@ -41,30 +46,100 @@ void fixup_sys_fixups_free(struct fixup_system* system)
   }
 }
 
+void fixup_sys_buckets_free(struct fixup_system* system)
+{
+  vector_set_peek_pointer(system->buckets, 0);
+  struct fixup_bucket* bucket = vector_peek_ptr(system->buckets);
+  while (bucket)
+  {
+    vector_free(bucket->fixups);
+    free(bucket);
+    bucket = vector_peek_ptr(system->buckets);
+  }
+}
+
 void fixup_sys_free(struct fixup_system* system)
 {
   fixup_sys_fixups_free(system);
+  fixup_sys_buckets_free(system);
   vector_free(system->fixups);
+  vector_free(system->buckets);
+  free(system->slots);
   free(system);
 }
 
 int fixup_sys_unresolved_fixups_count(struct fixup_system* system)
 {
-  size_t count = 0;
-  fixup_start_iteration(system);
-  struct fixup* fixup = fixup_next(system);
-  while (fixup)
+  return system->unresolved;
+}
+
+static unsigned int fixup_hash(const char* name)
+{
+  unsigned int hash = 2166136261u;
+  for (const char* c = name; *c; c++)
   {
-    if (fixup->flags & FIXUP_FLAG_RESOLVED)
+    hash = (hash ^ (unsigned char) *c) * 16777619u;
+  }
+  return hash;
+}
+
+static void fixup_slots_insert(struct fixup_system* system, struct fixup_bucket* bucket)
+{
+  unsigned int slot = fixup_hash(bucket->name) & (system->total_slots - 1);
+  bucket->next = system->slots[slot];
+  system->slots[slot] = bucket;
+}
+
+/**
+ * @brief Doubles the hash slots once there are more names than slots
+ */
+static void fixup_slots_grow(struct fixup_system* system)
+{
+  free(system->slots);
+  system->total_slots *= 2;
+  system->slots = calloc(system->total_slots, sizeof(struct fixup_bucket*));
+  for (int i = 0; i < vector_count(system->buckets); i++)
+  {
+    fixup_slots_insert(system, *(struct fixup_bucket**) vector_at(system->buckets, i));
+  }
+}
+
+struct fixup_bucket* fixup_bucket_for_name(struct fixup_system* system, const char* name)
+{
+  struct fixup_bucket* bucket = system->slots[fixup_hash(name) & (system->total_slots - 1)];
+  while (bucket)
+  {
+    if (S_EQ(bucket->name, name))
     {
-      fixup = fixup_next(system);
-      continue;
+      return bucket;
+    }
+    bucket = bucket->next;
+  }
+
+  return NULL;
+}
+
+void fixup_bucket_push(struct fixup_system* system, struct fixup* fixup)
+{
+  const char* name = fixup_config(fixup)->name;
+  struct fixup_bucket* bucket = fixup_bucket_for_name(system, name);
+  if (!bucket)
+  {
+    bucket = calloc(1, sizeof(struct fixup_bucket));
+    bucket->name = name;
+    bucket->fixups = vector_create(sizeof(struct fixup*));
+    vector_push(system->buckets, &bucket);
+    if (vector_count(system->buckets) > system->total_slots)
+    {
+      fixup_slots_grow(system);
+    }
+    else
+    {
+      fixup_slots_insert(system, bucket);
     }
-    count++;
-    fixup = fixup_next(system);
   }
 
-  return count;
+  vector_push(bucket->fixups, &fixup);
 }
 
 struct fixup* fixup_register(struct fixup_system* system, struct fixup_config* config)
@@ -72,15 +147,26 @@ struct fixup* fixup_register(struct fixup_system* system, struct fixup_config* c
   struct fixup* fixup = calloc(1, sizeof(struct fixup));
   memcpy(&fixup->config, config, sizeof(struct fixup_config));
   fixup->system = system;
-  vector_push(system->fixups, fixup);
+  vector_push(system->fixups, &fixup);
+  system->unresolved++;
+  if (config->name)
+  {
+    fixup_bucket_push(system, fixup);
+  }
   return fixup;
 }
 
 bool fixup_resolve(struct fixup* fixup)
 {
+  if (fixup->flags & FIXUP_FLAG_RESOLVED)
+  {
+    return true;
+  }
+
   if (fixup_config(fixup)->fix(fixup))
   {
     fixup->flags |= FIXUP_FLAG_RESOLVED;
+    fixup->system->unresolved--;
     return true;
   }
 
@@ -92,19 +178,44 @@ void* fixup_private(struct fixup* fixup)
   return fixup_config(fixup)->private;
 }
 
+void fixups_resolve_for_name(struct fixup_system* system, const char* name)
+{
+  if (!name)
+  {
+    return;
+  }
+
+  struct fixup_bucket* bucket = fixup_bucket_for_name(system, name);
+  if (!bucket)
+  {
+    // Nobody is waiting for this name
+    return;
+  }
+
+  vector_set_peek_pointer(bucket->fixups, 0);
+  struct fixup* fixup = vector_peek_ptr(bucket->fixups);
+  while (fixup)
+  {
+    fixup_resolve(fixup);
+    fixup = vector_peek_ptr(bucket->fixups);
+  }
+}
+
 bool fixups_resolve(struct fixup_system* system)
 {
+  if (system->unresolved == 0)
+  {
+    return true;
+  }
+
+  // Only fixups whose name was never defined are left, try them one last time
   fixup_start_iteration(system);
   struct fixup* fixup = fixup_next(system);
   while (fixup)
   {
-    if (fixup->flags & FIXUP_FLAG_RESOLVED)
-    {
-      continue;
-    }
     fixup_resolve(fixup);
     fixup = fixup_next(system);
   }
 
   return fixup_sys_unresolved_fixups_count(system) == 0;
-}
\ No newline at end of file
+}
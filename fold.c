@@ -0,0 +1,457 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <limits.h>
+
+/**
+ * Folds constant expressions in the node tree before code generation.
+ * Number nodes are int unless they are floating, i.e 1.5 or 1.5f. Everything here follows
+ * the rules of 32 bit signed int arithmetic and floating numbers are only negated and cast.
+ */
+
+// The compile process being folded, one per thread
+static _Thread_local struct compile_process* fold_process = NULL;
+
+static bool fold_int_value(struct node* node, int* value_out)
+{
+  if (node->type != NODE_TYPE_NUMBER || node_is_floating_number(node))
+  {
+    return false;
+  }
+
+  // Results we folded are stored sign extended, anything outside of int is left alone
+  long long value = (long long) node->llnum;
+  if (value < INT_MIN || value > INT_MAX)
+  {
+    return false;
+  }
+
+  *value_out = (int) value;
+  return true;
+}
+
+static void fold_to_number(struct node* node, int value)
+{
+  node->type = NODE_TYPE_NUMBER;
+  node->llnum = (long long) value;
+  node->num.type = NUMBER_TYPE_NORMAL;
+  fold_process->total_folded++;
+}
+
+static void fold_to_floating_number(struct node* node, double value, int type)
+{
+  node->type = NODE_TYPE_NUMBER;
+  node->dnum = type == NUMBER_TYPE_FLOAT ? (float) value : value;
+  node->num.type = type;
+  fold_process->total_folded++;
+}
+
+static void fold_to_node(struct node* node, struct node* other)
+{
+  *node = *other;
+  fold_process->total_folded++;
+}
+
+/**
+ * @brief Returns true if evaluating the node can not change anything, so it can be dropped
+ */
+static bool fold_is_pure(struct node* node)
+{
+  switch (node->type)
+  {
+    case NODE_TYPE_NUMBER:
+    case NODE_TYPE_IDENTIFIER:
+    case NODE_TYPE_STRING:
+      return true;
+
+    case NODE_TYPE_EXPRESSION:
+      if (is_node_assignment(node) || S_EQ(node->exp.op, "()") || S_EQ(node->exp.op, "?"))
+      {
+        return false;
+      }
+      return fold_is_pure(node->exp.left) && (node->exp.right->type == NODE_TYPE_BRACKET ? fold_is_pure(node->exp.right->bracket.inner) : fold_is_pure(node->exp.right));
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+      return fold_is_pure(node->parenthesis.exp);
+
+    case NODE_TYPE_UNARY:
+      return (S_EQ(node->unary.op, "-") || S_EQ(node->unary.op, "!") || S_EQ(node->unary.op, "~") || S_EQ(node->unary.op, "*") || S_EQ(node->unary.op, "&")) && fold_is_pure(node->unary.operand);
+
+    case NODE_TYPE_CAST:
+      return fold_is_pure(node->cast.operand);
+  }
+
+  return false;
+}
+
+/**
+ * @brief Evaluates "left op right" as C would for two ints. Returns false for operators
+ * we do not fold and for anything the C standard leaves undefined, i.e dividing by zero
+ */
+static bool fold_evaluate(const char* op, int left, int right, int* result_out)
+{
+  // Wrap around like the generated code would rather than overflowing in the compiler
+  unsigned int uleft = (unsigned int) left;
+  unsigned int uright = (unsigned int) right;
+  if (S_EQ(op, "+"))
+  {
+    *result_out = (int)(uleft + uright);
+  }
+  else if (S_EQ(op, "-"))
+  {
+    *result_out = (int)(uleft - uright);
+  }
+  else if (S_EQ(op, "*"))
+  {
+    *result_out = (int)(uleft * uright);
+  }
+  else if (S_EQ(op, "/") || S_EQ(op, "%"))
+  {
+    if (right == 0 || (left == INT_MIN && right == -1))
+    {
+      return false;
+    }
+    *result_out = S_EQ(op, "/") ? left / right : left % right;
+  }
+  else if (S_EQ(op, "<<") || S_EQ(op, ">>"))
+  {
+    if (right < 0 || right >= 32)
+    {
+      return false;
+    }
+    // Right shifts of signed values are arithmetic, the generated code uses sar
+    *result_out = S_EQ(op, "<<") ? (int)(uleft << right) : left >> right;
+  }
+  else if (S_EQ(op, "&"))
+  {
+    *result_out = left & right;
+  }
+  else if (S_EQ(op, "|"))
+  {
+    *result_out = left | right;
+  }
+  else if (S_EQ(op, "^"))
+  {
+    *result_out = left ^ right;
+  }
+  else if (S_EQ(op, "=="))
+  {
+    *result_out = left == right;
+  }
+  else if (S_EQ(op, "!="))
+  {
+    *result_out = left != right;
+  }
+  else if (S_EQ(op, "<"))
+  {
+    *result_out = left < right;
+  }
+  else if (S_EQ(op, ">"))
+  {
+    *result_out = left > right;
+  }
+  else if (S_EQ(op, "<="))
+  {
+    *result_out = left <= right;
+  }
+  else if (S_EQ(op, ">="))
+  {
+    *result_out = left >= right;
+  }
+  else if (S_EQ(op, "&&"))
+  {
+    *result_out = left && right;
+  }
+  else if (S_EQ(op, "||"))
+  {
+    *result_out = left || right;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Applies identities where only one side is a constant, i.e x+0 or x*0
+ */
+static void fold_identity(struct node* node, struct node* other, int value, bool constant_on_left)
+{
+  const char* op = node->exp.op;
+  if (value == 0 && (S_EQ(op, "+") || S_EQ(op, "|") || S_EQ(op, "^")))
+  {
+    fold_to_node(node, other);
+    return;
+  }
+
+  if (!constant_on_left && value == 0 && (S_EQ(op, "-") || S_EQ(op, "<<") || S_EQ(op, ">>")))
+  {
+    fold_to_node(node, other);
+    return;
+  }
+
+  if (value == 1 && (S_EQ(op, "*") || (!constant_on_left && S_EQ(op, "/"))))
+  {
+    fold_to_node(node, other);
+    return;
+  }
+
+  if (value == 0 && (S_EQ(op, "*") || S_EQ(op, "&")) && fold_is_pure(other))
+  {
+    fold_to_number(node, 0);
+    return;
+  }
+
+  // The right side is never evaluated in these cases
+  if (constant_on_left && ((value == 0 && S_EQ(op, "&&")) || (value != 0 && S_EQ(op, "||"))))
+  {
+    fold_to_number(node, value != 0);
+  }
+}
+
+static void fold_expression(struct node* node)
+{
+  if (S_EQ(node->exp.op, "?"))
+  {
+    int condition = 0;
+    struct node* tenary_node = node->exp.right;
+    if (fold_int_value(node->exp.left, &condition))
+    {
+      fold_to_node(node, condition ? tenary_node->tenary.true_node : tenary_node->tenary.false_node);
+    }
+    return;
+  }
+
+  int left = 0;
+  int right = 0;
+  bool left_is_constant = fold_int_value(node->exp.left, &left);
+  bool right_is_constant = fold_int_value(node->exp.right, &right);
+  if (left_is_constant && right_is_constant)
+  {
+    int result = 0;
+    if (fold_evaluate(node->exp.op, left, right, &result))
+    {
+      fold_to_number(node, result);
+    }
+    return;
+  }
+
+  if (left_is_constant)
+  {
+    fold_identity(node, node->exp.right, left, true);
+  }
+  else if (right_is_constant)
+  {
+    fold_identity(node, node->exp.left, right, false);
+  }
+}
+
+static void fold_unary(struct node* node)
+{
+  struct node* operand = node->unary.operand;
+  if (node_is_floating_number(operand) && S_EQ(node->unary.op, "-"))
+  {
+    fold_to_floating_number(node, -operand->dnum, operand->num.type);
+    return;
+  }
+
+  int value = 0;
+  if (!fold_int_value(operand, &value))
+  {
+    return;
+  }
+
+  if (S_EQ(node->unary.op, "-"))
+  {
+    fold_to_number(node, (int)(0u - (unsigned int) value));
+  }
+  else if (S_EQ(node->unary.op, "~"))
+  {
+    fold_to_number(node, ~value);
+  }
+  else if (S_EQ(node->unary.op, "!"))
+  {
+    fold_to_number(node, !value);
+  }
+}
+
+/**
+ * @brief Folds casts of constants to the integer types, the result must still fit in an int
+ * as number nodes have no type to say otherwise. i.e (unsigned int) -1 is left as a cast.
+ * Casts of constants to float and double become floating numbers
+ */
+static void fold_cast(struct node* node)
+{
+  struct datatype* dtype = &node->cast.dtype;
+  struct node* operand = node->cast.operand;
+  if (datatype_is_floating(dtype) && operand->type == NODE_TYPE_NUMBER)
+  {
+    double value = node_is_floating_number(operand) ? operand->dnum : (double)(long long) operand->llnum;
+    fold_to_floating_number(node, value, dtype->type == DATA_TYPE_FLOAT ? NUMBER_TYPE_FLOAT : NUMBER_TYPE_DOUBLE);
+    return;
+  }
+
+  int value = 0;
+  if (dtype->flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY))
+  {
+    return;
+  }
+
+  // Floating numbers are truncated towards zero, those that do not fit an int are left alone
+  if (node_is_floating_number(operand) && operand->dnum > INT_MIN - 1.0 && operand->dnum < INT_MAX + 1.0)
+  {
+    value = (int) operand->dnum;
+  }
+  else if (!fold_int_value(operand, &value))
+  {
+    return;
+  }
+
+  bool is_signed = dtype->flags & DATATYPE_FLAG_IS_SIGNED;
+  switch (dtype->type)
+  {
+    case DATA_TYPE_CHAR:
+      fold_to_number(node, is_signed ? (int)(signed char) value : (int)(unsigned char) value);
+    break;
+
+    case DATA_TYPE_SHORT:
+      fold_to_number(node, is_signed ? (int)(short) value : (int)(unsigned short) value);
+    break;
+
+    case DATA_TYPE_INTEGER:
+    case DATA_TYPE_LONG:
+      if (is_signed || value >= 0)
+      {
+        fold_to_number(node, value);
+      }
+    break;
+  }
+}
+
+static void fold_node_if_any(struct node* node)
+{
+  if (node)
+  {
+    fold_node(fold_process, node);
+  }
+}
+
+static void fold_statements(struct vector* statements)
+{
+  for (int i = 0; i < vector_count(statements); i++)
+  {
+    fold_node_if_any(*(struct node**) vector_at(statements, i));
+  }
+}
+
+struct node* fold_node(struct compile_process* process, struct node* node)
+{
+  fold_process = process;
+  switch (node->type)
+  {
+    case NODE_TYPE_EXPRESSION:
+      fold_node_if_any(node->exp.left);
+      if (S_EQ(node->exp.op, "()") && node->exp.right->type == NODE_TYPE_EXPRESSION_PARENTHESES)
+      {
+        // The call needs its parentheses, only fold the arguments inside
+        fold_node_if_any(node->exp.right->parenthesis.exp);
+        break;
+      }
+      fold_node_if_any(node->exp.right);
+      fold_expression(node);
+    break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+      fold_node_if_any(node->parenthesis.exp);
+      // Nothing left to group once the inside is a single value, i.e (a + 0)
+      if (node->parenthesis.exp->type == NODE_TYPE_NUMBER || node->parenthesis.exp->type == NODE_TYPE_IDENTIFIER)
+      {
+        fold_to_node(node, node->parenthesis.exp);
+      }
+    break;
+
+    case NODE_TYPE_UNARY:
+      fold_node_if_any(node->unary.operand);
+      fold_unary(node);
+    break;
+
+    case NODE_TYPE_CAST:
+      fold_node_if_any(node->cast.operand);
+      fold_cast(node);
+    break;
+
+    case NODE_TYPE_TENARY:
+      fold_node_if_any(node->tenary.true_node);
+      fold_node_if_any(node->tenary.false_node);
+    break;
+
+    case NODE_TYPE_BRACKET:
+      fold_node_if_any(node->bracket.inner);
+    break;
+
+    case NODE_TYPE_VARIABLE:
+      fold_node_if_any(node->var.val);
+    break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+      fold_statements(node->var_list.list);
+    break;
+
+    case NODE_TYPE_FUNCTION:
+      fold_node_if_any(node->func.body_n);
+    break;
+
+    case NODE_TYPE_BODY:
+      fold_statements(node->body.statements);
+    break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+      fold_node_if_any(node->stmt.return_stmt.exp);
+    break;
+
+    case NODE_TYPE_STATEMENT_IF:
+      fold_node_if_any(node->stmt.if_stmt.cond_node);
+      fold_node_if_any(node->stmt.if_stmt.body_node);
+      fold_node_if_any(node->stmt.if_stmt.next);
+    break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+      fold_node_if_any(node->stmt.else_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+      fold_node_if_any(node->stmt.while_stmt.exp_node);
+      fold_node_if_any(node->stmt.while_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+      fold_node_if_any(node->stmt.do_while_stmt.exp_node);
+      fold_node_if_any(node->stmt.do_while_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+      fold_node_if_any(node->stmt.for_stmt.init_node);
+      fold_node_if_any(node->stmt.for_stmt.cond_node);
+      fold_node_if_any(node->stmt.for_stmt.loop_node);
+      fold_node_if_any(node->stmt.for_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+      fold_node_if_any(node->stmt.switch_stmt.exp);
+      fold_node_if_any(node->stmt.switch_stmt.body);
+    break;
+
+    case NODE_TYPE_STATEMENT_CASE:
+      fold_node_if_any(node->stmt._case.exp);
+    break;
+  }
+
+  return node;
+}
+
+void fold(struct compile_process* process)
+{
+  fold_process = process;
+  fold_statements(process->node_tree_vec);
+}
@@ -0,0 +1,348 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Frame pointer omission. Every function addresses its arguments and locals through ebp,
+ * this pass follows how far esp is below where it was on entry at every instruction and
+ * rewrites those addresses relative to esp. The push ebp, mov ebp, esp and pop ebp go and ebp
+ * is no longer touched, a leaf function without locals is left with just its body and ret.
+ * Functions whose stack we can not follow, raw lines, indirect jumps or esp written some
+ * other way, keep their frame.
+ */
+
+// The depth of an instruction or label no path we followed reaches
+#define FRAME_DEPTH_UNKNOWN -1
+
+struct frame_label
+{
+  const char* name;
+  int depth;
+};
+
+struct frame
+{
+  struct vector* instructions;
+  struct regalloc_function* function;
+
+  // Vector of struct frame_label, how far esp is below its value on entry at each label
+  struct vector* labels;
+  // How far esp is below its value on entry before each instruction of the function runs
+  int* depths;
+};
+
+static struct instruction* frame_at(struct frame* frame, int index)
+{
+  return vector_at(frame->instructions, index);
+}
+
+static bool frame_is_live(struct instruction* ins)
+{
+  return !(ins->flags & INSTRUCTION_FLAG_DELETED) && ins->opcode != INSTRUCTION_OPCODE_COMMENT;
+}
+
+static bool frame_is_register(struct instruction_operand* operand, int reg)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && operand->reg == reg;
+}
+
+static bool frame_is_jump(struct instruction* ins)
+{
+  return ins->opcode >= INSTRUCTION_OPCODE_JMP && ins->opcode <= INSTRUCTION_OPCODE_JBE;
+}
+
+static bool frame_is_stack_adjust(struct instruction* ins)
+{
+  return (ins->opcode == INSTRUCTION_OPCODE_ADD || ins->opcode == INSTRUCTION_OPCODE_SUB) && frame_is_register(&ins->operands[0], REGISTER_ESP) &&
+    ins->operands[1].type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE && ins->operands[1].imm % DATA_SIZE_DWORD == 0;
+}
+
+/**
+ * @brief True for an address that is ebp and a constant, offset_out is given the constant
+ */
+static bool frame_ebp_address(struct instruction_operand* operand, int* offset_out)
+{
+  struct instruction_address* address = &operand->address;
+  if (operand->type != INSTRUCTION_OPERAND_TYPE_MEMORY || address->base != REGISTER_EBP || address->index != -1 || address->symbol)
+  {
+    return false;
+  }
+
+  *offset_out = address->displacement;
+  return true;
+}
+
+static bool frame_uses_ebp(struct instruction_operand* operand)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_MEMORY && instruction_address_uses(&operand->address, REGISTER_EBP);
+}
+
+static int* frame_label_depth(struct frame* frame, const char* name)
+{
+  vector_set_peek_pointer(frame->labels, 0);
+  struct frame_label* label = vector_peek(frame->labels);
+  while (label)
+  {
+    if (S_EQ(label->name, name))
+    {
+      return &label->depth;
+    }
+    label = vector_peek(frame->labels);
+  }
+
+  struct frame_label new_label = {.name=name, .depth=FRAME_DEPTH_UNKNOWN};
+  vector_push(frame->labels, &new_label);
+  return &((struct frame_label*) vector_back(frame->labels))->depth;
+}
+
+/**
+ * @brief Gives the label the depth esp is at when we get to it. Returns false if another
+ * path reaches it at a different depth, sets changed when we learn something new
+ */
+static bool frame_merge_label(struct frame* frame, const char* name, int depth, bool* changed)
+{
+  int* label_depth = frame_label_depth(frame, name);
+  if (*label_depth == FRAME_DEPTH_UNKNOWN)
+  {
+    *label_depth = depth;
+    *changed = true;
+    return true;
+  }
+
+  return *label_depth == depth;
+}
+
+/**
+ * @brief Works out the depth of esp before every instruction after the prologue. Code runs
+ * again until the labels stop changing, a jump back to a label tells us about the code after it.
+ * Returns false if the stack moves in a way we can not follow
+ */
+static bool frame_follow_stack(struct frame* frame)
+{
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    int depth = 0;
+    for (int i = frame->function->start + 2; i < frame->function->end; i++)
+    {
+      struct instruction* ins = frame_at(frame, i);
+      int* depth_out = &frame->depths[i - frame->function->start];
+      if (ins->opcode == INSTRUCTION_OPCODE_LABEL)
+      {
+        if (depth == FRAME_DEPTH_UNKNOWN)
+        {
+          depth = *frame_label_depth(frame, ins->text);
+        }
+        else if (!frame_merge_label(frame, ins->text, depth, &changed))
+        {
+          return false;
+        }
+      }
+
+      *depth_out = depth;
+      if (!frame_is_live(ins) || !instruction_is_machine_instruction(ins) || depth == FRAME_DEPTH_UNKNOWN)
+      {
+        continue;
+      }
+
+      if (frame_is_jump(ins))
+      {
+        if (ins->operands[0].type != INSTRUCTION_OPERAND_TYPE_SYMBOL || !frame_merge_label(frame, ins->operands[0].symbol, depth, &changed))
+        {
+          return false;
+        }
+        depth = ins->opcode == INSTRUCTION_OPCODE_JMP ? FRAME_DEPTH_UNKNOWN : depth;
+      }
+      else if (ins->opcode == INSTRUCTION_OPCODE_RET)
+      {
+        if (depth != 0)
+        {
+          return false;
+        }
+        depth = FRAME_DEPTH_UNKNOWN;
+      }
+      else if (ins->opcode == INSTRUCTION_OPCODE_PUSH)
+      {
+        depth += DATA_SIZE_DWORD;
+      }
+      else if (ins->opcode == INSTRUCTION_OPCODE_POP && !frame_is_register(&ins->operands[0], REGISTER_EBP))
+      {
+        // The pop ebp of the epilogue goes with the frame
+        depth -= DATA_SIZE_DWORD;
+      }
+      else if (frame_is_stack_adjust(ins))
+      {
+        depth += ins->opcode == INSTRUCTION_OPCODE_SUB ? ins->operands[1].imm : -ins->operands[1].imm;
+      }
+
+      if (depth != FRAME_DEPTH_UNKNOWN && depth < 0)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the offset from esp the ebp address will be at, -1 if we can not reach it from esp
+ */
+static int frame_esp_offset(struct frame* frame, int index, int operand_index)
+{
+  struct instruction* ins = frame_at(frame, index);
+  int depth = frame->depths[index - frame->function->start];
+  int offset = 0;
+  if (depth == FRAME_DEPTH_UNKNOWN || !frame_ebp_address(&ins->operands[operand_index], &offset))
+  {
+    return -1;
+  }
+
+  // The saved ebp at ebp+0 and the return address at ebp+4 are not ours to touch
+  if (offset >= 0 && offset < DATA_SIZE_DWORD * 2)
+  {
+    return -1;
+  }
+
+  // A pop works out the address it writes to after esp has moved
+  if (ins->opcode == INSTRUCTION_OPCODE_POP)
+  {
+    depth -= DATA_SIZE_DWORD;
+  }
+
+  // Arguments move down as the saved ebp is gone, locals stay where they are
+  int esp_offset = depth + (offset < 0 ? offset : offset - DATA_SIZE_DWORD);
+  return esp_offset >= 0 ? esp_offset : -1;
+}
+
+/**
+ * @brief Returns true if every use of ebp and esp after the prologue is one we can rewrite
+ */
+static bool frame_can_omit(struct frame* frame)
+{
+  for (int i = frame->function->start + 2; i < frame->function->end; i++)
+  {
+    struct instruction* ins = frame_at(frame, i);
+    if (!frame_is_live(ins))
+    {
+      continue;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_RAW)
+    {
+      return false;
+    }
+
+    if (!instruction_is_machine_instruction(ins))
+    {
+      continue;
+    }
+
+    // Anything else that writes esp moves it by an amount we do not know
+    if (frame_is_register(&ins->operands[0], REGISTER_ESP) && !frame_is_stack_adjust(ins))
+    {
+      return false;
+    }
+
+    for (int j = 0; j < ins->total_operands; j++)
+    {
+      struct instruction_operand* operand = &ins->operands[j];
+      if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && register_family(operand->reg) == REGISTER_EBP &&
+        !(ins->opcode == INSTRUCTION_OPCODE_POP && operand->reg == REGISTER_EBP))
+      {
+        return false;
+      }
+
+      if (frame_uses_ebp(operand) && frame_esp_offset(frame, i, j) == -1)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void frame_rewrite(struct frame* frame)
+{
+  frame_at(frame, frame->function->start)->flags |= INSTRUCTION_FLAG_DELETED;
+  frame_at(frame, frame->function->start + 1)->flags |= INSTRUCTION_FLAG_DELETED;
+  for (int i = frame->function->start + 2; i < frame->function->end; i++)
+  {
+    struct instruction* ins = frame_at(frame, i);
+    if (!frame_is_live(ins) || !instruction_is_machine_instruction(ins))
+    {
+      continue;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_POP && frame_is_register(&ins->operands[0], REGISTER_EBP))
+    {
+      ins->flags |= INSTRUCTION_FLAG_DELETED;
+      continue;
+    }
+
+    for (int j = 0; j < ins->total_operands; j++)
+    {
+      struct instruction_operand* operand = &ins->operands[j];
+      if (!frame_uses_ebp(operand))
+      {
+        continue;
+      }
+
+      operand->address = (struct instruction_address){.base=REGISTER_ESP, .index=-1, .scale=1, .displacement=frame_esp_offset(frame, i, j)};
+    }
+  }
+}
+
+static bool frame_has_prologue(struct frame* frame)
+{
+  if (frame->function->end - frame->function->start < 2)
+  {
+    return false;
+  }
+
+  struct instruction* push_ins = frame_at(frame, frame->function->start);
+  struct instruction* mov_ins = frame_at(frame, frame->function->start + 1);
+  return push_ins->opcode == INSTRUCTION_OPCODE_PUSH && frame_is_register(&push_ins->operands[0], REGISTER_EBP) &&
+    mov_ins->opcode == INSTRUCTION_OPCODE_MOV && frame_is_register(&mov_ins->operands[0], REGISTER_EBP) &&
+    frame_is_register(&mov_ins->operands[1], REGISTER_ESP);
+}
+
+static bool frame_omit_function(struct frame* frame)
+{
+  if (!frame_has_prologue(frame))
+  {
+    return false;
+  }
+
+  int total = frame->function->end - frame->function->start;
+  frame->depths = calloc(total, sizeof(int));
+  vector_clear(frame->labels);
+  bool omitted = frame_follow_stack(frame) && frame_can_omit(frame);
+  if (omitted)
+  {
+    frame_rewrite(frame);
+  }
+
+  free(frame->depths);
+  frame->depths = NULL;
+  return omitted;
+}
+
+void frame_omit(struct compile_process* process)
+{
+  struct code_generator* generator = process->generator;
+  struct frame frame = {.instructions=generator->instructions->instructions};
+  frame.labels = vector_create(sizeof(struct frame_label));
+  for (int i = 0; i < vector_count(generator->functions); i++)
+  {
+    frame.function = vector_at(generator->functions, i);
+    if (frame_omit_function(&frame))
+    {
+      generator->total_frames_omitted++;
+    }
+  }
+
+  vector_free(frame.labels);
+}
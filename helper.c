@@ -111,25 +111,13 @@ int array_multiplier(struct datatype* dtype, int index, int index_value)
     return index_value;
   }
 
-  vector_set_peek_pointer(dtype->array.brackets->n_brackets, index+1);
-  int size_sum = index_value;
-  struct node* bracket_node = vector_peek_ptr(dtype->array.brackets->n_brackets);
-  while (bracket_node)
-  {
-    assert(bracket_node->bracket.inner->type == NODE_TYPE_NUMBER);
-    int declared_index = bracket_node->bracket.inner->llnum;
-    int size_value = declared_index;
-    size_sum *= size_value;
-    bracket_node = vector_peek_ptr(dtype->array.brackets->n_brackets);
-  }
-
-  return size_sum;
+  return index_value * array_brackets_stride(dtype->array.brackets, index+1);
 }
 
 int array_offset(struct datatype* dtype, int index, int index_value)
 {
   if (!(dtype->flags & DATATYPE_FLAG_IS_ARRAY) ||
-      (index == vector_count(dtype->array.brackets->n_brackets) - 1))
+      (index == dtype->array.brackets->total - 1))
   {
     return index_value * datatype_element_size(dtype);
   }
@@ -285,6 +273,33 @@ struct datatype datatype_for_numeric()
   return dtype;
 }
 
+/**
+ * @brief The datatype of a string literal, a pointer to its first char
+ */
+struct datatype datatype_for_string()
+{
+  struct datatype dtype = {};
+  dtype.flags |= DATATYPE_FLAG_IS_SIGNED | DATATYPE_FLAG_IS_POINTER;
+  dtype.type = DATA_TYPE_CHAR;
+  dtype.type_str = "char";
+  dtype.size = DATA_SIZE_BYTE;
+  dtype.pointer_depth = 1;
+  return dtype;
+}
+
+/**
+ * @brief The datatype of a floating number node of the given NUMBER_TYPE_FLOAT or NUMBER_TYPE_DOUBLE
+ */
+struct datatype datatype_for_floating(int type)
+{
+  struct datatype dtype = {};
+  dtype.flags |= DATATYPE_FLAG_IS_SIGNED;
+  dtype.type = type == NUMBER_TYPE_FLOAT ? DATA_TYPE_FLOAT : DATA_TYPE_DOUBLE;
+  dtype.type_str = type == NUMBER_TYPE_FLOAT ? "float" : "double";
+  dtype.size = type == NUMBER_TYPE_FLOAT ? DATA_SIZE_DWORD : DATA_SIZE_DDWORD;
+  return dtype;
+}
+
 struct datatype* datatype_thats_a_pointer(struct datatype* d1, struct datatype* d2)
 {
   if (d1->flags & DATATYPE_FLAG_IS_POINTER)
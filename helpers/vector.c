@@ -29,6 +29,7 @@ struct vector* vector_create_no_saves(size_t esize)
   vector->pindex = 0;
   vector->esize = esize;
   vector->count = 0;
+  return vector;
 }
 
 size_t vector_total_size(struct vector* vector)
@@ -49,8 +50,12 @@ struct vector* vector_clone(struct vector* vector)
   memcpy(new_vec, vector, sizeof(struct vector));
   new_vec->data = new_data_address;
 
-  // Saves are not cloned with vector_clone yet.
+  // Saves are not cloned with vector_clone yet, the clone starts with its own empty save stack
   // assert(vector->saves == NULL);
+  if (vector->saves)
+  {
+    new_vec->saves = vector_create_no_saves(sizeof(struct vector));
+  }
 
   return new_vec;
 }
@@ -64,6 +69,11 @@ struct vector* vector_create(size_t esize)
 
 void vector_free(struct vector* vector)
 {
+  if (vector->saves)
+  {
+    vector_free(vector->saves);
+  }
+
   free(vector->data);
   free(vector);
 }
@@ -0,0 +1,615 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Inlines calls to small functions in the node tree before code generation. A function can be
+ * inlined when its body is a single return of an int expression made of its int parameters,
+ * int globals, numbers, operators and calls to functions returning int. It must not call itself through
+ * the functions it calls and must be no bigger than INLINER_MAX_NODES nodes unless it is
+ * declared inline. Functions are visited callees first so what we inline is already inlined.
+ *
+ * Each parameter is replaced by a copy of its argument. Arguments may not have side effects so
+ * when and how often they run does not matter, anything but a number or variable must be used
+ * exactly once so nothing is computed twice.
+ */
+
+// Functions bigger than this are only inlined when declared inline
+#define INLINER_MAX_NODES 16
+
+enum
+{
+  INLINER_FUNCTION_UNVISITED,
+  INLINER_FUNCTION_VISITING,
+  INLINER_FUNCTION_DONE
+};
+
+struct inliner_function
+{
+  struct node* node;
+  int state;
+  // Calls itself directly or through the functions it calls
+  bool recursive;
+};
+
+struct inliner_parameter
+{
+  // The number of times the callee reads the parameter
+  int uses;
+  // True if it is read in the arguments of a call the callee makes
+  bool in_call_arguments;
+  struct node* argument;
+};
+
+struct inliner
+{
+  struct compile_process* process;
+  // Vector of struct inliner_function, every function with a body
+  struct vector* functions;
+  // The function whose body we are inlining calls into
+  struct node* caller;
+};
+
+static bool inliner_is_int(struct datatype* dtype)
+{
+  return dtype->type == DATA_TYPE_INTEGER && dtype->flags & DATATYPE_FLAG_IS_SIGNED &&
+    !(dtype->flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY));
+}
+
+/**
+ * @brief True for the types whose values are the same as an int once promoted, i.e char
+ */
+static bool inliner_promotes_to_int(struct datatype* dtype)
+{
+  if (dtype->flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY))
+  {
+    return false;
+  }
+
+  return dtype->type == DATA_TYPE_CHAR || dtype->type == DATA_TYPE_SHORT || inliner_is_int(dtype);
+}
+
+static bool inliner_is_operator(const char* op)
+{
+  static const char* operators[] = {"+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^", "==", "!=", "<", ">", "<=", ">=", "&&", "||"};
+  for (size_t i = 0; i < sizeof(operators) / sizeof(const char*); i++)
+  {
+    if (S_EQ(op, operators[i]))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool inliner_is_call(struct node* node)
+{
+  return node->type == NODE_TYPE_EXPRESSION && S_EQ(node->exp.op, "()") && node->exp.left->type == NODE_TYPE_IDENTIFIER &&
+    node->exp.right->type == NODE_TYPE_EXPRESSION_PARENTHESES;
+}
+
+/**
+ * @brief Returns the function node with the name, its definition if there is one
+ */
+static struct node* inliner_function_node(struct inliner* inliner, const char* name)
+{
+  struct node* found = NULL;
+  for (int i = 0; i < vector_count(inliner->process->node_tree_vec); i++)
+  {
+    struct node* node = *(struct node**) vector_at(inliner->process->node_tree_vec, i);
+    if (node->type == NODE_TYPE_FUNCTION && S_EQ(node->func.name, name) && (!found || node->func.body_n))
+    {
+      found = node;
+    }
+  }
+
+  return found;
+}
+
+static struct inliner_function* inliner_function(struct inliner* inliner, const char* name)
+{
+  vector_set_peek_pointer(inliner->functions, 0);
+  struct inliner_function* function = vector_peek(inliner->functions);
+  while (function)
+  {
+    if (S_EQ(function->node->func.name, name))
+    {
+      return function;
+    }
+    function = vector_peek(inliner->functions);
+  }
+
+  return NULL;
+}
+
+static void inliner_check_variable(struct node* var_node, const char* name, bool* declared, bool* promotes_to_int)
+{
+  if (var_node->type == NODE_TYPE_VARIABLE && var_node->var.name && S_EQ(var_node->var.name, name))
+  {
+    *declared = true;
+    *promotes_to_int &= inliner_promotes_to_int(&var_node->var.type);
+  }
+}
+
+/**
+ * @brief Looks for variables with the name declared anywhere in the node, clears
+ * promotes_to_int if any of them holds something other than an int
+ */
+static void inliner_find_variables(struct node* node, const char* name, bool* declared, bool* promotes_to_int)
+{
+  if (!node)
+  {
+    return;
+  }
+
+  switch (node->type)
+  {
+    case NODE_TYPE_VARIABLE:
+      inliner_check_variable(node, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+    case NODE_TYPE_BODY:
+    {
+      struct vector* statements = node->type == NODE_TYPE_BODY ? node->body.statements : node->var_list.list;
+      for (int i = 0; i < vector_count(statements); i++)
+      {
+        inliner_find_variables(*(struct node**) vector_at(statements, i), name, declared, promotes_to_int);
+      }
+    }
+    break;
+
+    case NODE_TYPE_STATEMENT_IF:
+      inliner_find_variables(node->stmt.if_stmt.body_node, name, declared, promotes_to_int);
+      inliner_find_variables(node->stmt.if_stmt.next, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+      inliner_find_variables(node->stmt.else_stmt.body_node, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+      inliner_find_variables(node->stmt.while_stmt.body_node, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+      inliner_find_variables(node->stmt.do_while_stmt.body_node, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+      inliner_find_variables(node->stmt.for_stmt.init_node, name, declared, promotes_to_int);
+      inliner_find_variables(node->stmt.for_stmt.body_node, name, declared, promotes_to_int);
+    break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+      inliner_find_variables(node->stmt.switch_stmt.body, name, declared, promotes_to_int);
+    break;
+  }
+}
+
+/**
+ * @brief True if the caller declares a parameter or local with the name anywhere in it
+ */
+static bool inliner_caller_declares(struct inliner* inliner, const char* name, bool* promotes_to_int)
+{
+  bool declared = false;
+  *promotes_to_int = true;
+  struct vector* arguments = function_node_argument_vec(inliner->caller);
+  for (int i = 0; i < vector_count(arguments); i++)
+  {
+    inliner_check_variable(*(struct node**) vector_at(arguments, i), name, &declared, promotes_to_int);
+  }
+  inliner_find_variables(inliner->caller->func.body_n, name, &declared, promotes_to_int);
+  return declared;
+}
+
+/**
+ * @brief True if the name is a global variable that holds an int once promoted
+ */
+static bool inliner_is_int_global(struct inliner* inliner, const char* name)
+{
+  bool declared = false;
+  bool promotes_to_int = true;
+  for (int i = 0; i < vector_count(inliner->process->node_tree_vec); i++)
+  {
+    struct node* node = *(struct node**) vector_at(inliner->process->node_tree_vec, i);
+    if (node->type == NODE_TYPE_VARIABLE || node->type == NODE_TYPE_VARIABLE_LIST)
+    {
+      inliner_find_variables(node, name, &declared, &promotes_to_int);
+    }
+  }
+
+  return declared && promotes_to_int;
+}
+
+static int inliner_parameter_index(struct node* callee, const char* name)
+{
+  struct vector* parameters = function_node_argument_vec(callee);
+  for (int i = 0; i < vector_count(parameters); i++)
+  {
+    struct node* parameter = *(struct node**) vector_at(parameters, i);
+    if (S_EQ(parameter->var.name, name))
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Checks the callee's return expression can be moved into the caller as is, counting its
+ * nodes and how the parameters are used as it goes
+ */
+static bool inliner_check_callee_expression(struct inliner* inliner, struct node* callee, struct node* node, struct inliner_parameter* parameters, bool in_call_arguments, int* total_nodes)
+{
+  (*total_nodes)++;
+  bool promotes_to_int = true;
+  switch (node->type)
+  {
+    case NODE_TYPE_NUMBER:
+      return !node_is_floating_number(node);
+
+    case NODE_TYPE_IDENTIFIER:
+    {
+      int index = inliner_parameter_index(callee, node->sval);
+      if (index != -1)
+      {
+        parameters[index].uses++;
+        parameters[index].in_call_arguments |= in_call_arguments;
+        return true;
+      }
+
+      // In the caller the name must still mean the global it means in the callee
+      return inliner_is_int_global(inliner, node->sval) && !inliner_caller_declares(inliner, node->sval, &promotes_to_int);
+    }
+
+    case NODE_TYPE_UNARY:
+      return (S_EQ(node->unary.op, "-") || S_EQ(node->unary.op, "~") || S_EQ(node->unary.op, "!")) &&
+        inliner_check_callee_expression(inliner, callee, node->unary.operand, parameters, in_call_arguments, total_nodes);
+
+    case NODE_TYPE_EXPRESSION:
+      if (inliner_is_call(node))
+      {
+        struct node* function_node = inliner_function_node(inliner, node->exp.left->sval);
+        struct node* arguments = node->exp.right->parenthesis.exp;
+        return function_node && inliner_is_int(&function_node->func.rtype) && !inliner_caller_declares(inliner, node->exp.left->sval, &promotes_to_int) &&
+          (arguments->type == NODE_TYPE_BLANK || inliner_check_callee_expression(inliner, callee, arguments, parameters, true, total_nodes));
+      }
+
+      // Commas only separate call arguments here. Tenaries are left out, code generation
+      // only ever sees them as a whole expression and not as the operand of another
+      if (!inliner_is_operator(node->exp.op) && !(in_call_arguments && S_EQ(node->exp.op, ",")))
+      {
+        return false;
+      }
+      return inliner_check_callee_expression(inliner, callee, node->exp.left, parameters, in_call_arguments, total_nodes) &&
+        inliner_check_callee_expression(inliner, callee, node->exp.right, parameters, in_call_arguments, total_nodes);
+  }
+
+  return false;
+}
+
+/**
+ * @brief True if the argument is an int expression of the caller's variables and numbers
+ * that can be evaluated any number of times without changing anything
+ */
+static bool inliner_is_pure_argument(struct inliner* inliner, struct node* node)
+{
+  bool promotes_to_int = true;
+  switch (node->type)
+  {
+    case NODE_TYPE_NUMBER:
+      return !node_is_floating_number(node);
+
+    case NODE_TYPE_IDENTIFIER:
+      if (inliner_caller_declares(inliner, node->sval, &promotes_to_int))
+      {
+        return promotes_to_int;
+      }
+      return inliner_is_int_global(inliner, node->sval);
+
+    case NODE_TYPE_UNARY:
+      return (S_EQ(node->unary.op, "-") || S_EQ(node->unary.op, "~") || S_EQ(node->unary.op, "!")) && inliner_is_pure_argument(inliner, node->unary.operand);
+
+    case NODE_TYPE_EXPRESSION:
+      return inliner_is_operator(node->exp.op) && inliner_is_pure_argument(inliner, node->exp.left) && inliner_is_pure_argument(inliner, node->exp.right);
+  }
+
+  return false;
+}
+
+/**
+ * @brief Splits "a, b, c" into its arguments in order. Returns false if there are more than fit
+ */
+static bool inliner_collect_arguments(struct node* node, struct node** arguments, int max, int* total)
+{
+  if (node->type == NODE_TYPE_BLANK)
+  {
+    return true;
+  }
+
+  if (node_is_expression(node, ","))
+  {
+    return inliner_collect_arguments(node->exp.left, arguments, max, total) && inliner_collect_arguments(node->exp.right, arguments, max, total);
+  }
+
+  if (*total == max)
+  {
+    return false;
+  }
+
+  arguments[(*total)++] = node;
+  return true;
+}
+
+/**
+ * @brief Returns the expression the callee returns if calls to it can be inlined, otherwise NULL
+ */
+static struct node* inliner_callee_expression(struct inliner_function* function)
+{
+  struct node* callee = function->node;
+  struct node* body = callee->func.body_n;
+  if (function->state != INLINER_FUNCTION_DONE || function->recursive || callee->func.flags & FUNCTION_NODE_FLAG_IS_NATIVE ||
+    !inliner_is_int(&callee->func.rtype) || vector_count(body->body.statements) != 1)
+  {
+    return NULL;
+  }
+
+  struct vector* parameters = function_node_argument_vec(callee);
+  for (int i = 0; i < vector_count(parameters); i++)
+  {
+    struct node* parameter = *(struct node**) vector_at(parameters, i);
+    if (parameter->type != NODE_TYPE_VARIABLE || !inliner_is_int(&parameter->var.type))
+    {
+      return NULL;
+    }
+  }
+
+  struct node* stmt = *(struct node**) vector_at(body->body.statements, 0);
+  return stmt->type == NODE_TYPE_STATEMENT_RETURN ? stmt->stmt.return_stmt.exp : NULL;
+}
+
+/**
+ * @brief Copies the callee's expression with every parameter replaced by a copy of its argument
+ */
+static struct node* inliner_clone(struct node* callee, struct node* node, struct inliner_parameter* parameters)
+{
+  // Arguments are copied with no parameters, their names are the caller's
+  if (parameters && node->type == NODE_TYPE_IDENTIFIER)
+  {
+    int index = inliner_parameter_index(callee, node->sval);
+    if (index != -1)
+    {
+      return inliner_clone(callee, parameters[index].argument, NULL);
+    }
+  }
+
+  struct node* copy = malloc(sizeof(struct node));
+  memcpy(copy, node, sizeof(struct node));
+  switch (node->type)
+  {
+    case NODE_TYPE_EXPRESSION:
+      copy->exp.left = inliner_clone(callee, node->exp.left, parameters);
+      copy->exp.right = inliner_clone(callee, node->exp.right, parameters);
+    break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+      copy->parenthesis.exp = inliner_clone(callee, node->parenthesis.exp, parameters);
+    break;
+
+    case NODE_TYPE_UNARY:
+      copy->unary.operand = inliner_clone(callee, node->unary.operand, parameters);
+    break;
+  }
+
+  return copy;
+}
+
+/**
+ * @brief Replaces the call with the body of the function it calls if we can
+ */
+static void inliner_inline_call(struct inliner* inliner, struct node* node, struct inliner_function* function)
+{
+  struct node* expression = inliner_callee_expression(function);
+  if (!expression)
+  {
+    return;
+  }
+
+  struct node* callee = function->node;
+  int total_parameters = vector_count(function_node_argument_vec(callee));
+  struct inliner_parameter* parameters = calloc(total_parameters + 1, sizeof(struct inliner_parameter));
+  struct node** arguments = calloc(total_parameters + 1, sizeof(struct node*));
+  int total_arguments = 0;
+  int total_nodes = 0;
+  bool inline_call = inliner_collect_arguments(node->exp.right->parenthesis.exp, arguments, total_parameters, &total_arguments) &&
+    total_arguments == total_parameters && inliner_check_callee_expression(inliner, callee, expression, parameters, false, &total_nodes) &&
+    (total_nodes <= INLINER_MAX_NODES || callee->func.rtype.flags & DATATYPE_FLAG_IS_INLINE);
+
+  for (int i = 0; inline_call && i < total_parameters; i++)
+  {
+    struct node* argument = arguments[i];
+    parameters[i].argument = argument;
+    bool is_simple = argument->type == NODE_TYPE_NUMBER || argument->type == NODE_TYPE_IDENTIFIER;
+    inline_call = inliner_is_pure_argument(inliner, argument) && (is_simple || (parameters[i].uses == 1 && !parameters[i].in_call_arguments));
+  }
+
+  if (inline_call)
+  {
+    struct node* copy = inliner_clone(callee, expression, parameters);
+    *node = *copy;
+    free(copy);
+    inliner->process->total_inlined++;
+  }
+
+  free(parameters);
+  free(arguments);
+}
+
+static void inliner_visit(struct inliner* inliner, struct inliner_function* function);
+
+static void inliner_node(struct inliner* inliner, struct node* node);
+
+static void inliner_node_if_any(struct inliner* inliner, struct node* node)
+{
+  if (node)
+  {
+    inliner_node(inliner, node);
+  }
+}
+
+static void inliner_statements(struct inliner* inliner, struct vector* statements)
+{
+  for (int i = 0; i < vector_count(statements); i++)
+  {
+    inliner_node_if_any(inliner, *(struct node**) vector_at(statements, i));
+  }
+}
+
+static void inliner_call(struct inliner* inliner, struct node* node)
+{
+  // Arguments first so what we pass on is already inlined
+  inliner_node_if_any(inliner, node->exp.right->parenthesis.exp);
+  struct inliner_function* function = inliner_function(inliner, node->exp.left->sval);
+  if (!function)
+  {
+    return;
+  }
+
+  if (function->state == INLINER_FUNCTION_UNVISITED)
+  {
+    inliner_visit(inliner, function);
+  }
+  else if (function->state == INLINER_FUNCTION_VISITING)
+  {
+    function->recursive = true;
+  }
+
+  inliner_inline_call(inliner, node, function);
+}
+
+static void inliner_node(struct inliner* inliner, struct node* node)
+{
+  switch (node->type)
+  {
+    case NODE_TYPE_EXPRESSION:
+      if (inliner_is_call(node))
+      {
+        inliner_call(inliner, node);
+        break;
+      }
+      inliner_node_if_any(inliner, node->exp.left);
+      inliner_node_if_any(inliner, node->exp.right);
+    break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+      inliner_node_if_any(inliner, node->parenthesis.exp);
+    break;
+
+    case NODE_TYPE_UNARY:
+      inliner_node_if_any(inliner, node->unary.operand);
+    break;
+
+    case NODE_TYPE_CAST:
+      inliner_node_if_any(inliner, node->cast.operand);
+    break;
+
+    case NODE_TYPE_TENARY:
+      inliner_node_if_any(inliner, node->tenary.true_node);
+      inliner_node_if_any(inliner, node->tenary.false_node);
+    break;
+
+    case NODE_TYPE_BRACKET:
+      inliner_node_if_any(inliner, node->bracket.inner);
+    break;
+
+    case NODE_TYPE_VARIABLE:
+      inliner_node_if_any(inliner, node->var.val);
+    break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+      inliner_statements(inliner, node->var_list.list);
+    break;
+
+    case NODE_TYPE_BODY:
+      inliner_statements(inliner, node->body.statements);
+    break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+      inliner_node_if_any(inliner, node->stmt.return_stmt.exp);
+    break;
+
+    case NODE_TYPE_STATEMENT_IF:
+      inliner_node_if_any(inliner, node->stmt.if_stmt.cond_node);
+      inliner_node_if_any(inliner, node->stmt.if_stmt.body_node);
+      inliner_node_if_any(inliner, node->stmt.if_stmt.next);
+    break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+      inliner_node_if_any(inliner, node->stmt.else_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+      inliner_node_if_any(inliner, node->stmt.while_stmt.exp_node);
+      inliner_node_if_any(inliner, node->stmt.while_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+      inliner_node_if_any(inliner, node->stmt.do_while_stmt.exp_node);
+      inliner_node_if_any(inliner, node->stmt.do_while_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+      inliner_node_if_any(inliner, node->stmt.for_stmt.init_node);
+      inliner_node_if_any(inliner, node->stmt.for_stmt.cond_node);
+      inliner_node_if_any(inliner, node->stmt.for_stmt.loop_node);
+      inliner_node_if_any(inliner, node->stmt.for_stmt.body_node);
+    break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+      inliner_node_if_any(inliner, node->stmt.switch_stmt.exp);
+      inliner_node_if_any(inliner, node->stmt.switch_stmt.body);
+    break;
+  }
+}
+
+/**
+ * @brief Inlines the calls in the function's body, visiting the functions it calls first
+ */
+static void inliner_visit(struct inliner* inliner, struct inliner_function* function)
+{
+  struct node* caller = inliner->caller;
+  function->state = INLINER_FUNCTION_VISITING;
+  inliner->caller = function->node;
+  inliner_node(inliner, function->node->func.body_n);
+  inliner->caller = caller;
+  function->state = INLINER_FUNCTION_DONE;
+}
+
+void inliner(struct compile_process* process)
+{
+  struct inliner inliner = {.process=process};
+  inliner.functions = vector_create(sizeof(struct inliner_function));
+  for (int i = 0; i < vector_count(process->node_tree_vec); i++)
+  {
+    struct node* node = *(struct node**) vector_at(process->node_tree_vec, i);
+    if (node->type == NODE_TYPE_FUNCTION && node->func.body_n)
+    {
+      struct inliner_function function = {.node=node};
+      vector_push(inliner.functions, &function);
+    }
+  }
+
+  for (int i = 0; i < vector_count(inliner.functions); i++)
+  {
+    struct inliner_function* function = vector_at(inliner.functions, i);
+    if (function->state == INLINER_FUNCTION_UNVISITED)
+    {
+      inliner_visit(&inliner, function);
+    }
+  }
+
+  vector_free(inliner.functions);
+}
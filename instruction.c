@@ -0,0 +1,486 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define INSTRUCTION_SYMBOL_START_SLOTS 64
+
+static const char* instruction_opcode_names[] = {
+  [INSTRUCTION_OPCODE_MOV] = "mov",
+  [INSTRUCTION_OPCODE_MOVZX] = "movzx",
+  [INSTRUCTION_OPCODE_MOVSX] = "movsx",
+  [INSTRUCTION_OPCODE_LEA] = "lea",
+  [INSTRUCTION_OPCODE_PUSH] = "push",
+  [INSTRUCTION_OPCODE_POP] = "pop",
+  [INSTRUCTION_OPCODE_ADD] = "add",
+  [INSTRUCTION_OPCODE_SUB] = "sub",
+  [INSTRUCTION_OPCODE_IMUL] = "imul",
+  [INSTRUCTION_OPCODE_MUL] = "mul",
+  [INSTRUCTION_OPCODE_IDIV] = "idiv",
+  [INSTRUCTION_OPCODE_DIV] = "div",
+  [INSTRUCTION_OPCODE_CDQ] = "cdq",
+  [INSTRUCTION_OPCODE_NEG] = "neg",
+  [INSTRUCTION_OPCODE_NOT] = "not",
+  [INSTRUCTION_OPCODE_INC] = "inc",
+  [INSTRUCTION_OPCODE_DEC] = "dec",
+  [INSTRUCTION_OPCODE_XOR] = "xor",
+  [INSTRUCTION_OPCODE_OR] = "or",
+  [INSTRUCTION_OPCODE_AND] = "and",
+  [INSTRUCTION_OPCODE_SAL] = "sal",
+  [INSTRUCTION_OPCODE_SAR] = "sar",
+  [INSTRUCTION_OPCODE_SHL] = "shl",
+  [INSTRUCTION_OPCODE_SHR] = "shr",
+  [INSTRUCTION_OPCODE_CMP] = "cmp",
+  [INSTRUCTION_OPCODE_TEST] = "test",
+  [INSTRUCTION_OPCODE_JMP] = "jmp",
+  [INSTRUCTION_OPCODE_JE] = "je",
+  [INSTRUCTION_OPCODE_JNE] = "jne",
+  [INSTRUCTION_OPCODE_JG] = "jg",
+  [INSTRUCTION_OPCODE_JL] = "jl",
+  [INSTRUCTION_OPCODE_JGE] = "jge",
+  [INSTRUCTION_OPCODE_JLE] = "jle",
+  [INSTRUCTION_OPCODE_JA] = "ja",
+  [INSTRUCTION_OPCODE_JB] = "jb",
+  [INSTRUCTION_OPCODE_JAE] = "jae",
+  [INSTRUCTION_OPCODE_JBE] = "jbe",
+  [INSTRUCTION_OPCODE_SETE] = "sete",
+  [INSTRUCTION_OPCODE_SETNE] = "setne",
+  [INSTRUCTION_OPCODE_SETG] = "setg",
+  [INSTRUCTION_OPCODE_SETL] = "setl",
+  [INSTRUCTION_OPCODE_SETGE] = "setge",
+  [INSTRUCTION_OPCODE_SETLE] = "setle",
+  [INSTRUCTION_OPCODE_SETA] = "seta",
+  [INSTRUCTION_OPCODE_SETB] = "setb",
+  [INSTRUCTION_OPCODE_SETAE] = "setae",
+  [INSTRUCTION_OPCODE_SETBE] = "setbe",
+  [INSTRUCTION_OPCODE_CALL] = "call",
+  [INSTRUCTION_OPCODE_RET] = "ret",
+};
+
+static const char* instruction_register_names[] = {
+  [REGISTER_EAX] = "eax",
+  [REGISTER_EBX] = "ebx",
+  [REGISTER_ECX] = "ecx",
+  [REGISTER_EDX] = "edx",
+  [REGISTER_ESI] = "esi",
+  [REGISTER_EDI] = "edi",
+  [REGISTER_EBP] = "ebp",
+  [REGISTER_ESP] = "esp",
+  [REGISTER_AX] = "ax",
+  [REGISTER_BX] = "bx",
+  [REGISTER_CX] = "cx",
+  [REGISTER_DX] = "dx",
+  [REGISTER_AL] = "al",
+  [REGISTER_BL] = "bl",
+  [REGISTER_CL] = "cl",
+  [REGISTER_DL] = "dl",
+  [REGISTER_AH] = "ah",
+  [REGISTER_BH] = "bh",
+  [REGISTER_CH] = "ch",
+  [REGISTER_DH] = "dh",
+};
+
+static const char* instruction_size_keywords[] = {
+  [DATA_SIZE_BYTE] = "byte",
+  [DATA_SIZE_WORD] = "word",
+  [DATA_SIZE_DWORD] = "dword",
+  [DATA_SIZE_DDWORD] = "qword",
+};
+
+const char* instruction_opcode_name(int opcode)
+{
+  assert(opcode >= 0 && opcode < INSTRUCTION_OPCODE_TOTAL);
+  return instruction_opcode_names[opcode];
+}
+
+const char* instruction_register_name(int reg)
+{
+  assert(reg >= 0 && reg < REGISTER_TOTAL);
+  return instruction_register_names[reg];
+}
+
+/**
+ * @brief The keyword for a memory access of size bytes, only byte, word, dword and qword accesses exist
+ */
+const char* instruction_size_keyword(int size)
+{
+  assert(size > 0 && size < sizeof(instruction_size_keywords) / sizeof(*instruction_size_keywords) && instruction_size_keywords[size]);
+  return instruction_size_keywords[size];
+}
+
+struct instruction_list* instruction_list_new()
+{
+  struct instruction_list* list = calloc(1, sizeof(struct instruction_list));
+  list->instructions = vector_create(sizeof(struct instruction));
+  list->inserts = vector_create(sizeof(struct instruction_insert));
+  list->total_symbol_slots = INSTRUCTION_SYMBOL_START_SLOTS;
+  list->symbol_slots = calloc(list->total_symbol_slots, sizeof(struct instruction_symbol*));
+  return list;
+}
+
+void instruction_list_free(struct instruction_list* list)
+{
+  instruction_list_clear(list);
+  vector_free(list->instructions);
+  vector_free(list->inserts);
+  for (int i = 0; i < list->total_symbol_slots; i++)
+  {
+    struct instruction_symbol* symbol = list->symbol_slots[i];
+    while (symbol)
+    {
+      struct instruction_symbol* next = symbol->next;
+      free(symbol->name);
+      free(symbol);
+      symbol = next;
+    }
+  }
+  free(list->symbol_slots);
+  free(list);
+}
+
+void instruction_list_clear(struct instruction_list* list)
+{
+  vector_set_peek_pointer(list->instructions, 0);
+  struct instruction* ins = vector_peek(list->instructions);
+  while (ins)
+  {
+    free(ins->text);
+    ins = vector_peek(list->instructions);
+  }
+  vector_clear(list->instructions);
+}
+
+static unsigned int instruction_symbol_hash(const char* name)
+{
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (const char* c = name; *c; c++)
+  {
+    hash = (hash ^ (unsigned char) *c) * 16777619u;
+  }
+  return hash;
+}
+
+static void instruction_symbol_slot_add(struct instruction_list* list, struct instruction_symbol* symbol)
+{
+  int index = instruction_symbol_hash(symbol->name) & (list->total_symbol_slots - 1);
+  symbol->next = list->symbol_slots[index];
+  list->symbol_slots[index] = symbol;
+}
+
+/**
+ * @brief Doubles the hash slots once there are more names than slots
+ */
+static void instruction_symbol_slots_grow(struct instruction_list* list)
+{
+  struct instruction_symbol** old_slots = list->symbol_slots;
+  int old_total = list->total_symbol_slots;
+  list->total_symbol_slots *= 2;
+  list->symbol_slots = calloc(list->total_symbol_slots, sizeof(struct instruction_symbol*));
+  for (int i = 0; i < old_total; i++)
+  {
+    struct instruction_symbol* symbol = old_slots[i];
+    while (symbol)
+    {
+      struct instruction_symbol* next = symbol->next;
+      instruction_symbol_slot_add(list, symbol);
+      symbol = next;
+    }
+  }
+  free(old_slots);
+}
+
+/**
+ * @brief Returns the list's copy of the name, the same name always gives the same pointer
+ */
+const char* instruction_list_symbol(struct instruction_list* list, const char* name)
+{
+  int index = instruction_symbol_hash(name) & (list->total_symbol_slots - 1);
+  for (struct instruction_symbol* symbol = list->symbol_slots[index]; symbol; symbol = symbol->next)
+  {
+    if (S_EQ(symbol->name, name))
+    {
+      return symbol->name;
+    }
+  }
+
+  struct instruction_symbol* symbol = calloc(1, sizeof(struct instruction_symbol));
+  symbol->name = strdup(name);
+  list->total_symbols++;
+  if (list->total_symbols > list->total_symbol_slots)
+  {
+    instruction_symbol_slots_grow(list);
+  }
+  instruction_symbol_slot_add(list, symbol);
+  return symbol->name;
+}
+
+struct instruction* instruction_list_push(struct instruction_list* list, struct instruction* ins)
+{
+  vector_push(list->instructions, ins);
+  return vector_back(list->instructions);
+}
+
+/**
+ * @brief Queues the instruction to go in front of the one at the index. Nothing moves until
+ * instruction_list_apply_inserts so the indexes of the list stay as they are until then.
+ * Of the instructions queued for the same index the last one queued ends up first.
+ */
+void instruction_list_insert(struct instruction_list* list, int index, struct instruction* ins)
+{
+  struct instruction_insert insert = {.index=index, .ins=*ins};
+  vector_push(list->inserts, &insert);
+}
+
+static int instruction_compare_inserts(const void* a, const void* b)
+{
+  const struct instruction_insert* insert_a = *(struct instruction_insert* const*) a;
+  const struct instruction_insert* insert_b = *(struct instruction_insert* const*) b;
+  if (insert_a->index != insert_b->index)
+  {
+    return insert_a->index - insert_b->index;
+  }
+
+  // Later in the queue goes first, the addresses tell the order they were queued in
+  return insert_a < insert_b ? 1 : -1;
+}
+
+/**
+ * @brief Puts every queued instruction in place, moving each instruction of the list once
+ */
+void instruction_list_apply_inserts(struct instruction_list* list)
+{
+  int total_inserts = vector_count(list->inserts);
+  if (total_inserts == 0)
+  {
+    return;
+  }
+
+  // qsort is not stable, sorting pointers into the queue lets the comparison see the order they were queued in
+  struct instruction_insert** sorted = calloc(total_inserts, sizeof(struct instruction_insert*));
+  for (int i = 0; i < total_inserts; i++)
+  {
+    sorted[i] = vector_at(list->inserts, i);
+  }
+  qsort(sorted, total_inserts, sizeof(struct instruction_insert*), instruction_compare_inserts);
+
+  int total = vector_count(list->instructions);
+  struct instruction empty = {};
+  for (int i = 0; i < total_inserts; i++)
+  {
+    vector_push(list->instructions, &empty);
+  }
+
+  // Fill from the back, an instruction queued for index i goes after the one at i-1
+  int read = total - 1;
+  int insert = total_inserts - 1;
+  for (int write = total + total_inserts - 1; insert >= 0; write--)
+  {
+    if (read >= 0 && sorted[insert]->index <= read)
+    {
+      memcpy(vector_at(list->instructions, write), vector_at(list->instructions, read), sizeof(struct instruction));
+      read--;
+      continue;
+    }
+
+    memcpy(vector_at(list->instructions, write), &sorted[insert]->ins, sizeof(struct instruction));
+    insert--;
+  }
+
+  free(sorted);
+  vector_clear(list->inserts);
+}
+
+static void instruction_push_text(struct instruction_list* list, int opcode, const char* text, size_t len)
+{
+  struct instruction ins = {.opcode=opcode};
+  ins.text = strndup(text, len);
+  instruction_list_push(list, &ins);
+}
+
+/**
+ * @brief Pushes a line that is not an instruction we model, i.e labels, comments and directives.
+ * Instructions are built as struct instruction and pushed with instruction_list_push
+ */
+struct instruction* instruction_list_push_text(struct instruction_list* list, const char* line, size_t len)
+{
+  if (len == 0 || line[0] == ';')
+  {
+    instruction_push_text(list, INSTRUCTION_OPCODE_COMMENT, line, len);
+    return vector_back(list->instructions);
+  }
+
+  if (line[len-1] == ':' && !memchr(line, ' ', len))
+  {
+    instruction_push_text(list, INSTRUCTION_OPCODE_LABEL, line, len-1);
+    return vector_back(list->instructions);
+  }
+
+  // alignb is the form for .bss
+  if ((len > 6 && strncmp(line, "align ", 6) == 0) || (len > 7 && strncmp(line, "alignb ", 7) == 0))
+  {
+    instruction_push_text(list, INSTRUCTION_OPCODE_ALIGN, line, len);
+    return vector_back(list->instructions);
+  }
+
+  instruction_push_text(list, INSTRUCTION_OPCODE_RAW, line, len);
+  return vector_back(list->instructions);
+}
+
+struct instruction_operand instruction_register(int reg)
+{
+  return (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_REGISTER, .reg=reg};
+}
+
+struct instruction_operand instruction_immediate(long long value)
+{
+  return (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_IMMEDIATE, .imm=value};
+}
+
+/**
+ * @brief Builds [symbol+base+index*scale+displacement], the symbol must come from instruction_list_symbol.
+ * A size of 0 leaves the size of the access to the other operand
+ */
+struct instruction_operand instruction_memory(int size, int base, int index, int scale, const char* symbol, long long displacement)
+{
+  if (size)
+  {
+    instruction_size_keyword(size);
+  }
+
+  struct instruction_operand operand = {.type=INSTRUCTION_OPERAND_TYPE_MEMORY, .size=size};
+  operand.address = (struct instruction_address){.base=base, .index=index, .scale=scale, .displacement=displacement, .symbol=symbol};
+  return operand;
+}
+
+struct instruction_operand instruction_symbol(const char* symbol)
+{
+  return (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_SYMBOL, .symbol=symbol};
+}
+
+bool instruction_address_uses(struct instruction_address* address, int reg)
+{
+  return address->base == reg || address->index == reg;
+}
+
+bool instruction_address_equal(struct instruction_address* address, struct instruction_address* other)
+{
+  return address->base == other->base && address->index == other->index && address->scale == other->scale &&
+    address->displacement == other->displacement && address->symbol == other->symbol;
+}
+
+bool instruction_is_machine_instruction(struct instruction* ins)
+{
+  return ins->opcode < INSTRUCTION_OPCODE_TOTAL;
+}
+
+static void instruction_print_address(struct instruction_address* address, struct emitter* emitter)
+{
+  bool first = true;
+  if (address->symbol)
+  {
+    emitter_write(emitter, address->symbol, strlen(address->symbol));
+    first = false;
+  }
+
+  if (address->base != -1)
+  {
+    emitter_printf(emitter, "%s%s", first ? "" : "+", instruction_register_name(address->base));
+    first = false;
+  }
+
+  if (address->index != -1)
+  {
+    emitter_printf(emitter, "%s%s*%i", first ? "" : "+", instruction_register_name(address->index), address->scale);
+    first = false;
+  }
+
+  if (address->displacement != 0 || first)
+  {
+    emitter_printf(emitter, first ? "%lld" : "%+lld", address->displacement);
+  }
+}
+
+static void instruction_print_operand(struct instruction_operand* operand, struct emitter* emitter)
+{
+  if (operand->size)
+  {
+    const char* keyword = instruction_size_keyword(operand->size);
+    emitter_write(emitter, keyword, strlen(keyword));
+    emitter_write(emitter, " ", 1);
+  }
+
+  switch (operand->type)
+  {
+    case INSTRUCTION_OPERAND_TYPE_REGISTER:
+    {
+      const char* name = instruction_register_name(operand->reg);
+      emitter_write(emitter, name, strlen(name));
+    }
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_IMMEDIATE:
+      emitter_printf(emitter, "%lld", operand->imm);
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_MEMORY:
+      emitter_write(emitter, "[", 1);
+      instruction_print_address(&operand->address, emitter);
+      emitter_write(emitter, "]", 1);
+    break;
+
+    case INSTRUCTION_OPERAND_TYPE_SYMBOL:
+      emitter_write(emitter, operand->symbol, strlen(operand->symbol));
+    break;
+  }
+}
+
+void instruction_print(struct instruction* ins, struct emitter* emitter)
+{
+  switch (ins->opcode)
+  {
+    case INSTRUCTION_OPCODE_LABEL:
+      emitter_write(emitter, ins->text, strlen(ins->text));
+      emitter_write(emitter, ":\n", 2);
+      return;
+
+    case INSTRUCTION_OPCODE_COMMENT:
+    case INSTRUCTION_OPCODE_ALIGN:
+    case INSTRUCTION_OPCODE_RAW:
+      emitter_write(emitter, ins->text, strlen(ins->text));
+      emitter_write(emitter, "\n", 1);
+      return;
+  }
+
+  const char* name = instruction_opcode_name(ins->opcode);
+  emitter_write(emitter, name, strlen(name));
+  for (int i = 0; i < ins->total_operands; i++)
+  {
+    emitter_write(emitter, i == 0 ? " " : ", ", i == 0 ? 1 : 2);
+    instruction_print_operand(&ins->operands[i], emitter);
+  }
+  emitter_write(emitter, "\n", 1);
+}
+
+int instruction_list_print(struct instruction_list* list, struct emitter* emitter)
+{
+  int total = 0;
+  vector_set_peek_pointer(list->instructions, 0);
+  struct instruction* ins = vector_peek(list->instructions);
+  while (ins)
+  {
+    if (!(ins->flags & INSTRUCTION_FLAG_DELETED))
+    {
+      instruction_print(ins, emitter);
+      if (instruction_is_machine_instruction(ins))
+      {
+        total++;
+      }
+    }
+    ins = vector_peek(list->instructions);
+  }
+
+  list->total_printed += total;
+  instruction_list_clear(list);
+  return total;
+}
@@ -15,8 +15,7 @@
 struct token* read_next_token();
 bool lex_is_in_expression();
 
-static struct lex_process* lex_process;
-static struct token tmp_token;
+static _Thread_local struct lex_process* lex_process;
 
 static char peekc()
 {
@@ -61,13 +60,13 @@ static struct pos lex_file_position()
 
 struct token* token_create(struct token* _token)
 {
-  memcpy(&tmp_token, _token, sizeof(struct token));
-  tmp_token.pos = lex_file_position();
+  memcpy(&lex_process->tmp_token, _token, sizeof(struct token));
+  lex_process->tmp_token.pos = lex_file_position();
   if (lex_is_in_expression())
   {
-    tmp_token.between_brackets = buffer_ptr(lex_process->parentheses_buffer);
+    lex_process->tmp_token.between_brackets = buffer_ptr(lex_process->parentheses_buffer);
   }
-  return &tmp_token;
+  return &lex_process->tmp_token;
 }
 
 static struct token* lexer_last_token()
@@ -98,12 +97,6 @@ const char* read_number_str()
   return buffer_ptr(buffer);
 }
 
-unsigned long long read_number()
-{
-  const char* s = read_number_str();
-  return atoll(s);
-}
-
 int lexer_number_type(char c)
 {
   int res = NUMBER_TYPE_NORMAL;
@@ -127,12 +120,66 @@ struct token* token_make_number_for_value(unsigned long number)
   {
     nextc();
   }
+
+  if (number_type == NUMBER_TYPE_FLOAT)
+  {
+    return token_create(&(struct token){.type=TOKEN_TYPE_NUMBER, .dnum=(double) number, .num.type=number_type});
+  }
   return token_create(&(struct token){.type=TOKEN_TYPE_NUMBER, .llnum=number, .num.type=number_type});
 }
 
+/**
+ * @brief Reads the rest of a floating point number after its whole part, i.e ".5e3f" of 1.5e3f.
+ * Numbers are double unless they end in f, long double is treated as double
+ */
+struct token* token_make_floating_number(const char* whole_part)
+{
+  struct buffer* buffer = buffer_create();
+  buffer_printf(buffer, "%s", whole_part);
+  char c = peekc();
+  if (c == '.')
+  {
+    buffer_write(buffer, nextc());
+    LEX_GETC_IF(buffer, c, (c >= '0' && c <= '9'));
+  }
+
+  if (c == 'e' || c == 'E')
+  {
+    buffer_write(buffer, nextc());
+    c = peekc();
+    if (c == '+' || c == '-')
+    {
+      buffer_write(buffer, nextc());
+    }
+    LEX_GETC_IF(buffer, c, (c >= '0' && c <= '9'));
+  }
+  buffer_write(buffer, 0x00);
+
+  int number_type = NUMBER_TYPE_DOUBLE;
+  c = peekc();
+  if (c == 'f' || c == 'F')
+  {
+    number_type = NUMBER_TYPE_FLOAT;
+    nextc();
+  }
+  else if (c == 'l' || c == 'L')
+  {
+    nextc();
+  }
+
+  double number = strtod(buffer_ptr(buffer), NULL);
+  return token_create(&(struct token){.type=TOKEN_TYPE_NUMBER, .dnum=number, .num.type=number_type});
+}
+
 struct token* token_make_number()
 {
-  return token_make_number_for_value(read_number());
+  const char* number_str = read_number_str();
+  char c = peekc();
+  if (c == '.' || c == 'e' || c == 'E')
+  {
+    return token_make_floating_number(number_str);
+  }
+  return token_make_number_for_value(atoll(number_str));
 }
 
 static struct token* token_make_string(char start_delim, char end_delim)
@@ -340,7 +387,8 @@ bool is_keyword(const char* str)
           S_EQ(str, "typedef") ||
           S_EQ(str, "const") ||
           S_EQ(str, "extern") ||
-          S_EQ(str, "restrict");
+          S_EQ(str, "restrict") ||
+          S_EQ(str, "inline");
 }
 
 static struct token* token_make_operator_or_string()
@@ -8,28 +8,76 @@ int main(int argc, char** argv)
   const char* output_file = "./test";
   const char* option = "exec";
 
-  if (argc > 1)
+  // -save-temps and -fomit-frame-pointer can go anywhere, everything else is in order
+  bool save_temps = false;
+  bool omit_frame_pointer = false;
+  const char* arguments[3] = {input_file, output_file, option};
+  int total_arguments = 0;
+  for (int i = 1; i < argc; i++)
   {
-    input_file = argv[1];
+    if (S_EQ(argv[i], "-save-temps"))
+    {
+      save_temps = true;
+      continue;
+    }
+
+    if (S_EQ(argv[i], "-fomit-frame-pointer"))
+    {
+      omit_frame_pointer = true;
+      continue;
+    }
+
+    if (total_arguments < 3)
+    {
+      arguments[total_arguments++] = argv[i];
+    }
   }
+  input_file = arguments[0];
+  output_file = arguments[1];
+  option = arguments[2];
 
-  if (argc > 2)
+  int compile_flags = COMPILE_PROCESS_EXECUTE_NASM;
+  if (S_EQ(option, "object"))
+  {
+    compile_flags |= COMPILE_PROCESS_EXPORT_AS_OBJECT;
+  }
+  else if (S_EQ(option, "stats"))
+  {
+    compile_flags |= COMPILE_PROCESS_PRINT_STATS;
+  }
+  else if (S_EQ(option, "echo"))
+  {
+    compile_flags |= COMPILE_PROCESS_ECHO_ASM;
+  }
+  else if (S_EQ(option, "O0"))
   {
-    output_file = argv[2];
+    compile_flags |= COMPILE_PROCESS_NO_OPTIMIZE;
+  }
+  else if (S_EQ(option, "regs"))
+  {
+    compile_flags |= COMPILE_PROCESS_ALLOCATE_REGISTERS;
+  }
+  else if (S_EQ(option, "elf"))
+  {
+    // We write the object ourselves, nothing needs to run NASM
+    compile_flags |= COMPILE_PROCESS_ASSEMBLE_OBJECT;
+    compile_flags &= ~COMPILE_PROCESS_EXECUTE_NASM;
   }
 
-  if (argc > 3)
+  if (save_temps)
   {
-    option = argv[3];
+    compile_flags |= COMPILE_PROCESS_SAVE_TEMPS;
   }
 
-  int compile_flags = COMPILE_PROCESS_EXECUTE_NASM;
-  if (S_EQ(option, "object"))
+  if (omit_frame_pointer)
   {
-    compile_flags |= COMPILE_PROCESS_EXPORT_AS_OBJECT;
+    compile_flags |= COMPILE_PROCESS_OMIT_FRAME_POINTER;
   }
 
-  int res = compile_file(input_file, output_file, compile_flags);
+  // The driver runs NASM and the linker as it compiles
+  int res = compile_flags & COMPILE_PROCESS_EXECUTE_NASM ?
+    driver_compile(input_file, output_file, compile_flags) :
+    compile_file(input_file, output_file, compile_flags);
   if (res == COMPILER_FILE_COMPILED_OK)
   {
     printf("Everything compiled fine\n");
@@ -43,28 +91,5 @@ int main(int argc, char** argv)
     printf("Unknown response for compile file\n");
   }
 
-  if (compile_flags & COMPILE_PROCESS_EXECUTE_NASM)
-  {
-    char nasm_output_file[40];
-    char nasm_cmd[512];
-    sprintf(nasm_output_file, "%s.o", output_file);
-    if (compile_flags & COMPILE_PROCESS_EXPORT_AS_OBJECT)
-    {
-      sprintf(nasm_cmd, "nasm -f elf32 %s -o %s", output_file, nasm_output_file);
-    }
-    else
-    {
-      sprintf(nasm_cmd, "nasm -f elf32 %s -o %s && gcc -m32 %s -o %s", output_file, nasm_output_file, nasm_output_file, output_file);
-    }
-
-    printf("%s\n", nasm_cmd);
-    int res = system(nasm_cmd);
-    if (res < 0)
-    {
-      printf("Issue assembling the assembly file with NASM and linking with gcc\n");
-      return res;
-    }
-  }
-
   return 0;
 }
\ No newline at end of file
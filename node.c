@@ -2,43 +2,39 @@
 #include "helpers/vector.h"
 #include <assert.h>
 
-struct vector* node_vector = NULL;
-struct vector* node_vector_root = NULL;
+// The compile process whose node vectors we operate on, one per thread
+static _Thread_local struct compile_process* node_process = NULL;
 
-struct node* parser_current_body = NULL;
-struct node* parser_current_function = NULL;
-
-void node_set_vector(struct vector* vec, struct vector* root_vec)
+void node_set_process(struct compile_process* process)
 {
-  node_vector = vec;
-  node_vector_root = root_vec;
+  node_process = process;
 }
 
 void node_push(struct node* node)
 {
-  vector_push(node_vector, &node);
+  vector_push(node_process->node_vec, &node);
 }
 
 struct node* node_peek_or_null()
 {
-  return vector_back_ptr_or_null(node_vector);
+  return vector_back_ptr_or_null(node_process->node_vec);
 }
 
 struct node* node_peek()
 {
-  return *(struct node**)(vector_back(node_vector));
+  return *(struct node**)(vector_back(node_process->node_vec));
 }
 
 struct node* node_pop()
 {
-  struct node* last_node = vector_back_ptr(node_vector);
-  struct node* last_node_root = vector_empty(node_vector) ? NULL : vector_back_ptr_or_null(node_vector_root);
+  struct node* last_node = vector_back_ptr(node_process->node_vec);
+  struct node* last_node_root = vector_empty(node_process->node_vec) ? NULL : vector_back_ptr_or_null(node_process->node_tree_vec);
 
-  vector_pop(node_vector);
+  vector_pop(node_process->node_vec);
 
   if (last_node == last_node_root)
   {
-    vector_pop(node_vector_root);
+    vector_pop(node_process->node_tree_vec);
   }
 
   return last_node;
@@ -75,6 +71,11 @@ void make_case_node(struct node* exp_node)
   node_create(&(struct node){.type=NODE_TYPE_STATEMENT_CASE, .stmt._case.exp=exp_node});
 }
 
+void make_default_node()
+{
+  node_create(&(struct node){.type=NODE_TYPE_STATEMENT_DEFAULT});
+}
+
 void make_goto_node(struct node* label_node)
 {
   node_create(&(struct node){.type=NODE_TYPE_STATEMENT_GOTO, .stmt._goto.label=label_node});
@@ -234,8 +235,8 @@ struct node* node_create(struct node* _node)
 {
   struct node* node = malloc(sizeof(struct node));
   memcpy(node, _node, sizeof(struct node));
-  node->binded.owner = parser_current_body;
-  node->binded.function = parser_current_function;
+  node->binded.owner = node_process->parser.current_body;
+  node->binded.function = node_process->parser.current_function;
   node_push(node);
   return node;
 }
@@ -331,6 +332,11 @@ bool node_is_expression(struct node* node, const char* op)
   return node->type == NODE_TYPE_EXPRESSION && S_EQ(node->exp.op, op);
 }
 
+bool node_is_floating_number(struct node* node)
+{
+  return node->type == NODE_TYPE_NUMBER && (node->num.type == NUMBER_TYPE_FLOAT || node->num.type == NUMBER_TYPE_DOUBLE);
+}
+
 bool is_node_assignment(struct node* node)
 {
   if (node->type != NODE_TYPE_EXPRESSION)
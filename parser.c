@@ -2,17 +2,12 @@
 #include "helpers/vector.h"
 #include <assert.h>
 
-static struct compile_process* current_process;
-static struct fixup_system* parser_fixup_sys;
-static struct token* parser_last_token;
+static _Thread_local struct compile_process* current_process;
 
-extern struct node* parser_current_body;
-extern struct node* parser_current_function;
 
 extern struct expressionable_op_precedence_group op_precedence[TOTAL_OPERATOR_GROUPS];
 
 // NODE_TYPE_BLANK
-struct node* parser_blank_node;
 
 enum
 {
@@ -164,7 +159,7 @@ static struct token* token_next()
   {
     current_process->pos = next_token->pos;
   }
-  parser_last_token = next_token;
+  current_process->parser.last_token = next_token;
   return vector_peek(current_process->token_vec);
 }
 
@@ -228,7 +223,11 @@ void parse_single_token_to_node()
   switch(token->type)
   {
     case TOKEN_TYPE_NUMBER:
-      node = node_create(&(struct node){.type = NODE_TYPE_NUMBER, .llnum = token->llnum});
+      node = node_create(&(struct node){.type = NODE_TYPE_NUMBER, .llnum = token->llnum, .num.type = token->num.type});
+      if (node->num.type == NUMBER_TYPE_FLOAT || node->num.type == NUMBER_TYPE_DOUBLE)
+      {
+        node->dnum = token->dnum;
+      }
     break;
   
     case TOKEN_TYPE_IDENTIFIER:
@@ -354,7 +353,7 @@ void parser_reorder_expression(struct node** node_out)
     }
   }
 
-  if ((is_array_node(node->exp.left) || is_node_assignment(node->exp.right)) ||
+  if ((is_array_node(node->exp.left) && is_node_assignment(node->exp.right)) ||
     ((node_is_expression(node->exp.left, "()")) &&
       node_is_expression(node->exp.right, ",")))
   {
@@ -367,16 +366,46 @@ bool parser_is_unary_operator(const char* op)
   return is_unary_operator(op);
 }
 
+/**
+ * @brief The operand of a unary operator is parsed with the rest of the expression, *p = 50 gives
+ * *E(p = 50). Moves the operator down onto the leftmost operand so it binds tighter than any
+ * binary operator, E(*p = 50). Member, array and call operators still bind tighter than a unary operator
+ */
+struct node* parser_unary_to_leftmost_operand(const char* op, struct node* operand_node)
+{
+  if (operand_node->type == NODE_TYPE_EXPRESSION && !is_access_node(operand_node) &&
+      !is_array_node(operand_node) && !is_parentheses_node(operand_node))
+  {
+    operand_node->exp.left = parser_unary_to_leftmost_operand(op, operand_node->exp.left);
+    return operand_node;
+  }
+
+  make_unary_node(op, operand_node);
+  return node_pop();
+}
+
+/**
+ * @brief Pushes the expression with the unary operator applied to its leftmost operand, returns the unary node
+ */
+struct node* parser_push_unary(const char* op, struct node* operand_node)
+{
+  struct node* root_node = parser_unary_to_leftmost_operand(op, operand_node);
+  node_push(root_node);
+  struct node* unary_node = root_node;
+  while (unary_node->type == NODE_TYPE_EXPRESSION)
+  {
+    unary_node = unary_node->exp.left;
+  }
+  return unary_node;
+}
+
 void parse_for_indirection_unary()
 {
   int depth = parser_get_pointer_depth();
   parse_expressionable(history_begin(0));
   struct node* unary_operand_node = node_pop();
-  make_unary_node("*", unary_operand_node);
-
-  struct node* unary_node = node_pop();
+  struct node* unary_node = parser_push_unary("*", unary_operand_node);
   unary_node->unary.indirection.depth = depth;
-  node_push(unary_node);
 }
 
 void parse_for_normal_unary()
@@ -384,7 +413,7 @@ void parse_for_normal_unary()
   const char* unary_op = token_next()->sval;
   parse_expressionable(history_begin(0));
   struct node* unary_operand_node = node_pop();
-  make_unary_node(unary_op, unary_operand_node);
+  parser_push_unary(unary_op, unary_operand_node);
 }
 
 void parse_for_unary()
@@ -481,7 +510,7 @@ void parse_for_parentheses(struct history* history)
     node_pop();
   }
 
-  struct node* exp_node = parser_blank_node;
+  struct node* exp_node = current_process->parser.blank_node;
   if (!token_next_is_symbol(')'))
   {
     parse_expressionable_root(history_begin(0));
@@ -583,6 +612,8 @@ static bool is_keyword_variable_modifier(const char* val)
           S_EQ(val, "static") ||
           S_EQ(val, "const") ||
           S_EQ(val, "extern") ||
+          S_EQ(val, "restrict") ||
+          S_EQ(val, "inline") ||
           S_EQ(val, "__ignore_typecheck__");
 }
 
@@ -616,6 +647,14 @@ void parse_datatype_modifiers(struct datatype* dtype)
     {
       dtype->flags |= DATATYPE_FLAG_IS_EXTERN;
     }
+    else if (S_EQ(token->sval, "restrict"))
+    {
+      dtype->flags |= DATATYPE_FLAG_IS_RESTRICT;
+    }
+    else if (S_EQ(token->sval, "inline"))
+    {
+      dtype->flags |= DATATYPE_FLAG_IS_INLINE;
+    }
     else if (S_EQ(token->sval, "__ignore_typecheck__"))
     {
       dtype->flags |= DATATYPE_FLAG_IGNORE_TYPE_CHECKING;
@@ -654,9 +693,8 @@ int parser_datatype_expected_for_type_string(const char* str)
 
 int parser_get_random_type_index()
 {
-  static int x = 0;
-  x++;
-  return x;
+  current_process->parser.random_type_index++;
+  return current_process->parser.random_type_index;
 }
 
 struct token* parser_build_random_type_name()
@@ -747,7 +785,7 @@ void parser_datatype_init_type_and_size_for_primitive(struct token* datatype_tok
   else if (S_EQ(datatype_token->sval, "double"))
   {
     datatype_out->type = DATA_TYPE_DOUBLE;
-    datatype_out->size = DATA_SIZE_DWORD;
+    datatype_out->size = DATA_SIZE_DDWORD;
   }
   else
   {
@@ -942,7 +980,7 @@ void make_variable_node(struct datatype* dtype, struct token* name_token, struct
   {
     struct datatype_struct_node_fix_private* private = calloc(1, sizeof(struct datatype_struct_node_fix_private));
     private->node = var_node;
-    fixup_register(parser_fixup_sys, &(struct fixup_config){.fix=datatype_struct_node_fix, .end=datatype_struct_node_end, .private=private});
+    fixup_register(current_process->parser.fixup_sys, &(struct fixup_config){.fix=datatype_struct_node_fix, .end=datatype_struct_node_end, .name=var_node->var.type.type_str, .private=private});
   }
 }
 
@@ -953,7 +991,7 @@ void parser_scope_offset_for_stack(struct node* node, struct history* history)
   int offset = -variable_size(node);
   if (upward_stack)
   {
-    size_t stack_addition = function_node_argument_stack_addition(parser_current_function);
+    size_t stack_addition = function_node_argument_stack_addition(current_process->parser.current_function);
     offset = stack_addition;
     if (last_entity)
     {
@@ -976,6 +1014,14 @@ void parser_scope_offset_for_stack(struct node* node, struct history* history)
     variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, DATA_SIZE_DWORD);
   }
   variable_node(node)->var.aoffset = offset + (upward_stack ? variable_node(node)->var.padding : -variable_node(node)->var.padding);
+
+  // A body that ended gave its offsets back to the bodies after it so sibling bodies overlap,
+  // the function only needs room down to its deepest local
+  struct node* function = current_process->parser.current_function;
+  if (!upward_stack && function && -variable_node(node)->var.aoffset > (int) function->func.stack_size)
+  {
+    function->func.stack_size = -variable_node(node)->var.aoffset;
+  }
 }
 
 void parser_scope_offset_for_global(struct node* node, struct history* history)
@@ -1051,7 +1097,8 @@ struct array_brackets* parse_array_brackets(struct history* history)
     parse_expressionable_root(history);
     expect_sym(']');
 
-    struct node* exp_node = node_pop();
+    // Array sizes must be known now, i.e int x[4*8]
+    struct node* exp_node = fold_node(current_process, node_pop());
     make_bracket_node(exp_node);
 
     struct node* bracket_node = node_pop();
@@ -1070,6 +1117,7 @@ void parse_variable(struct datatype* dtype, struct token* name_token, struct his
   if (token_next_is_operator("["))
   {
     brackets = parse_array_brackets(history);
+    array_brackets_calculate_strides(brackets);
     dtype->array.brackets = brackets;
     dtype->array.size = array_brackets_calculate_size(dtype, brackets);
     dtype->flags |= DATATYPE_FLAG_IS_ARRAY;
@@ -1099,7 +1147,7 @@ void parse_function(struct datatype* ret_type, struct token* name_token, struct
   resolver_default_new_scope(current_process->resolver, 0);
   make_function_node(ret_type, name_token->sval, NULL, NULL);
   struct node* function_node = node_peek();
-  parser_current_function = function_node;
+  current_process->parser.current_function = function_node;
   if (datatype_is_struct_or_union(ret_type))
   {
     function_node->func.args.stack_addition += DATA_SIZE_DWORD;
@@ -1126,7 +1174,7 @@ void parse_function(struct datatype* ret_type, struct token* name_token, struct
     expect_sym(';');
   }
 
-  parser_current_function = NULL;
+  current_process->parser.current_function = NULL;
   resolver_default_finish_scope(current_process->resolver);
   parser_scope_finish();
 }
@@ -1250,8 +1298,8 @@ void parse_body_single_statement(size_t* variable_size, struct vector* body_vec,
 {
   make_body_node(NULL, 0, false, NULL);
   struct node* body_node = node_pop();
-  body_node->binded.owner = parser_current_body;
-  parser_current_body = body_node;
+  body_node->binded.owner = current_process->parser.current_body;
+  current_process->parser.current_body = body_node;
   struct node* stmt_node = NULL;
   parse_statement(history_down(history, history->flags));
   stmt_node = node_pop();
@@ -1266,7 +1314,7 @@ void parse_body_single_statement(size_t* variable_size, struct vector* body_vec,
   }
 
   parser_finalize_body(history, body_node, body_vec, variable_size, largest_var_node, largest_var_node);
-  parser_current_body = body_node->binded.owner;
+  current_process->parser.current_body = body_node->binded.owner;
 
   node_push(body_node);
 }
@@ -1276,8 +1324,8 @@ void parse_body_multiple_statements(size_t* variable_size, struct vector* body_v
   // Create a blank body node
   make_body_node(NULL, 0, false, NULL);
   struct node* body_node = node_pop();
-  body_node->binded.owner = parser_current_body;
-  parser_current_body = body_node;
+  body_node->binded.owner = current_process->parser.current_body;
+  current_process->parser.current_body = body_node;
 
   struct node* stmt_node = NULL;
   struct node* largest_possible_var_node = NULL;
@@ -1317,7 +1365,7 @@ void parse_body_multiple_statements(size_t* variable_size, struct vector* body_v
   expect_sym('}');
 
   parser_finalize_body(history, body_node, body_vec, variable_size, largest_align_eligible_var_node, largest_possible_var_node);
-  parser_current_body = body_node->binded.owner;
+  current_process->parser.current_body = body_node->binded.owner;
 
   // Let's now push the body node back to the stack :)
   node_push(body_node);
@@ -1352,14 +1400,6 @@ void parse_body(size_t* variable_size, struct history* history)
   parse_body_multiple_statements(variable_size, body_vec, history);
   resolver_default_finish_scope(current_process->resolver);
   parser_scope_finish();
-
-  if (variable_size)
-  {
-    if (history->flags & HISTORY_FLAG_INSIDE_FUNCTION_BODY)
-    {
-      parser_current_function->func.stack_size += *variable_size;
-    }
-  }
 }
 
 void parse_struct_no_new_scope(struct datatype* dtype, bool is_forward_declaration)
@@ -1551,6 +1591,8 @@ void parse_variable_function_or_struct_union(struct history* history)
 
     struct node* su_node = node_pop();
     symresolver_build_for_node(current_process, su_node);
+    // Variables that used this structure before it was defined can be fixed now
+    fixups_resolve_for_name(current_process->parser.fixup_sys, su_node->type == NODE_TYPE_STRUCT ? su_node->_struct.name : su_node->_union.name);
     node_push(su_node);
     return;
   }
@@ -1665,7 +1707,7 @@ void parse_case(struct history* history)
 {
   expect_keyword("case");
   parse_expressionable_root(history);
-  struct node* case_exp_node = node_pop();
+  struct node* case_exp_node = fold_node(current_process, node_pop());
   expect_sym(':');
   make_case_node(case_exp_node);
 
@@ -1676,6 +1718,32 @@ void parse_case(struct history* history)
 
   struct node* case_node = node_pop();
   parser_register_case(history, case_node);
+  // The case stays in the body so code generation can place its label
+  node_push(case_node);
+}
+
+void parse_default(struct history* history)
+{
+  expect_keyword("default");
+  expect_sym(':');
+  make_default_node();
+}
+
+bool parser_body_has_default(struct node* body_node)
+{
+  // Each statement is parsed with its own copy of the history, so we look for the default afterwards
+  vector_set_peek_pointer(body_node->body.statements, 0);
+  struct node* statement = vector_peek_ptr(body_node->body.statements);
+  while (statement)
+  {
+    if (statement->type == NODE_TYPE_STATEMENT_DEFAULT)
+    {
+      return true;
+    }
+    statement = vector_peek_ptr(body_node->body.statements);
+  }
+
+  return false;
 }
 
 void parse_switch(struct history* history)
@@ -1686,6 +1754,7 @@ void parse_switch(struct history* history)
   size_t variable_size = 0;
   parse_body(&variable_size, history);
   struct node* body_node = node_pop();
+  _switch.case_data.has_default_case = parser_body_has_default(body_node);
   // Make the switch node
   make_switch_node(switch_exp_node, body_node, _switch.case_data.cases, _switch.case_data.has_default_case);
   parser_end_switch_statement(&_switch);
@@ -1902,6 +1971,11 @@ void parse_keyword(struct history* history)
     parse_case(history);
     return;
   }
+  else if (S_EQ(token->sval, "default"))
+  {
+    parse_default(history);
+    return;
+  }
 
   compiler_error(current_process, "Invalid keyword\n");
 }
@@ -2009,10 +2083,10 @@ int parse(struct compile_process* process)
 {
   scope_create_root(process);
   current_process = process;
-  parser_last_token = NULL;
-  node_set_vector(process->node_vec, process->node_tree_vec);
-  parser_blank_node = node_create(&(struct node){.type=NODE_TYPE_BLANK});
-  parser_fixup_sys = fixup_sys_new();
+  current_process->parser.last_token = NULL;
+  node_set_process(process);
+  current_process->parser.blank_node = node_create(&(struct node){.type=NODE_TYPE_BLANK});
+  current_process->parser.fixup_sys = fixup_sys_new();
 
   struct node* node = NULL;
   vector_set_peek_pointer(process->token_vec, 0);
@@ -2022,7 +2096,7 @@ int parse(struct compile_process* process)
     vector_push(process->node_tree_vec, &node);
   }
 
-  assert(fixups_resolve(parser_fixup_sys));
+  assert(fixups_resolve(current_process->parser.fixup_sys));
   scope_free_root(process);
 
   return PARSE_ALL_OK;
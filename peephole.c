@@ -0,0 +1,847 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+
+// Give up following the control flow after this many instructions and assume the register is live
+#define PEEPHOLE_MAX_LIVENESS_STEPS 256
+#define PEEPHOLE_MAX_PASSES 10
+// Must be a power of two
+#define PEEPHOLE_LABEL_SLOTS 64
+
+struct peephole_label
+{
+  const char* name;
+  int index;
+  // The next label in the same hash slot, -1 if there is none
+  int next;
+};
+
+struct peephole
+{
+  struct vector* instructions;
+  // Vector of struct peephole_label
+  struct vector* labels;
+  // The first label in each hash slot, -1 if the slot is empty. total_slots is a power of two
+  int* slots;
+  int total_slots;
+  // The number of instructions removed so far
+  int removed;
+};
+
+static const int peephole_register_family[] = {
+  [REGISTER_EAX] = REGISTER_EAX,
+  [REGISTER_EBX] = REGISTER_EBX,
+  [REGISTER_ECX] = REGISTER_ECX,
+  [REGISTER_EDX] = REGISTER_EDX,
+  [REGISTER_ESI] = REGISTER_ESI,
+  [REGISTER_EDI] = REGISTER_EDI,
+  [REGISTER_EBP] = REGISTER_EBP,
+  [REGISTER_ESP] = REGISTER_ESP,
+  [REGISTER_AX] = REGISTER_EAX,
+  [REGISTER_BX] = REGISTER_EBX,
+  [REGISTER_CX] = REGISTER_ECX,
+  [REGISTER_DX] = REGISTER_EDX,
+  [REGISTER_AL] = REGISTER_EAX,
+  [REGISTER_BL] = REGISTER_EBX,
+  [REGISTER_CL] = REGISTER_ECX,
+  [REGISTER_DL] = REGISTER_EDX,
+  [REGISTER_AH] = REGISTER_EAX,
+  [REGISTER_BH] = REGISTER_EBX,
+  [REGISTER_CH] = REGISTER_ECX,
+  [REGISTER_DH] = REGISTER_EDX,
+};
+
+int register_family(int reg)
+{
+  assert(reg >= 0 && reg < REGISTER_TOTAL);
+  return peephole_register_family[reg];
+}
+
+bool register_is_dword(int reg)
+{
+  return register_family(reg) == reg;
+}
+
+static struct instruction* peephole_at(struct peephole* peephole, int index)
+{
+  if (index < 0 || index >= vector_count(peephole->instructions))
+  {
+    return NULL;
+  }
+
+  return vector_at(peephole->instructions, index);
+}
+
+/**
+ * @brief Returns the index of the next instruction that is still alive,
+ * comments and alignment are skipped as they do not change what the code does. -1 if there is none.
+ */
+static int peephole_next(struct peephole* peephole, int index)
+{
+  struct instruction* ins = peephole_at(peephole, ++index);
+  while (ins)
+  {
+    if (!(ins->flags & INSTRUCTION_FLAG_DELETED) && ins->opcode != INSTRUCTION_OPCODE_COMMENT && ins->opcode != INSTRUCTION_OPCODE_ALIGN)
+    {
+      return index;
+    }
+    ins = peephole_at(peephole, ++index);
+  }
+
+  return -1;
+}
+
+static void peephole_delete(struct peephole* peephole, struct instruction* ins)
+{
+  ins->flags |= INSTRUCTION_FLAG_DELETED;
+  peephole->removed++;
+}
+
+static unsigned int peephole_hash(const char* name)
+{
+  // FNV-1a
+  unsigned int hash = 2166136261u;
+  for (const char* c = name; *c; c++)
+  {
+    hash = (hash ^ (unsigned char) *c) * 16777619u;
+  }
+  return hash;
+}
+
+static void peephole_build_labels(struct peephole* peephole)
+{
+  vector_clear(peephole->labels);
+  for (int i = 0; i < vector_count(peephole->instructions); i++)
+  {
+    struct instruction* ins = peephole_at(peephole, i);
+    if (ins->opcode == INSTRUCTION_OPCODE_LABEL)
+    {
+      struct peephole_label label = {.name=ins->text, .index=i, .next=-1};
+      vector_push(peephole->labels, &label);
+    }
+  }
+
+  // Keep at least as many slots as labels so the chains stay short
+  if (vector_count(peephole->labels) > peephole->total_slots)
+  {
+    while (vector_count(peephole->labels) > peephole->total_slots)
+    {
+      peephole->total_slots *= 2;
+    }
+    free(peephole->slots);
+    peephole->slots = malloc(peephole->total_slots * sizeof(int));
+  }
+
+  for (int i = 0; i < peephole->total_slots; i++)
+  {
+    peephole->slots[i] = -1;
+  }
+
+  for (int i = 0; i < vector_count(peephole->labels); i++)
+  {
+    struct peephole_label* label = vector_at(peephole->labels, i);
+    unsigned int slot = peephole_hash(label->name) & (peephole->total_slots - 1);
+    label->next = peephole->slots[slot];
+    peephole->slots[slot] = i;
+  }
+}
+
+static int peephole_label_index(struct peephole* peephole, const char* name)
+{
+  int i = peephole->slots[peephole_hash(name) & (peephole->total_slots - 1)];
+  while (i != -1)
+  {
+    struct peephole_label* label = vector_at(peephole->labels, i);
+    if (S_EQ(label->name, name))
+    {
+      return label->index;
+    }
+    i = label->next;
+  }
+
+  return -1;
+}
+
+static bool operand_is_register(struct instruction_operand* operand, int reg)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && operand->reg == reg;
+}
+
+static bool operand_is_dword_register(struct instruction_operand* operand)
+{
+  return operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER && register_is_dword(operand->reg);
+}
+
+static bool operand_reads_family(struct instruction_operand* operand, int family)
+{
+  switch (operand->type)
+  {
+    case INSTRUCTION_OPERAND_TYPE_REGISTER:
+      return register_family(operand->reg) == family;
+
+    case INSTRUCTION_OPERAND_TYPE_MEMORY:
+      return instruction_address_uses(&operand->address, family);
+  }
+
+  return false;
+}
+
+static bool operand_uses_esp(struct instruction_operand* operand)
+{
+  return operand_reads_family(operand, REGISTER_ESP);
+}
+
+static bool instruction_opcode_is_jump(int opcode)
+{
+  return opcode >= INSTRUCTION_OPCODE_JMP && opcode <= INSTRUCTION_OPCODE_JBE;
+}
+
+static bool instruction_opcode_is_set(int opcode)
+{
+  return opcode >= INSTRUCTION_OPCODE_SETE && opcode <= INSTRUCTION_OPCODE_SETBE;
+}
+
+/**
+ * @brief Returns true if the instruction may read the register family.
+ * Writes to part of a register are treated as reads as the rest of the value survives.
+ */
+static bool peephole_reads(struct instruction* ins, int family)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  switch (ins->opcode)
+  {
+    case INSTRUCTION_OPCODE_MOV:
+    case INSTRUCTION_OPCODE_MOVZX:
+    case INSTRUCTION_OPCODE_MOVSX:
+    case INSTRUCTION_OPCODE_LEA:
+      if (dst->type == INSTRUCTION_OPERAND_TYPE_MEMORY && operand_reads_family(dst, family))
+      {
+        return true;
+      }
+
+      if (dst->type == INSTRUCTION_OPERAND_TYPE_REGISTER && register_family(dst->reg) == family && !register_is_dword(dst->reg))
+      {
+        return true;
+      }
+      return operand_reads_family(&ins->operands[1], family);
+
+    case INSTRUCTION_OPCODE_POP:
+      if (family == REGISTER_ESP)
+      {
+        return true;
+      }
+      return dst->type == INSTRUCTION_OPERAND_TYPE_MEMORY && operand_reads_family(dst, family);
+
+    case INSTRUCTION_OPCODE_PUSH:
+      return family == REGISTER_ESP || operand_reads_family(dst, family);
+
+    case INSTRUCTION_OPCODE_XOR:
+      if (ins->total_operands == 2 && operand_is_dword_register(dst) && operand_is_register(&ins->operands[1], dst->reg))
+      {
+        // xor eax, eax does not care what eax was
+        return false;
+      }
+    break;
+
+    case INSTRUCTION_OPCODE_IMUL:
+    case INSTRUCTION_OPCODE_MUL:
+    case INSTRUCTION_OPCODE_IDIV:
+    case INSTRUCTION_OPCODE_DIV:
+      if (ins->total_operands == 1)
+      {
+        if (family == REGISTER_EAX || operand_reads_family(dst, family))
+        {
+          return true;
+        }
+
+        return family == REGISTER_EDX && (ins->opcode == INSTRUCTION_OPCODE_IDIV || ins->opcode == INSTRUCTION_OPCODE_DIV);
+      }
+
+      if (ins->total_operands == 3)
+      {
+        return operand_reads_family(&ins->operands[1], family) || (dst->type == INSTRUCTION_OPERAND_TYPE_MEMORY && operand_reads_family(dst, family));
+      }
+    break;
+
+    case INSTRUCTION_OPCODE_CDQ:
+      return family == REGISTER_EAX;
+
+    case INSTRUCTION_OPCODE_CALL:
+      return family == REGISTER_ESP || operand_reads_family(dst, family);
+
+    case INSTRUCTION_OPCODE_RET:
+      return family == REGISTER_EAX || family == REGISTER_ESP || family == REGISTER_EBP;
+  }
+
+  for (int i = 0; i < ins->total_operands; i++)
+  {
+    if (operand_reads_family(&ins->operands[i], family))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Returns true if the instruction overwrites the whole register family
+ * without needing its previous value.
+ */
+static bool peephole_writes(struct instruction* ins, int family)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  switch (ins->opcode)
+  {
+    case INSTRUCTION_OPCODE_MOV:
+    case INSTRUCTION_OPCODE_MOVZX:
+    case INSTRUCTION_OPCODE_MOVSX:
+    case INSTRUCTION_OPCODE_LEA:
+    case INSTRUCTION_OPCODE_POP:
+      return operand_is_register(dst, family);
+
+    case INSTRUCTION_OPCODE_XOR:
+      return ins->total_operands == 2 && operand_is_register(dst, family) && operand_is_register(&ins->operands[1], family);
+
+    case INSTRUCTION_OPCODE_IMUL:
+      if (ins->total_operands == 3)
+      {
+        return operand_is_register(dst, family);
+      }
+    // Fall through to the single operand forms
+    case INSTRUCTION_OPCODE_MUL:
+      return ins->total_operands == 1 && (family == REGISTER_EAX || family == REGISTER_EDX);
+
+    case INSTRUCTION_OPCODE_IDIV:
+    case INSTRUCTION_OPCODE_DIV:
+      return family == REGISTER_EAX || family == REGISTER_EDX;
+
+    case INSTRUCTION_OPCODE_CDQ:
+      return family == REGISTER_EDX;
+
+    case INSTRUCTION_OPCODE_CALL:
+      // Caller saved registers do not survive a call
+      return family == REGISTER_EAX || family == REGISTER_ECX || family == REGISTER_EDX;
+  }
+
+  return false;
+}
+
+static bool peephole_is_dead_from(struct peephole* peephole, int index, int family, int* steps);
+
+static bool peephole_is_dead_at_label(struct peephole* peephole, const char* name, int family, int* steps)
+{
+  int index = peephole_label_index(peephole, name);
+  if (index == -1)
+  {
+    // Jumping somewhere we do not know about
+    return false;
+  }
+
+  return peephole_is_dead_from(peephole, index, family, steps);
+}
+
+/**
+ * @brief Returns true if the value in the register family is never read again
+ * when execution continues at the given index.
+ */
+static bool peephole_is_dead_from(struct peephole* peephole, int index, int family, int* steps)
+{
+  struct instruction* ins = peephole_at(peephole, index);
+  while (ins)
+  {
+    (*steps)++;
+    if (*steps > PEEPHOLE_MAX_LIVENESS_STEPS)
+    {
+      return false;
+    }
+
+    if (ins->flags & INSTRUCTION_FLAG_DELETED || ins->opcode == INSTRUCTION_OPCODE_COMMENT || ins->opcode == INSTRUCTION_OPCODE_ALIGN || ins->opcode == INSTRUCTION_OPCODE_LABEL)
+    {
+      ins = peephole_at(peephole, ++index);
+      continue;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_RAW)
+    {
+      return false;
+    }
+
+    if (peephole_reads(ins, family))
+    {
+      return false;
+    }
+
+    if (peephole_writes(ins, family))
+    {
+      return true;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_RET)
+    {
+      return true;
+    }
+
+    if (instruction_opcode_is_jump(ins->opcode))
+    {
+      if (ins->operands[0].type != INSTRUCTION_OPERAND_TYPE_SYMBOL)
+      {
+        return false;
+      }
+
+      if (!peephole_is_dead_at_label(peephole, ins->operands[0].symbol, family, steps))
+      {
+        return false;
+      }
+
+      if (ins->opcode == INSTRUCTION_OPCODE_JMP)
+      {
+        return true;
+      }
+    }
+
+    ins = peephole_at(peephole, ++index);
+  }
+
+  return false;
+}
+
+static bool peephole_is_dead_after(struct peephole* peephole, int index, int family)
+{
+  int steps = 0;
+  return peephole_is_dead_from(peephole, index+1, family, &steps);
+}
+
+/**
+ * @brief Builds "mov dst, src" for a value that went through the stack. Returns false
+ * if there is no single mov that does the same.
+ */
+static bool peephole_make_move(struct instruction_operand* dst, struct instruction_operand* src, struct instruction* out)
+{
+  if (operand_uses_esp(dst) || operand_uses_esp(src))
+  {
+    return false;
+  }
+
+  struct instruction ins = {.opcode=INSTRUCTION_OPCODE_MOV, .total_operands=2};
+  ins.operands[0] = *dst;
+  ins.operands[1] = *src;
+  if (operand_is_dword_register(dst))
+  {
+    ins.operands[0].size = 0;
+    ins.operands[1].size = 0;
+    if (src->type == INSTRUCTION_OPERAND_TYPE_REGISTER && !register_is_dword(src->reg))
+    {
+      return false;
+    }
+  }
+  else if (dst->type == INSTRUCTION_OPERAND_TYPE_MEMORY && operand_is_dword_register(src))
+  {
+    ins.operands[0].size = DATA_SIZE_DWORD;
+    ins.operands[1].size = 0;
+  }
+  else
+  {
+    return false;
+  }
+
+  *out = ins;
+  return true;
+}
+
+// mov eax, eax
+static bool peephole_self_move(struct peephole* peephole, int index)
+{
+  struct instruction* ins = peephole_at(peephole, index);
+  if (ins->opcode != INSTRUCTION_OPCODE_MOV || !operand_is_dword_register(&ins->operands[0]))
+  {
+    return false;
+  }
+
+  if (!operand_is_register(&ins->operands[1], ins->operands[0].reg))
+  {
+    return false;
+  }
+
+  peephole_delete(peephole, ins);
+  return true;
+}
+
+// push eax, pop ecx = mov ecx, eax
+static bool peephole_push_pop(struct peephole* peephole, int index)
+{
+  struct instruction* push_ins = peephole_at(peephole, index);
+  if (push_ins->opcode != INSTRUCTION_OPCODE_PUSH)
+  {
+    return false;
+  }
+
+  int next_index = peephole_next(peephole, index);
+  struct instruction* next_ins = peephole_at(peephole, next_index);
+  if (!next_ins)
+  {
+    return false;
+  }
+
+  struct instruction_operand* value = &push_ins->operands[0];
+  struct instruction* pop_ins = next_ins;
+  struct instruction* between_ins = NULL;
+  if (next_ins->opcode != INSTRUCTION_OPCODE_POP)
+  {
+    // push eax, mov ecx, 5, pop ebx. We can still move the value if the instruction
+    // between does not touch the stack or anything the pushed value depends on
+    between_ins = next_ins;
+    if (between_ins->opcode != INSTRUCTION_OPCODE_MOV && between_ins->opcode != INSTRUCTION_OPCODE_MOVZX && between_ins->opcode != INSTRUCTION_OPCODE_LEA)
+    {
+      return false;
+    }
+
+    struct instruction_operand* between_dst = &between_ins->operands[0];
+    if (!operand_is_dword_register(between_dst) || operand_uses_esp(&between_ins->operands[1]) || between_dst->reg == REGISTER_ESP)
+    {
+      return false;
+    }
+
+    if (operand_reads_family(value, between_dst->reg))
+    {
+      return false;
+    }
+
+    pop_ins = peephole_at(peephole, peephole_next(peephole, next_index));
+    if (!pop_ins || pop_ins->opcode != INSTRUCTION_OPCODE_POP)
+    {
+      return false;
+    }
+  }
+
+  struct instruction_operand* dst = &pop_ins->operands[0];
+  if (operand_is_dword_register(value) && operand_is_register(dst, value->reg) && !between_ins)
+  {
+    peephole_delete(peephole, push_ins);
+    peephole_delete(peephole, pop_ins);
+    return true;
+  }
+
+  struct instruction move;
+  if (!peephole_make_move(dst, value, &move))
+  {
+    return false;
+  }
+
+  if (between_ins)
+  {
+    // Order becomes between instruction then the move
+    *push_ins = *between_ins;
+    *between_ins = move;
+  }
+  else
+  {
+    *push_ins = move;
+  }
+  peephole_delete(peephole, pop_ins);
+  return true;
+}
+
+static bool peephole_can_take_source(struct instruction* ins, struct instruction_operand* src)
+{
+  struct instruction_operand* dst = &ins->operands[0];
+  switch (ins->opcode)
+  {
+    case INSTRUCTION_OPCODE_PUSH:
+      return src->type != INSTRUCTION_OPERAND_TYPE_REGISTER || register_is_dword(src->reg);
+
+    case INSTRUCTION_OPCODE_MOV:
+    case INSTRUCTION_OPCODE_ADD:
+    case INSTRUCTION_OPCODE_SUB:
+    case INSTRUCTION_OPCODE_AND:
+    case INSTRUCTION_OPCODE_OR:
+    case INSTRUCTION_OPCODE_XOR:
+    case INSTRUCTION_OPCODE_CMP:
+      if (ins->total_operands != 2)
+      {
+        return false;
+      }
+
+      if (src->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+      {
+        return register_is_dword(src->reg);
+      }
+
+      if (src->type == INSTRUCTION_OPERAND_TYPE_MEMORY)
+      {
+        // No memory to memory forms
+        return operand_is_dword_register(dst);
+      }
+
+      if (src->type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE)
+      {
+        return operand_is_dword_register(dst) || dst->size == DATA_SIZE_DWORD;
+      }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Returns true if the instruction loads a register without touching the register
+ * or source operand of the move before it, so the move's value can be used past it.
+ */
+static bool peephole_is_independent_load(struct instruction* ins, int reg, struct instruction_operand* src)
+{
+  if (ins->opcode != INSTRUCTION_OPCODE_MOV && ins->opcode != INSTRUCTION_OPCODE_MOVZX && ins->opcode != INSTRUCTION_OPCODE_LEA)
+  {
+    return false;
+  }
+
+  struct instruction_operand* dst = &ins->operands[0];
+  if (!operand_is_dword_register(dst) || dst->reg == reg || dst->reg == REGISTER_ESP)
+  {
+    return false;
+  }
+
+  return !operand_reads_family(&ins->operands[1], reg) && !operand_reads_family(src, dst->reg);
+}
+
+// mov ecx, 5, add eax, ecx = add eax, 5 when ecx is not needed again
+static bool peephole_forward_move(struct peephole* peephole, int index)
+{
+  struct instruction* move = peephole_at(peephole, index);
+  if (move->opcode != INSTRUCTION_OPCODE_MOV || !operand_is_dword_register(&move->operands[0]))
+  {
+    return false;
+  }
+
+  int reg = move->operands[0].reg;
+  struct instruction_operand* src = &move->operands[1];
+  if (reg == REGISTER_ESP || reg == REGISTER_EBP || src->type == INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    return false;
+  }
+
+  if (src->type == INSTRUCTION_OPERAND_TYPE_MEMORY && operand_reads_family(src, reg))
+  {
+    return false;
+  }
+
+  int use_index = peephole_next(peephole, index);
+  struct instruction* use = peephole_at(peephole, use_index);
+  if (use && peephole_is_independent_load(use, reg, src))
+  {
+    // mov ecx, 5, mov eax, [ebp-4], cmp eax, ecx
+    use_index = peephole_next(peephole, use_index);
+    use = peephole_at(peephole, use_index);
+  }
+
+  if (!use || !instruction_is_machine_instruction(use) || use->total_operands == 0)
+  {
+    return false;
+  }
+
+  // The register may only be read by the last operand
+  int last = use->total_operands - 1;
+  if (!operand_is_register(&use->operands[last], reg))
+  {
+    return false;
+  }
+
+  for (int i = 0; i < last; i++)
+  {
+    if (operand_reads_family(&use->operands[i], reg))
+    {
+      return false;
+    }
+  }
+
+  if (!peephole_can_take_source(use, src) || !peephole_is_dead_after(peephole, use_index, reg))
+  {
+    return false;
+  }
+
+  int size = use->operands[last].size;
+  use->operands[last] = *src;
+  use->operands[last].size = size;
+  if (use->opcode == INSTRUCTION_OPCODE_PUSH && src->type != INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    use->operands[last].size = DATA_SIZE_DWORD;
+  }
+  else if (src->type == INSTRUCTION_OPERAND_TYPE_MEMORY)
+  {
+    use->operands[last].size = 0;
+  }
+
+  peephole_delete(peephole, move);
+  return true;
+}
+
+static int peephole_inverted_jump_for_set(int opcode)
+{
+  switch (opcode)
+  {
+    case INSTRUCTION_OPCODE_SETE: return INSTRUCTION_OPCODE_JNE;
+    case INSTRUCTION_OPCODE_SETNE: return INSTRUCTION_OPCODE_JE;
+    case INSTRUCTION_OPCODE_SETG: return INSTRUCTION_OPCODE_JLE;
+    case INSTRUCTION_OPCODE_SETL: return INSTRUCTION_OPCODE_JGE;
+    case INSTRUCTION_OPCODE_SETGE: return INSTRUCTION_OPCODE_JL;
+    case INSTRUCTION_OPCODE_SETLE: return INSTRUCTION_OPCODE_JG;
+    case INSTRUCTION_OPCODE_SETA: return INSTRUCTION_OPCODE_JBE;
+    case INSTRUCTION_OPCODE_SETB: return INSTRUCTION_OPCODE_JAE;
+    case INSTRUCTION_OPCODE_SETAE: return INSTRUCTION_OPCODE_JB;
+    case INSTRUCTION_OPCODE_SETBE: return INSTRUCTION_OPCODE_JA;
+  }
+
+  return -1;
+}
+
+static int peephole_jump_for_set(int opcode)
+{
+  return peephole_inverted_jump_for_set(peephole_inverted_jump_for_set(opcode) - INSTRUCTION_OPCODE_JE + INSTRUCTION_OPCODE_SETE);
+}
+
+// cmp eax, ecx, setg al, movzx eax, al, cmp eax, 0, je .label = cmp eax, ecx, jle .label
+static bool peephole_compare_and_branch(struct peephole* peephole, int index)
+{
+  struct instruction* cmp = peephole_at(peephole, index);
+  if (cmp->opcode != INSTRUCTION_OPCODE_CMP)
+  {
+    return false;
+  }
+
+  int set_index = peephole_next(peephole, index);
+  struct instruction* set = peephole_at(peephole, set_index);
+  if (!set || !instruction_opcode_is_set(set->opcode) || !operand_is_register(&set->operands[0], REGISTER_AL))
+  {
+    return false;
+  }
+
+  int movzx_index = peephole_next(peephole, set_index);
+  struct instruction* movzx = peephole_at(peephole, movzx_index);
+  if (!movzx || movzx->opcode != INSTRUCTION_OPCODE_MOVZX || !operand_is_register(&movzx->operands[0], REGISTER_EAX) || !operand_is_register(&movzx->operands[1], REGISTER_AL))
+  {
+    return false;
+  }
+
+  int test_index = peephole_next(peephole, movzx_index);
+  struct instruction* test = peephole_at(peephole, test_index);
+  if (!test || test->opcode != INSTRUCTION_OPCODE_CMP || !operand_is_register(&test->operands[0], REGISTER_EAX))
+  {
+    return false;
+  }
+
+  if (test->operands[1].type != INSTRUCTION_OPERAND_TYPE_IMMEDIATE || test->operands[1].imm != 0)
+  {
+    return false;
+  }
+
+  int jump_index = peephole_next(peephole, test_index);
+  struct instruction* jump = peephole_at(peephole, jump_index);
+  // The value is 0 or 1 so jle is the same as je and jg the same as jne
+  if (!jump || (jump->opcode != INSTRUCTION_OPCODE_JE && jump->opcode != INSTRUCTION_OPCODE_JNE && jump->opcode != INSTRUCTION_OPCODE_JLE && jump->opcode != INSTRUCTION_OPCODE_JG))
+  {
+    return false;
+  }
+
+  if (jump->operands[0].type != INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    return false;
+  }
+
+  // Nothing may need the 0 or 1 we are no longer computing, whether the jump is taken or not
+  int steps = 0;
+  if (!peephole_is_dead_after(peephole, jump_index, REGISTER_EAX) || !peephole_is_dead_at_label(peephole, jump->operands[0].symbol, REGISTER_EAX, &steps))
+  {
+    return false;
+  }
+
+  // je jumps when the condition was false
+  bool jump_if_false = jump->opcode == INSTRUCTION_OPCODE_JE || jump->opcode == INSTRUCTION_OPCODE_JLE;
+  jump->opcode = jump_if_false ? peephole_inverted_jump_for_set(set->opcode) : peephole_jump_for_set(set->opcode);
+  peephole_delete(peephole, set);
+  peephole_delete(peephole, movzx);
+  peephole_delete(peephole, test);
+  return true;
+}
+
+// jmp .label straight into .label:
+static bool peephole_jump_to_next(struct peephole* peephole, int index)
+{
+  struct instruction* jump = peephole_at(peephole, index);
+  if (jump->opcode != INSTRUCTION_OPCODE_JMP || jump->operands[0].type != INSTRUCTION_OPERAND_TYPE_SYMBOL)
+  {
+    return false;
+  }
+
+  struct instruction* label = peephole_at(peephole, peephole_next(peephole, index));
+  if (!label || label->opcode != INSTRUCTION_OPCODE_LABEL || !S_EQ(label->text, jump->operands[0].symbol))
+  {
+    return false;
+  }
+
+  peephole_delete(peephole, jump);
+  return true;
+}
+
+// mov ecx, 5 where ecx is never read again
+static bool peephole_dead_move(struct peephole* peephole, int index)
+{
+  struct instruction* ins = peephole_at(peephole, index);
+  if (ins->opcode != INSTRUCTION_OPCODE_MOV && ins->opcode != INSTRUCTION_OPCODE_MOVZX && ins->opcode != INSTRUCTION_OPCODE_LEA)
+  {
+    return false;
+  }
+
+  if (!operand_is_dword_register(&ins->operands[0]))
+  {
+    return false;
+  }
+
+  int reg = ins->operands[0].reg;
+  if (reg == REGISTER_ESP || reg == REGISTER_EBP || !peephole_is_dead_after(peephole, index, reg))
+  {
+    return false;
+  }
+
+  peephole_delete(peephole, ins);
+  return true;
+}
+
+static bool peephole_pass(struct peephole* peephole)
+{
+  bool changed = false;
+  peephole_build_labels(peephole);
+  for (int i = 0; i < vector_count(peephole->instructions); i++)
+  {
+    struct instruction* ins = peephole_at(peephole, i);
+    if (ins->flags & INSTRUCTION_FLAG_DELETED || !instruction_is_machine_instruction(ins))
+    {
+      continue;
+    }
+
+    changed |= peephole_self_move(peephole, i) ||
+               peephole_push_pop(peephole, i) ||
+               peephole_compare_and_branch(peephole, i) ||
+               peephole_forward_move(peephole, i) ||
+               peephole_jump_to_next(peephole, i) ||
+               peephole_dead_move(peephole, i);
+  }
+
+  return changed;
+}
+
+int peephole_optimize(struct instruction_list* list)
+{
+  struct peephole peephole = {.instructions=list->instructions};
+  peephole.labels = vector_create(sizeof(struct peephole_label));
+  peephole.total_slots = PEEPHOLE_LABEL_SLOTS;
+  peephole.slots = malloc(PEEPHOLE_LABEL_SLOTS * sizeof(int));
+  for (int i = 0; i < PEEPHOLE_MAX_PASSES; i++)
+  {
+    if (!peephole_pass(&peephole))
+    {
+      break;
+    }
+  }
+
+  vector_free(peephole.labels);
+  free(peephole.slots);
+  return peephole.removed;
+}
@@ -0,0 +1,912 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Linear scan register allocation over the instructions of one function at a time.
+ *
+ * Two kinds of values are given registers, scalar dword locals that never have their
+ * address taken and the push/pop pairs the code generator uses for expression temporaries.
+ * Only registers code generation never uses are handed out so allocated values can not clash
+ * with the scratch registers, eax, ecx and edx stay with code generation and are never allocated.
+ * In practice the pool is esi and edi. ebx joins them only in a function that makes no calls and
+ * does not use ebx itself, every call loads the callee's address into ebx first.
+ * Values do not move between registers and memory, one that gets no register stays in memory.
+ * esi, edi and ebx are callee saved so the function saves the ones it uses.
+ */
+
+enum
+{
+  REGALLOC_INTERVAL_LOCAL,
+  REGALLOC_INTERVAL_TEMPORARY
+};
+
+struct regalloc_interval
+{
+  int type;
+  // First and last instruction index the value is live for
+  int start;
+  int end;
+
+  // The stack offset of the local, i.e -4
+  int offset;
+  // The index of the pop for temporaries, start is the push
+  int pop_index;
+
+  // The register given to the interval, -1 if it stays in memory
+  int reg;
+};
+
+struct regalloc
+{
+  struct compile_process* process;
+  struct vector* instructions;
+  struct regalloc_function* function;
+
+  // Vector of struct regalloc_interval
+  struct vector* intervals;
+
+  // Registers we can hand out in this function
+  int pool[3];
+  int total_pool;
+};
+
+static struct instruction* regalloc_at(struct regalloc* regalloc, int index)
+{
+  return vector_at(regalloc->instructions, index);
+}
+
+static bool regalloc_is_live(struct instruction* ins)
+{
+  return !(ins->flags & INSTRUCTION_FLAG_DELETED) && ins->opcode != INSTRUCTION_OPCODE_COMMENT;
+}
+
+static int regalloc_register_size(int reg)
+{
+  if (register_is_dword(reg))
+  {
+    return DATA_SIZE_DWORD;
+  }
+
+  return reg >= REGISTER_AL ? DATA_SIZE_BYTE : DATA_SIZE_WORD;
+}
+
+static bool regalloc_operand_mentions(struct instruction_operand* operand, int reg)
+{
+  if (operand->type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+  {
+    return register_family(operand->reg) == reg;
+  }
+
+  return operand->type == INSTRUCTION_OPERAND_TYPE_MEMORY && instruction_address_uses(&operand->address, reg);
+}
+
+static bool regalloc_instruction_mentions(struct instruction* ins, int reg)
+{
+  for (int i = 0; i < ins->total_operands; i++)
+  {
+    if (regalloc_operand_mentions(&ins->operands[i], reg))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief True for an address that is ebp and a constant, offset_out is given the constant
+ */
+static bool regalloc_ebp_address(struct instruction_operand* operand, int* offset_out)
+{
+  struct instruction_address* address = &operand->address;
+  if (operand->type != INSTRUCTION_OPERAND_TYPE_MEMORY || address->base != REGISTER_EBP || address->index != -1 || address->symbol)
+  {
+    return false;
+  }
+
+  *offset_out = address->displacement;
+  return true;
+}
+
+/**
+ * @brief Returns the number of bytes the instruction accesses through the operand, 0 if we can not tell
+ */
+static int regalloc_access_size(struct instruction* ins, int index)
+{
+  if (ins->operands[index].size)
+  {
+    return ins->operands[index].size;
+  }
+
+  if (ins->opcode == INSTRUCTION_OPCODE_PUSH || ins->opcode == INSTRUCTION_OPCODE_POP)
+  {
+    return DATA_SIZE_DWORD;
+  }
+
+  for (int i = 0; i < ins->total_operands; i++)
+  {
+    if (i != index && ins->operands[i].type == INSTRUCTION_OPERAND_TYPE_REGISTER)
+    {
+      return regalloc_register_size(ins->operands[i].reg);
+    }
+  }
+
+  return 0;
+}
+
+static bool regalloc_is_candidate_local(struct regalloc* regalloc, int offset)
+{
+  vector_set_peek_pointer(regalloc->function->locals, 0);
+  int* local = vector_peek(regalloc->function->locals);
+  while (local)
+  {
+    if (*local == offset)
+    {
+      return true;
+    }
+    local = vector_peek(regalloc->function->locals);
+  }
+
+  return false;
+}
+
+static struct regalloc_interval* regalloc_local_interval(struct regalloc* regalloc, int offset)
+{
+  vector_set_peek_pointer(regalloc->intervals, 0);
+  struct regalloc_interval* interval = vector_peek(regalloc->intervals);
+  while (interval)
+  {
+    if (interval->type == REGALLOC_INTERVAL_LOCAL && interval->offset == offset)
+    {
+      return interval;
+    }
+    interval = vector_peek(regalloc->intervals);
+  }
+
+  return NULL;
+}
+
+static void regalloc_remove_local_interval(struct regalloc* regalloc, int offset)
+{
+  struct regalloc_interval* interval = regalloc_local_interval(regalloc, offset);
+  if (!interval)
+  {
+    struct regalloc_interval new_interval = {.type=REGALLOC_INTERVAL_LOCAL, .offset=offset, .reg=-1};
+    vector_push(regalloc->intervals, &new_interval);
+    interval = vector_back(regalloc->intervals);
+  }
+
+  // A start of -1 keeps the local in memory, later accesses do not bring it back
+  interval->start = -1;
+}
+
+static bool regalloc_ranges_overlap(int start1, int size1, int start2, int size2)
+{
+  return start1 < start2 + size2 && start2 < start1 + size1;
+}
+
+/**
+ * @brief Disqualifies every candidate local that the access at the given offset
+ * may touch without being a plain dword access of it
+ */
+static void regalloc_disqualify_overlapping(struct regalloc* regalloc, int offset, int size)
+{
+  vector_set_peek_pointer(regalloc->function->locals, 0);
+  int* local = vector_peek(regalloc->function->locals);
+  while (local)
+  {
+    if (regalloc_ranges_overlap(*local, DATA_SIZE_DWORD, offset, size))
+    {
+      regalloc_remove_local_interval(regalloc, *local);
+    }
+    local = vector_peek(regalloc->function->locals);
+  }
+}
+
+/**
+ * @brief Builds the intervals of the candidate locals. Returns false if the function
+ * accesses its stack frame in a way we can not follow
+ */
+static bool regalloc_build_local_intervals(struct regalloc* regalloc)
+{
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins) || !instruction_is_machine_instruction(ins))
+    {
+      continue;
+    }
+
+    for (int j = 0; j < ins->total_operands; j++)
+    {
+      struct instruction_operand* operand = &ins->operands[j];
+      if (operand->type != INSTRUCTION_OPERAND_TYPE_MEMORY || !regalloc_operand_mentions(operand, REGISTER_EBP))
+      {
+        continue;
+      }
+
+      int offset = 0;
+      if (!regalloc_ebp_address(operand, &offset))
+      {
+        return false;
+      }
+
+      int size = regalloc_access_size(ins, j);
+      if (ins->opcode == INSTRUCTION_OPCODE_LEA)
+      {
+        // Address taken, whatever lives there must stay in memory
+        regalloc_disqualify_overlapping(regalloc, offset, DATA_SIZE_DWORD);
+        continue;
+      }
+
+      if (size == 0)
+      {
+        return false;
+      }
+
+      bool exact = size == DATA_SIZE_DWORD && regalloc_is_candidate_local(regalloc, offset);
+      if (!exact)
+      {
+        regalloc_disqualify_overlapping(regalloc, offset, size);
+        continue;
+      }
+
+      struct regalloc_interval* interval = regalloc_local_interval(regalloc, offset);
+      if (!interval)
+      {
+        struct regalloc_interval new_interval = {.type=REGALLOC_INTERVAL_LOCAL, .start=i, .end=i, .offset=offset, .reg=-1};
+        vector_push(regalloc->intervals, &new_interval);
+        continue;
+      }
+
+      if (interval->start != -1)
+      {
+        interval->end = i;
+      }
+    }
+  }
+
+  return true;
+}
+
+static int regalloc_label_index(struct regalloc* regalloc, const char* name)
+{
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (ins->opcode == INSTRUCTION_OPCODE_LABEL && S_EQ(ins->text, name))
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief A local used inside a loop must keep its register for the whole loop,
+ * stretch every interval that overlaps a backwards jump to cover it
+ */
+static void regalloc_extend_for_loops(struct regalloc* regalloc)
+{
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+    {
+      struct instruction* ins = regalloc_at(regalloc, i);
+      if (!regalloc_is_live(ins) || ins->opcode < INSTRUCTION_OPCODE_JMP || ins->opcode > INSTRUCTION_OPCODE_JBE)
+      {
+        continue;
+      }
+
+      int target = regalloc_label_index(regalloc, ins->operands[0].symbol);
+      if (target == -1 || target > i)
+      {
+        continue;
+      }
+
+      vector_set_peek_pointer(regalloc->intervals, 0);
+      struct regalloc_interval* interval = vector_peek(regalloc->intervals);
+      while (interval)
+      {
+        if (interval->start != -1 && interval->start <= i && interval->end >= target && (interval->start > target || interval->end < i))
+        {
+          interval->start = interval->start < target ? interval->start : target;
+          interval->end = interval->end > i ? interval->end : i;
+          changed = true;
+        }
+        interval = vector_peek(regalloc->intervals);
+      }
+    }
+  }
+}
+
+static bool regalloc_is_stack_adjust(struct instruction* ins)
+{
+  return (ins->opcode == INSTRUCTION_OPCODE_ADD || ins->opcode == INSTRUCTION_OPCODE_SUB) && ins->operands[0].type == INSTRUCTION_OPERAND_TYPE_REGISTER &&
+    ins->operands[0].reg == REGISTER_ESP && ins->operands[1].type == INSTRUCTION_OPERAND_TYPE_IMMEDIATE && ins->operands[1].imm % DATA_SIZE_DWORD == 0;
+}
+
+static bool regalloc_is_dword_value(struct instruction_operand* operand)
+{
+  switch (operand->type)
+  {
+    case INSTRUCTION_OPERAND_TYPE_REGISTER:
+      return register_is_dword(operand->reg) && operand->reg != REGISTER_ESP && operand->reg != REGISTER_EBP;
+
+    case INSTRUCTION_OPERAND_TYPE_IMMEDIATE:
+      return true;
+
+    case INSTRUCTION_OPERAND_TYPE_MEMORY:
+      return (operand->size == 0 || operand->size == DATA_SIZE_DWORD) && !regalloc_operand_mentions(operand, REGISTER_ESP);
+  }
+
+  return false;
+}
+
+/**
+ * @brief Finds the pop that takes the value pushed at the given index. Returns -1 if
+ * anything between makes it unsafe to keep the value in a register instead.
+ */
+static int regalloc_matching_pop(struct regalloc* regalloc, int push_index)
+{
+  // Depth in dwords of anything pushed after our value
+  int depth = 0;
+  for (int i = push_index + 1; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins))
+    {
+      continue;
+    }
+
+    // Control flow could reach the pop with a different stack
+    if (!instruction_is_machine_instruction(ins) || (ins->opcode >= INSTRUCTION_OPCODE_JMP && ins->opcode <= INSTRUCTION_OPCODE_JBE) || ins->opcode == INSTRUCTION_OPCODE_RET)
+    {
+      return -1;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_PUSH)
+    {
+      depth++;
+      continue;
+    }
+
+    if (ins->opcode == INSTRUCTION_OPCODE_POP)
+    {
+      if (depth == 0)
+      {
+        struct instruction_operand* dst = &ins->operands[0];
+        return regalloc_is_dword_value(dst) && dst->type != INSTRUCTION_OPERAND_TYPE_IMMEDIATE ? i : -1;
+      }
+      depth--;
+      continue;
+    }
+
+    if (regalloc_is_stack_adjust(ins))
+    {
+      int amount = ins->operands[1].imm / DATA_SIZE_DWORD;
+      depth += ins->opcode == INSTRUCTION_OPCODE_SUB ? amount : -amount;
+      if (depth < 0)
+      {
+        return -1;
+      }
+      continue;
+    }
+
+    // Anything else that looks at esp sees a different stack once the push is gone
+    if (regalloc_instruction_mentions(ins, REGISTER_ESP))
+    {
+      return -1;
+    }
+  }
+
+  return -1;
+}
+
+static void regalloc_build_temporary_intervals(struct regalloc* regalloc)
+{
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins) || ins->opcode != INSTRUCTION_OPCODE_PUSH || !regalloc_is_dword_value(&ins->operands[0]))
+    {
+      continue;
+    }
+
+    int pop_index = regalloc_matching_pop(regalloc, i);
+    if (pop_index == -1)
+    {
+      continue;
+    }
+
+    struct regalloc_interval interval = {.type=REGALLOC_INTERVAL_TEMPORARY, .start=i, .end=pop_index, .pop_index=pop_index, .reg=-1};
+    vector_push(regalloc->intervals, &interval);
+  }
+}
+
+static int regalloc_compare_intervals(const void* a, const void* b)
+{
+  const struct regalloc_interval* interval1 = a;
+  const struct regalloc_interval* interval2 = b;
+  if (interval1->start != interval2->start)
+  {
+    return interval1->start - interval2->start;
+  }
+
+  return interval1->end - interval2->end;
+}
+
+/**
+ * @brief Hands out the registers. Intervals are visited in order of their start, an interval
+ * whose end has passed gives its register back and when none are left the interval
+ * that lives longest stays in memory.
+ */
+static void regalloc_linear_scan(struct regalloc* regalloc)
+{
+  int total = vector_count(regalloc->intervals);
+  if (total == 0)
+  {
+    return;
+  }
+
+  qsort(vector_at(regalloc->intervals, 0), total, sizeof(struct regalloc_interval), regalloc_compare_intervals);
+
+  // The interval holding each register of the pool, NULL if free
+  struct regalloc_interval* active[3] = {};
+  for (int i = 0; i < total; i++)
+  {
+    struct regalloc_interval* interval = vector_at(regalloc->intervals, i);
+    if (interval->start == -1)
+    {
+      continue;
+    }
+
+    int free_slot = -1;
+    int longest_slot = -1;
+    for (int j = 0; j < regalloc->total_pool; j++)
+    {
+      if (active[j] && active[j]->end < interval->start)
+      {
+        active[j] = NULL;
+      }
+
+      if (!active[j])
+      {
+        free_slot = j;
+      }
+      else if (longest_slot == -1 || active[j]->end > active[longest_slot]->end)
+      {
+        longest_slot = j;
+      }
+    }
+
+    if (free_slot == -1)
+    {
+      if (longest_slot == -1 || active[longest_slot]->end <= interval->end)
+      {
+        regalloc->process->generator->total_spilled++;
+        continue;
+      }
+
+      // Whoever lives longest gives up their register
+      active[longest_slot]->reg = -1;
+      regalloc->process->generator->total_allocated--;
+      regalloc->process->generator->total_spilled++;
+      free_slot = longest_slot;
+    }
+
+    interval->reg = regalloc->pool[free_slot];
+    active[free_slot] = interval;
+    regalloc->process->generator->total_allocated++;
+  }
+}
+
+static void regalloc_rewrite_local(struct regalloc* regalloc, struct regalloc_interval* interval)
+{
+  for (int i = interval->start; i <= interval->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins) || !instruction_is_machine_instruction(ins))
+    {
+      continue;
+    }
+
+    for (int j = 0; j < ins->total_operands; j++)
+    {
+      struct instruction_operand* operand = &ins->operands[j];
+      int offset = 0;
+      if (regalloc_ebp_address(operand, &offset) && offset == interval->offset)
+      {
+        memset(operand, 0, sizeof(struct instruction_operand));
+        operand->type = INSTRUCTION_OPERAND_TYPE_REGISTER;
+        operand->reg = interval->reg;
+      }
+    }
+  }
+}
+
+static void regalloc_rewrite_temporary(struct regalloc* regalloc, struct regalloc_interval* interval)
+{
+  struct instruction* push_ins = regalloc_at(regalloc, interval->start);
+  struct instruction* pop_ins = regalloc_at(regalloc, interval->pop_index);
+  struct instruction_operand reg = {.type=INSTRUCTION_OPERAND_TYPE_REGISTER, .reg=interval->reg};
+
+  // push eax becomes mov esi, eax
+  push_ins->opcode = INSTRUCTION_OPCODE_MOV;
+  push_ins->total_operands = 2;
+  push_ins->operands[1] = push_ins->operands[0];
+  push_ins->operands[1].size = 0;
+  push_ins->operands[0] = reg;
+
+  // pop ecx becomes mov ecx, esi
+  pop_ins->opcode = INSTRUCTION_OPCODE_MOV;
+  pop_ins->total_operands = 2;
+  if (pop_ins->operands[0].type == INSTRUCTION_OPERAND_TYPE_MEMORY)
+  {
+    pop_ins->operands[0].size = DATA_SIZE_DWORD;
+  }
+  pop_ins->operands[1] = reg;
+}
+
+/**
+ * @brief Finds where the epilogue before the ret starts, the add esp or pop ebp. -1 if
+ * the function does not end the way we expect
+ */
+static int regalloc_epilogue_start(struct regalloc* regalloc, int ret_index)
+{
+  int index = ret_index - 1;
+  while (index > regalloc->function->start && !regalloc_is_live(regalloc_at(regalloc, index)))
+  {
+    index--;
+  }
+
+  struct instruction* ins = regalloc_at(regalloc, index);
+  if (ins->opcode != INSTRUCTION_OPCODE_POP || ins->operands[0].type != INSTRUCTION_OPERAND_TYPE_REGISTER || ins->operands[0].reg != REGISTER_EBP)
+  {
+    return -1;
+  }
+
+  int pop_index = index--;
+  while (index > regalloc->function->start && !regalloc_is_live(regalloc_at(regalloc, index)))
+  {
+    index--;
+  }
+
+  return regalloc_is_stack_adjust(regalloc_at(regalloc, index)) ? index : pop_index;
+}
+
+/**
+ * @brief Returns the index after the prologue where callee saved registers get pushed
+ */
+static int regalloc_prologue_end(struct regalloc* regalloc)
+{
+  int index = regalloc->function->start;
+  struct instruction* ins = regalloc_at(regalloc, index);
+  if (ins->opcode != INSTRUCTION_OPCODE_PUSH || !regalloc_operand_mentions(&ins->operands[0], REGISTER_EBP))
+  {
+    return -1;
+  }
+
+  // mov ebp, esp and then the sub esp if there are locals
+  index++;
+  ins = regalloc_at(regalloc, index);
+  if (ins->opcode != INSTRUCTION_OPCODE_MOV || ins->operands[0].reg != REGISTER_EBP)
+  {
+    return -1;
+  }
+
+  index++;
+  if (index < regalloc->function->end && regalloc_is_stack_adjust(regalloc_at(regalloc, index)))
+  {
+    index++;
+  }
+
+  return index;
+}
+
+static bool regalloc_can_save_registers(struct regalloc* regalloc)
+{
+  if (regalloc_prologue_end(regalloc) == -1)
+  {
+    return false;
+  }
+
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (regalloc_is_live(ins) && ins->opcode == INSTRUCTION_OPCODE_RET && regalloc_epilogue_start(regalloc, i) == -1)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void regalloc_save_registers(struct regalloc* regalloc, bool* used)
+{
+  // Restore before every ret, working backwards so the indexes we have not reached stay put
+  for (int i = regalloc->function->end - 1; i >= regalloc->function->start; i--)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins) || ins->opcode != INSTRUCTION_OPCODE_RET)
+    {
+      continue;
+    }
+
+    int index = regalloc_epilogue_start(regalloc, i);
+    for (int j = 0; j < regalloc->total_pool; j++)
+    {
+      if (used[j])
+      {
+        struct instruction pop_ins = {.opcode=INSTRUCTION_OPCODE_POP, .total_operands=1};
+        pop_ins.operands[0] = (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_REGISTER, .reg=regalloc->pool[j]};
+        instruction_list_insert(regalloc->process->generator->instructions, index, &pop_ins);
+      }
+    }
+  }
+
+  int index = regalloc_prologue_end(regalloc);
+  for (int j = regalloc->total_pool - 1; j >= 0; j--)
+  {
+    if (used[j])
+    {
+      struct instruction push_ins = {.opcode=INSTRUCTION_OPCODE_PUSH, .total_operands=1};
+      push_ins.operands[0] = (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_REGISTER, .reg=regalloc->pool[j]};
+      instruction_list_insert(regalloc->process->generator->instructions, index, &push_ins);
+    }
+  }
+}
+
+static void regalloc_build_pool(struct regalloc* regalloc)
+{
+  bool has_call = false;
+  bool mentions[REGISTER_TOTAL] = {};
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    has_call |= ins->opcode == INSTRUCTION_OPCODE_CALL;
+    for (int reg = REGISTER_EBX; reg <= REGISTER_EDI; reg++)
+    {
+      mentions[reg] |= regalloc_instruction_mentions(ins, reg);
+    }
+  }
+
+  regalloc->total_pool = 0;
+  if (!mentions[REGISTER_ESI])
+  {
+    regalloc->pool[regalloc->total_pool++] = REGISTER_ESI;
+  }
+
+  if (!mentions[REGISTER_EDI])
+  {
+    regalloc->pool[regalloc->total_pool++] = REGISTER_EDI;
+  }
+
+  // Functions we generate use ebx without saving it, so it can not be trusted across a call
+  if (!mentions[REGISTER_EBX] && !has_call)
+  {
+    regalloc->pool[regalloc->total_pool++] = REGISTER_EBX;
+  }
+}
+
+/**
+ * @brief True for an address that can not change while the function runs, a global or ebp plus a constant
+ */
+static bool regalloc_is_invariant_address(struct instruction_operand* operand)
+{
+  if (operand->type != INSTRUCTION_OPERAND_TYPE_MEMORY)
+  {
+    return false;
+  }
+
+  for (int reg = REGISTER_EAX; reg <= REGISTER_ESP; reg++)
+  {
+    if (reg != REGISTER_EBP && regalloc_operand_mentions(operand, reg))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool regalloc_is_pool_register(struct regalloc* regalloc, int reg)
+{
+  for (int i = 0; i < regalloc->total_pool; i++)
+  {
+    if (regalloc->pool[i] == reg)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Moves the address loads of locals and globals inside a loop in front of it, each address goes
+ * into a pool register the scan left free and the loads in the loop become moves from that register
+ */
+static void regalloc_hoist_addresses(struct regalloc* regalloc, bool* used)
+{
+  // Registers the scan gave out are taken for the whole function, a hoisted address only holds its
+  // register from where it was hoisted to on, so a loop earlier in the function can use it again
+  bool allocated[3] = {};
+  int hoisted_from[3] = {-1, -1, -1};
+  memcpy(allocated, used, sizeof(allocated));
+
+  // Outer loops end last, starting from the end hoists nested addresses as far out as they go
+  for (int i = regalloc->function->end - 1; i >= regalloc->function->start; i--)
+  {
+    struct instruction* ins = regalloc_at(regalloc, i);
+    if (!regalloc_is_live(ins) || ins->opcode < INSTRUCTION_OPCODE_JMP || ins->opcode > INSTRUCTION_OPCODE_JBE)
+    {
+      continue;
+    }
+
+    // Only loops we generated, nothing but the back jump can enter those at the head
+    int head = regalloc_label_index(regalloc, ins->operands[0].symbol);
+    if (head == -1 || head > i || strncmp(regalloc_at(regalloc, head)->text, ".loop_", 6) != 0)
+    {
+      continue;
+    }
+
+    // In front of the alignment padding so the head stays aligned
+    int index = head > 0 && regalloc_at(regalloc, head - 1)->opcode == INSTRUCTION_OPCODE_ALIGN ? head - 1 : head;
+    // Queued last first once the loop is done, the loads keep their order in front of the loop
+    struct instruction hoisted[3];
+    int total_hoisted = 0;
+    for (int j = head + 1; j < i; j++)
+    {
+      struct instruction* lea = regalloc_at(regalloc, j);
+      if (!regalloc_is_live(lea) || lea->opcode != INSTRUCTION_OPCODE_LEA || regalloc_is_pool_register(regalloc, lea->operands[0].reg) ||
+        !regalloc_is_invariant_address(&lea->operands[1]))
+      {
+        continue;
+      }
+
+      int slot = -1;
+      for (int k = 0; k < regalloc->total_pool && slot == -1; k++)
+      {
+        slot = allocated[k] || (hoisted_from[k] != -1 && hoisted_from[k] <= i) ? -1 : k;
+      }
+
+      if (slot == -1)
+      {
+        break;
+      }
+
+      used[slot] = true;
+      int reg = regalloc->pool[slot];
+      hoisted[total_hoisted] = *lea;
+      hoisted[total_hoisted].operands[0].reg = reg;
+      total_hoisted++;
+
+      // Every load of the same address in the loop shares the register
+      struct instruction_address address = lea->operands[1].address;
+      for (int k = j; k < i; k++)
+      {
+        struct instruction* other = regalloc_at(regalloc, k);
+        if (regalloc_is_live(other) && other->opcode == INSTRUCTION_OPCODE_LEA && other->operands[1].type == INSTRUCTION_OPERAND_TYPE_MEMORY &&
+          instruction_address_equal(&other->operands[1].address, &address) && !regalloc_is_pool_register(regalloc, other->operands[0].reg))
+        {
+          other->opcode = INSTRUCTION_OPCODE_MOV;
+          other->operands[1] = (struct instruction_operand){.type=INSTRUCTION_OPERAND_TYPE_REGISTER, .reg=reg};
+        }
+      }
+
+      hoisted_from[slot] = index;
+    }
+
+    for (int k = total_hoisted - 1; k >= 0; k--)
+    {
+      instruction_list_insert(regalloc->process->generator->instructions, index, &hoisted[k]);
+    }
+  }
+}
+
+static bool regalloc_function_has_raw(struct regalloc* regalloc)
+{
+  for (int i = regalloc->function->start; i < regalloc->function->end; i++)
+  {
+    if (regalloc_at(regalloc, i)->opcode == INSTRUCTION_OPCODE_RAW)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void regalloc_function(struct regalloc* regalloc)
+{
+  if (regalloc_function_has_raw(regalloc) || !regalloc_can_save_registers(regalloc))
+  {
+    return;
+  }
+
+  regalloc_build_pool(regalloc);
+  if (regalloc->total_pool == 0)
+  {
+    return;
+  }
+
+  vector_clear(regalloc->intervals);
+  if (regalloc_build_local_intervals(regalloc))
+  {
+    regalloc_extend_for_loops(regalloc);
+  }
+  else
+  {
+    vector_clear(regalloc->intervals);
+  }
+  regalloc_build_temporary_intervals(regalloc);
+  regalloc_linear_scan(regalloc);
+
+  bool used[3] = {};
+  // Locals first so temporaries that push a local push its register
+  for (int pass = REGALLOC_INTERVAL_LOCAL; pass <= REGALLOC_INTERVAL_TEMPORARY; pass++)
+  {
+    for (int i = 0; i < vector_count(regalloc->intervals); i++)
+    {
+      struct regalloc_interval* interval = vector_at(regalloc->intervals, i);
+      if (interval->type != pass || interval->reg == -1)
+      {
+        continue;
+      }
+
+      for (int j = 0; j < regalloc->total_pool; j++)
+      {
+        used[j] |= regalloc->pool[j] == interval->reg;
+      }
+
+      if (pass == REGALLOC_INTERVAL_LOCAL)
+      {
+        regalloc_rewrite_local(regalloc, interval);
+        continue;
+      }
+      regalloc_rewrite_temporary(regalloc, interval);
+    }
+  }
+
+  regalloc_hoist_addresses(regalloc, used);
+  regalloc_save_registers(regalloc, used);
+}
+
+void regalloc(struct compile_process* process)
+{
+  struct code_generator* generator = process->generator;
+  struct regalloc regalloc = {.process=process, .instructions=generator->instructions->instructions};
+  regalloc.intervals = vector_create(sizeof(struct regalloc_interval));
+
+  // The saves and hoisted loads are queued, nothing moves until they all go in at once
+  struct vector* inserts = generator->instructions->inserts;
+  int total_functions = vector_count(generator->functions);
+  int* inserted = calloc(total_functions, sizeof(int));
+  for (int i = 0; i < total_functions; i++)
+  {
+    regalloc.function = vector_at(generator->functions, i);
+    int queued = vector_count(inserts);
+    regalloc_function(&regalloc);
+    inserted[i] = vector_count(inserts) - queued;
+  }
+  instruction_list_apply_inserts(generator->instructions);
+
+  // Keep the bounds of the functions right for the passes that run after us
+  int offset = 0;
+  for (int i = 0; i < total_functions; i++)
+  {
+    struct regalloc_function* function = vector_at(generator->functions, i);
+    function->start += offset;
+    offset += inserted[i];
+    function->end += offset;
+  }
+
+  free(inserted);
+  vector_free(regalloc.intervals);
+}
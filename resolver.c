@@ -1,8 +1,12 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
+// The slots the resolver cache starts with, they double as the cache fills
+#define RESOLVER_CACHE_START_SLOTS 64
+
 void resolver_follow_part(struct resolver_process* resolver, struct node* node, struct resolver_result* result);
 struct resolver_entity* resolver_follow_exp(struct resolver_process* resolver, struct node* node, struct resolver_result* result);
 struct resolver_result* resolver_follow(struct resolver_process* resolver, struct node* node);
@@ -190,6 +194,8 @@ struct resolver_scope* resolver_new_scope(struct resolver_process* resolver, voi
   resolver->scope.current = scope;
   scope->private = private;
   scope->flags = flags;
+  // Until it has entities of its own names resolve as they do in the parent
+  scope->epoch = scope->prev->epoch;
   return scope;
 }
 
@@ -198,6 +204,7 @@ void resolver_finish_scope(struct resolver_process* resolver)
   struct resolver_scope* scope = resolver->scope.current;
   resolver->scope.current = scope->prev;
   resolver->callbacks.delete_scope(scope);
+  vector_free(scope->entities);
   free(scope);
 }
 
@@ -208,9 +215,37 @@ struct resolver_process* resolver_new_process(struct compile_process* compiler,
   memcpy(&process->callbacks, callbacks, sizeof(process->callbacks));
   process->scope.root = resolver_new_scope_create();
   process->scope.current = process->scope.root;
+  process->cache.total_slots = RESOLVER_CACHE_START_SLOTS;
+  process->cache.slots = calloc(process->cache.total_slots, sizeof(struct resolver_cache_entry*));
   return process;
 }
 
+void resolver_free(struct resolver_process* process)
+{
+  // A compiler error can leave scopes open
+  while (process->scope.current != process->scope.root)
+  {
+    resolver_finish_scope(process);
+  }
+  process->callbacks.delete_scope(process->scope.root);
+  vector_free(process->scope.root->entities);
+  free(process->scope.root);
+
+  for (int i = 0; i < process->cache.total_slots; i++)
+  {
+    struct resolver_cache_entry* entry = process->cache.slots[i];
+    while (entry)
+    {
+      struct resolver_cache_entry* next = entry->next;
+      resolver_result_free(entry->result);
+      free(entry);
+      entry = next;
+    }
+  }
+  free(process->cache.slots);
+  free(process);
+}
+
 struct resolver_entity* resolver_create_new_entity(struct resolver_result* result, int type, void* private)
 {
   struct resolver_entity* entity = calloc(1, sizeof(struct resolver_entity));
@@ -402,6 +437,7 @@ struct resolver_entity* resolver_new_entity_for_var_node(struct resolver_process
   }
 
   vector_push(process->scope.current->entities, &entity);
+  resolver_cache_invalidate(process, process->scope.current);
   return entity;
 }
 
@@ -450,6 +486,10 @@ struct resolver_entity* resolver_create_new_entity_for_function_call(struct reso
 
   entity->dtype = lefy_operand_entity->dtype;
   entity->func_call_data.arguments = vector_create(sizeof(struct node*));
+  if (lefy_operand_entity->type == RESOLVER_ENTITY_TYPE_FUNCTION)
+  {
+    entity->func_call_data.function = lefy_operand_entity->node;
+  }
   return entity;
 }
 
@@ -466,6 +506,7 @@ struct resolver_entity* resolver_register_function(struct resolver_process* proc
   entity->dtype = func_node->func.rtype;
   entity->scope = resolver_process_scope_current(process);
   vector_push(process->scope.current->entities, &entity);
+  resolver_cache_invalidate(process, process->scope.current);
   return entity;
 }
 
@@ -660,18 +701,19 @@ void resolver_build_function_call_arguments(struct resolver_process* resolver, s
   else if (node_valid(argument_node))
   {
     vector_push(root_func_call_entity->func_call_data.arguments, &argument_node);
-    size_t stack_change = DATA_SIZE_DWORD;
+    // A push of the target unless it's a structure
+    size_t slot_size = target_current()->stack_slot_size;
+    size_t stack_change = slot_size;
     struct datatype* dtype = resolver_get_datatype(resolver, argument_node);
     if (dtype)
     {
-      // 4 bytes unless it's a structure
       stack_change = datatype_element_size(dtype);
-      if (stack_change < DATA_SIZE_DWORD)
+      if (stack_change < slot_size)
       {
-        stack_change = DATA_SIZE_DWORD;
+        stack_change = slot_size;
       }
 
-      stack_change = align_value(stack_change, DATA_SIZE_DWORD);
+      stack_change = align_value(stack_change, slot_size);
     }
     *total_size_out += stack_change;
   }
@@ -767,6 +809,11 @@ struct resolver_entity* resolver_follow_array_bracket(struct resolver_process* r
   {
     datatype_decrement_pointer(&array_bracket_entity->dtype);
   }
+  else if (index == array_brackets_count(&dtype) - 1)
+  {
+    // abc[1][2]; the last bracket is an element of the array
+    array_bracket_entity->dtype.flags &= ~DATATYPE_FLAG_IS_ARRAY;
+  }
 
   resolver_result_entity_push(result, array_bracket_entity);
   return array_bracket_entity;
@@ -1071,7 +1118,8 @@ void resolver_finalize_result_flags(struct resolver_process* resolver, struct re
 
     if (entity->type == RESOLVER_ENTITY_TYPE_ARRAY_BRACKET)
     {
-      if (entity->dtype.flags & DATATYPE_FLAG_IS_POINTER)
+      // int* abc; abc[i]; the address is the value of the pointer
+      if (entity->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY)
       {
         flags |= RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE;
         flags &= ~RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX;
@@ -1106,6 +1154,16 @@ void resolver_finalize_result_flags(struct resolver_process* resolver, struct re
   {
     flags |= RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE;
   }
+  else if (last_entity->type == RESOLVER_ENTITY_TYPE_ARRAY_BRACKET && !(last_entity->dtype.flags & DATATYPE_FLAG_IS_ARRAY))
+  {
+    // int abc[50]; abc[i]; the last bracket addresses an element rather than a row
+    flags |= RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE;
+  }
+  else if (last_entity->type == RESOLVER_ENTITY_TYPE_UNARY_INDIRECTION)
+  {
+    // int* p; *p; the entity leaves the address p points at
+    flags |= RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE;
+  }
 
   if (does_get_address)
   {
@@ -1169,11 +1227,108 @@ void resolver_finalize_result(struct resolver_process* resolver, struct resolver
   resolver_finalize_last_entity(resolver, result);
 }
 
+void resolver_cache_invalidate(struct resolver_process* resolver, struct resolver_scope* scope)
+{
+  // A new entity can change what a name resolves to in this scope, the entries of its parents stay valid there
+  scope->epoch = ++resolver->cache.epoch;
+}
+
+static unsigned int resolver_cache_hash(struct node* node)
+{
+  // FNV-1a over the bytes of the pointer
+  uintptr_t value = (uintptr_t) node;
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(value); i++)
+  {
+    hash = (hash ^ (unsigned char) (value >> (i * 8))) * 16777619u;
+  }
+  return hash;
+}
+
+static struct resolver_cache_entry** resolver_cache_slot(struct resolver_process* resolver, struct node* node)
+{
+  return &resolver->cache.slots[resolver_cache_hash(node) & (resolver->cache.total_slots - 1)];
+}
+
+static void resolver_cache_grow(struct resolver_process* resolver)
+{
+  struct resolver_cache_entry** old_slots = resolver->cache.slots;
+  int old_total_slots = resolver->cache.total_slots;
+  resolver->cache.total_slots *= 2;
+  resolver->cache.slots = calloc(resolver->cache.total_slots, sizeof(struct resolver_cache_entry*));
+  for (int i = 0; i < old_total_slots; i++)
+  {
+    struct resolver_cache_entry* entry = old_slots[i];
+    while (entry)
+    {
+      struct resolver_cache_entry* next = entry->next;
+      struct resolver_cache_entry** slot = resolver_cache_slot(resolver, entry->node);
+      entry->next = *slot;
+      *slot = entry;
+      entry = next;
+    }
+  }
+  free(old_slots);
+}
+
+static struct resolver_cache_entry* resolver_cache_find(struct resolver_process* resolver, struct node* node)
+{
+  struct resolver_cache_entry* entry = *resolver_cache_slot(resolver, node);
+  while (entry && entry->node != node)
+  {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+struct resolver_result* resolver_cache_get(struct resolver_process* resolver, struct node* node)
+{
+  struct resolver_cache_entry* entry = resolver_cache_find(resolver, node);
+  return entry && entry->epoch == resolver->scope.current->epoch ? entry->result : NULL;
+}
+
+void resolver_cache_put(struct resolver_process* resolver, struct node* node, struct resolver_result* result)
+{
+  // A node followed again in another epoch takes over its old entry
+  struct resolver_cache_entry* entry = resolver_cache_find(resolver, node);
+  if (!entry)
+  {
+    if (resolver->cache.total_entries >= resolver->cache.total_slots)
+    {
+      resolver_cache_grow(resolver);
+    }
+
+    struct resolver_cache_entry** slot = resolver_cache_slot(resolver, node);
+    entry = calloc(1, sizeof(struct resolver_cache_entry));
+    entry->node = node;
+    entry->next = *slot;
+    *slot = entry;
+    resolver->cache.total_entries++;
+  }
+
+  entry->epoch = resolver->scope.current->epoch;
+  entry->result = result;
+}
+
+void resolver_print_stats(struct resolver_process* resolver, FILE* fp)
+{
+  size_t total = resolver->cache.hits + resolver->cache.misses;
+  fprintf(fp, "resolver cache: %zu hits, %zu misses, %.1f%% hit rate, %i epochs\n", resolver->cache.hits, resolver->cache.misses, total ? (resolver->cache.hits * 100.0) / total : 0.0, resolver->cache.epoch);
+}
+
 struct resolver_result* resolver_follow(struct resolver_process* resolver, struct node* node)
 {
   assert(resolver);
   assert(node);
-  struct resolver_result* result = resolver_new_result(resolver);
+  struct resolver_result* result = resolver_cache_get(resolver, node);
+  if (result)
+  {
+    resolver->cache.hits++;
+    return result;
+  }
+
+  resolver->cache.misses++;
+  result = resolver_new_result(resolver);
   resolver_follow_part(resolver, node, result);
   if (!resolver_result_entity_root(result))
   {
@@ -1182,5 +1337,9 @@ struct resolver_result* resolver_follow(struct resolver_process* resolver, struc
   resolver_execute_rules(resolver, result);
   resolver_merge_compile_times(resolver, result);
   resolver_finalize_result(resolver, result);
+  if (resolver_result_ok(result))
+  {
+    resolver_cache_put(resolver, node, result);
+  }
   return result;
 }
\ No newline at end of file
@@ -4,104 +4,100 @@
 #include <stdlib.h>
 #include <assert.h>
 
-struct scope* scope_alloc()
+static void scope_update_pointers(struct compile_process* process)
 {
-  struct scope* scope = calloc(1, sizeof(struct scope));
-  scope->entities = vector_create(sizeof(void*));
-  vector_set_peek_pointer_end(scope->entities);
-  vector_set_flag(scope->entities, VECTOR_FLAG_PEEK_DECREMENT);
-  return scope;
+  // Pushing a frame can move the frames vector so refresh our pointers
+  process->scope.root = vector_back_or_null(process->scope.frames) ? vector_at(process->scope.frames, 0) : NULL;
+  process->scope.current = vector_back_or_null(process->scope.frames);
 }
 
-void scope_dealloc(struct scope* scope)
+static void scope_push_frame(struct compile_process* process, int flags)
 {
-  // Do nothing for now
+  struct scope scope = {};
+  scope.flags = flags;
+  scope.start = vector_count(process->scope.entities);
+  vector_push(process->scope.frames, &scope);
+  scope_update_pointers(process);
 }
 
-struct scope* scope_create_root(struct compile_process* process)
+static void scope_pop_frame(struct compile_process* process)
 {
-  assert(!process->scope.root);
-  assert(!process->scope.current);
-
-  struct scope* root_scope = scope_alloc();
-  process->scope.root = root_scope;
-  process->scope.current = root_scope;
-  return root_scope;
-}
+  struct scope* scope = process->scope.current;
+  // The scope owns the entities that were pushed to it
+  while (vector_count(process->scope.entities) > scope->start)
+  {
+    free(vector_back_ptr(process->scope.entities));
+    vector_pop(process->scope.entities);
+  }
 
-void scope_free_root(struct compile_process* process)
-{
-  scope_dealloc(process->scope.root);
-  process->scope.root = NULL;
-  process->scope.current = NULL;
+  vector_pop(process->scope.frames);
+  scope_update_pointers(process);
 }
 
-struct scope* scope_new(struct compile_process* process, int flags)
+struct scope* scope_create_root(struct compile_process* process)
 {
-  assert(process->scope.root);
-  assert(process->scope.current);
+  assert(!process->scope.root);
+  assert(!process->scope.current);
 
-  struct scope* new_scope = scope_alloc();
-  new_scope->flags = flags;
-  new_scope->parent = process->scope.current;
-  process->scope.current = new_scope;
-  return new_scope;
+  process->scope.frames = vector_create(sizeof(struct scope));
+  process->scope.entities = vector_create(sizeof(void*));
+  scope_push_frame(process, 0);
+  return process->scope.root;
 }
 
-void scope_iteration_start(struct scope* scope)
+void scope_free_root(struct compile_process* process)
 {
-  vector_set_peek_pointer(scope->entities, 0);
-  if (scope->entities->flags & VECTOR_FLAG_PEEK_DECREMENT)
+  while (process->scope.current)
   {
-    vector_set_peek_pointer_end(scope->entities);
+    scope_pop_frame(process);
   }
-}
 
-void scope_iteration_end(struct scope* scope)
-{
+  vector_free(process->scope.frames);
+  vector_free(process->scope.entities);
+  process->scope.frames = NULL;
+  process->scope.entities = NULL;
 }
 
-void* scope_iterate_back(struct scope* scope)
+struct scope* scope_new(struct compile_process* process, int flags)
 {
-  if (vector_count(scope->entities) == 0)
-    return NULL;
+  assert(process->scope.root);
+  assert(process->scope.current);
 
-  return vector_peek_ptr(scope->entities);
+  scope_push_frame(process, flags);
+  return process->scope.current;
 }
 
-void* scope_last_entity_at_scope(struct scope* scope)
+void* scope_last_entity_at_scope(struct compile_process* process, struct scope* scope)
 {
-  if (vector_count(scope->entities) == 0)
+  int count = vector_count(process->scope.entities);
+  int end = scope == process->scope.current ? count : (scope+1)->start;
+  if (end == scope->start)
     return NULL;
 
-  return vector_back_ptr(scope->entities);
+  return *(void**)(vector_at(process->scope.entities, end - 1));
 }
 
-void* scope_last_entity_from_scope_stop_at(struct scope* scope, struct scope* stop_scope)
+void* scope_last_entity_stop_at(struct compile_process* process, struct scope* stop_scope)
 {
-  if (scope == stop_scope)
+  // Entities of every open scope are contiguous, so the last one pushed above
+  // the stop scope is simply the top of the stack
+  int stop_index = 0;
+  if (stop_scope)
   {
-    return NULL;
-  }
+    if (stop_scope == process->scope.current)
+    {
+      return NULL;
+    }
 
-  void* last = scope_last_entity_at_scope(scope);
-  if (last)
-  {
-    return last;
+    stop_index = (stop_scope+1)->start;
   }
 
-  struct scope* parent = scope->parent;
-  if (parent)
+  if (vector_count(process->scope.entities) <= stop_index)
   {
-    return scope_last_entity_from_scope_stop_at(parent, stop_scope);
+    return NULL;
   }
 
-  return NULL;
-}
-
-void* scope_last_entity_stop_at(struct compile_process* process, struct scope* stop_scope)
-{
-  return scope_last_entity_from_scope_stop_at(process->scope.current, stop_scope);
+  return vector_back_ptr(process->scope.entities);
 }
 
 void* scope_last_entity(struct compile_process* process)
@@ -111,22 +107,16 @@ void* scope_last_entity(struct compile_process* process)
 
 void scope_push(struct compile_process* process, void* ptr, size_t elem_size)
 {
-  vector_push(process->scope.current->entities, &ptr);
+  vector_push(process->scope.entities, &ptr);
   process->scope.current->size += elem_size;
 }
 
 void scope_finish(struct compile_process* process)
 {
-  struct scope* new_current_scope = process->scope.current->parent;
-  scope_dealloc(process->scope.current);
-  process->scope.current = new_current_scope;
-  if (process->scope.root && !process->scope.current)
-  {
-    process->scope.root = NULL;
-  }
+  scope_pop_frame(process);
 }
 
 struct scope* scope_current(struct compile_process* process)
 {
   return process->scope.current;
-}
\ No newline at end of file
+}
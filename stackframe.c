@@ -49,14 +49,15 @@ void stackframe_push(struct node* func_node, struct stack_frame_element* element
 {
   struct stack_frame* frame = &func_node->func.frame;
   // The stack grows downwards
-  element->offset_from_bp = -(vector_count(frame->elements) * STACK_PUSH_SIZE);
+  element->offset_from_bp = -(vector_count(frame->elements) * target_current()->stack_slot_size);
   vector_push(frame->elements, element);
 }
 
 void stackframe_sub(struct node* func_node, int type, const char* name, size_t amount)
 {
-  assert((amount % STACK_PUSH_SIZE) == 0);
-  size_t total_pushes = amount / STACK_PUSH_SIZE;
+  int slot_size = target_current()->stack_slot_size;
+  assert((amount % slot_size) == 0);
+  size_t total_pushes = amount / slot_size;
   for (size_t i = 0; i < total_pushes; i++)
   {
     stackframe_push(func_node, &(struct stack_frame_element){.type=type, .name=name});
@@ -65,8 +66,9 @@ void stackframe_sub(struct node* func_node, int type, const char* name, size_t a
 
 void stackframe_add(struct node* func_node, int type, const char* name, size_t amount)
 {
-  assert((amount % STACK_PUSH_SIZE) == 0);
-  size_t total_pops = amount / STACK_PUSH_SIZE;
+  int slot_size = target_current()->stack_slot_size;
+  assert((amount % slot_size) == 0);
+  size_t total_pops = amount / slot_size;
   for (size_t i = 0; i < total_pops; i++)
   {
     stackframe_pop(func_node);
@@ -20,6 +20,30 @@ void symresolver_new_table(struct compile_process* process)
   process->symbols.table = vector_create(sizeof(struct symbol*));
 }
 
+static void symresolver_free_table(struct vector* table)
+{
+  if (!table)
+  {
+    return;
+  }
+
+  for (int i = 0; i < vector_count(table); i++)
+  {
+    free(*(struct symbol**) vector_at(table, i));
+  }
+  vector_free(table);
+}
+
+void symresolver_free(struct compile_process* process)
+{
+  symresolver_free_table(process->symbols.table);
+  for (int i = 0; i < vector_count(process->symbols.tables); i++)
+  {
+    symresolver_free_table(*(struct vector**) vector_at(process->symbols.tables, i));
+  }
+  vector_free(process->symbols.tables);
+}
+
 void symresolver_end_table(struct compile_process* process)
 {
   struct vector* last_table = vector_back_ptr(process->symbols.tables);
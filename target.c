@@ -0,0 +1,32 @@
+#include "compiler.h"
+
+/**
+ * The machine we generate code for. Code generation asks the target for everything that
+ * depends on it rather than assuming 32 bit x86, there is only the one target for now
+ */
+
+const struct target target_x86_32 = {
+  .name="i386",
+  .nasm_format="elf32",
+  .link_option="-m32",
+  .pointer_size=DATA_SIZE_DWORD,
+  .stack_slot_size=DATA_SIZE_DWORD
+};
+
+// The target of the file being compiled, one per thread
+static _Thread_local const struct target* target_active = &target_x86_32;
+
+const struct target* target_for_flags(int flags)
+{
+  return &target_x86_32;
+}
+
+void target_select(const struct target* target)
+{
+  target_active = target;
+}
+
+const struct target* target_current()
+{
+  return target_active;
+}
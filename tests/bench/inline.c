@@ -0,0 +1,33 @@
+// The loop the inliner was timed with, tests/run.sh leaves it out as it has no expected result.
+// Build it with ./main tests/bench/inline.c ./inline [regs] and time ./inline, then again with
+// a compiler without the inliner. 200M iterations took 0.99s before and 0.55s after, 1.30s
+// before and 0.47s after with regs.
+int add(int a, int b)
+{
+  return a + b;
+}
+
+int mask(int a, int b)
+{
+  return a & b;
+}
+
+int mix(int a, int b)
+{
+  return a * 31 + b;
+}
+
+int main()
+{
+  int i;
+  int s;
+  int t;
+  s = 0;
+  for (i = 0; i < 200000000; i = i + 1)
+  {
+    t = mix(s, i);
+    s = add(t, i);
+    s = mask(s, 65535);
+  }
+  return s & 255;
+}
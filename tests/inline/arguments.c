@@ -0,0 +1,89 @@
+// expect 0
+// Each parameter is replaced by a copy of its argument. An argument that has side effects or
+// would be computed more than once must keep the call, the rest inline and give the same result.
+int calls;
+
+int next()
+{
+  calls = calls + 1;
+  return calls;
+}
+
+int twice(int n)
+{
+  return n + n;
+}
+
+int square(int n)
+{
+  return n * n;
+}
+
+int plus_one(int n)
+{
+  return n + 1;
+}
+
+int first(int a, int b)
+{
+  return a;
+}
+
+int sub(int a, int b)
+{
+  return a - b;
+}
+
+int pick(int a, int b, int c)
+{
+  return a * 100 + b * 10 + c;
+}
+
+int check(int got, int expect)
+{
+  if (got != expect)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int failures;
+  int got;
+  int a;
+  int b;
+  failures = 0;
+  calls = 0;
+  a = 3;
+  b = 7;
+
+  // A call as the argument runs once however often the parameter is read
+  got = twice(next());
+  failures = failures + check(got, 2);
+  failures = failures + check(calls, 1);
+  got = plus_one(next());
+  failures = failures + check(got, 3);
+  failures = failures + check(calls, 2);
+
+  // Nor is a call dropped because the parameter is never read
+  got = first(5, next());
+  failures = failures + check(got, 5);
+  failures = failures + check(calls, 3);
+
+  // Computed arguments read once or more than once
+  got = square(a + 1);
+  failures = failures + check(got, 16);
+  got = plus_one(a * b);
+  failures = failures + check(got, 22);
+
+  // Arguments naming the caller's variables in the other order than the parameters
+  got = sub(b, a);
+  failures = failures + check(got, 4);
+  got = pick(b, a, 1);
+  failures = failures + check(got, 731);
+  got = pick(1, b, a);
+  failures = failures + check(got, 173);
+  return failures;
+}
@@ -0,0 +1,67 @@
+// expect 0
+// Functions that call themselves, directly or through others, are never inlined. Inlining
+// them would not end, the calls into them from other functions have to stay calls.
+int is_even(int n);
+
+int is_odd(int n)
+{
+  return n != 0 && is_even(n - 1);
+}
+
+int is_even(int n)
+{
+  return n == 0 || is_odd(n - 1);
+}
+
+int count_down(int n)
+{
+  return n > 0 && count_down(n - 1) + 1;
+}
+
+int odd_of(int n)
+{
+  return is_odd(n);
+}
+
+int twice(int n)
+{
+  return n + n;
+}
+
+int sum_twice(int n)
+{
+  if (n == 0)
+  {
+    return 0;
+  }
+  return twice(n) + sum_twice(n - 1);
+}
+
+int check(int got, int expect)
+{
+  if (got != expect)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int failures;
+  int got;
+  failures = 0;
+  got = is_even(10);
+  failures = failures + check(got, 1);
+  got = is_odd(7);
+  failures = failures + check(got, 1);
+  got = is_even(7);
+  failures = failures + check(got, 0);
+  got = odd_of(4);
+  failures = failures + check(got, 0);
+  got = count_down(5);
+  failures = failures + check(got, 1);
+  got = sum_twice(6);
+  failures = failures + check(got, 42);
+  return failures;
+}
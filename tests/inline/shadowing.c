@@ -0,0 +1,72 @@
+// expect 0
+// A callee reading a global can't be inlined where the caller has a variable of that name,
+// the copy would read the caller's variable instead. Calls to such a caller still inline.
+int base;
+int scale;
+
+int from_base(int n)
+{
+  return base + n;
+}
+
+int scaled(int n)
+{
+  return n * scale;
+}
+
+int local_base(int n)
+{
+  int base;
+  base = 1000;
+  return from_base(n) + base;
+}
+
+int parameter_base(int base)
+{
+  return from_base(base);
+}
+
+int block_scale(int n)
+{
+  int total;
+  total = scaled(n);
+  if (n > 0)
+  {
+    int scale;
+    scale = 50;
+    total = total + scale;
+  }
+  return total;
+}
+
+int no_shadow(int n)
+{
+  return from_base(n) + scaled(n);
+}
+
+int check(int got, int expect)
+{
+  if (got != expect)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int failures;
+  int got;
+  failures = 0;
+  base = 10;
+  scale = 3;
+  got = local_base(5);
+  failures = failures + check(got, 1015);
+  got = parameter_base(7);
+  failures = failures + check(got, 17);
+  got = block_scale(4);
+  failures = failures + check(got, 62);
+  got = no_shadow(2);
+  failures = failures + check(got, 18);
+  return failures;
+}
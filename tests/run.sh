@@ -0,0 +1,49 @@
+#!/bin/sh
+# Compiles every program under tests/ whose first line is "// expect N", runs it and checks that
+# it exits with N. Arguments go to the compiler after the file names, tests/run.sh regs runs
+# the corpus with register allocation. Needs nasm and gcc -m32 like the compiler itself.
+# A second line "// vectorized N" also checks that N loops went through the SSE2 vector loop
+# when the compiler is run without arguments.
+cd "$(dirname "$0")/.." || exit 1
+out_dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$out_dir"' EXIT
+
+pass=0
+fail=0
+for file in tests/*/*.c; do
+  expect=$(sed -n '1s|^// expect ||p' "$file")
+  if [ -z "$expect" ]; then
+    continue
+  fi
+
+  program="$out_dir/$(basename "$file" .c)"
+  vectorized=$(sed -n '2s|^// vectorized ||p' "$file")
+  if [ -n "$vectorized" ] && [ $# -eq 0 ]; then
+    got=$(./main "$file" "$program" stats 2>&1 | sed -n 's|^vectorize: \([0-9]*\) loops vectorized$|\1|p')
+    if [ "$got" != "$vectorized" ]; then
+      echo "FAIL $file: expected $vectorized vectorized loops got ${got:-none}"
+      fail=$((fail + 1))
+      continue
+    fi
+  fi
+
+  ./main "$file" "$program" "$@" > "$program.log" 2>&1
+  if [ ! -x "$program" ]; then
+    echo "FAIL $file: did not compile"
+    cat "$program.log"
+    fail=$((fail + 1))
+    continue
+  fi
+
+  "$program"
+  status=$?
+  if [ "$status" -ne "$expect" ]; then
+    echo "FAIL $file: expected $expect got $status"
+    fail=$((fail + 1))
+    continue
+  fi
+  pass=$((pass + 1))
+done
+
+echo "$pass passed, $fail failed"
+[ "$fail" -eq 0 ]
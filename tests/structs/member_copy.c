@@ -0,0 +1,91 @@
+// expect 0
+// Structures assigned to and from members, directly or through ->, keep their members in order
+// whether they are copied a dword at a time or with rep movsd.
+struct small
+{
+  int a;
+  int b;
+  int c;
+};
+
+struct large
+{
+  int v[20];
+};
+
+struct holder
+{
+  int tag;
+  struct small s;
+  struct small t;
+  struct large l;
+  struct large m;
+};
+
+int digits(struct small s)
+{
+  return s.a * 100 + s.b * 10 + s.c;
+}
+
+int main()
+{
+  struct small s;
+  struct small u;
+  struct large l;
+  struct large k;
+  struct holder h;
+  struct holder* hp;
+  int i;
+  int failures;
+  failures = 0;
+  s.a = 1;
+  s.b = 2;
+  s.c = 3;
+  hp = &h;
+  h.tag = 5;
+  hp->s = s;
+  if (digits(h.s) != 123)
+  {
+    failures = failures | 1;
+  }
+
+  h.t = hp->s;
+  u = hp->t;
+  if (digits(u) != 123)
+  {
+    failures = failures | 2;
+  }
+
+  hp->t.b = 9;
+  hp->s = h.t;
+  if (digits(hp->s) != 193)
+  {
+    failures = failures | 4;
+  }
+
+  for (i = 0; i < 20; i = i + 1)
+  {
+    l.v[i] = i + 1;
+  }
+  hp->l = l;
+  h.m = hp->l;
+  k = hp->m;
+  for (i = 0; i < 20; i = i + 1)
+  {
+    if (h.l.v[i] != i + 1)
+    {
+      failures = failures | 8;
+    }
+
+    if (k.v[i] != i + 1)
+    {
+      failures = failures | 16;
+    }
+  }
+
+  if (h.tag != 5)
+  {
+    failures = failures | 32;
+  }
+  return failures;
+}
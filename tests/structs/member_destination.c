@@ -0,0 +1,47 @@
+// expect 0
+// A structure assigned to a member reached through a pointer is copied into the member,
+// the members around it are left alone.
+struct big
+{
+  int a;
+  int b;
+  int c;
+};
+
+struct holder
+{
+  int tag;
+  struct big inner;
+  int after;
+};
+
+int main()
+{
+  struct big big;
+  struct holder h;
+  struct holder* hp;
+  int failures;
+  failures = 0;
+  big.a = 1;
+  big.b = 2;
+  big.c = 3;
+  hp = &h;
+  hp->tag = 4;
+  hp->after = 5;
+  hp->inner = big;
+  if (hp->inner.a * 100 + hp->inner.b * 10 + hp->inner.c != 123)
+  {
+    failures = failures + 1;
+  }
+
+  if (h.tag != 4)
+  {
+    failures = failures + 2;
+  }
+
+  if (h.after != 5)
+  {
+    failures = failures + 4;
+  }
+  return failures;
+}
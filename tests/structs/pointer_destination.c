@@ -0,0 +1,100 @@
+// expect 0
+// Values assigned through * are stored where the pointer points. Small structures are copied a
+// dword at a time and large ones with rep movsd, either way with their members in order.
+struct small
+{
+  int a;
+  int b;
+  int c;
+};
+
+struct large
+{
+  int v[20];
+};
+
+int digits(struct small s)
+{
+  return s.a * 100 + s.b * 10 + s.c;
+}
+
+void set(int* p, int value)
+{
+  *p = value;
+}
+
+int main()
+{
+  int x;
+  int y;
+  int* p;
+  int** pp;
+  struct small s;
+  struct small t;
+  struct small* sp;
+  struct large l;
+  struct large m;
+  struct large* lp;
+  int i;
+  int failures;
+  failures = 0;
+
+  // The indirection binds tighter than the operators around it
+  p = &x;
+  pp = &p;
+  *p = 4;
+  y = *p * 2 + 1;
+  if (y != 9)
+  {
+    failures = failures | 1;
+  }
+
+  **pp = 6;
+  if (x + *p != 12)
+  {
+    failures = failures | 2;
+  }
+
+  set(&y, 3);
+  if (y != 3)
+  {
+    failures = failures | 4;
+  }
+
+  s.a = 1;
+  s.b = 2;
+  s.c = 3;
+  sp = &t;
+  *sp = s;
+  if (digits(t) != 123)
+  {
+    failures = failures | 8;
+  }
+
+  sp->b = 5;
+  s = *sp;
+  if (digits(s) != 153)
+  {
+    failures = failures | 16;
+  }
+
+  if (digits(*sp) != 153)
+  {
+    failures = failures | 32;
+  }
+
+  for (i = 0; i < 20; i = i + 1)
+  {
+    l.v[i] = i + 1;
+  }
+  lp = &m;
+  *lp = l;
+  for (i = 0; i < 20; i = i + 1)
+  {
+    if (m.v[i] != i + 1)
+    {
+      failures = failures | 64;
+    }
+  }
+  return failures;
+}
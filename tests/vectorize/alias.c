@@ -0,0 +1,117 @@
+// expect 0
+// vectorized 3
+// Through pointers the destination can overlap a source. Where it is up to three elements
+// ahead the scalar loop reads what it wrote the iteration before, the vector loop must not run.
+int buf[24];
+int other[24];
+
+int reset()
+{
+  int i;
+  for (i = 0; i < 24; i = i + 1)
+  {
+    buf[i] = 1;
+    other[i] = i;
+  }
+  return 0;
+}
+
+int sum()
+{
+  int i;
+  int total;
+  total = 0;
+  for (i = 0; i < 24; i = i + 1)
+  {
+    total = total + buf[i];
+  }
+  return total;
+}
+
+int add_one(int* dst, int* src, int n)
+{
+  int i;
+  for (i = 0; i < n; i = i + 1)
+  {
+    dst[i] = src[i] + 1;
+  }
+  return sum();
+}
+
+int add_both(int* dst, int* src, int n)
+{
+  int i;
+  for (i = 0; i < n; i = i + 1)
+  {
+    dst[i] = other[i] + src[i];
+  }
+  return sum();
+}
+
+int add_restrict(int* restrict dst, int* restrict src, int n)
+{
+  int i;
+  for (i = 0; i < n; i = i + 1)
+  {
+    dst[i] = src[i] + 1;
+  }
+  return sum();
+}
+
+int check(int got, int expect)
+{
+  if (got != expect)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int failures;
+  int got;
+  int* p;
+  int* q;
+  failures = 0;
+
+  // The destination one, two, three and four elements ahead of the source
+  reset();
+  p = &buf[1];
+  got = add_one(p, buf, 16);
+  failures = failures + check(got, 160);
+  reset();
+  p = &buf[2];
+  got = add_one(p, buf, 16);
+  failures = failures + check(got, 96);
+  reset();
+  p = &buf[3];
+  got = add_one(p, buf, 16);
+  failures = failures + check(got, 75);
+  reset();
+  p = &buf[4];
+  got = add_one(p, buf, 16);
+  failures = failures + check(got, 64);
+
+  // The source ahead of the destination and both the same
+  reset();
+  q = &buf[1];
+  got = add_one(buf, q, 16);
+  failures = failures + check(got, 40);
+  reset();
+  got = add_one(buf, buf, 16);
+  failures = failures + check(got, 40);
+
+  // The overlapping source second with an array first
+  reset();
+  p = &buf[1];
+  got = add_both(p, buf, 12);
+  failures = failures + check(got, 310);
+
+  // Distinct arrays through restrict pointers
+  reset();
+  p = &buf[8];
+  got = add_restrict(buf, p, 8);
+  failures = failures + check(got, 32);
+  return failures;
+}
@@ -0,0 +1,115 @@
+// expect 0
+// vectorized 2
+// The vector loop loads and stores four elements at a time without knowing where they are,
+// bases a few elements into an array or a counter starting past zero are not 16 byte aligned.
+int src[20];
+int dst[20];
+float fsrc[20];
+float fdst[20];
+
+int reset()
+{
+  int i;
+  for (i = 0; i < 20; i = i + 1)
+  {
+    src[i] = i;
+    dst[i] = 0;
+    fsrc[i] = i;
+    fdst[i] = 0;
+  }
+  return 0;
+}
+
+int sum()
+{
+  int i;
+  int total;
+  total = 0;
+  for (i = 0; i < 20; i = i + 1)
+  {
+    total = total + dst[i] + fdst[i];
+  }
+  return total;
+}
+
+int shift(int* to, int* from, int n)
+{
+  int i;
+  for (i = 0; i < n; i = i + 1)
+  {
+    to[i] = from[i] << 1;
+  }
+  return sum();
+}
+
+int shift_from(int s, int n)
+{
+  int i;
+  for (i = s; i < n; i = i + 1)
+  {
+    dst[i] = src[i] + 10;
+  }
+  return sum();
+}
+
+int scale(float* to, float* from, int n)
+{
+  int i;
+  for (i = 0; i < n; i = i + 1)
+  {
+    to[i] = from[i] * 4.0;
+  }
+  return sum();
+}
+
+int check(int got, int expect)
+{
+  if (got != expect)
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int main()
+{
+  int failures;
+  int got;
+  int* p;
+  int* q;
+  float* fp;
+  float* fq;
+  failures = 0;
+
+  // Both bases off by the same amount and by different amounts
+  reset();
+  p = &dst[1];
+  q = &src[1];
+  got = shift(p, q, 13);
+  failures = failures + check(got, 182);
+  reset();
+  p = &dst[3];
+  q = &src[2];
+  got = shift(p, q, 9);
+  failures = failures + check(got, 108);
+  reset();
+  p = &dst[2];
+  got = shift(p, src, 17);
+  failures = failures + check(got, 272);
+
+  // The counter starting past zero
+  reset();
+  got = shift_from(1, 14);
+  failures = failures + check(got, 221);
+  reset();
+  got = shift_from(3, 20);
+  failures = failures + check(got, 357);
+
+  // Floats off by one and three elements
+  reset();
+  fp = &fdst[1];
+  fq = &fsrc[3];
+  got = scale(fp, fq, 10);
+  failures = failures + check(got, 300);
+  return failures;
+}
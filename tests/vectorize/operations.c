@@ -0,0 +1,179 @@
+// expect 0
+// vectorized 10
+// Every operator the vector loop knows, with a constant on either side. The loops that check
+// the results have an if for a body so they stay scalar and compare against plain arithmetic.
+int a[14];
+int b[14];
+int r[14];
+float fa[14];
+float fb[14];
+float fr[14];
+
+int reset()
+{
+  int i;
+  for (i = 0; i < 14; i = i + 1)
+  {
+    a[i] = i * 7 + 3;
+    b[i] = i * 5 + 1;
+    r[i] = 0;
+    fa[i] = i + 1;
+    fb[i] = 2 * i + 4;
+    fr[i] = 0;
+  }
+  return 0;
+}
+
+int main()
+{
+  int i;
+  int x;
+  int y;
+  int failures;
+  failures = 0;
+
+  reset();
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = a[i] + b[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (r[i] != i * 12 + 4)
+    {
+      failures = failures | 1;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = a[i] - b[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (r[i] != i * 2 + 2)
+    {
+      failures = failures | 2;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = 100 - a[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (r[i] != 97 - i * 7)
+    {
+      failures = failures | 4;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = a[i] & b[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    x = i * 7 + 3;
+    y = i * 5 + 1;
+    x = x & y;
+    if (r[i] != x)
+    {
+      failures = failures | 8;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = a[i] | 64;
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    x = i * 7 + 3;
+    x = x | 64;
+    if (r[i] != x)
+    {
+      failures = failures | 16;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    r[i] = a[i] ^ b[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    x = i * 7 + 3;
+    y = i * 5 + 1;
+    x = x ^ y;
+    if (r[i] != x)
+    {
+      failures = failures | 32;
+    }
+  }
+
+  // Small whole numbers and halves are exact in a float, so are the results compared here
+  for (i = 0; i < 14; i = i + 1)
+  {
+    fr[i] = fa[i] + fb[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (fr[i] != 3 * i + 5)
+    {
+      failures = failures | 64;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    fr[i] = fb[i] - fa[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (fr[i] != i + 3)
+    {
+      failures = failures | 128;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    fr[i] = fa[i] * fb[i];
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    x = i + 1;
+    y = 2 * i + 4;
+    x = x * y;
+    if (fr[i] != x)
+    {
+      failures = failures | 256;
+    }
+  }
+
+  for (i = 0; i < 14; i = i + 1)
+  {
+    fr[i] = fa[i] / 2.0;
+  }
+  for (i = 0; i < 14; i = i + 1)
+  {
+    if (fr[i] * 2 != i + 1)
+    {
+      failures = failures | 512;
+    }
+  }
+
+  // The scalar loops must not have changed what the vector loops left behind
+  if (a[13] + b[13] != 160)
+  {
+    failures = failures | 1024;
+  }
+
+  if (fa[13] != 14)
+  {
+    failures = failures | 1024;
+  }
+  return failures;
+}
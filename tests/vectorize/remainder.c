@@ -0,0 +1,185 @@
+// expect 0
+// vectorized 3
+// The vector loop runs four elements at a time, the scalar loop after it has to finish
+// the zero to three elements left over and leave the counter where the scalar loop would.
+int a[16];
+int b[16];
+int c[16];
+float fa[16];
+float fb[16];
+int last;
+
+int reset()
+{
+  int i;
+  for (i = 0; i < 16; i = i + 1)
+  {
+    a[i] = 0;
+    b[i] = i + 1;
+    c[i] = 100;
+    fa[i] = 0;
+    fb[i] = i;
+  }
+  return 0;
+}
+
+int sum()
+{
+  int i;
+  int total;
+  total = 0;
+  for (i = 0; i < 16; i = i + 1)
+  {
+    total = total + a[i];
+  }
+  return total;
+}
+
+int add(int n)
+{
+  int i;
+  reset();
+  for (i = 0; i < n; i = i + 1)
+  {
+    a[i] = b[i] + c[i];
+  }
+  last = i;
+  return sum();
+}
+
+int add_from(int s, int n)
+{
+  int i;
+  reset();
+  for (i = s; i < n; i = i + 1)
+  {
+    a[i] = b[i] * 3;
+  }
+  last = i;
+  return sum();
+}
+
+int add_seven()
+{
+  int i;
+  reset();
+  for (i = 0; i < 7; i = i + 1)
+  {
+    a[i] = c[i] - b[i];
+  }
+  last = i;
+  return sum();
+}
+
+int scale(int n)
+{
+  int i;
+  int total;
+  reset();
+  for (i = 0; i < n; i = i + 1)
+  {
+    fa[i] = fb[i] * 2.0;
+  }
+  last = i;
+  total = 0;
+  for (i = 0; i < 16; i = i + 1)
+  {
+    total = total + fa[i];
+  }
+  return total;
+}
+
+int main()
+{
+  int failures;
+  failures = 0;
+  if (add(0) != 0)
+  {
+    failures = failures + 1;
+  }
+  if (last != 0)
+  {
+    failures = failures + 1;
+  }
+  if (add(1) != 101)
+  {
+    failures = failures + 1;
+  }
+  if (last != 1)
+  {
+    failures = failures + 1;
+  }
+  if (add(3) != 306)
+  {
+    failures = failures + 1;
+  }
+  if (last != 3)
+  {
+    failures = failures + 1;
+  }
+  if (add(4) != 410)
+  {
+    failures = failures + 1;
+  }
+  if (last != 4)
+  {
+    failures = failures + 1;
+  }
+  if (add(5) != 515)
+  {
+    failures = failures + 1;
+  }
+  if (last != 5)
+  {
+    failures = failures + 1;
+  }
+  if (add(11) != 1166)
+  {
+    failures = failures + 1;
+  }
+  if (last != 11)
+  {
+    failures = failures + 1;
+  }
+  if (add(16) != 1736)
+  {
+    failures = failures + 1;
+  }
+  if (last != 16)
+  {
+    failures = failures + 1;
+  }
+  if (add_from(5, 3) != 0)
+  {
+    failures = failures + 1;
+  }
+  if (last != 5)
+  {
+    failures = failures + 1;
+  }
+  if (add_from(2, 9) != 126)
+  {
+    failures = failures + 1;
+  }
+  if (last != 9)
+  {
+    failures = failures + 1;
+  }
+  if (add_seven() != 672)
+  {
+    failures = failures + 1;
+  }
+  if (last != 7)
+  {
+    failures = failures + 1;
+  }
+  if (scale(6) != 30)
+  {
+    failures = failures + 1;
+  }
+  if (last != 6)
+  {
+    failures = failures + 1;
+  }
+  return failures;
+}